@@ -135,6 +135,9 @@ namespace client
 
     using PreparedTxs = std::vector<PreparedTx>;
 
+    // Scratch space for concatenating pipelined transactions
+    std::vector<uint8_t> pipelined;
+
     std::shared_ptr<RpcTlsClient> rpc_connection;
     PreparedTxs prepared_txs;
 
@@ -177,8 +180,11 @@ namespace client
       bool expects_commit,
       const std::optional<size_t>& index)
     {
-      const PreparedTx tx{
-        rpc_connection->gen_rpc(method, params), method, expects_commit};
+      const PreparedTx tx{binary ?
+                            rpc_connection->gen_binary_rpc(method, params) :
+                            rpc_connection->gen_rpc(method, params),
+                          method,
+                          expects_commit};
 
       if (index.has_value())
       {
@@ -210,11 +216,13 @@ namespace client
     size_t thread_count = 1;
     size_t session_count = 1;
     size_t max_writes_ahead = 0;
+    size_t pipeline_depth = 1;
     size_t latency_rounds = 1;
     size_t verbosity = 0;
     size_t generator_seed = 42u;
 
     bool sign = false;
+    bool binary = false;
     bool no_create = false;
     bool no_wait = false;
     bool write_tx_times = false;
@@ -259,7 +267,12 @@ namespace client
 
         // Write everything
         while (written < txs.size())
-          write(txs[written], read, written, connection);
+        {
+          if (pipeline_depth > 1)
+            write_pipelined(txs, read, written, connection);
+          else
+            write(txs[written], read, written, connection);
+        }
 
         blocking_read(read, written, connection);
 
@@ -297,6 +310,41 @@ namespace client
       connection->write(tx.rpc.encoded);
       ++written;
 
+      read_available(read, written, connection);
+    }
+
+    // Send the next pipeline_depth transactions in a single write, so that
+    // they reach the node together and can be processed back to back
+    inline void write_pipelined(
+      const PreparedTxs& txs,
+      size_t& read,
+      size_t& written,
+      const std::shared_ptr<RpcTlsClient>& connection)
+    {
+      const auto end = std::min(txs.size(), written + pipeline_depth);
+
+      pipelined.clear();
+      for (; written < end; ++written)
+      {
+        const auto& tx = txs[written];
+
+        if (timing.has_value())
+          timing->record_send(tx.method, tx.rpc.id, tx.expects_commit);
+
+        pipelined.insert(
+          pipelined.end(), tx.rpc.encoded.begin(), tx.rpc.encoded.end());
+      }
+
+      connection->write(pipelined);
+
+      read_available(read, written, connection);
+    }
+
+    inline void read_available(
+      size_t& read,
+      size_t written,
+      const std::shared_ptr<RpcTlsClient>& connection)
+    {
       // Optimistically read (non-blocking) any current responses
       while (read < written)
       {
@@ -489,12 +537,28 @@ namespace client
         "responses, 1 will minimise latency by serially waiting for each "
         "transaction's response, other values may provide a balance between "
         "throughput and latency");
+      app
+        .add_option(
+          "--pipeline-depth",
+          pipeline_depth,
+          "How many transactions to send to the node in a single write. The "
+          "node processes all requests which arrive together back to back, "
+          "and returns their responses together")
+        ->check(CLI::Range(1, 1 << 16));
 
       app.add_option("--latency-rounds", latency_rounds);
       app.add_flag("-v,-V,--verbose", verbosity);
 
       // Boolean flags
-      app.add_flag("--sign", sign, "Send client-signed transactions");
+      auto sign_opt =
+        app.add_flag("--sign", sign, "Send client-signed transactions");
+      app
+        .add_flag(
+          "--binary",
+          binary,
+          "Send transactions with the binary request encoding, identifying "
+          "methods by numeric ID")
+        ->excludes(sign_opt);
       app.add_flag(
         "--no-create", no_create, "Skip creation/setup transactions");
       app.add_flag(
@@ -150,8 +150,7 @@ namespace ccfapp
     {
       // SNIPPET_START: record
       // SNIPPET_START: macro_validation_record
-      auto record = [this](Store::Tx& tx, const nlohmann::json& params) {
-        const auto in = params.get<LoggingRecord::In>();
+      auto record = [this](RequestArgs& args, LoggingRecord::In&& in) {
         // SNIPPET_END: macro_validation_record
 
         if (in.msg.empty())
@@ -160,7 +159,7 @@ namespace ccfapp
             LoggerErrors::MESSAGE_EMPTY, "Cannot record an empty log message");
         }
 
-        auto view = tx.get_view(records);
+        auto view = args.tx.get_view(records);
         view->put(in.id, in.msg);
         return jsonrpc::success(true);
       };
@@ -3,6 +3,8 @@
 #pragma once
 #include "ds/json.h"
 
+#include <msgpack-c/msgpack.hpp>
+
 namespace ccf
 {
   // Private record/get
@@ -14,6 +16,8 @@ namespace ccf
     {
       size_t id;
       std::string msg;
+
+      MSGPACK_DEFINE_MAP(id, msg);
     };
   };
 
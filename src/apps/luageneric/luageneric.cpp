@@ -133,12 +133,23 @@ namespace ccfapp
             jsonrpc::StandardErrorCodes::METHOD_NOT_FOUND,
             "No handler script found for method '" + args.method + "'");
 
+        // The versions of the scripts identify the interpreters which have
+        // already loaded them
+        const auto env_script = scripts->get(UserScriptIds::ENV_HANDLER);
+        std::optional<ScriptVersion> handler_version, env_version;
+        if (auto v = scripts->get_version(args.method))
+          handler_version = ScriptVersion{args.method, *v};
+        if (auto v = scripts->get_version(UserScriptIds::ENV_HANDLER))
+          env_version = ScriptVersion{UserScriptIds::ENV_HANDLER, *v};
+
         const auto response = tsr->run<nlohmann::json>(
           args.tx,
           {*handler_script,
            {},
            WlIds::USER_APP_CAN_READ_ONLY,
-           scripts->get(UserScriptIds::ENV_HANDLER)},
+           env_script,
+           handler_version,
+           env_version},
           // vvv arguments to the script vvv
           args);
 
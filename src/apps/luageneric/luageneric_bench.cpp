@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "ds/logger.h"
+#include "enclave/appinterface.h"
+#include "genesisgen/genesisgen.h"
+#include "luainterp/luainterp.h"
+#include "node/rpc/jsonrpc.h"
+#include "node/rpc/test/node_stub.h"
+#include "runtime_config/default_whitelists.h"
+
+#include <picobench/picobench.hpp>
+#include <string>
+
+using namespace ccfapp;
+using namespace ccf;
+using namespace std;
+using namespace jsonrpc;
+
+constexpr auto env_script = R"xxx(
+  return {
+    __environment = [[
+      function env.jsucc (result)
+        return {result = result}
+      end
+
+      function env.jerr (code, message)
+        return {error = {code = code, message = message}}
+      end
+    ]]
+  }
+)xxx";
+
+constexpr auto handler = R"xxx(
+  tables, gov_tables, args = ...
+  tables.priv0:put(args.params.k, args.params.v)
+  return env.jsucc(tables.priv0:get(args.params.k))
+)xxx";
+
+struct LuaApp
+{
+  logger::Level log_level;
+  GenesisGenerator network;
+  StubNotifier notifier;
+  shared_ptr<enclave::RpcHandler> frontend;
+
+  LuaApp() : log_level(logger::config::level())
+  {
+    logger::config::level() = logger::FATAL;
+
+    network.add_user({0});
+    for (const auto& wl : default_whitelists)
+      network.set_whitelist(wl.first, wl.second);
+    network.set_app_scripts(
+      lua::Interpreter().invoke<nlohmann::json>(env_script));
+    network.finalize_raw();
+    frontend = get_rpc_handler(network, notifier);
+  }
+
+  ~LuaApp()
+  {
+    logger::config::level() = log_level;
+  }
+
+  void set_handler(const string& method, const Script& h)
+  {
+    Store::Tx tx;
+    tx.get_view(network.app_scripts)->put(method, h);
+    if (tx.commit() != kv::CommitSuccess::OK)
+      throw logic_error("Could not set handler");
+  }
+};
+
+static vector<uint8_t> make_pc(const string& method, size_t i)
+{
+  using Params = map<string, size_t>;
+  return nlohmann::json::to_msgpack(
+    ProcedureCall<Params>{method, i, {{"k", i}, {"v", i}}});
+}
+
+// Every request runs a script the frontend has not run before, so needs a new
+// interpreter with its environment set up from scratch
+static void cold_request(picobench::state& s)
+{
+  LuaApp app;
+  const Cert u0 = {0};
+  enclave::RPCContext rpc_ctx(0, u0);
+
+  vector<vector<uint8_t>> requests;
+  for (int i = 0; i < s.iterations(); ++i)
+  {
+    const auto method = "put" + to_string(i);
+    app.set_handler(method, {handler + string("-- ") + method});
+    requests.push_back(make_pc(method, i));
+  }
+
+  s.start_timer();
+  for (auto& request : requests)
+    app.frontend->process(rpc_ctx, request);
+  s.stop_timer();
+}
+
+// Every request runs the same script, so reuses a warm interpreter
+static void warm_request(picobench::state& s)
+{
+  LuaApp app;
+  const Cert u0 = {0};
+  enclave::RPCContext rpc_ctx(0, u0);
+
+  app.set_handler("put", {handler});
+  vector<vector<uint8_t>> requests;
+  for (int i = 0; i < s.iterations(); ++i)
+    requests.push_back(make_pc("put", i));
+
+  // Warm up the pool
+  app.frontend->process(rpc_ctx, requests.front());
+
+  s.start_timer();
+  for (auto& request : requests)
+    app.frontend->process(rpc_ctx, request);
+  s.stop_timer();
+}
+
+const std::vector<int> request_count = {10, 100, 1000};
+
+PICOBENCH_SUITE("lua request");
+PICOBENCH(cold_request).iterations(request_count).samples(10).baseline();
+PICOBENCH(warm_request).iterations(request_count).samples(10);
@@ -163,6 +163,64 @@ TEST_CASE("simple lua apps")
     check_success(frontend->process(rpc_ctx, pc), verb);
   }
 
+  SUBCASE("globals do not persist between calls")
+  {
+    // Interpreters are reused between calls to the same handler, but must not
+    // carry over the globals or env entries written by a previous call
+    constexpr auto app = R"xxx(
+      tables, gov_tables, args = ...
+      counter = (counter or 0) + 1
+      env.counter = (env.counter or 0) + 1
+      return env.jsucc(counter + env.counter)
+    )xxx";
+    set_handler(network, "count", {app});
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+      const auto pc = make_pc("count", {});
+      check_success(frontend->process(rpc_ctx, pc), 2);
+    }
+  }
+
+  SUBCASE("string metatable does not persist between calls")
+  {
+    // The string metatable is not reachable from the globals, but is shared
+    // by every string in the interpreter
+    constexpr auto app = R"xxx(
+      tables, gov_tables, args = ...
+      local upper = ("x"):upper()
+      getmetatable("").__index = {upper = function() return "leaked" end}
+      return env.jsucc(upper)
+    )xxx";
+    set_handler(network, "upper", {app});
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+      const auto pc = make_pc("upper", {});
+      check_success(frontend->process(rpc_ctx, pc), std::string("X"));
+    }
+  }
+
+  SUBCASE("replaced handler is not run from a warm interpreter")
+  {
+    // Interpreters are reused by version of the handler, so the previous
+    // one must not be run once it has been replaced
+    for (size_t i = 0; i < 3; ++i)
+    {
+      const auto app = fmt::format(
+        R"xxx(
+          tables, gov_tables, args = ...
+          return env.jsucc({})
+        )xxx",
+        i);
+      set_handler(network, "replaced", {app});
+
+      const auto pc = make_pc("replaced", {});
+      check_success(frontend->process(rpc_ctx, pc), i);
+      check_success(frontend->process(rpc_ctx, pc), i);
+    }
+  }
+
   SUBCASE("store/load different types in generic table")
   {
     constexpr auto store = R"xxx(
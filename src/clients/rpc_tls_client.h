@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "node/rpc/jsonrpc.h"
 #include "tls_client.h"
 
 #include <nlohmann/json.hpp>
@@ -23,14 +24,19 @@ public:
   PreparedRpc gen_rpc_raw(
     const nlohmann::json& j, const std::optional<size_t>& explicit_id = {})
   {
-    auto m = nlohmann::json::to_msgpack(j);
+    return frame(
+      nlohmann::json::to_msgpack(j),
+      explicit_id.has_value() ? explicit_id.value() : j["id"].get<size_t>());
+  }
+
+  PreparedRpc frame(const std::vector<uint8_t>& m, size_t rpc_id)
+  {
     auto len = static_cast<const uint32_t>(m.size());
     std::vector<uint8_t> r(len + sizeof(len));
     std::copy(m.cbegin(), m.cend(), r.begin() + sizeof(len));
     auto plen = reinterpret_cast<const uint8_t*>(&len);
     std::copy(plen, plen + sizeof(len), r.begin());
-    return {
-      r, explicit_id.has_value() ? explicit_id.value() : j["id"].get<size_t>()};
+    return {r, rpc_id};
   }
 
   /** Generate and serialize transaction
@@ -53,6 +59,32 @@ public:
     return gen_rpc_raw(json_rpc(method, nlohmann::json::array()));
   }
 
+  /** Generate and serialize a binary transaction
+   *
+   * The method is identified by its numeric ID, and params are sent as
+   * MsgPack. The response is MsgPack, as for other transactions.
+   *
+   * @param method Method name
+   * @param params Method parameters
+   * @param readonly For MayWrite methods, whether this call will only read
+   *
+   * @return serialized transaction
+   */
+  PreparedRpc gen_binary_rpc(
+    const std::string& method,
+    const nlohmann::json& params,
+    bool readonly = true)
+  {
+    const auto rpc_id = id++;
+    return frame(
+      jsonrpc::pack_binary(
+        jsonrpc::method_id(method),
+        rpc_id,
+        nlohmann::json::to_msgpack(params),
+        readonly),
+      rpc_id);
+  }
+
   nlohmann::json json_rpc(
     const std::string& method, const nlohmann::json& params)
   {
@@ -2,40 +2,80 @@
 // Licensed under the Apache 2.0 License.
 #include "symmkey.h"
 
+#include "../ds/spinlock.h"
 #include "error.h"
 
 #include <mbedtls/aes.h>
 #include <mbedtls/gcm.h>
+#include <mbedtls/platform_util.h>
+#include <mutex>
 
 namespace crypto
 {
-  KeyAesGcm::KeyAesGcm(CBuffer rawKey)
+  struct KeyAesGcm::ContextPool
   {
-    ctx = new mbedtls_gcm_context;
-    mbedtls_gcm_init(reinterpret_cast<mbedtls_gcm_context*>(ctx));
+    SpinLock lock;
+    std::vector<mbedtls_gcm_context*> free;
 
-    if (mbedtls_gcm_setkey(
-          reinterpret_cast<mbedtls_gcm_context*>(ctx),
-          MBEDTLS_CIPHER_ID_AES,
-          rawKey.p,
-          static_cast<unsigned int>(rawKey.rawSize() * 8)))
-      throw crypto_error("Failed to set AES GCM key");
-  }
+    ~ContextPool()
+    {
+      for (auto ctx : free)
+      {
+        mbedtls_gcm_free(ctx);
+        delete ctx;
+      }
+    }
+  };
 
-  KeyAesGcm::KeyAesGcm(KeyAesGcm&& that)
+  KeyAesGcm::KeyAesGcm(CBuffer rawKey) :
+    key(rawKey.p, rawKey.p + rawKey.n),
+    contexts(std::make_unique<ContextPool>())
   {
-    ctx = that.ctx;
-    that.ctx = nullptr;
+    // Create the first context now, so that an invalid key is reported here
+    release(acquire());
   }
 
+  KeyAesGcm::KeyAesGcm(KeyAesGcm&& that) = default;
+
   KeyAesGcm::~KeyAesGcm()
   {
-    if (ctx)
+    // The contexts free their own copies of the key schedule
+    mbedtls_platform_zeroize(key.data(), key.size());
+  }
+
+  void* KeyAesGcm::acquire() const
+  {
     {
-      auto ctx_ = reinterpret_cast<mbedtls_gcm_context*>(ctx);
-      mbedtls_gcm_free(ctx_);
-      delete ctx_;
+      std::lock_guard<SpinLock> guard(contexts->lock);
+      if (!contexts->free.empty())
+      {
+        auto ctx = contexts->free.back();
+        contexts->free.pop_back();
+        return ctx;
+      }
     }
+
+    auto ctx = new mbedtls_gcm_context;
+    mbedtls_gcm_init(ctx);
+
+    if (mbedtls_gcm_setkey(
+          ctx,
+          MBEDTLS_CIPHER_ID_AES,
+          key.data(),
+          static_cast<unsigned int>(key.size() * 8)))
+    {
+      mbedtls_gcm_free(ctx);
+      delete ctx;
+      throw crypto_error("Failed to set AES GCM key");
+    }
+
+    return ctx;
+  }
+
+  void KeyAesGcm::release(void* ctx) const
+  {
+    std::lock_guard<SpinLock> guard(contexts->lock);
+    contexts->free.push_back(reinterpret_cast<mbedtls_gcm_context*>(ctx));
   }
 
   void KeyAesGcm::encrypt(
@@ -45,18 +85,22 @@ namespace crypto
     uint8_t* cipher,
     uint8_t tag[GCM_SIZE_TAG]) const
   {
-    if (mbedtls_gcm_crypt_and_tag(
-          reinterpret_cast<mbedtls_gcm_context*>(ctx),
-          MBEDTLS_GCM_ENCRYPT,
-          plain.n,
-          iv.p,
-          iv.n,
-          aad.p,
-          aad.n,
-          plain.p,
-          cipher,
-          GCM_SIZE_TAG,
-          tag))
+    auto ctx = acquire();
+    auto rc = mbedtls_gcm_crypt_and_tag(
+      reinterpret_cast<mbedtls_gcm_context*>(ctx),
+      MBEDTLS_GCM_ENCRYPT,
+      plain.n,
+      iv.p,
+      iv.n,
+      aad.p,
+      aad.n,
+      plain.p,
+      cipher,
+      GCM_SIZE_TAG,
+      tag);
+    release(ctx);
+
+    if (rc)
       throw crypto_error("AES GCM encryption failed.");
   }
 
@@ -67,7 +111,8 @@ namespace crypto
     CBuffer aad,
     uint8_t* plain) const
   {
-    return !mbedtls_gcm_auth_decrypt(
+    auto ctx = acquire();
+    auto rc = mbedtls_gcm_auth_decrypt(
       reinterpret_cast<mbedtls_gcm_context*>(ctx),
       cipher.n,
       iv.p,
@@ -78,5 +123,8 @@ namespace crypto
       GCM_SIZE_TAG,
       cipher.p,
       plain);
+    release(ctx);
+
+    return rc == 0;
   }
 }
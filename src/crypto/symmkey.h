@@ -4,6 +4,8 @@
 #include "../ds/buffer.h"
 #include "../ds/serialized.h"
 
+#include <memory>
+
 namespace crypto
 {
   constexpr size_t GCM_SIZE_TAG = 16;
@@ -105,7 +107,17 @@ namespace crypto
   class KeyAesGcm
   {
   private:
-    mutable void* ctx;
+    // Kept to set up new contexts, and wiped on destruction
+    std::vector<uint8_t> key;
+
+    // A context holds the state of a single operation, so it cannot be used by
+    // several threads at once. Each operation takes one from this pool, and
+    // a new one is created if none is free.
+    struct ContextPool;
+    std::unique_ptr<ContextPool> contexts;
+
+    void* acquire() const;
+    void release(void* ctx) const;
 
   public:
     KeyAesGcm(CBuffer rawKey);
@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "spinlock.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace ds
+{
+  /** Jobs submitted from several threads, run together in batches.
+   *
+   * A submitter queues its jobs and then drains the queue: whichever thread
+   * finds jobs queued takes all of them, from every submitter, and runs them
+   * as a single batch (for instance in parallel on the enclave's workers).
+   * Only one batch runs at a time, so jobs queued while it runs are collected
+   * into the next. A submitter returns once its own jobs have run, on
+   * whichever thread ran them, so jobs may refer to the submitter's stack.
+   */
+  class BatchQueue
+  {
+  public:
+    using Job = std::function<void()>;
+    using BatchRunner = std::function<void(std::vector<Job>&&)>;
+
+  private:
+    SpinLock lock;
+    std::vector<Job> queued;
+
+    // Held by the thread running a batch
+    SpinLock running;
+
+  public:
+    /** Run jobs, together with any others queued meanwhile.
+     *
+     * @param jobs Jobs to run, which must not throw
+     * @param run_batch Runs a batch of jobs and returns once they have all
+     *  finished, or nullptr to run them one after another on this thread
+     */
+    void run(std::vector<Job>&& jobs, const BatchRunner& run_batch)
+    {
+      if (jobs.empty())
+        return;
+
+      auto remaining = std::make_shared<std::atomic<size_t>>(jobs.size());
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        for (auto& job : jobs)
+        {
+          queued.emplace_back([job = std::move(job), remaining]() {
+            job();
+            --*remaining;
+          });
+        }
+      }
+
+      while (remaining->load() > 0)
+      {
+        // Another thread is running a batch, which may include our jobs
+        std::unique_lock<SpinLock> rguard(running, std::try_to_lock);
+        if (!rguard.owns_lock())
+        {
+          _mm_pause();
+          continue;
+        }
+
+        std::vector<Job> batch;
+        {
+          std::lock_guard<SpinLock> guard(lock);
+          batch.swap(queued);
+        }
+
+        if (batch.empty())
+          continue;
+
+        if (run_batch)
+        {
+          run_batch(std::move(batch));
+        }
+        else
+        {
+          for (auto& job : batch)
+            job();
+        }
+      }
+    }
+  };
+}
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "buffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace ds
+{
+  /** FIFO of bytes, appended at the back and consumed from the front.
+   *
+   * Unread bytes are always contiguous, so they can be parsed in place through
+   * data(). Consumed space at the front is only reclaimed when more has been
+   * consumed than remains unread, so each byte is moved a bounded number of
+   * times on average regardless of how appends and reads are interleaved.
+   */
+  class ByteQueue
+  {
+  private:
+    std::vector<uint8_t> buf;
+    size_t front = 0;
+    size_t back = 0;
+
+  public:
+    size_t size() const
+    {
+      return back - front;
+    }
+
+    bool empty() const
+    {
+      return front == back;
+    }
+
+    /// View of all unread bytes, valid until the queue is next modified
+    CBuffer data() const
+    {
+      return {buf.data() + front, size()};
+    }
+
+    /// Space for at least n more bytes at the back, which become part of the
+    /// queue once they are passed to commit()
+    Buffer prepare(size_t n)
+    {
+      if (buf.size() - back < n)
+      {
+        if (front >= size())
+          compact();
+
+        if (buf.size() - back < n)
+          buf.resize(std::max(buf.size() * 2, back + n));
+      }
+
+      return {buf.data() + back, buf.size() - back};
+    }
+
+    void commit(size_t n)
+    {
+      back += n;
+    }
+
+    void append(const uint8_t* bytes, size_t n)
+    {
+      if (n == 0)
+        return;
+
+      auto space = prepare(n);
+      ::memcpy(space.p, bytes, n);
+      commit(n);
+    }
+
+    void consume(size_t n)
+    {
+      front += std::min(n, size());
+
+      if (front == back)
+        front = back = 0;
+    }
+
+    /// Copy up to n bytes from the front to dst, and consume them
+    size_t read(uint8_t* dst, size_t n)
+    {
+      n = std::min(n, size());
+      ::memcpy(dst, buf.data() + front, n);
+      consume(n);
+      return n;
+    }
+
+    void clear()
+    {
+      front = back = 0;
+    }
+
+  private:
+    void compact()
+    {
+      ::memmove(buf.data(), buf.data() + front, size());
+      back -= front;
+      front = 0;
+    }
+  };
+}
@@ -2,9 +2,17 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <stdexcept>
+#include <unordered_map>
 #include <vector>
 
 namespace champ
@@ -34,6 +42,19 @@ namespace champ
     return (hash >> ((Hash)depth * index_mask_bits)) & index_mask;
   }
 
+  // Identifies the Map::Transient that created a node, and may therefore
+  // update it in place. Nodes with no_edit are never updated in place. Edits
+  // are never reused, so nodes left behind by a transient are immutable once
+  // it has moved on to a new edit.
+  using Edit = uint64_t;
+  static constexpr Edit no_edit = 0;
+
+  inline Edit next_edit()
+  {
+    static std::atomic<Edit> edit_counter{1};
+    return edit_counter++;
+  }
+
   class Bitmap
   {
     uint32_t _bits;
@@ -69,16 +90,261 @@ namespace champ
     }
   };
 
+  // Nodes are allocated from pools of fixed size blocks, one pool per node
+  // size, rather than individually from the heap. Each thread allocates from
+  // its own cache of slabs. A block freed by the thread whose cache owns its
+  // slab goes straight back to that cache. Blocks freed by other threads are
+  // pushed onto the owning cache's remote list, which its thread takes back
+  // once it runs out of local blocks. When a thread exits, its cache is kept,
+  // with all of its blocks, for the next thread to start. Slabs are never
+  // returned to the heap.
+  template <size_t size>
+  class NodePool
+  {
+  private:
+    struct Block
+    {
+      Block* next;
+    };
+
+    struct Cache
+    {
+      // Only used by the thread that currently has the cache
+      Block* local = nullptr;
+      // Pushed to by any thread, and only emptied by the cache's thread
+      std::atomic<Block*> remote{nullptr};
+    };
+
+    // Slabs are aligned to their size, so that the slab, and the cache that
+    // owns it, can be found from any block in it
+    struct Slab
+    {
+      Cache* owner;
+    };
+
+    static constexpr size_t block_align = alignof(std::max_align_t);
+    static constexpr size_t block_size =
+      ((std::max(size, sizeof(Block)) + block_align - 1) / block_align) *
+      block_align;
+    static constexpr size_t slab_header_size =
+      ((sizeof(Slab) + block_align - 1) / block_align) * block_align;
+    static constexpr size_t slab_size = 16 * 1024;
+    static_assert(slab_header_size + block_size <= slab_size);
+    static constexpr size_t blocks_per_slab =
+      (slab_size - slab_header_size) / block_size;
+
+    static inline std::atomic<size_t> slab_count{0};
+
+    static inline std::mutex idle_caches_lock;
+    static inline std::vector<Cache*> idle_caches;
+
+    // The cache of the current thread, or nullptr if it has none
+    static Cache*& current()
+    {
+      thread_local Cache* cache = nullptr;
+      return cache;
+    }
+
+    // Takes an idle cache, or creates one, for the lifetime of the thread
+    struct ThreadCache
+    {
+      ThreadCache()
+      {
+        std::lock_guard<std::mutex> guard(idle_caches_lock);
+        if (idle_caches.empty())
+        {
+          current() = new Cache;
+        }
+        else
+        {
+          current() = idle_caches.back();
+          idle_caches.pop_back();
+        }
+      }
+
+      ~ThreadCache()
+      {
+        std::lock_guard<std::mutex> guard(idle_caches_lock);
+        idle_caches.push_back(current());
+        current() = nullptr;
+      }
+    };
+
+    static Cache& thread_cache()
+    {
+      thread_local ThreadCache thread_cache;
+      return *current();
+    }
+
+  public:
+    static void* allocate()
+    {
+      auto& cache = thread_cache();
+      if (cache.local == nullptr)
+        cache.local = cache.remote.exchange(nullptr, std::memory_order_acquire);
+
+      if (cache.local == nullptr)
+      {
+        auto slab = static_cast<uint8_t*>(
+          ::operator new(slab_size, std::align_val_t(slab_size)));
+        reinterpret_cast<Slab*>(slab)->owner = &cache;
+        slab_count.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < blocks_per_slab; ++i)
+        {
+          auto block = reinterpret_cast<Block*>(
+            slab + slab_header_size + i * block_size);
+          block->next = cache.local;
+          cache.local = block;
+        }
+      }
+
+      auto block = cache.local;
+      cache.local = block->next;
+      return block;
+    }
+
+    static void deallocate(void* p)
+    {
+      auto block = static_cast<Block*>(p);
+      auto slab = reinterpret_cast<Slab*>(
+        reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(slab_size - 1));
+      auto owner = slab->owner;
+
+      if (owner == current())
+      {
+        block->next = owner->local;
+        owner->local = block;
+        return;
+      }
+
+      auto head = owner->remote.load(std::memory_order_relaxed);
+      do
+      {
+        block->next = head;
+      } while (!owner->remote.compare_exchange_weak(
+        head, block, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Number of slabs allocated so far, across all threads
+    static size_t slabs()
+    {
+      return slab_count.load(std::memory_order_relaxed);
+    }
+  };
+
+  enum class NodeKind : uint8_t
+  {
+    Entry,
+    SubNodes,
+    Collisions
+  };
+
+  // Header of every node, holding its reference count. Copying a node makes
+  // a new, unreferenced node.
+  struct NodeHeader
+  {
+    mutable std::atomic<uint32_t> refs{0};
+    const NodeKind kind;
+
+    NodeHeader(NodeKind kind_) : kind(kind_) {}
+
+    NodeHeader(const NodeHeader& other) : kind(other.kind) {}
+
+    NodeHeader& operator=(const NodeHeader&) = delete;
+  };
+
+  template <class K, class V, class H>
+  void destroy_node(NodeHeader* node);
+
+  // Reference to a node of any kind
   template <class K, class V, class H>
-  struct SubNodes;
+  class Node
+  {
+  private:
+    NodeHeader* node = nullptr;
+
+    void acquire()
+    {
+      if (node != nullptr)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+      if (
+        node != nullptr &&
+        node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        destroy_node<K, V, H>(node);
+      node = nullptr;
+    }
+
+  public:
+    Node() = default;
+
+    explicit Node(NodeHeader* node_) : node(node_)
+    {
+      acquire();
+    }
+
+    Node(const Node& other) : node(other.node)
+    {
+      acquire();
+    }
+
+    Node(Node&& other) noexcept : node(other.node)
+    {
+      other.node = nullptr;
+    }
+
+    ~Node()
+    {
+      release();
+    }
+
+    Node& operator=(const Node& other)
+    {
+      if (node != other.node)
+      {
+        release();
+        node = other.node;
+        acquire();
+      }
+      return *this;
+    }
+
+    Node& operator=(Node&& other) noexcept
+    {
+      if (this != &other)
+      {
+        release();
+        node = other.node;
+        other.node = nullptr;
+      }
+      return *this;
+    }
+
+    template <class A>
+    A* as() const
+    {
+      return static_cast<A*>(node);
+    }
+  };
+
+  template <class K, class V, class H, class A, class... Args>
+  Node<K, V, H> make_node(Args&&... args)
+  {
+    auto p = NodePool<sizeof(A)>::allocate();
+    return Node<K, V, H>(new (p) A(std::forward<Args>(args)...));
+  }
 
   template <class K, class V>
-  struct Entry
+  struct Entry : public NodeHeader
   {
     K key;
     V value;
 
-    Entry(K k, V v) : key(k), value(v) {}
+    Entry(K k, V v) : NodeHeader(NodeKind::Entry), key(k), value(v) {}
 
     const V* getp(const K& k) const
     {
@@ -90,12 +356,12 @@ namespace champ
   };
 
   template <class K, class V, class H>
-  using Node = std::shared_ptr<void>;
-
-  template <class K, class V, class H>
-  struct Collisions
+  struct Collisions : public NodeHeader
   {
-    std::array<std::vector<std::shared_ptr<Entry<K, V>>>, collision_bins> bins;
+    std::array<std::vector<Node<K, V, H>>, collision_bins> bins;
+    Edit edit = no_edit;
+
+    Collisions() : NodeHeader(NodeKind::Collisions) {}
 
     const V* getp(Hash hash, const K& k) const
     {
@@ -103,8 +369,9 @@ namespace champ
       const auto& bin = bins[idx];
       for (const auto& node : bin)
       {
-        if (k == node->key)
-          return &node->value;
+        const auto entry = node.template as<Entry<K, V>>();
+        if (k == entry->key)
+          return &entry->value;
       }
       return nullptr;
     }
@@ -115,14 +382,14 @@ namespace champ
       auto& bin = bins[idx];
       for (size_t i = 0; i < bin.size(); ++i)
       {
-        const auto& entry = bin[i];
+        const auto entry = bin[i].template as<Entry<K, V>>();
         if (k == entry->key)
         {
-          bin[i] = std::make_shared<Entry<K, V>>(k, v);
+          bin[i] = make_node<K, V, H, Entry<K, V>>(k, v);
           return false;
         }
       }
-      bin.push_back(std::make_shared<Entry<K, V>>(k, v));
+      bin.push_back(make_node<K, V, H, Entry<K, V>>(k, v));
       return true;
     }
 
@@ -131,26 +398,34 @@ namespace champ
     {
       for (const auto& bin : bins)
       {
-        for (const auto& entry : bin)
+        for (const auto& node : bin)
+        {
+          const auto entry = node.template as<Entry<K, V>>();
           if (!f(entry->key, entry->value))
             return false;
+        }
       }
       return true;
     }
   };
 
   template <class K, class V, class H>
-  struct SubNodes
+  struct SubNodes : public NodeHeader
   {
     std::vector<Node<K, V, H>> nodes;
     Bitmap node_map;
     Bitmap data_map;
+    Edit edit = no_edit;
 
-    SubNodes() {}
+    SubNodes() : NodeHeader(NodeKind::SubNodes) {}
 
-    SubNodes(std::vector<Node<K, V, H>> ns) : nodes(ns) {}
+    SubNodes(std::vector<Node<K, V, H>> ns) :
+      NodeHeader(NodeKind::SubNodes),
+      nodes(ns)
+    {}
 
     SubNodes(std::vector<Node<K, V, H>> ns, Bitmap nm, Bitmap dm) :
+      NodeHeader(NodeKind::SubNodes),
       nodes(ns),
       node_map(nm),
       data_map(dm)
@@ -185,7 +460,8 @@ namespace champ
       return node_as<SubNodes<K, V, H>>(c_idx)->getp(depth + 1, hash, k);
     }
 
-    bool put_mut(SmallIndex depth, Hash hash, const K& k, const V& v)
+    bool put_mut(
+      SmallIndex depth, Hash hash, const K& k, const V& v, Edit edit_)
     {
       const auto idx = mask(hash, depth);
       auto c_idx = compressed_idx(idx);
@@ -195,78 +471,67 @@ namespace champ
         data_map = data_map.set(idx);
         c_idx = compressed_idx(idx);
         nodes.insert(
-          nodes.begin() + c_idx, std::make_shared<Entry<K, V>>(k, v));
+          nodes.begin() + c_idx, make_node<K, V, H, Entry<K, V>>(k, v));
         return true;
       }
 
       if (node_map.check(idx))
       {
-        bool insert;
         if (depth < (collision_depth - 1))
-        {
-          auto sn = *node_as<SubNodes<K, V, H>>(c_idx);
-          insert = sn.put_mut(depth + 1, hash, k, v);
-          nodes[c_idx] = std::make_shared<SubNodes<K, V, H>>(std::move(sn));
-        }
+          return mutable_node<SubNodes<K, V, H>>(c_idx, edit_)->put_mut(
+            depth + 1, hash, k, v, edit_);
         else
-        {
-          auto sn = *node_as<Collisions<K, V, H>>(c_idx);
-          insert = sn.put_mut(hash, k, v);
-          nodes[c_idx] = std::make_shared<Collisions<K, V, H>>(std::move(sn));
-        }
-        return insert;
+          return mutable_node<Collisions<K, V, H>>(c_idx, edit_)->put_mut(
+            hash, k, v);
       }
 
-      const auto& entry0 = node_as<Entry<K, V>>(c_idx);
-      if (k == entry0->key)
+      const auto entry0 = nodes[c_idx];
+      const auto& key0 = entry0.template as<Entry<K, V>>()->key;
+      if (k == key0)
       {
-        nodes[c_idx] = std::make_shared<Entry<K, V>>(k, v);
+        nodes[c_idx] = make_node<K, V, H, Entry<K, V>>(k, v);
         return false;
       }
 
+      Node<K, V, H> sub_node;
       if (depth < (collision_depth - 1))
       {
-        const auto hash0 = H()(entry0->key);
+        const auto hash0 = H()(key0);
         const auto idx0 = mask(hash0, depth + 1);
-        auto sub_node =
-          SubNodes<K, V, H>({entry0}, Bitmap(0), Bitmap(0).set(idx0));
-        sub_node.put_mut(depth + 1, hash, k, v);
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<SubNodes<K, V, H>>(std::move(sub_node)));
+        sub_node = make_node<K, V, H, SubNodes<K, V, H>>(
+          std::vector<Node<K, V, H>>{entry0}, Bitmap(0), Bitmap(0).set(idx0));
+        auto sn = sub_node.template as<SubNodes<K, V, H>>();
+        sn->edit = edit_;
+        sn->put_mut(depth + 1, hash, k, v, edit_);
       }
       else
       {
-        auto sub_node = Collisions<K, V, H>();
-        const auto hash0 = H()(entry0->key);
+        sub_node = make_node<K, V, H, Collisions<K, V, H>>();
+        auto sn = sub_node.template as<Collisions<K, V, H>>();
+        sn->edit = edit_;
+        const auto hash0 = H()(key0);
         const auto idx0 = mask(hash0, collision_depth);
-        sub_node.bins[idx0].push_back(entry0);
+        sn->bins[idx0].push_back(entry0);
         const auto idx1 = mask(hash, collision_depth);
-        sub_node.bins[idx1].push_back(std::make_shared<Entry<K, V>>(k, v));
-
-        nodes.erase(nodes.begin() + c_idx);
-        data_map = data_map.clear(idx);
-        node_map = node_map.set(idx);
-        c_idx = compressed_idx(idx);
-        nodes.insert(
-          nodes.begin() + c_idx,
-          std::make_shared<Collisions<K, V, H>>(std::move(sub_node)));
+        sn->bins[idx1].push_back(make_node<K, V, H, Entry<K, V>>(k, v));
       }
+
+      nodes.erase(nodes.begin() + c_idx);
+      data_map = data_map.clear(idx);
+      node_map = node_map.set(idx);
+      c_idx = compressed_idx(idx);
+      nodes.insert(nodes.begin() + c_idx, std::move(sub_node));
       return true;
     }
 
-    std::pair<std::shared_ptr<SubNodes<K, V, H>>, bool> put(
+    std::pair<Node<K, V, H>, bool> put(
       SmallIndex depth, Hash hash, const K& k, const V& v) const
     {
-      auto node = *this;
-      auto r = node.put_mut(depth, hash, k, v);
-      return std::make_pair(
-        std::make_shared<SubNodes<K, V, H>>(std::move(node)), r);
+      auto node = make_node<K, V, H, SubNodes<K, V, H>>(*this);
+      auto sn = node.template as<SubNodes<K, V, H>>();
+      sn->edit = no_edit;
+      auto r = sn->put_mut(depth, hash, k, v, no_edit);
+      return std::make_pair(std::move(node), r);
     }
 
     template <class F>
@@ -275,7 +540,7 @@ namespace champ
       const auto entries = data_map.pop();
       for (SmallIndex i = 0; i < entries; ++i)
       {
-        const auto& entry = node_as<Entry<K, V>>(i);
+        const auto entry = node_as<Entry<K, V>>(i);
         if (!f(entry->key, entry->value))
           return false;
       }
@@ -298,26 +563,78 @@ namespace champ
 
   private:
     template <class A>
-    const std::shared_ptr<A>& node_as(SmallIndex c_idx) const
+    A* node_as(SmallIndex c_idx) const
     {
-      return reinterpret_cast<const std::shared_ptr<A>&>(nodes[c_idx]);
+      return nodes[c_idx].template as<A>();
+    }
+
+    // Returns the sub-node at c_idx, having first replaced it with a copy
+    // owned by edit_ unless it already was.
+    template <class A>
+    A* mutable_node(SmallIndex c_idx, Edit edit_)
+    {
+      const auto node = node_as<A>(c_idx);
+      if (edit_ != no_edit && node->edit == edit_)
+        return node;
+
+      nodes[c_idx] = make_node<K, V, H, A>(*node);
+      auto copy = node_as<A>(c_idx);
+      copy->edit = edit_;
+      return copy;
     }
   };
 
+  template <class K, class V, class H>
+  void destroy_node(NodeHeader* node)
+  {
+    switch (node->kind)
+    {
+      case NodeKind::Entry:
+      {
+        using A = Entry<K, V>;
+        static_cast<A*>(node)->~A();
+        NodePool<sizeof(A)>::deallocate(node);
+        break;
+      }
+      case NodeKind::SubNodes:
+      {
+        using A = SubNodes<K, V, H>;
+        static_cast<A*>(node)->~A();
+        NodePool<sizeof(A)>::deallocate(node);
+        break;
+      }
+      case NodeKind::Collisions:
+      {
+        using A = Collisions<K, V, H>;
+        static_cast<A*>(node)->~A();
+        NodePool<sizeof(A)>::deallocate(node);
+        break;
+      }
+    }
+  }
+
+  template <class K, class V, class H, class T>
+  class Serialiser;
+
   template <class K, class V, class H = std::hash<K>>
   class Map
   {
   private:
-    std::shared_ptr<SubNodes<K, V, H>> root;
+    template <class, class, class, class>
+    friend class Serialiser;
+
+    Node<K, V, H> root;
     size_t _size = 0;
 
-    Map(std::shared_ptr<SubNodes<K, V, H>> root_, size_t size_) :
-      root(root_),
-      _size(size_)
-    {}
+    Map(Node<K, V, H> root_, size_t size_) : root(root_), _size(size_) {}
+
+    SubNodes<K, V, H>* root_node() const
+    {
+      return root.template as<SubNodes<K, V, H>>();
+    }
 
   public:
-    Map() : root(std::make_shared<SubNodes<K, V, H>>()) {}
+    Map() : root(make_node<K, V, H, SubNodes<K, V, H>>()) {}
 
     size_t size() const
     {
@@ -331,7 +648,7 @@ namespace champ
 
     std::optional<V> get(const K& key) const
     {
-      auto v = root->getp(0, H()(key), key);
+      auto v = root_node()->getp(0, H()(key), key);
 
       if (v)
         return *v;
@@ -341,12 +658,12 @@ namespace champ
 
     const V* getp(const K& key) const
     {
-      return root->getp(0, H()(key), key);
+      return root_node()->getp(0, H()(key), key);
     }
 
     const Map<K, V, H> put(const K& key, const V& value) const
     {
-      auto r = root->put(0, H()(key), key, value);
+      auto r = root_node()->put(0, H()(key), key, value);
       auto size_ = _size;
       if (r.second)
         size_++;
@@ -357,7 +674,286 @@ namespace champ
     template <class F>
     bool foreach(F&& f) const
     {
-      return root->foreach(0, std::forward<F>(f));
+      return root_node()->foreach(0, std::forward<F>(f));
+    }
+
+    // A mutable copy of a Map, for applying a batch of writes. Like put(),
+    // the first write to a node copies it, but the copy is then owned by the
+    // transient and updated in place by later writes, rather than the whole
+    // path being copied again for every key.
+    class Transient
+    {
+    private:
+      Node<K, V, H> root;
+      size_t _size;
+      Edit edit;
+
+      SubNodes<K, V, H>* root_node() const
+      {
+        return root.template as<SubNodes<K, V, H>>();
+      }
+
+    public:
+      Transient(const Map<K, V, H>& map) :
+        root(map.root),
+        _size(map._size),
+        edit(next_edit())
+      {}
+
+      size_t size() const
+      {
+        return _size;
+      }
+
+      std::optional<V> get(const K& key) const
+      {
+        auto v = root_node()->getp(0, H()(key), key);
+
+        if (v)
+          return *v;
+        else
+          return {};
+      }
+
+      const V* getp(const K& key) const
+      {
+        return root_node()->getp(0, H()(key), key);
+      }
+
+      void put(const K& key, const V& value)
+      {
+        if (root_node()->edit != edit)
+        {
+          root = make_node<K, V, H, SubNodes<K, V, H>>(*root_node());
+          root_node()->edit = edit;
+        }
+
+        if (root_node()->put_mut(0, H()(key), key, value, edit))
+          _size++;
+      }
+
+      // Returns a Map of the writes so far. Nodes written until now are
+      // frozen: later writes through this transient will copy them again.
+      const Map<K, V, H> persistent()
+      {
+        edit = next_edit();
+        return Map(root, _size);
+      }
+    };
+
+    Transient transient() const
+    {
+      return Transient(*this);
+    }
+  };
+
+  // Serialises a Map a bounded number of entries at a time, so that a large
+  // map can be written out without materialising it in one go, nor blocking
+  // the thread for the whole of it.
+  //
+  // The map is split into chunks: one for the entries stored above
+  // chunk_depth, then one per subtree rooted at chunk_depth. Frozen nodes are
+  // never modified, so a subtree still in the map since the previous snapshot
+  // holds the same entries as then. Rather than being walked again, it is
+  // passed to the visitor as the T returned when it was first emitted (a hash
+  // of its serialised entries, for instance). The subtrees of the previous
+  // snapshot are kept alive until the next one is complete, so that they
+  // cannot be freed and their nodes reused in the meantime.
+  //
+  // The visitor is called with:
+  //   begin_chunk(), before the entries of a chunk to be emitted,
+  //   entry(const K&, const V&), for each of those entries,
+  //   T end_chunk(), after them,
+  //   reuse_chunk(const T&), for a subtree emitted by the previous snapshot.
+  template <class K, class V, class H, class T>
+  class Serialiser
+  {
+  private:
+    using NodeRef = Node<K, V, H>;
+    using Chunks =
+      std::unordered_map<const NodeHeader*, std::pair<NodeRef, T>>;
+
+    struct Frame
+    {
+      const NodeHeader* node;
+      SmallIndex depth;
+      size_t bin;
+      size_t pos;
+    };
+
+    const SmallIndex chunk_depth;
+
+    // Map being serialised, split into its chunks by start()
+    std::optional<Map<K, V, H>> map;
+    std::vector<NodeRef> top;
+    std::vector<NodeRef> subtrees;
+
+    // Progress through the chunks: 0 is the top chunk, i > 0 is the subtree
+    // at i - 1. The stack is empty between chunks.
+    size_t next_chunk = 0;
+    size_t top_pos = 0;
+    std::vector<Frame> stack;
+
+    Chunks previous;
+    Chunks current;
+
+    void split(const SubNodes<K, V, H>* node, SmallIndex depth)
+    {
+      const auto entries = node->data_map.pop();
+      for (size_t i = 0; i < node->nodes.size(); ++i)
+      {
+        if (i < entries)
+          top.push_back(node->nodes[i]);
+        else if (depth + 1 == chunk_depth)
+          subtrees.push_back(node->nodes[i]);
+        else
+          split(node->nodes[i].template as<SubNodes<K, V, H>>(), depth + 1);
+      }
+    }
+
+    // Visits the next entry of the current subtree, if any is left
+    template <class Visitor>
+    bool advance(Visitor& visitor)
+    {
+      while (!stack.empty())
+      {
+        auto& frame = stack.back();
+        if (frame.node->kind == NodeKind::Collisions)
+        {
+          const auto c = static_cast<const Collisions<K, V, H>*>(frame.node);
+          while (frame.bin < c->bins.size() &&
+                 frame.pos == c->bins[frame.bin].size())
+          {
+            frame.bin++;
+            frame.pos = 0;
+          }
+          if (frame.bin == c->bins.size())
+          {
+            stack.pop_back();
+            continue;
+          }
+
+          const auto e =
+            c->bins[frame.bin][frame.pos++].template as<Entry<K, V>>();
+          visitor.entry(e->key, e->value);
+          return true;
+        }
+
+        const auto sn = static_cast<const SubNodes<K, V, H>*>(frame.node);
+        if (frame.pos == sn->nodes.size())
+        {
+          stack.pop_back();
+          continue;
+        }
+
+        const auto i = frame.pos++;
+        if (i < sn->data_map.pop())
+        {
+          const auto e = sn->nodes[i].template as<Entry<K, V>>();
+          visitor.entry(e->key, e->value);
+          return true;
+        }
+
+        const auto child = sn->nodes[i].template as<NodeHeader>();
+        const auto depth = (SmallIndex)(frame.depth + 1);
+        stack.push_back({child, depth, 0, 0});
+      }
+      return false;
+    }
+
+  public:
+    // Subtrees at chunk_depth must be SubNodes, so chunk_depth must be
+    // between 1 and collision_depth - 1
+    Serialiser(SmallIndex chunk_depth_ = 2) : chunk_depth(chunk_depth_)
+    {
+      if (chunk_depth < 1 || chunk_depth >= collision_depth)
+        throw std::logic_error("Invalid chunk depth");
+    }
+
+    // Starts a snapshot of map, abandoning any snapshot still in progress
+    void start(const Map<K, V, H>& map_)
+    {
+      map = map_;
+      top.clear();
+      subtrees.clear();
+      next_chunk = 0;
+      top_pos = 0;
+      stack.clear();
+      current.clear();
+      split(map->root_node(), 0);
+      current.reserve(subtrees.size());
+    }
+
+    // Visits at most max_entries entries of the map, returning true while
+    // the snapshot is incomplete. Reused chunks count as a single entry.
+    template <class Visitor>
+    bool step(size_t max_entries, Visitor& visitor)
+    {
+      if (!map.has_value())
+        return false;
+
+      size_t n = 0;
+      while (n < max_entries)
+      {
+        if (next_chunk == 0)
+        {
+          if (top_pos == 0)
+            visitor.begin_chunk();
+
+          if (top_pos < top.size())
+          {
+            const auto e = top[top_pos++].template as<Entry<K, V>>();
+            visitor.entry(e->key, e->value);
+            n++;
+            continue;
+          }
+
+          visitor.end_chunk();
+          next_chunk++;
+          continue;
+        }
+
+        const auto i = next_chunk - 1;
+        if (i == subtrees.size())
+        {
+          // Only keep alive the subtrees of this snapshot
+          previous = std::move(current);
+          current.clear();
+          map.reset();
+          top.clear();
+          subtrees.clear();
+          return false;
+        }
+
+        const auto node = subtrees[i].template as<NodeHeader>();
+        if (stack.empty())
+        {
+          auto it = previous.find(node);
+          if (it != previous.end())
+          {
+            visitor.reuse_chunk(it->second.second);
+            current.emplace(node, it->second);
+            next_chunk++;
+            n++;
+            continue;
+          }
+
+          visitor.begin_chunk();
+          stack.push_back({node, chunk_depth, 0, 0});
+        }
+
+        if (advance(visitor))
+        {
+          n++;
+          continue;
+        }
+
+        current.emplace(
+          node, std::make_pair(subtrees[i], visitor.end_chunk()));
+        next_chunk++;
+      }
+
+      return true;
     }
   };
 }
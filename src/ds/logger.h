@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ringbuffer.h"
+#include "spinlock.h"
 
 #include <chrono>
 #include <cstring>
@@ -11,6 +12,7 @@
 #include <fmt/time.h>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
@@ -162,8 +164,14 @@ namespace logger
       if (line.log_level == Level::FATAL)
         throw std::logic_error("Fatal: " + line.ss.str());
       else
+      {
+        // The writer is shared by every enclave thread, and may be part way
+        // through an oversized message
+        static SpinLock writer_lock;
+        std::lock_guard<SpinLock> guard(writer_lock);
         config::writer()->write(
           config::msg(), config::elapsed_ms(), line.ss.str());
+      }
 
       return true;
     }
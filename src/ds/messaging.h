@@ -8,8 +8,10 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <exception>
 #include <map>
 #include <stdexcept>
+#include <thread>
 
 namespace messaging
 {
@@ -149,6 +151,101 @@ namespace messaging
 
   using RingbufferDispatcher = Dispatcher<ringbuffer::Message>;
 
+  // Idle policies for BufferProcessor::run. idle() is called each time the
+  // ringbuffer is found empty, and returns false to stop run(). reset() is
+  // called whenever messages are processed.
+
+  /// Never sleeps, spinning for as long as the ringbuffer is empty
+  struct SpinIdle
+  {
+    void reset() {}
+
+    bool idle(ringbuffer::Reader&)
+    {
+      _mm_pause();
+      return true;
+    }
+  };
+
+  /// Blocks the current thread until a writer wakes the reader
+  struct WaitUntilWoken
+  {
+    template <typename R>
+    bool operator()(R& r)
+    {
+      r.wait_until_woken();
+      return true;
+    }
+  };
+
+  /** Backs off the longer the ringbuffer stays empty.
+   *
+   * The reader first spins, then yields its core, and then sleeps until a
+   * writer wakes it. Park is called once the reader is asleep (see
+   * Reader::try_sleep), and either waits to be woken and returns true, or
+   * returns false to stop run() so the caller can wait elsewhere.
+   *
+   * Anything else which can sleep until woken, with the same try_sleep() and
+   * wait_until_woken() as a ringbuffer::Reader, may be idled in the same way.
+   */
+  struct BackoffConfig
+  {
+    // Number of polls of an empty ringbuffer to spin for, and then to yield
+    // for, before sleeping
+    size_t spins = 1 << 12;
+    size_t yields = 64;
+  };
+
+  template <typename Park = WaitUntilWoken>
+  class BackoffIdle
+  {
+  private:
+    Park park;
+    BackoffConfig config;
+    size_t polls = 0;
+
+  public:
+    BackoffIdle(Park park = {}, BackoffConfig config = {}) :
+      park(std::move(park)),
+      config(config)
+    {}
+
+    void reset()
+    {
+      polls = 0;
+    }
+
+    template <typename R>
+    bool idle(R& r)
+    {
+      ++polls;
+
+      if (polls <= config.spins)
+      {
+        _mm_pause();
+        return true;
+      }
+
+      if (polls <= config.spins + config.yields)
+      {
+#if defined(INSIDE_ENCLAVE) && !defined(VIRTUAL_ENCLAVE)
+        // There is no scheduler to yield to inside SGX
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+        return true;
+      }
+
+      polls = 0;
+
+      if (!r.try_sleep())
+        return true;
+
+      return park(r);
+    }
+  };
+
   class BufferProcessor
   {
     RingbufferDispatcher dispatcher;
@@ -174,22 +271,44 @@ namespace messaging
       finished.store(v);
     }
 
+    bool is_finished() const
+    {
+      return finished.load();
+    }
+
     size_t read_n(size_t max_messages, ringbuffer::Reader& r)
     {
       size_t total_read = 0;
+      std::exception_ptr failed;
 
       while (!finished.load() && total_read < max_messages)
       {
-        // Read one at a time so we don't process any after being told to stop
-        auto read = r.read(
-          1,
-          [& d = dispatcher](
-            ringbuffer::Message m, const uint8_t* data, size_t size) {
-            d.dispatch(m, data, size);
+        // Messages are read in runs, but dispatched one at a time so we don't
+        // process any after being told to stop. Anything not dispatched stays
+        // in the buffer.
+        auto read = r.read_run(
+          max_messages - total_read,
+          [this, &failed](const ringbuffer::MessageView* msgs, size_t n) {
+            size_t i = 0;
+            try
+            {
+              for (; i < n && !finished.load(); ++i)
+                dispatcher.dispatch(msgs[i].m, msgs[i].data, msgs[i].size);
+            }
+            catch (...)
+            {
+              failed = std::current_exception();
+            }
+            return i;
           });
 
         total_read += read;
 
+        if (failed)
+        {
+          std::rethrow_exception(failed);
+        }
+
         if (read == 0)
         {
           break;
@@ -199,7 +318,15 @@ namespace messaging
       return total_read;
     };
 
-    size_t run(ringbuffer::Reader& r)
+    /** Process messages until set_finished() is called, or idle says to
+     * stop.
+     *
+     * A reader which is asleep is only woken by a write, so another thread
+     * should stop this by sending a message whose handler calls
+     * set_finished().
+     */
+    template <typename Idle = SpinIdle>
+    size_t run(ringbuffer::Reader& r, Idle&& idle = Idle())
     {
       size_t total_read = 0;
 
@@ -208,19 +335,13 @@ namespace messaging
         auto num_read = read_n(-1, r);
         if (num_read == 0)
         {
-          // TODO(#performance): If this is ever idle (the underlying
-          // buffer has no pending messages), it will spin here. With low
-          // traffic this may even be where most execution time is spent. To
-          // avoid too many wasteful spins, we should add customisable
-          // backoff behaviour here. On the host this could simply be a sleep or
-          // a wait on a condition variable, while waiting inside the enclave is
-          // more complicated (may initially spin inside, then after some
-          // attempts OCALL to sleep outside).
-          _mm_pause();
+          if (!idle.idle(r))
+            break;
         }
         else
         {
           total_read += num_read;
+          idle.reset();
         }
       }
 
@@ -14,6 +14,46 @@ namespace oversized
   {
     /// Part of a larger message. Can be sent both ways
     DEFINE_RINGBUFFER_MSG_TYPE(fragment),
+
+    /// Describes a larger message written to an arena. Can be sent both ways
+    DEFINE_RINGBUFFER_MSG_TYPE(arena_message),
+
+    /// Payload of a larger message, within an arena
+    DEFINE_RINGBUFFER_MSG_TYPE(arena_payload),
+  };
+
+#pragma pack(push, 1)
+  struct ArenaMessageHeader
+  {
+    ringbuffer::Message contained;
+    size_t index;
+    size_t size;
+  };
+#pragma pack(pop)
+
+  // Separately allocated buffers for the payloads of large messages, one for
+  // each direction. These are written by the same writers as the matching
+  // buffers of a ringbuffer::Circuit, and freed by its readers once the
+  // messages have been dispatched. Like Circuit, this is entirely non-virtual
+  // so can be safely passed to the enclave.
+  class Arenas
+  {
+  private:
+    ringbuffer::Reader from_outside;
+    ringbuffer::Reader from_inside;
+
+  public:
+    Arenas(size_t size) : from_outside(size), from_inside(size) {}
+
+    ringbuffer::Reader& read_from_outside()
+    {
+      return from_outside;
+    }
+
+    ringbuffer::Reader& read_from_inside()
+    {
+      return from_inside;
+    }
   };
 
   class FragmentReconstructor
@@ -31,9 +71,55 @@ namespace oversized
 
     std::unordered_map<size_t, PartialMessage> partial_messages;
 
+    ringbuffer::Reader* arena;
+
   public:
-    FragmentReconstructor(messaging::RingbufferDispatcher& d) : dispatcher(d)
+    FragmentReconstructor(
+      messaging::RingbufferDispatcher& d,
+      ringbuffer::Reader* arena_ = nullptr) :
+      dispatcher(d),
+      arena(arena_)
     {
+      if (arena != nullptr)
+      {
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          d,
+          OversizedMessage::arena_message,
+          [this](const uint8_t* data, size_t size) {
+            auto header = serialized::read<ArenaMessageHeader>(data, size);
+
+            // The payload is dispatched in place, without copying it out of
+            // the arena
+            auto payload = arena->view(
+              OversizedMessage::arena_payload, header.index, header.size);
+            if (payload == nullptr)
+            {
+              throw ringbuffer::message_error(
+                header.contained,
+                "Invalid arena message. Message " +
+                  std::to_string(header.contained) + " claims " +
+                  std::to_string(header.size) + " bytes at " +
+                  std::to_string(header.index));
+            }
+
+            // The space is released even if the handler throws, as it would
+            // otherwise never be reused
+            struct ReleaseOnExit
+            {
+              ringbuffer::Reader* arena;
+              size_t index;
+
+              ~ReleaseOnExit()
+              {
+                arena->release(index);
+                arena->reclaim();
+              }
+            } release_on_exit{arena, header.index};
+
+            dispatcher.dispatch(header.contained, payload, header.size);
+          });
+      }
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         d,
         OversizedMessage::fragment,
@@ -93,6 +179,9 @@ namespace oversized
     ~FragmentReconstructor()
     {
       dispatcher.remove_message_handler(OversizedMessage::fragment);
+
+      if (arena != nullptr)
+        dispatcher.remove_message_handler(OversizedMessage::arena_message);
     }
   };
 
@@ -105,6 +194,23 @@ namespace oversized
   };
 #pragma pack(pop)
 
+  // Writes the payloads of large messages to an arena
+  class ArenaWriter : public ringbuffer::Writer
+  {
+  public:
+    using ringbuffer::Writer::Writer;
+
+    using ringbuffer::Writer::finish;
+    using ringbuffer::Writer::prepare;
+    using ringbuffer::Writer::write_bytes;
+
+    bool fits(size_t size) const
+    {
+      return ringbuffer::Const::entry_size(size) <=
+        ringbuffer::Const::max_reservation_size(c.size);
+    }
+  };
+
   class Writer : public ringbuffer::Writer
   {
     using Base = ringbuffer::Writer;
@@ -112,6 +218,21 @@ namespace oversized
     const size_t max_fragment_size;
     const size_t max_total_size;
 
+    // If set, messages larger than a fragment are written here when they fit,
+    // and only an arena_message describing them is written to the ringbuffer
+    std::optional<ArenaWriter> arena;
+
+    struct ArenaProgress
+    {
+      WriteMarker marker;
+      ringbuffer::Message m;
+      size_t size;
+    };
+
+    // None unless we are within a [prepare, write_bytes*, finish] loop for a
+    // message written to the arena
+    std::optional<ArenaProgress> arena_progress;
+
     struct FragmentProgress
     {
       WriteMarker marker; // Track this so a later call can finish this fragment
@@ -124,12 +245,19 @@ namespace oversized
     std::optional<FragmentProgress> fragment_progress;
 
   public:
-    Writer(const ringbuffer::Reader& r, size_t f, size_t t = -1) :
+    Writer(
+      const ringbuffer::Reader& r,
+      size_t f,
+      size_t t = -1,
+      const ringbuffer::Reader* arena_ = nullptr) :
       Base(r),
       max_fragment_size(f),
       max_total_size(t),
       fragment_progress({})
     {
+      if (arena_ != nullptr)
+        arena.emplace(*arena_);
+
       if (max_fragment_size >= max_total_size)
         throw std::logic_error(
           "Fragment sizes must be smaller than total max (" +
@@ -145,6 +273,11 @@ namespace oversized
     }
 
   protected:
+    size_t max_direct_size() override
+    {
+      return max_fragment_size;
+    }
+
     virtual WriteMarker prepare(
       ringbuffer::Message m,
       size_t total_size,
@@ -152,7 +285,7 @@ namespace oversized
       size_t* identifier = nullptr) override
     {
       // Ensure this is not called out of order
-      if (fragment_progress.has_value())
+      if (fragment_progress.has_value() || arena_progress.has_value())
       {
         throw std::logic_error("This Writer is already preparing a message");
       }
@@ -170,6 +303,19 @@ namespace oversized
           " bytes, max allowed is " + std::to_string(max_total_size));
       }
 
+      if (arena.has_value() && arena->fits(total_size))
+      {
+        const auto marker = arena->prepare(
+          OversizedMessage::arena_payload, total_size, wait, identifier);
+        if (!marker.has_value())
+        {
+          return {};
+        }
+
+        arena_progress = {marker, m, total_size};
+        return marker;
+      }
+
       // Need to split this message into multiple fragments
 
       if (!wait)
@@ -209,7 +355,24 @@ namespace oversized
 
     virtual void finish(const WriteMarker& marker) override
     {
-      if (fragment_progress.has_value())
+      if (arena_progress.has_value())
+      {
+        arena->finish(arena_progress->marker);
+
+        // The payload is only freed once the reader has seen this, so it must
+        // be written even if the payload was written without waiting
+        ArenaMessageHeader header = {arena_progress->m,
+                                     arena_progress->marker.value(),
+                                     arena_progress->size};
+        const auto descriptor =
+          Base::prepare(OversizedMessage::arena_message, sizeof(header), true);
+        Base::write_bytes(
+          descriptor, (const uint8_t*)&header, sizeof(header));
+        Base::finish(descriptor);
+
+        arena_progress = {};
+      }
+      else if (fragment_progress.has_value())
       {
         // We were writing an oversized message, the given marker means nothing
         // to us
@@ -241,6 +404,11 @@ namespace oversized
         return {};
       }
 
+      if (arena_progress.has_value())
+      {
+        return arena->write_bytes(marker, bytes, size);
+      }
+
       if (!fragment_progress.has_value())
       {
         // Writing a small message - nothing to do here
@@ -303,6 +471,10 @@ namespace oversized
   {
     size_t max_fragment_size;
     size_t max_total_size;
+
+    // If set, messages larger than a fragment are written to these arenas
+    // when they fit, rather than being fragmented
+    Arenas* arenas = nullptr;
   };
 
   // Wrap ringbuffer::Circuit to provide the same fragment/total maximum sizes
@@ -325,7 +497,8 @@ namespace oversized
       return std::make_unique<oversized::Writer>(
         raw_circuit->read_from_inside(),
         config.max_fragment_size,
-        config.max_total_size);
+        config.max_total_size,
+        config.arenas ? &config.arenas->read_from_inside() : nullptr);
     }
 
     std::unique_ptr<ringbuffer::AbstractWriter> create_writer_to_inside()
@@ -334,7 +507,8 @@ namespace oversized
       return std::make_unique<oversized::Writer>(
         raw_circuit->read_from_outside(),
         config.max_fragment_size,
-        config.max_total_size);
+        config.max_total_size,
+        config.arenas ? &config.arenas->read_from_outside() : nullptr);
     }
   };
 }
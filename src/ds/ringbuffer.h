@@ -2,6 +2,8 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <cstring>
 #include <functional>
@@ -12,6 +14,15 @@
 #  include <xmmintrin.h>
 #endif
 
+// Outside of SGX, a sleeping reader blocks on a futex. Inside SGX there are no
+// syscalls, so the enclave must leave to sleep (see Reader::try_sleep).
+#if defined(__linux__) && (!defined(INSIDE_ENCLAVE) || defined(VIRTUAL_ENCLAVE))
+#  define RINGBUFFER_USE_FUTEX
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
 #include "ringbuffer_types.h"
 
 // This file implements a Multiple-Producer Single-Consumer ringbuffer.
@@ -36,13 +47,72 @@ namespace ringbuffer
   static constexpr uint32_t pending_write_flag = 1 << 31;
   static constexpr uint32_t length_mask = ~pending_write_flag;
 
+  // States of a reader which may sleep while its buffer is empty
+  struct Sleep
+  {
+    enum : uint32_t
+    {
+      awake = 0,
+      asleep = 1,
+      woken = 2
+    };
+  };
+
   struct alignas(CACHELINE_SIZE) Var
   {
     std::atomic<size_t> head_cache;
     std::atomic<size_t> tail;
     alignas(CACHELINE_SIZE) std::atomic<size_t> head;
+
+    // Read by every writer, but only written when the reader falls asleep or
+    // is woken. This is a futex word, so must be 32 bits.
+    alignas(CACHELINE_SIZE) std::atomic<uint32_t> sleep_state;
   };
 
+  namespace futex
+  {
+    inline void wait(std::atomic<uint32_t>& word, uint32_t expected)
+    {
+#ifdef RINGBUFFER_USE_FUTEX
+      syscall(
+        SYS_futex,
+        reinterpret_cast<uint32_t*>(&word),
+        FUTEX_WAIT_PRIVATE,
+        expected,
+        nullptr,
+        nullptr,
+        0);
+#else
+      (void)word;
+      (void)expected;
+      _mm_pause();
+#endif
+    }
+
+    inline void wake_all(std::atomic<uint32_t>& word)
+    {
+#ifdef RINGBUFFER_USE_FUTEX
+      syscall(
+        SYS_futex,
+        reinterpret_cast<uint32_t*>(&word),
+        FUTEX_WAKE_PRIVATE,
+        std::numeric_limits<int>::max(),
+        nullptr,
+        nullptr,
+        0);
+#else
+      (void)word;
+#endif
+    }
+  }
+
+  inline void wake_reader(Var& v)
+  {
+    uint32_t expected = Sleep::asleep;
+    if (v.sleep_state.compare_exchange_strong(expected, Sleep::woken))
+      futex::wake_all(v.sleep_state);
+  }
+
   struct Const
   {
     enum : Message
@@ -102,6 +172,19 @@ namespace ringbuffer
     }
   };
 
+  static_assert(
+    Batch::header_size == Const::header_size() &&
+      Batch::entry_size(1) == Const::entry_size(1),
+    "Batches must use the same entry layout as ringbuffers");
+
+  // A message in a ringbuffer, passed to Reader::read_run handlers
+  struct MessageView
+  {
+    Message m;
+    const uint8_t* data;
+    size_t size;
+  };
+
   class Reader
   {
     friend class Writer;
@@ -114,7 +197,7 @@ namespace ringbuffer
     Reader(const size_t size) :
       buffer(size, 0),
       c(buffer.data(), size),
-      v{{0}, {0}, {0}}
+      v{{0}, {0}, {0}, {Sleep::awake}}
     {}
 
     size_t read(size_t limit, Handler f)
@@ -167,6 +250,200 @@ namespace ringbuffer
       return count;
     }
 
+    // Most messages passed to a single read_run handler
+    static constexpr size_t max_run = 64;
+
+    /** Read a run of up to limit messages, and pass them to f together.
+     *
+     * f is called with an array of MessageView and its length, and returns
+     * how many of those messages it has processed. Only those are removed
+     * from the buffer, so the rest will be read again. The head is advanced
+     * once for the whole run, rather than once per message.
+     */
+    template <typename F>
+    size_t read_run(size_t limit, F&& f)
+    {
+      std::array<MessageView, max_run> run;
+      std::array<size_t, max_run> ends;
+
+      limit = std::min(limit, max_run);
+
+      auto mask = c.size - 1;
+      auto hd = v.head.load(std::memory_order_acquire);
+      auto hd_index = hd & mask;
+      auto block = c.size - hd_index;
+      size_t advance = 0;
+      size_t count = 0;
+
+      while ((advance < block) && (count < limit))
+      {
+        auto msg_index = hd_index + advance;
+        auto header = read64(msg_index);
+        auto size = length(header);
+
+        if ((size & pending_write_flag) != 0u)
+          break;
+
+        auto m = message(header);
+
+        if (m == Const::msg_none)
+        {
+          break;
+        }
+        else if (m == Const::msg_pad)
+        {
+          advance += size;
+          continue;
+        }
+
+        advance += Const::entry_size(size);
+        run[count] = {
+          m, c.buffer + msg_index + Const::header_size(), (size_t)size};
+        ends[count] = advance;
+        ++count;
+      }
+
+      if (count == 0)
+      {
+        // Skip any trailing padding, so that the next read starts at the
+        // front of the buffer
+        if (advance > 0)
+        {
+          ::memset(c.buffer + hd_index, 0, advance);
+          v.head.store(hd + advance, std::memory_order_release);
+        }
+
+        return 0;
+      }
+
+      const size_t processed = std::min<size_t>(f(run.data(), count), count);
+
+      if (processed > 0)
+      {
+        advance = ends[processed - 1];
+        ::memset(c.buffer + hd_index, 0, advance);
+        v.head.store(hd + advance, std::memory_order_release);
+      }
+
+      return processed;
+    }
+
+    /** View of a message which is read in place, rather than through read().
+     *
+     * index is the offset of the payload, as returned by Writer::prepare. This
+     * returns nullptr unless there is a finished message of type m and the
+     * given size at that index.
+     */
+    const uint8_t* view(Message m, size_t index, size_t size)
+    {
+      if (
+        index < Const::header_size() || index > c.size ||
+        size > c.size - index || (index % Const::header_size()) != 0)
+        return nullptr;
+
+      auto header = read64(index - Const::header_size());
+      if (message(header) != m || length(header) != size)
+        return nullptr;
+
+      return c.buffer + index;
+    }
+
+    /** Mark a message read in place as done with.
+     *
+     * The message is turned into padding, so that reclaim() can skip it.
+     */
+    void release(size_t index)
+    {
+      const auto header_index = index - Const::header_size();
+      auto size = length(read64(header_index));
+      write64(
+        header_index,
+        ((uint64_t)Const::msg_pad << 32) | Const::entry_size(size));
+    }
+
+    /** Free space at the front of the buffer used by released messages.
+     *
+     * Stops at the first message which has not been released.
+     */
+    void reclaim()
+    {
+      auto mask = c.size - 1;
+      auto hd = v.head.load(std::memory_order_acquire);
+      auto hd_index = hd & mask;
+      auto block = c.size - hd_index;
+      size_t advance = 0;
+
+      while (advance < block)
+      {
+        auto header = read64(hd_index + advance);
+        auto size = length(header);
+
+        if (
+          (size & pending_write_flag) != 0u ||
+          message(header) != Const::msg_pad)
+          break;
+
+        advance += size;
+      }
+
+      if (advance > 0)
+      {
+        ::memset(c.buffer + hd_index, 0, advance);
+        v.head.store(hd + advance, std::memory_order_release);
+      }
+
+      // Released messages may continue from the front of the buffer
+      if (advance == block)
+        reclaim();
+    }
+
+    /** Announce that the reader is about to sleep until it is woken.
+     *
+     * This fails, leaving the reader awake, if anything has been written (or
+     * reserved) since the buffer was last found empty. Otherwise, the next
+     * writer to finish a message will wake the reader, and the caller should
+     * now wait_until_woken(), or arrange for that to happen elsewhere.
+     */
+    bool try_sleep()
+    {
+      v.sleep_state.store(Sleep::asleep, std::memory_order_seq_cst);
+
+      // Pairs with the fence in Writer::finish. Either a writer sees that we
+      // are asleep, or we see its reservation here.
+      if (
+        v.tail.load(std::memory_order_seq_cst) !=
+        v.head.load(std::memory_order_relaxed))
+      {
+        v.sleep_state.store(Sleep::awake, std::memory_order_relaxed);
+        return false;
+      }
+
+      return true;
+    }
+
+    /// True between a successful try_sleep() and the end of the matching
+    /// wait_until_woken(), whether or not a writer has woken the reader yet
+    bool is_sleeping() const
+    {
+      return v.sleep_state.load(std::memory_order_acquire) != Sleep::awake;
+    }
+
+    /// Block until a writer wakes the reader. This can only block outside of
+    /// SGX, and otherwise spins.
+    void wait_until_woken()
+    {
+      while (v.sleep_state.load(std::memory_order_acquire) == Sleep::asleep)
+        futex::wait(v.sleep_state, Sleep::asleep);
+
+      v.sleep_state.store(Sleep::awake, std::memory_order_relaxed);
+    }
+
+    /// Wake the reader as a writer would, without writing a message
+    void wake()
+    {
+      wake_reader(v);
+    }
+
   private:
     uint64_t read64(size_t index)
     {
@@ -175,6 +452,12 @@ namespace ringbuffer
       return r;
     }
 
+    void write64(size_t index, uint64_t value)
+    {
+      atomic_thread_fence(std::memory_order_acq_rel);
+      *reinterpret_cast<volatile uint64_t*>(c.buffer + index) = value;
+    }
+
     static Message message(uint64_t header)
     {
       return (Message)(header >> 32);
@@ -280,10 +563,83 @@ namespace ringbuffer
         const auto index = marker.value() - Const::header_size();
         auto size = read32(index);
         write32(index, size & length_mask);
+
+        // Orders the reservation of this message before the check, see
+        // Reader::try_sleep()
+        atomic_thread_fence(std::memory_order_seq_cst);
+        if (v->sleep_state.load(std::memory_order_relaxed) == Sleep::asleep)
+          wake_reader(*v);
       }
     }
 
+    /** Write the batch with as few reservations as possible.
+     *
+     * Consecutive entries are reserved together, in runs of up to the
+     * largest reservation this buffer allows, and each run is published to
+     * the reader at once. Entries which cannot be written directly go through
+     * prepare() individually.
+     */
+    size_t write_batch(const Batch& batch, bool wait = true) override
+    {
+      const auto rmax = Const::max_reservation_size(c.size);
+      const auto max_direct = max_direct_size();
+
+      auto entry = batch.data();
+      const auto end = entry + batch.size();
+      size_t written = 0;
+
+      while (entry < end)
+      {
+        const auto run_start = entry;
+        size_t run_count = 0;
+
+        while (entry < end)
+        {
+          auto [m, size] = Batch::read_header(entry);
+          const auto esize = Const::entry_size(size);
+
+          if (
+            size > max_direct || (size_t)(entry - run_start) + esize > rmax ||
+            (m < Const::msg_min) || (m > Const::msg_max))
+            break;
+
+          entry += esize;
+          ++run_count;
+        }
+
+        if (run_count == 0)
+        {
+          // Let prepare() handle (or reject) this entry on its own
+          auto [m, size] = Batch::read_header(entry);
+          const auto marker = prepare(m, size, wait);
+          if (!marker.has_value())
+            break;
+
+          write_bytes(marker, entry + Const::header_size(), size);
+          finish(marker);
+
+          entry += Const::entry_size(size);
+          ++written;
+          continue;
+        }
+
+        if (!write_run(run_start, entry - run_start, wait))
+          break;
+
+        written += run_count;
+      }
+
+      return written;
+    }
+
   protected:
+    /// Largest message payload which may be written to the buffer as a
+    /// single entry by write_batch
+    virtual size_t max_direct_size()
+    {
+      return Const::max_size();
+    }
+
     virtual WriteMarker write_bytes(
       const WriteMarker& marker, const uint8_t* bytes, size_t size) override
     {
@@ -304,6 +660,39 @@ namespace ringbuffer
     }
 
   private:
+    bool write_run(const uint8_t* entries, size_t size, bool wait)
+    {
+      auto r = reserve(size);
+
+      if (!r.has_value())
+      {
+        if (!wait)
+          return false;
+
+        do
+        {
+          _mm_pause();
+          r = reserve(size);
+        } while (!r.has_value());
+      }
+
+      // Copy every entry in the run, then mark the first as pending until
+      // they are all in place. The reader stops at the first entry, so it
+      // sees the whole run at once when that is finished.
+      const auto index = r.value().index;
+      auto [m, first_size] = Batch::read_header(entries);
+
+      write64(index, make_header(m, first_size));
+      checkAccess(index, size);
+      ::memcpy(
+        c.buffer + index + Const::header_size(),
+        entries + Const::header_size(),
+        size - Const::header_size());
+
+      Writer::finish({index + Const::header_size()});
+      return true;
+    }
+
     uint32_t read32(size_t index)
     {
       uint32_t r;
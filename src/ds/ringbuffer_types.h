@@ -5,6 +5,8 @@
 #include "hash.h"
 #include "serializer.h"
 
+#include <cstring>
+#include <limits>
 #include <optional>
 #include <string>
 #include <vector>
@@ -25,11 +27,18 @@ namespace ringbuffer
     {}
   };
 
+  class Batch;
+
   class AbstractWriter
   {
   public:
     virtual ~AbstractWriter() = default;
 
+    /// Write every message in the batch, in order. Returns the number of
+    /// messages written, which is only less than batch.count() if wait is
+    /// false and there was not enough space for the rest.
+    virtual size_t write_batch(const Batch& batch, bool wait = true);
+
     /// Write a message of the given type, containing serialized representation
     /// of each of the args, in order. Blocks until the entire message is
     /// written.
@@ -114,6 +123,126 @@ namespace ringbuffer
     }
   };
 
+  /** Messages serialized into local memory, to be written together.
+   *
+   * Each entry is laid out as it would be in a ringbuffer: an 8 byte header
+   * holding the payload size and the message type, then the payload, padded
+   * to a multiple of 8 bytes. A ringbuffer::Writer can then reserve space for
+   * a run of entries at once, and copy them in with a single memcpy.
+   */
+  class Batch : public AbstractWriter
+  {
+  public:
+    static constexpr size_t header_size = sizeof(uint32_t) + sizeof(Message);
+
+    static constexpr size_t entry_size(size_t size)
+    {
+      return (size + header_size + (header_size - 1)) & ~(header_size - 1);
+    }
+
+    static std::pair<Message, size_t> read_header(const uint8_t* entry)
+    {
+      uint64_t header;
+      std::memcpy(&header, entry, sizeof(header));
+      return {(Message)(header >> 32), (size_t)(uint32_t)header};
+    }
+
+  private:
+    std::vector<uint8_t> entries;
+    size_t num_entries = 0;
+
+  public:
+    /// Number of messages in the batch
+    size_t count() const
+    {
+      return num_entries;
+    }
+
+    bool empty() const
+    {
+      return num_entries == 0;
+    }
+
+    /// Serialized entries, size() bytes in total
+    const uint8_t* data() const
+    {
+      return entries.data();
+    }
+
+    size_t size() const
+    {
+      return entries.size();
+    }
+
+    void clear()
+    {
+      entries.clear();
+      num_entries = 0;
+    }
+
+  protected:
+    WriteMarker prepare(
+      Message m,
+      size_t size,
+      bool wait = true,
+      size_t* identifier = nullptr) override
+    {
+      if (size > std::numeric_limits<int32_t>::max() - header_size)
+        throw message_error(
+          m,
+          "Message (" + std::to_string(m) + ") is too long to batch (" +
+            std::to_string(size) + ")");
+
+      const auto start = entries.size();
+      entries.resize(start + entry_size(size));
+
+      const uint64_t header = (((uint64_t)m) << 32) | (uint32_t)size;
+      std::memcpy(entries.data() + start, &header, sizeof(header));
+      ++num_entries;
+
+      return {start + header_size};
+    }
+
+    void finish(const WriteMarker&) override {}
+
+    WriteMarker write_bytes(
+      const WriteMarker& marker, const uint8_t* bytes, size_t size) override
+    {
+      if (!marker.has_value())
+        return {};
+
+      if (size > 0)
+        std::memcpy(entries.data() + marker.value(), bytes, size);
+
+      return {marker.value() + size};
+    }
+  };
+
+  inline size_t AbstractWriter::write_batch(const Batch& batch, bool wait)
+  {
+    // Write each message separately
+    auto entry = batch.data();
+    const auto end = entry + batch.size();
+    size_t written = 0;
+
+    while (entry < end)
+    {
+      auto [m, size] = Batch::read_header(entry);
+
+      const auto marker = prepare(m, size, wait);
+      if (!marker.has_value())
+        break;
+
+      write_bytes(marker, entry + Batch::header_size, size);
+      finish(marker);
+
+      entry += Batch::entry_size(size);
+      ++written;
+    }
+
+    return written;
+  }
+
   class AbstractWriterFactory
   {
   public:
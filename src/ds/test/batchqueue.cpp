@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../batchqueue.h"
+
+#include <chrono>
+#include <doctest/doctest.h>
+#include <thread>
+
+TEST_CASE(
+  "Jobs from several threads are run together" *
+  doctest::test_suite("batchqueue"))
+{
+  ds::BatchQueue q;
+
+  std::atomic<bool> release{false};
+  std::atomic<size_t> batches{0};
+  std::vector<size_t> batch_sizes;
+  SpinLock sizes_lock;
+
+  // The first batch is held until the other threads have queued their jobs,
+  // which are then all run in the next batch
+  auto run_batch = [&](std::vector<ds::BatchQueue::Job>&& jobs) {
+    {
+      std::lock_guard<SpinLock> guard(sizes_lock);
+      batch_sizes.push_back(jobs.size());
+    }
+
+    if (batches++ == 0)
+    {
+      while (!release.load())
+        std::this_thread::yield();
+    }
+
+    for (auto& job : jobs)
+      job();
+  };
+
+  constexpr size_t thread_count = 4;
+  constexpr size_t jobs_per_thread = 3;
+  std::vector<size_t> done(thread_count, 0);
+  std::vector<size_t> done_on_return(thread_count, 0);
+
+  auto submit = [&](size_t t) {
+    std::vector<ds::BatchQueue::Job> jobs;
+    for (size_t i = 0; i < jobs_per_thread; ++i)
+      jobs.emplace_back([&done, t]() { ++done[t]; });
+    q.run(std::move(jobs), run_batch);
+    done_on_return[t] = done[t];
+  };
+
+  std::vector<std::thread> threads;
+  threads.emplace_back(submit, 0);
+  while (batches.load() == 0)
+    std::this_thread::yield();
+
+  for (size_t t = 1; t < thread_count; ++t)
+    threads.emplace_back(submit, t);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  release.store(true);
+
+  for (auto& t : threads)
+    t.join();
+
+  // Each submitter returns only once its own jobs have run
+  for (size_t t = 0; t < thread_count; ++t)
+    REQUIRE(done_on_return[t] == jobs_per_thread);
+
+  REQUIRE(batch_sizes.size() == 2);
+  REQUIRE(batch_sizes[0] == jobs_per_thread);
+  REQUIRE(batch_sizes[1] == (thread_count - 1) * jobs_per_thread);
+}
+
+TEST_CASE(
+  "Jobs run on the submitting thread without a runner" *
+  doctest::test_suite("batchqueue"))
+{
+  ds::BatchQueue q;
+
+  const auto id = std::this_thread::get_id();
+  size_t count = 0;
+  std::vector<ds::BatchQueue::Job> jobs;
+  for (size_t i = 0; i < 10; ++i)
+    jobs.emplace_back([&]() {
+      REQUIRE(std::this_thread::get_id() == id);
+      ++count;
+    });
+
+  q.run(std::move(jobs), nullptr);
+  REQUIRE(count == 10);
+}
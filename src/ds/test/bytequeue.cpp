@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "../bytequeue.h"
+
+#include <doctest/doctest.h>
+#include <numeric>
+
+TEST_CASE(
+  "Bytes are read in the order they were appended" *
+  doctest::test_suite("bytequeue"))
+{
+  ds::ByteQueue q;
+  REQUIRE(q.empty());
+
+  std::vector<uint8_t> bytes(1000);
+  std::iota(bytes.begin(), bytes.end(), 0);
+
+  size_t next_write = 0;
+  size_t next_read = 0;
+  size_t chunk = 1;
+
+  while (next_read < bytes.size())
+  {
+    const auto to_write = std::min(chunk, bytes.size() - next_write);
+    q.append(bytes.data() + next_write, to_write);
+    next_write += to_write;
+
+    // Read a little less than was written, so the queue holds a backlog
+    std::vector<uint8_t> out(chunk > 1 ? chunk - 1 : 1);
+    const auto rd = q.read(out.data(), out.size());
+    REQUIRE(rd <= out.size());
+
+    for (size_t i = 0; i < rd; ++i)
+      REQUIRE(out[i] == bytes[next_read + i]);
+
+    next_read += rd;
+    REQUIRE(q.size() == next_write - next_read);
+
+    chunk = (chunk * 7) % 61 + 1;
+  }
+
+  REQUIRE(q.empty());
+}
+
+TEST_CASE("Unread bytes are contiguous" * doctest::test_suite("bytequeue"))
+{
+  ds::ByteQueue q;
+
+  const std::string first("hello ");
+  const std::string second("world");
+
+  q.append((const uint8_t*)first.data(), first.size());
+  q.consume(2);
+
+  auto space = q.prepare(second.size());
+  REQUIRE(space.n >= second.size());
+  ::memcpy(space.p, second.data(), second.size());
+  q.commit(second.size());
+
+  const auto data = q.data();
+  REQUIRE(std::string((const char*)data.p, data.n) == "llo world");
+
+  q.consume(data.n);
+  REQUIRE(q.empty());
+  REQUIRE(q.data().n == 0);
+}
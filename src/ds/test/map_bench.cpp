@@ -1,13 +1,72 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
-#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_IMPLEMENT
 #include "../champmap.h"
 #include "../rbmap.h"
 
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <map>
+#include <new>
 #include <picobench/picobench.hpp>
+#include <string>
 
 using namespace std;
 
+// Count heap allocations, to report how many each way of committing a batch
+// of writes makes, and how much memory a map takes per entry
+static size_t allocations = 0;
+static size_t live_bytes = 0;
+
+void* operator new(size_t size)
+{
+  ++allocations;
+  auto p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  live_bytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+// champ::NodePool takes its slabs from the aligned overloads
+void* operator new(size_t size, std::align_val_t align)
+{
+  ++allocations;
+  auto p = aligned_alloc(static_cast<size_t>(align), size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  live_bytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+// Allocations per commit, by benchmark and by number of keys written
+static map<string, map<size_t, size_t>> commit_allocations;
+
 using K = uint64_t;
 using V = std::vector<uint64_t>;
 
@@ -117,6 +176,140 @@ static void benchmark_foreach(picobench::state& s)
   s.stop_timer();
 }
 
+static constexpr size_t commit_map_size = 32 << 8;
+
+// Writes a batch of keys to a map, as Map::TxView::commit does, by making a
+// new persistent map for every key
+template <class M>
+static void benchmark_commit_put(picobench::state& s)
+{
+  size_t keys = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(commit_map_size);
+  size_t allocations_before = allocations;
+  s.start_timer();
+  auto res = map;
+  for (size_t i = 0; i < keys; ++i)
+  {
+    res = res.put((i * 7) % commit_map_size, v);
+  }
+  do_not_optimize(res);
+  clobber_memory();
+  s.stop_timer();
+  commit_allocations["put"][keys] = allocations - allocations_before;
+}
+
+// Writes the same batch of keys through a single transient
+template <class M>
+static void benchmark_commit_transient(picobench::state& s)
+{
+  size_t keys = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(commit_map_size);
+  size_t allocations_before = allocations;
+  s.start_timer();
+  auto t = map.transient();
+  for (size_t i = 0; i < keys; ++i)
+  {
+    t.put((i * 7) % commit_map_size, v);
+  }
+  auto res = t.persistent();
+  do_not_optimize(res);
+  clobber_memory();
+  s.stop_timer();
+  commit_allocations["transient"][keys] = allocations - allocations_before;
+}
+
+// Copies the entries of a map to a buffer, as serialising them would
+static void write_entry(vector<uint8_t>& buf, const K& k, const V& v)
+{
+  auto p = reinterpret_cast<const uint8_t*>(&k);
+  buf.insert(buf.end(), p, p + sizeof(k));
+  p = reinterpret_cast<const uint8_t*>(v.data());
+  buf.insert(buf.end(), p, p + v.size() * sizeof(uint64_t));
+}
+
+struct BufferVisitor
+{
+  vector<uint8_t> buf;
+  size_t chunks = 0;
+
+  void begin_chunk() {}
+
+  void entry(const K& k, const V& v)
+  {
+    write_entry(buf, k, v);
+  }
+
+  size_t end_chunk()
+  {
+    return chunks++;
+  }
+
+  void reuse_chunk(const size_t&) {}
+};
+
+static constexpr size_t snapshot_map_size = 32 << 10;
+static constexpr size_t snapshot_step = 1024;
+
+// Snapshots a map after a batch of writes, by visiting every entry
+template <class M>
+static void benchmark_snapshot_foreach(picobench::state& s)
+{
+  size_t keys = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(snapshot_map_size);
+  vector<uint8_t> buf;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    auto t = map.transient();
+    for (size_t i = 0; i < keys; ++i)
+      t.put((i * 7) % snapshot_map_size, v);
+    map = t.persistent();
+    buf.clear();
+    map.foreach([&buf](const auto& key, const auto& value) {
+      write_entry(buf, key, value);
+      return true;
+    });
+    do_not_optimize(buf);
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
+// Snapshots the same map incrementally, so that only the subtrees changed by
+// the batch are visited again
+template <class M>
+static void benchmark_snapshot_incremental(picobench::state& s)
+{
+  size_t keys = s.iterations();
+  auto v = gen_val(val_size);
+  auto map = gen_map<M>(snapshot_map_size);
+  champ::Serialiser<K, V, std::hash<K>, size_t> serialiser;
+  BufferVisitor visitor;
+  serialiser.start(map);
+  while (serialiser.step(snapshot_step, visitor))
+    ;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    auto t = map.transient();
+    for (size_t i = 0; i < keys; ++i)
+      t.put((i * 7) % snapshot_map_size, v);
+    map = t.persistent();
+    visitor.buf.clear();
+    serialiser.start(map);
+    while (serialiser.step(snapshot_step, visitor))
+      ;
+    do_not_optimize(visitor.buf);
+    clobber_memory();
+  }
+  s.stop_timer();
+}
+
 const std::vector<int> sizes = {32, 32 << 2, 32 << 4, 32 << 6, 32 << 8};
 
 PICOBENCH_SUITE("put");
@@ -142,3 +335,66 @@ auto bench_rb_map_foreach = benchmark_foreach<RBMap<K, V>>;
 PICOBENCH(bench_rb_map_foreach).iterations(for_sizes).samples(10).baseline();
 auto bench_champ_map_foreach = benchmark_foreach<champ::Map<K, V>>;
 PICOBENCH(bench_champ_map_foreach).iterations(for_sizes).samples(10);
+
+const std::vector<int> commit_sizes = {1, 8, 64, 512};
+
+PICOBENCH_SUITE("commit");
+auto bench_champ_map_commit_put = benchmark_commit_put<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_commit_put)
+  .iterations(commit_sizes)
+  .samples(10)
+  .baseline();
+auto bench_champ_map_commit_transient =
+  benchmark_commit_transient<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_commit_transient)
+  .iterations(commit_sizes)
+  .samples(10);
+
+const std::vector<int> snapshot_sizes = {1, 8, 64, 512};
+
+PICOBENCH_SUITE("snapshot");
+auto bench_champ_map_snapshot_foreach =
+  benchmark_snapshot_foreach<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_snapshot_foreach)
+  .iterations(snapshot_sizes)
+  .samples(10)
+  .baseline();
+auto bench_champ_map_snapshot_incremental =
+  benchmark_snapshot_incremental<champ::Map<K, V>>;
+PICOBENCH(bench_champ_map_snapshot_incremental)
+  .iterations(snapshot_sizes)
+  .samples(10);
+
+int main(int argc, char* argv[])
+{
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  // Measured before the benchmarks run, so that the node pools' slabs are
+  // allocated (and counted) here rather than reused from earlier runs
+  {
+    // Use small values, so that the map's own overhead dominates
+    constexpr size_t entries = commit_map_size;
+    size_t allocations_before = allocations;
+    size_t bytes_before = live_bytes;
+    champ::Map<K, K> map;
+    for (K i = 0; i < entries; ++i)
+      map = map.put(i, i);
+    do_not_optimize(map);
+
+    cout << "Map of " << entries << " entries:" << endl;
+    cout << "  allocations: " << allocations - allocations_before << endl;
+    cout << "  bytes per entry: "
+         << (live_bytes - bytes_before) / (double)entries << endl;
+  }
+
+  auto rc = runner.run();
+
+  cout << "Allocations per commit:" << endl;
+  for (const auto& [name, by_keys] : commit_allocations)
+  {
+    for (const auto& [keys, count] : by_keys)
+      cout << "  " << name << " " << keys << " keys: " << count << endl;
+  }
+
+  return rc;
+}
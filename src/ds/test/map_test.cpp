@@ -6,6 +6,7 @@
 
 #include <doctest/doctest.h>
 #include <random>
+#include <thread>
 
 using namespace std;
 
@@ -136,3 +137,207 @@ TEST_CASE("persistent map operations")
     champ = champ_new;
   }
 }
+
+TEST_CASE("transient batch writes")
+{
+  RBMap<K, V> rb;
+  champ::Map<K, V, H> champ;
+
+  auto ops = gen_ops(500);
+  constexpr size_t batch_size = 50;
+  for (size_t i = 0; i < ops.size(); i += batch_size)
+  {
+    // Apply a batch of writes through a transient, checking that neither the
+    // map it was created from nor the map it returned earlier are modified
+    auto transient = champ.transient();
+    auto rb_new = rb;
+    RBMap<K, V> rb_mid;
+    champ::Map<K, V, H> champ_mid;
+    for (size_t j = i; j < std::min(i + batch_size, ops.size()); ++j)
+    {
+      auto put = dynamic_cast<Put*>(ops[j].get());
+      REQUIRE(put != nullptr);
+      rb_new = rb_new.put(put->k, put->v);
+      transient.put(put->k, put->v);
+      REQUIRE(transient.get(put->k) == put->v);
+
+      if (j == i + batch_size / 2)
+      {
+        rb_mid = rb_new;
+        champ_mid = transient.persistent();
+      }
+    }
+    auto champ_new = transient.persistent();
+
+    INFO("check consistency of transient result");
+    {
+      size_t n = 0;
+      champ_new.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb_new.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == champ_new.size());
+      REQUIRE(n == transient.size());
+    }
+
+    INFO("check persistence of previous versions");
+    {
+      size_t n = 0;
+      champ.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == champ.size());
+
+      n = 0;
+      champ_mid.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb_mid.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == champ_mid.size());
+    }
+
+    rb = rb_new;
+    champ = champ_new;
+  }
+}
+
+// Rebuilds maps from the chunks passed to it by a champ::Serialiser, keeping
+// the entries of each chunk by id, to be reused by later snapshots
+struct ChunkReader
+{
+  map<size_t, vector<pair<K, V>>> chunks;
+  vector<pair<K, V>> chunk;
+  champ::Map<K, V, H> result;
+  size_t emitted = 0;
+  size_t reused = 0;
+
+  void begin_chunk()
+  {
+    REQUIRE(chunk.empty());
+  }
+
+  void entry(const K& k, const V& v)
+  {
+    chunk.emplace_back(k, v);
+    result = result.put(k, v);
+    emitted++;
+  }
+
+  size_t end_chunk()
+  {
+    const auto id = chunks.size();
+    chunks.emplace(id, std::move(chunk));
+    chunk.clear();
+    return id;
+  }
+
+  void reuse_chunk(const size_t& id)
+  {
+    const auto it = chunks.find(id);
+    REQUIRE(it != chunks.end());
+    for (const auto& [k, v] : it->second)
+      result = result.put(k, v);
+    reused++;
+  }
+};
+
+TEST_CASE("incremental serialisation")
+{
+  RBMap<K, V> rb;
+  champ::Map<K, V, H> champ;
+  champ::Serialiser<K, V, H, size_t> serialiser(1);
+  ChunkReader reader;
+  size_t total_size = 0;
+  size_t total_emitted = 0;
+  size_t total_reused = 0;
+
+  auto ops = gen_ops(500);
+  constexpr size_t batch_size = 10;
+  constexpr size_t max_entries = 7;
+  for (size_t i = 0; i < ops.size(); i += batch_size)
+  {
+    auto transient = champ.transient();
+    for (size_t j = i; j < std::min(i + batch_size, ops.size()); ++j)
+    {
+      auto put = dynamic_cast<Put*>(ops[j].get());
+      REQUIRE(put != nullptr);
+      rb = rb.put(put->k, put->v);
+      transient.put(put->k, put->v);
+    }
+    champ = transient.persistent();
+
+    // Writes made while a snapshot is in progress do not affect it
+    serialiser.start(champ);
+    reader.result = {};
+    reader.emitted = 0;
+    reader.reused = 0;
+    auto other = champ.transient();
+    other.put(0, 0);
+    while (true)
+    {
+      const auto emitted = reader.emitted;
+      const auto reused = reader.reused;
+      const auto more = serialiser.step(max_entries, reader);
+      REQUIRE(reader.emitted + reader.reused - emitted - reused <= max_entries);
+      if (!more)
+        break;
+    }
+
+    INFO("check consistency of rebuilt map");
+    {
+      size_t n = 0;
+      reader.result.foreach([&](const auto& k, const auto& v) {
+        n++;
+        auto p = rb.get(k);
+        REQUIRE(p.has_value());
+        REQUIRE(p.value() == v);
+        return true;
+      });
+      REQUIRE(n == champ.size());
+    }
+
+    total_size += champ.size();
+    total_emitted += reader.emitted;
+    total_reused += reader.reused;
+  }
+
+  INFO("check that unchanged subtrees are not emitted again");
+  REQUIRE(total_reused > 0);
+  REQUIRE(total_emitted < total_size);
+}
+
+TEST_CASE("nodes freed by other threads are reused")
+{
+  using Pool = champ::NodePool<sizeof(champ::Entry<K, V>)>;
+
+  // Maps are built on one thread and released on another, as transactions
+  // executed on worker threads are committed to the store
+  champ::Map<K, V, H> champ;
+  auto build = [&]() {
+    for (size_t i = 0; i < 1000; ++i)
+      champ = champ.put(i, i);
+  };
+
+  std::thread(build).join();
+  champ = {};
+  const auto slabs = Pool::slabs();
+
+  for (size_t i = 0; i < 10; ++i)
+  {
+    std::thread(build).join();
+    champ = {};
+  }
+
+  INFO("check that blocks freed on this thread were used again");
+  REQUIRE(Pool::slabs() == slabs);
+}
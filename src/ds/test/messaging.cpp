@@ -251,6 +251,73 @@ TEST_CASE("Basic message loop" * doctest::test_suite("messaging"))
   }
 }
 
+TEST_CASE("Backoff idle" * doctest::test_suite("messaging"))
+{
+  enum : Message
+  {
+    count = Const::msg_min,
+    finish
+  };
+
+  BufferProcessor bp;
+  Reader r(1 << 10);
+  Writer w(r);
+
+  size_t counted = 0;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, count, [&](const uint8_t*, size_t) { ++counted; });
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, finish, [&](const uint8_t*, size_t) { bp.set_finished(); });
+
+  BackoffConfig config;
+  config.spins = 10;
+  config.yields = 10;
+
+  SUBCASE("Park can stop the loop, leaving the reader asleep")
+  {
+    size_t parks = 0;
+    auto leave = [&](ringbuffer::Reader&) {
+      ++parks;
+      return false;
+    };
+
+    w.write(count);
+    REQUIRE(bp.run(r, BackoffIdle(leave, config)) == 1);
+    REQUIRE(parks == 1);
+    REQUIRE(r.is_sleeping());
+    REQUIRE_FALSE(bp.is_finished());
+
+    // A write wakes it, and the loop can resume
+    w.write(count);
+    r.wait_until_woken();
+    REQUIRE_FALSE(r.is_sleeping());
+
+    w.write(finish);
+    bp.run(r, BackoffIdle(leave, config));
+    REQUIRE(counted == 2);
+    REQUIRE(parks == 1);
+  }
+
+  SUBCASE("Sleeping loop is woken by writes from another thread")
+  {
+    constexpr size_t n = 100;
+    std::thread writer([&w]() {
+      for (size_t i = 0; i < n; ++i)
+      {
+        w.write(count);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+      w.write(finish);
+    });
+
+    bp.run(r, BackoffIdle<>({}, config));
+    writer.join();
+
+    REQUIRE(counted == n);
+    REQUIRE_FALSE(r.is_sleeping());
+  }
+}
+
 TEST_CASE("Multiple threads" * doctest::test_suite("messaging"))
 {
   enum : Message
@@ -443,4 +443,126 @@ TEST_CASE("Nesting" * doctest::test_suite("oversized"))
     disp.dispatch(type, payload.data(), payload.size());
     REQUIRE(core_received);
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Batches" * doctest::test_suite("oversized"))
+{
+  constexpr size_t fragment_size = 64;
+  constexpr size_t payload_size = 200;
+
+  ringbuffer::Reader rr(1 << 10);
+  oversized::Writer writer(rr, fragment_size);
+
+  messaging::RingbufferDispatcher disp("oversized");
+  oversized::FragmentReconstructor fr(disp);
+
+  std::vector<ringbuffer::Message> seen;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    disp, ascending, [&](const uint8_t* data, size_t size) {
+      REQUIRE(size == payload_size);
+      REQUIRE(std::is_sorted(data, data + size));
+      seen.push_back(ascending);
+    });
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    disp, unfragmented, [&](const uint8_t* data, size_t size) {
+      REQUIRE(size == 1);
+      REQUIRE(*data == unfragmented_magic_value);
+      seen.push_back(unfragmented);
+    });
+
+  std::vector<uint8_t> big(payload_size);
+  std::iota(big.begin(), big.end(), 0);
+
+  // Entries larger than a fragment are still fragmented, in order with the
+  // rest of the batch
+  ringbuffer::Batch batch;
+  batch.write(unfragmented, unfragmented_magic_value);
+  batch.write(ascending, serializer::ByteRange{big.data(), big.size()});
+  batch.write(unfragmented, unfragmented_magic_value);
+  REQUIRE(writer.write_batch(batch) == 3);
+
+  rr.read(-1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+    disp.dispatch(m, data, size);
+  });
+
+  REQUIRE(
+    seen ==
+    std::vector<ringbuffer::Message>{unfragmented, ascending, unfragmented});
+}
+
+TEST_CASE("Arenas" * doctest::test_suite("oversized"))
+{
+  constexpr size_t fragment_size = 64;
+  constexpr size_t arena_size = 1 << 10;
+
+  ringbuffer::Reader rr(1 << 12);
+  oversized::Arenas arenas(arena_size);
+  auto& arena = arenas.read_from_outside();
+  oversized::Writer writer(rr, fragment_size, -1, &arena);
+
+  messaging::BufferProcessor bp("oversized");
+  oversized::FragmentReconstructor fr(bp.get_dispatcher(), &arena);
+
+  std::vector<uint8_t> last_message;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, ascending, [&](const uint8_t* data, size_t size) {
+      last_message.assign(data, data + size);
+    });
+
+  SUBCASE("Large messages are passed through the arena")
+  {
+    // Write many more bytes than fit in the arena, so that its space must be
+    // reclaimed and reused
+    for (size_t i = 0; i < 100; ++i)
+    {
+      const auto size = 100 + (i * 37) % 300;
+      std::vector<uint8_t> msg(size, (uint8_t)i);
+      writer.write(ascending, serializer::ByteRange{msg.data(), msg.size()});
+
+      // Only a descriptor is written to the ringbuffer
+      rr.read_run(-1, [](const ringbuffer::MessageView* msgs, size_t n) {
+        REQUIRE(n == 1);
+        REQUIRE(msgs[0].m == oversized::OversizedMessage::arena_message);
+        return 0;
+      });
+
+      REQUIRE(bp.read_n(-1, rr) == 1);
+      REQUIRE(last_message == msg);
+    }
+
+    // Nothing is left in the arena
+    REQUIRE(arena.read(-1, [](auto, auto, auto) {}) == 0);
+  }
+
+  SUBCASE("Arena space is released when a handler throws")
+  {
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      bp, unfragmented, [](const uint8_t*, size_t) {
+        throw std::logic_error("Handler failed");
+      });
+
+    std::vector<uint8_t> msg(300, 42);
+    writer.write(unfragmented, serializer::ByteRange{msg.data(), msg.size()});
+    REQUIRE_THROWS_AS(bp.read_n(-1, rr), std::logic_error);
+
+    REQUIRE(arena.read(-1, [](auto, auto, auto) {}) == 0);
+  }
+
+  SUBCASE("Messages too large for the arena are fragmented")
+  {
+    std::vector<uint8_t> msg(arena_size, 42);
+    writer.write(ascending, serializer::ByteRange{msg.data(), msg.size()});
+    while (last_message.empty())
+      bp.read_n(-1, rr);
+    REQUIRE(last_message == msg);
+  }
+
+  SUBCASE("Invalid descriptors are rejected")
+  {
+    ringbuffer::Writer w(rr);
+    oversized::ArenaMessageHeader header = {ascending, 8, 100};
+    w.write(
+      oversized::OversizedMessage::arena_message,
+      serializer::ByteRange{(const uint8_t*)&header, sizeof(header)});
+    REQUIRE_THROWS_AS(bp.read_n(-1, rr), ringbuffer::message_error);
+  }
+}
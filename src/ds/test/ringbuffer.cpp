@@ -494,3 +494,157 @@ TEST_CASE("Multiple threads can wait" * doctest::test_suite("ringbuffer"))
     }
   }
 }
+
+TEST_CASE("Sleeping reader" * doctest::test_suite("ringbuffer"))
+{
+  Reader r(1 << 8);
+  Writer w(r);
+
+  SUBCASE("Cannot sleep with messages pending")
+  {
+    w.write(small_message, (uint8_t)1);
+    REQUIRE_FALSE(r.try_sleep());
+    REQUIRE_FALSE(r.is_sleeping());
+
+    REQUIRE(r.read(-1, handle_message) == 1);
+    REQUIRE(r.try_sleep());
+    REQUIRE(r.is_sleeping());
+  }
+
+  SUBCASE("Writes wake the reader")
+  {
+    REQUIRE(r.try_sleep());
+    w.write(small_message, (uint8_t)1);
+    REQUIRE(r.is_sleeping());
+
+    // Already woken, so this returns immediately
+    r.wait_until_woken();
+    REQUIRE_FALSE(r.is_sleeping());
+    REQUIRE(r.read(-1, handle_message) == 1);
+  }
+
+  SUBCASE("Waiting reader is woken by another thread")
+  {
+    constexpr size_t n = 1000;
+    std::thread writer([&w]() {
+      for (size_t i = 0; i < n; ++i)
+      {
+        w.write(small_message, (uint8_t)(i % 256));
+        if (i % 100 == 0)
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+
+    size_t reads = 0;
+    while (reads < n)
+    {
+      auto read = r.read(-1, handle_message);
+      reads += read;
+
+      if (read == 0 && r.try_sleep())
+        r.wait_until_woken();
+    }
+
+    writer.join();
+    REQUIRE_FALSE(r.is_sleeping());
+  }
+}
+
+TEST_CASE("Batched writes" * doctest::test_suite("ringbuffer"))
+{
+  Reader r(1 << 8);
+  Writer w(r);
+
+  const std::vector<uint8_t> big(big_size, 0xab);
+
+  Batch batch;
+  batch.write(empty_message);
+  batch.write(small_message, (uint8_t)42);
+  batch.write(
+    awkward_message, serializer::ByteRange{big.data(), awkward_size});
+  batch.write(big_message, serializer::ByteRange{big.data(), big_size});
+  REQUIRE(batch.count() == 4);
+
+  SUBCASE("Messages are read in order")
+  {
+    // The big message does not fit in a single reservation, so is written
+    // (and rejected) on its own
+    REQUIRE_THROWS_AS(w.write_batch(batch), message_error);
+
+    std::vector<Message> seen;
+    r.read(-1, [&](Message m, const uint8_t* data, size_t size) {
+      handle_message(m, data, size);
+      seen.push_back(m);
+    });
+    REQUIRE(
+      seen ==
+      std::vector<Message>{empty_message, small_message, awkward_message});
+  }
+
+  SUBCASE("Batches larger than a reservation are split")
+  {
+    Batch small_batch;
+    constexpr size_t n = 40;
+    for (size_t i = 0; i < n; ++i)
+      small_batch.write(small_message, (uint8_t)i);
+
+    // 40 * 16 bytes does not fit in one reservation of a 256 byte buffer
+    size_t written = 0;
+    std::thread writer(
+      [&w, &small_batch, &written]() { written = w.write_batch(small_batch); });
+
+    size_t reads = 0;
+    while (reads < n)
+    {
+      r.read(-1, [&](Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == small_message);
+        REQUIRE(size == 1);
+        REQUIRE(*data == reads);
+        ++reads;
+      });
+    }
+
+    writer.join();
+    REQUIRE(written == n);
+  }
+
+  SUBCASE("Try-writes stop when full")
+  {
+    Batch small_batch;
+    for (size_t i = 0; i < 40; ++i)
+      small_batch.write(small_message, (uint8_t)i);
+
+    const auto written = w.write_batch(small_batch, false);
+    REQUIRE(written > 0);
+    REQUIRE(written < small_batch.count());
+    REQUIRE(r.read(-1, handle_message) == written);
+  }
+
+  SUBCASE("Runs can be partially processed")
+  {
+    Batch small_batch;
+    for (size_t i = 0; i < 10; ++i)
+      small_batch.write(small_message, (uint8_t)i);
+    REQUIRE(w.write_batch(small_batch) == 10);
+
+    size_t next = 0;
+    auto take = [&](size_t k) {
+      return r.read_run(-1, [&](const MessageView* msgs, size_t count) {
+        REQUIRE(count == 10 - next);
+        for (size_t i = 0; i < k; ++i)
+        {
+          REQUIRE(msgs[i].m == small_message);
+          REQUIRE(msgs[i].size == 1);
+          REQUIRE(*msgs[i].data == next + i);
+        }
+        next += k;
+        return k;
+      });
+    };
+
+    REQUIRE(take(3) == 3);
+    REQUIRE(take(0) == 0);
+    REQUIRE(take(7) == 7);
+    REQUIRE(r.read(-1, handle_message) == 0);
+  }
+}
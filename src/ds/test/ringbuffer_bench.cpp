@@ -2,10 +2,13 @@
 // Licensed under the Apache 2.0 License.
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #define PICOBENCH_DONT_BIND_TO_ONE_CORE
+#include "../messaging.h"
+#include "../oversized.h"
 #include "../ringbuffer.h"
 
 #include <picobench/picobench.hpp>
 #include <thread>
+#include <time.h>
 
 using namespace ringbuffer;
 
@@ -181,3 +184,240 @@ auto spin_200 = specialize<32, 1, 4, spin_pause_handler<200>>;
 FIXED_PICO(spin_200);
 auto spin_400 = specialize<32, 1, 4, spin_pause_handler<400>>;
 FIXED_PICO(spin_400);
+
+//
+// Batched writes, and reads of whole runs
+//
+template <size_t BatchSize>
+static void write_batched(picobench::state& s)
+{
+  constexpr size_t buf_size = 4096;
+  constexpr size_t message_size = 16;
+  constexpr size_t writer_count = 4;
+
+  Reader r(buf_size);
+  std::vector<std::thread> writer_threads;
+
+  const size_t total_messages = s.iterations();
+  const size_t messages_per_writer = total_messages / writer_count;
+
+  size_t reads = 0;
+
+  s.start_timer();
+
+  for (size_t i = 0; i < writer_count; ++i)
+  {
+    writer_threads.emplace_back([messages_per_writer, &r]() {
+      Writer w(r);
+      Batch batch;
+
+      std::vector<uint8_t> raw(message_size);
+      std::iota(raw.begin(), raw.end(), 0);
+
+      for (size_t m = 0; m < messages_per_writer; m += BatchSize)
+      {
+        const auto n = std::min(BatchSize, messages_per_writer - m);
+        for (size_t j = 0; j < n; ++j)
+          batch.write(msg_type, serializer::ByteRange{raw.data(), raw.size()});
+
+        w.write_batch(batch);
+        batch.clear();
+      }
+    });
+  }
+
+  const auto expected = messages_per_writer * writer_count;
+  while (reads < expected)
+  {
+    auto read_count =
+      r.read_run(-1, [](const MessageView*, size_t n) { return n; });
+    reads += read_count;
+    if (read_count == 0)
+      _mm_pause();
+  }
+
+  s.stop_timer();
+
+  for (auto& thr : writer_threads)
+  {
+    thr.join();
+  }
+}
+
+const std::vector<int> batch_msg_counts = {4000, 16000};
+
+PICOBENCH_SUITE("batched writes (4k buffer, 16b per-message, 4 writers)");
+auto batch_1 = write_batched<1>;
+PICOBENCH(batch_1).iterations(batch_msg_counts).samples(10).baseline();
+auto batch_4 = write_batched<4>;
+PICOBENCH(batch_4).iterations(batch_msg_counts).samples(10);
+auto batch_16 = write_batched<16>;
+PICOBENCH(batch_16).iterations(batch_msg_counts).samples(10);
+auto batch_64 = write_batched<64>;
+PICOBENCH(batch_64).iterations(batch_msg_counts).samples(10);
+
+//
+// Idle behaviour of BufferProcessor::run
+//
+constexpr Message msg_stop = msg_type + 1;
+
+using Clock = std::chrono::steady_clock;
+
+static int64_t thread_cpu_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Runs a BufferProcessor with the given idle policy on another thread
+template <typename Idle>
+class IdleReader
+{
+  Reader r;
+  messaging::BufferProcessor bp;
+  std::thread thread;
+
+public:
+  Writer w;
+  std::atomic<int64_t> latency_ns = 0;
+  std::atomic<size_t> received = 0;
+  std::atomic<int64_t> cpu_ns = 0;
+
+  IdleReader() : r(1 << 12), w(r)
+  {
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      bp, msg_type, [this](const uint8_t* data, size_t size) {
+        auto sent = serialized::read<Clock::rep>(data, size);
+        latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - Clock::time_point(Clock::duration(sent)))
+                        .count();
+        ++received;
+      });
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      bp, msg_stop, [this](const uint8_t*, size_t) { bp.set_finished(); });
+
+    thread = std::thread([this]() {
+      auto start = thread_cpu_ns();
+      bp.run(r, Idle());
+      cpu_ns = thread_cpu_ns() - start;
+    });
+  }
+
+  void send_now()
+  {
+    w.write(msg_type, Clock::now().time_since_epoch().count());
+  }
+
+  void stop()
+  {
+    w.write(msg_stop);
+    thread.join();
+  }
+};
+
+// Time from writing a message to it being handled, when the reader has been
+// idle for 1ms before each message
+template <typename Idle>
+static void wake_latency(picobench::state& s)
+{
+  IdleReader<Idle> reader;
+  const auto n = (size_t)s.iterations();
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    reader.send_now();
+
+    while (reader.received < i + 1)
+      std::this_thread::yield();
+  }
+
+  reader.stop();
+  s.add_custom_duration(reader.latency_ns);
+}
+
+// CPU time used by the reader while its buffer is empty, for 1ms per
+// iteration
+template <typename Idle>
+static void idle_cpu(picobench::state& s)
+{
+  IdleReader<Idle> reader;
+  std::this_thread::sleep_for(std::chrono::milliseconds(s.iterations()));
+  reader.stop();
+  s.add_custom_duration(reader.cpu_ns);
+}
+
+const std::vector<int> wake_counts = {10, 100};
+const std::vector<int> idle_ms = {10, 100};
+
+PICOBENCH_SUITE("wake latency (after 1ms idle)");
+auto wake_spin = wake_latency<messaging::SpinIdle>;
+PICOBENCH(wake_spin).iterations(wake_counts).samples(5).baseline();
+auto wake_backoff = wake_latency<messaging::BackoffIdle<>>;
+PICOBENCH(wake_backoff).iterations(wake_counts).samples(5);
+
+PICOBENCH_SUITE("idle reader CPU time (per ms idle)");
+auto cpu_spin = idle_cpu<messaging::SpinIdle>;
+PICOBENCH(cpu_spin).iterations(idle_ms).samples(5).baseline();
+auto cpu_backoff = idle_cpu<messaging::BackoffIdle<>>;
+PICOBENCH(cpu_backoff).iterations(idle_ms).samples(5);
+
+//
+// Large messages, fragmented or passed through an arena
+//
+template <size_t MessageSize, bool UseArena>
+static void write_large(picobench::state& s)
+{
+  constexpr size_t buf_size = 1 << 22;
+  constexpr size_t fragment_size = 1 << 16;
+  constexpr size_t arena_size = 1 << 26;
+
+  Reader r(buf_size);
+  oversized::Arenas arenas(arena_size);
+  auto& arena = arenas.read_from_outside();
+
+  messaging::BufferProcessor bp;
+  oversized::FragmentReconstructor fr(
+    bp.get_dispatcher(), UseArena ? &arena : nullptr);
+
+  size_t reads = 0;
+  bp.get_dispatcher().set_message_handler(
+    msg_type, "large", [&reads](const uint8_t*, size_t) { ++reads; });
+
+  const size_t total_messages = s.iterations();
+  std::vector<uint8_t> raw(MessageSize);
+  std::iota(raw.begin(), raw.end(), 0);
+
+  s.start_timer();
+
+  std::thread writer_thread([&]() {
+    oversized::Writer w(
+      r, fragment_size, -1, UseArena ? &arena : (const Reader*)nullptr);
+
+    for (size_t i = 0; i < total_messages; ++i)
+      w.write(msg_type, serializer::ByteRange{raw.data(), raw.size()});
+  });
+
+  while (reads < total_messages)
+  {
+    if (bp.read_n(-1, r) == 0)
+      _mm_pause();
+  }
+
+  s.stop_timer();
+
+  writer_thread.join();
+}
+
+const std::vector<int> large_msg_counts = {4, 16};
+
+PICOBENCH_SUITE("large messages (4M buffer, 64k fragments, 64M arena)");
+auto fragmented_1m = write_large<1 << 20, false>;
+PICOBENCH(fragmented_1m).iterations(large_msg_counts).samples(5).baseline();
+auto arena_1m = write_large<1 << 20, true>;
+PICOBENCH(arena_1m).iterations(large_msg_counts).samples(5);
+auto fragmented_16m = write_large<1 << 24, false>;
+PICOBENCH(fragmented_16m).iterations(large_msg_counts).samples(5);
+auto arena_16m = write_large<1 << 24, true>;
+PICOBENCH(arena_16m).iterations(large_msg_counts).samples(5);
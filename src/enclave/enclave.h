@@ -18,6 +18,7 @@
 #include "rpcclient.h"
 #include "rpcmap.h"
 #include "rpcsessions.h"
+#include "workerpool.h"
 
 namespace enclave
 {
@@ -26,6 +27,16 @@ namespace enclave
   private:
     ringbuffer::Circuit* circuit;
     oversized::WriterFactory writer_factory;
+    WorkerPool workers;
+    std::atomic<size_t> next_thread_id{WorkerPool::main_thread};
+    messaging::BufferProcessor bp{"Enclave"};
+
+    // reconstruct oversized messages sent to the enclave
+    oversized::FragmentReconstructor fr;
+
+    // Set when the main thread returns to the host to sleep, so that it
+    // resumes processing rather than starting again when it next enters
+    std::atomic<bool> main_sleeping{false};
     RPCSessions rpcsessions;
     ccf::NetworkState network;
     ccf::NodeState node;
@@ -39,12 +50,18 @@ namespace enclave
     Enclave(EnclaveConfig* config) :
       circuit(config->circuit),
       writer_factory(circuit, config->writer_config),
-      rpcsessions(writer_factory),
+      workers(config->worker_threads),
+      fr(
+        bp.get_dispatcher(),
+        config->writer_config.arenas ?
+          &config->writer_config.arenas->read_from_outside() :
+          nullptr),
+      rpcsessions(writer_factory, workers),
       n2n_channels(std::make_shared<ccf::NodeToNode>(writer_factory)),
       node(writer_factory, network, rpcsessions),
       notifier(writer_factory),
       cmd_forwarder(
-        std::make_shared<ccf::Forwarder>(rpcsessions, n2n_channels)),
+        std::make_shared<ccf::Forwarder>(rpcsessions, n2n_channels, &workers)),
       rpc_map(std::make_shared<RpcMap>())
     {
       REGISTER_FRONTEND(
@@ -78,7 +95,35 @@ namespace enclave
       logger::config::msg() = AdminMessage::log_msg;
       logger::config::writer() = writer_factory.create_writer_to_outside();
 
-      node.initialize(config->raft_config, n2n_channels, rpc_map);
+      // Followers parse the transactions replicated to them, and the history
+      // hashes the transactions it appends, on any workers which are free
+      if (workers.num_workers() > 0)
+      {
+        // Posting a task to the main thread wakes its reader, as a write from
+        // the host would, so that it can sleep in the same way (see run_main)
+        workers.set_waker(WorkerPool::main_thread, [this]() {
+          circuit->read_from_outside().wake();
+        });
+
+        network.tables->set_task_runner(
+          [this](std::vector<std::function<void()>>&& tasks) {
+            workers.run_all(std::move(tasks));
+          });
+
+        // Signatures are made on the last worker, rather than by the thread
+        // which happens to be replicating when the root becomes known. If
+        // that worker is itself waiting to commit, the store runs them.
+        network.tables->set_background_runner(
+          [this](std::function<void()>&& task) {
+            workers.post(workers.num_workers(), std::move(task));
+          });
+      }
+
+      node.initialize(
+        config->raft_config,
+        n2n_channels,
+        rpc_map,
+        config->signature_intervals.sig_max_tx);
       rpcsessions.initialize(rpc_map);
       cmd_forwarder->initialize(rpc_map);
     }
@@ -115,14 +160,22 @@ namespace enclave
       try
 #endif
       {
-        messaging::BufferProcessor bp("Enclave");
+        if (main_sleeping.exchange(false))
+          return run_main();
 
-        // reconstruct oversized messages sent to the enclave
-        oversized::FragmentReconstructor fr(bp.get_dispatcher());
+        // The first thread to enter becomes the main thread, which reads
+        // from the host. Every other thread runs a worker.
+        const auto thread_id = next_thread_id++;
+        if (thread_id != WorkerPool::main_thread)
+        {
+          workers.run_worker(thread_id);
+          return true;
+        }
 
         DISPATCHER_SET_MESSAGE_HANDLER(
-          bp, AdminMessage::stop, [&bp](const uint8_t*, size_t) {
+          bp, AdminMessage::stop, [this](const uint8_t*, size_t) {
             bp.set_finished();
+            workers.set_finished();
           });
 
         DISPATCHER_SET_MESSAGE_HANDLER(
@@ -165,32 +218,28 @@ namespace enclave
             }
           });
 
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp, raft::log_durable, [this](const uint8_t* data, size_t size) {
+            auto [idx, epoch] =
+              ringbuffer::read_message<raft::log_durable>(data, size);
+            node.durable_ledger(idx, epoch);
+          });
+
         if (recover)
         {
           DISPATCHER_SET_MESSAGE_HANDLER(
-            bp, raft::log_entry, [this](const uint8_t* data, size_t size) {
-              auto [body] =
-                ringbuffer::read_message<raft::log_entry>(data, size);
-              if (node.is_reading_public_ledger())
-                node.recover_public_ledger_entry(body);
-              else if (node.is_reading_private_ledger())
-                node.recover_private_ledger_entry(body);
-              else
-                LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
-            });
-
-          DISPATCHER_SET_MESSAGE_HANDLER(
-            bp, raft::log_no_entry, [this](const uint8_t* data, size_t size) {
-              ringbuffer::read_message<raft::log_no_entry>(data, size);
-              node.recover_ledger_end();
+            bp, raft::log_entries, [this](const uint8_t* data, size_t size) {
+              auto [from, framed_entries] =
+                ringbuffer::read_message<raft::log_entries>(data, size);
+              node.recover_ledger_entries(from, framed_entries);
             });
 
           node.start_ledger_recovery();
         }
 
         rpcsessions.register_message_handlers(bp.get_dispatcher());
-        bp.run(circuit->read_from_outside());
-        return true;
+
+        return run_main();
       }
 #ifndef VIRTUAL_ENCLAVE
       catch (const std::exception& e)
@@ -202,5 +251,56 @@ namespace enclave
       }
 #endif
     }
+
+  private:
+    bool run_main()
+    {
+      auto& reader = circuit->read_from_outside();
+
+      // When idle for long enough, return to the host to sleep. The host
+      // calls run() again once it has written to us (see host/main.cpp).
+      auto leave_to_sleep = [this](ringbuffer::Reader&) {
+        main_sleeping.store(true);
+        return false;
+      };
+
+      if (workers.num_workers() == 0)
+      {
+        bp.run(reader, messaging::BackoffIdle(leave_to_sleep));
+        return true;
+      }
+
+      // Workers hand node-to-node work back to this thread, so drain that
+      // queue alongside the ringbuffer
+      workers.set_current_thread(WorkerPool::main_thread);
+
+      auto leave_unless_queued = [this, &leave_to_sleep](
+                                   ringbuffer::Reader& r) {
+        // A task posted before the reader fell asleep did not wake it
+        if (workers.has_queued(WorkerPool::main_thread))
+        {
+          r.wake();
+          r.wait_until_woken();
+          return true;
+        }
+
+        return leave_to_sleep(r);
+      };
+
+      messaging::BackoffIdle idle(leave_unless_queued);
+      while (!bp.is_finished())
+      {
+        auto num_processed =
+          bp.read_n(-1, reader) + workers.run_queued(WorkerPool::main_thread);
+        if (num_processed == 0)
+        {
+          if (!idle.idle(reader))
+            break;
+        }
+        else
+          idle.reset();
+      }
+      return true;
+    }
   };
 }
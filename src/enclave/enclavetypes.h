@@ -6,12 +6,34 @@
 #include "node/entities.h"
 #include "node/rpc/jsonrpc.h"
 
+#include <memory>
 #include <vector>
 
+namespace tls
+{
+  class Verifier;
+}
+
 namespace enclave
 {
   static constexpr size_t InvalidSessionId = std::numeric_limits<size_t>::max();
 
+  // The caller of a session, as resolved by its frontend. It is kept by the
+  // session and reused by each of its requests, until the certs table or the
+  // store it was resolved from changes.
+  struct SessionCaller
+  {
+    std::optional<ccf::CallerId> caller_id = std::nullopt;
+    // Only used by the session's thread, so it need not support concurrent
+    // verification
+    std::shared_ptr<tls::Verifier> verifier = nullptr;
+
+    // Global commits to the certs table seen by the frontend, and rollbacks
+    // of the store, when caller_id was resolved
+    size_t certs_epoch = 0;
+    int64_t rollback_count = 0;
+  };
+
   struct RPCContext
   {
     //
@@ -20,8 +42,13 @@ namespace enclave
 
     const size_t client_session_id = InvalidSessionId;
     CBuffer caller_cert;
+    // Owned by the session, and not set for forwarded RPCs
+    SessionCaller* session_caller = nullptr;
     // Actor type to route to appropriate frontend
     const ccf::ActorsType actor;
+    // Whether the request's client signature is valid, if that was checked
+    // ahead of time
+    std::optional<bool> signature_verified = std::nullopt;
 
     //
     // Out parameters (changed during lifetime of context)
@@ -2,6 +2,8 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/buffer.h"
+
 #include <vector>
 
 namespace enclave
@@ -15,6 +17,6 @@ namespace enclave
     virtual void send(const std::vector<uint8_t>& data) = 0;
     virtual void close() = 0;
 
-    virtual bool handle_data(const std::vector<uint8_t>& data) = 0;
+    virtual bool handle_data(CBuffer data) = 0;
   };
 }
@@ -20,6 +20,10 @@ struct EnclaveConfig
   oversized::WriterConfig writer_config = {};
   raft::Config raft_config = {};
 
+  // Number of enclave threads processing RPC sessions, in addition to the
+  // main thread. The host calls enclave_run once for each thread.
+  size_t worker_threads = 0;
+
   struct SignatureIntervals
   {
     size_t sig_max_tx;
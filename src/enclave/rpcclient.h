@@ -43,9 +43,9 @@ namespace enclave
       handle_data_cb = f;
     }
 
-    bool handle_data(const std::vector<uint8_t>& data) override
+    bool handle_data(CBuffer data) override
     {
-      auto res = handle_data_cb(data);
+      auto res = handle_data_cb(std::vector<uint8_t>(data));
       if (res.first)
       {
         if (rpcresponder.reply_async(rpc_ctx.client_session_id, res.second))
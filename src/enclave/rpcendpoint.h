@@ -15,19 +15,14 @@ namespace enclave
     ccf::ActorsType actor;
     size_t session_id;
     CBuffer caller;
+    SessionCaller session_caller;
 
-  public:
-    RPCEndpoint(
-      std::shared_ptr<RpcMap> rpc_map_,
-      size_t session_id,
-      ringbuffer::AbstractWriterFactory& writer_factory,
-      std::unique_ptr<tls::Context> ctx) :
-      FramedTLSEndpoint(session_id, writer_factory, move(ctx)),
-      rpc_map(rpc_map_),
-      session_id(session_id)
-    {}
+    // Results of checking signatures in prepare_frames(), by where each
+    // frame starts, in the order the frames are handled
+    std::vector<std::pair<const uint8_t*, std::optional<bool>>> checked_frames;
+    size_t next_checked = 0;
 
-    bool handle_data(const std::vector<uint8_t>& data)
+    bool resolve_handler()
     {
       if (!handler)
       {
@@ -48,9 +43,52 @@ namespace enclave
         caller = peer_cert();
       }
 
+      return true;
+    }
+
+  public:
+    RPCEndpoint(
+      std::shared_ptr<RpcMap> rpc_map_,
+      size_t session_id,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      std::unique_ptr<tls::Context> ctx) :
+      FramedTLSEndpoint(session_id, writer_factory, move(ctx)),
+      rpc_map(rpc_map_),
+      session_id(session_id)
+    {}
+
+    void prepare_frames(const std::vector<CBuffer>& frames) override
+    {
+      checked_frames.clear();
+      next_checked = 0;
+
+      // Even a single request is checked ahead of time, so that it can be
+      // checked together with those pending on other sessions
+      if (!resolve_handler())
+        return;
+
+      RPCContext rpc_ctx(session_id, caller, actor);
+      rpc_ctx.session_caller = &session_caller;
+      auto results = handler->check_signatures(rpc_ctx, frames);
+      for (size_t i = 0; i < results.size() && i < frames.size(); ++i)
+        checked_frames.emplace_back(frames[i].p, results[i]);
+    }
+
+    bool handle_data(CBuffer data) override
+    {
+      if (!resolve_handler())
+        return false;
+
       // Create a new RPC context for each command since some may require
       // forwarding to the leader.
       RPCContext rpc_ctx(session_id, caller, actor);
+      rpc_ctx.session_caller = &session_caller;
+
+      if (
+        next_checked < checked_frames.size() &&
+        checked_frames[next_checked].first == data.p)
+        rpc_ctx.signature_verified = checked_frames[next_checked++].second;
+
       auto rep = handler->process(rpc_ctx, data);
 
       if (rpc_ctx.is_pending)
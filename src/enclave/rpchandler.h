@@ -6,6 +6,7 @@
 
 #include <chrono>
 #include <limits>
+#include <optional>
 #include <stdint.h>
 #include <vector>
 
@@ -16,8 +17,7 @@ namespace enclave
   public:
     virtual ~RpcHandler() {}
 
-    virtual std::vector<uint8_t> process(
-      RPCContext& ctx, const std::vector<uint8_t>& input) = 0;
+    virtual std::vector<uint8_t> process(RPCContext& ctx, CBuffer input) = 0;
 
     struct ProcessPbftResp
     {
@@ -28,6 +28,17 @@ namespace enclave
     virtual ProcessPbftResp process_pbft(
       RPCContext& ctx, const std::vector<uint8_t>& input) = 0;
 
+    /** Check the client signatures of several requests read together, before
+     * any of them is processed. Signatures pending on other sessions at the
+     * same time may be checked alongside them. The result for each request,
+     * if any, is passed back to process() in RPCContext::signature_verified.
+     */
+    virtual std::vector<std::optional<bool>> check_signatures(
+      RPCContext& ctx, const std::vector<CBuffer>& inputs)
+    {
+      return {};
+    }
+
     virtual void tick(std::chrono::milliseconds elapsed_ms_count) {}
   };
 }
@@ -13,6 +13,7 @@
 #include "tls/context.h"
 #include "tls/server.h"
 #include "tlsframedendpoint.h"
+#include "workerpool.h"
 
 #include <limits>
 #include <unordered_map>
@@ -35,9 +36,26 @@ namespace enclave
 
     ringbuffer::AbstractWriterFactory& writer_factory;
 
+    // Each session is pinned to one enclave thread, which processes all of its
+    // inbound and outbound data
+    WorkerPool& workers;
+
+    std::shared_ptr<Endpoint> find_session(size_t id)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      auto search = sessions.find(id);
+      if (search == sessions.end())
+        return nullptr;
+
+      return search->second;
+    }
+
   public:
-    RPCSessions(ringbuffer::AbstractWriterFactory& writer_factory) :
-      writer_factory(writer_factory)
+    RPCSessions(
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      WorkerPool& workers) :
+      writer_factory(writer_factory),
+      workers(workers)
     {}
 
     void initialize(std::shared_ptr<RpcMap> rpc_map_)
@@ -80,10 +98,8 @@ namespace enclave
 
     bool reply_async(size_t id, const std::vector<uint8_t>& data) override
     {
-      std::lock_guard<SpinLock> guard(lock);
-
-      auto search = sessions.find(id);
-      if (search == sessions.end())
+      auto session = find_session(id);
+      if (session == nullptr)
       {
         LOG_FAIL_FMT("Replying to unknown session {}", id);
         return false;
@@ -91,7 +107,9 @@ namespace enclave
 
       LOG_DEBUG_FMT("Replying to session {}", id);
 
-      search->second->send(data);
+      workers.run_on(
+        workers.thread_for_session(id),
+        [session, data]() { session->send(data); });
       return true;
     }
 
@@ -117,13 +135,29 @@ namespace enclave
       return session;
     }
 
+    void recv(size_t id, const uint8_t* data, size_t size)
+    {
+      auto session = find_session(id);
+      if (session == nullptr)
+      {
+        throw std::logic_error(
+          "tls_inbound for unknown session: " + std::to_string(id));
+      }
+
+      session->recv(data, size);
+    }
+
     void register_message_handlers(
       messaging::Dispatcher<ringbuffer::Message>& disp)
     {
+      // Messages for sessions pinned to a worker are handed over to that
+      // worker's queue, in order. The body of tls_inbound lives in the
+      // ringbuffer, so must be copied before it is queued.
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, tls::tls_start, [this](const uint8_t* data, size_t size) {
           auto [id] = ringbuffer::read_message<tls::tls_start>(data, size);
-          accept(id);
+          workers.run_on(
+            workers.thread_for_session(id), [this, id = id]() { accept(id); });
         });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
@@ -131,20 +165,28 @@ namespace enclave
           auto [id, body] =
             ringbuffer::read_message<tls::tls_inbound>(data, size);
 
-          auto search = sessions.find(id);
-          if (search == sessions.end())
+          auto t = workers.thread_for_session(id);
+          if (workers.is_current_thread(t))
           {
-            throw std::logic_error(
-              "tls_inbound for unknown session: " + std::to_string(id));
+            recv(id, body.data, body.size);
+            return;
           }
 
-          search->second->recv(body.data, body.size);
+          workers.post(
+            t,
+            [this,
+             id = id,
+             copy = std::vector<uint8_t>(body.data, body.data + body.size)]() {
+              recv(id, copy.data(), copy.size());
+            });
         });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, tls::tls_stop, [this](const uint8_t* data, size_t size) {
           auto [id] = ringbuffer::read_message<tls::tls_stop>(data, size);
-          remove_session(id);
+          workers.run_on(
+            workers.thread_for_session(id),
+            [this, id = id]() { remove_session(id); });
         });
     }
   };
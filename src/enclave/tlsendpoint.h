@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/bytequeue.h"
 #include "ds/logger.h"
 #include "ds/messaging.h"
 #include "ds/ringbuffer.h"
@@ -27,9 +28,21 @@ namespace enclave
       error
     };
 
-    std::vector<uint8_t> pending_write;
-    std::vector<uint8_t> pending_read;
-    std::vector<uint8_t> read_buffer;
+    // Largest plaintext in a single TLS record
+    static constexpr size_t max_record_size = 16384;
+
+    // Records produced by a single flush are passed to the host together, in
+    // messages of at most this size. This must fit comfortably in the
+    // ringbuffer.
+    static constexpr size_t max_outbound_size = 1 << 18;
+
+    // Plaintext waiting to be encrypted, ciphertext received from the host,
+    // decrypted data not yet consumed, and ciphertext not yet passed to the
+    // host
+    ds::ByteQueue pending_write;
+    ds::ByteQueue pending_read;
+    ds::ByteQueue read_buffer;
+    ds::ByteQueue pending_outbound;
 
     std::unique_ptr<tls::Context> ctx;
     Status status;
@@ -65,113 +78,94 @@ namespace enclave
                            nullb;
     }
 
-    std::vector<uint8_t> read(size_t up_to, bool exact = false)
+    /** Decrypt everything currently available
+     *
+     * @return View of all decrypted data that has not yet been consumed. This
+     * is only valid until the next call to read() or consume().
+     */
+    CBuffer read()
     {
-      LOG_TRACE_FMT("Requesting {} bytes", up_to);
-      // This will return en empty vector if the connection isn't
-      // ready, but it will not block on the handshake.
+      // This will return an empty buffer if the connection isn't ready, but
+      // it will not block on the handshake.
       do_handshake();
 
       if (status != ready)
-      {
         return {};
-      }
 
       // Send pending writes.
       flush();
 
-      std::vector<uint8_t> data(up_to);
-      size_t offset = 0;
-
-      if (read_buffer.size() > 0)
+      while (status == ready)
       {
-        LOG_TRACE_FMT("read_buffer is of size: {}", read_buffer.size());
-        offset = std::min(up_to, read_buffer.size());
-        ::memcpy(data.data(), read_buffer.data(), offset);
-
-        if (offset < read_buffer.size())
-          read_buffer.erase(read_buffer.begin(), read_buffer.begin() + offset);
-        else
-          read_buffer.clear();
-
-        if (offset == up_to)
-          return data;
-      }
+        auto space = read_buffer.prepare(max_record_size);
+        auto r = ctx->read(space.p, space.n);
+        LOG_TRACE_FMT("ctx->read returned: {}", r);
 
-      auto r = ctx->read(data.data() + offset, up_to - offset);
-      LOG_TRACE_FMT("ctx->read returned: {}", r);
-
-      switch (r)
-      {
-        case 0:
-        case MBEDTLS_ERR_NET_CONN_RESET:
-        case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+        if (r > 0)
         {
-          LOG_TRACE_FMT("TLS {} on read: {}", session_id, tls::error_string(r));
-
-          stop(closed);
-
-          if (!exact)
-          {
-            data.resize(offset);
-            return data;
-          }
-
-          return {};
+          read_buffer.commit(r);
+          continue;
         }
 
-        case MBEDTLS_ERR_SSL_WANT_READ:
-        case MBEDTLS_ERR_SSL_WANT_WRITE:
+        switch (r)
         {
-          data.resize(offset);
+          case 0:
+          case MBEDTLS_ERR_NET_CONN_RESET:
+          case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+          {
+            LOG_TRACE_FMT(
+              "TLS {} on read: {}", session_id, tls::error_string(r));
+            stop(closed);
+            break;
+          }
 
-          if (!exact)
-            return data;
+          case MBEDTLS_ERR_SSL_WANT_READ:
+          case MBEDTLS_ERR_SSL_WANT_WRITE:
+            break;
 
-          read_buffer = move(data);
-          return {};
+          default:
+          {
+            LOG_TRACE_FMT(
+              "TLS {} on read: {}", session_id, tls::error_string(r));
+            stop(error);
+            read_buffer.clear();
+            break;
+          }
         }
 
-        default:
-        {}
-      }
-
-      if (r < 0)
-      {
-        LOG_TRACE_FMT("TLS {} on read: {}", session_id, tls::error_string(r));
-        stop(error);
-        return {};
+        break;
       }
 
-      auto total = r + offset;
-      data.resize(total);
+      send_outbound();
+      return read_buffer.data();
+    }
 
-      // We read _some_ data but not enough, and didn't get
-      // MBEDTLS_ERR_SSL_WANT_READ. Probably hit a size limit - try again
-      if (exact && (total < up_to))
-      {
-        LOG_TRACE_FMT(
-          "Asked for exactly {}, received {}, retrying", up_to, total);
-        read_buffer = move(data);
-        return read(up_to, exact);
-      }
+    /// Discard the first n bytes of decrypted data
+    void consume(size_t n)
+    {
+      read_buffer.consume(n);
+    }
 
-      return data;
+    bool is_ready() const
+    {
+      return status == ready;
     }
 
     void recv(const uint8_t* data, size_t size)
     {
-      pending_read.insert(pending_read.end(), data, data + size);
-      do_handshake();
+      recv_buffered(data, size);
 
-      auto avail = ctx->available_bytes();
-      if (avail > 0)
-        handle_data(read(avail));
+      auto plain = read();
+      if (plain.n > 0)
+      {
+        handle_data(plain);
+        consume(plain.n);
+      }
     }
 
     void recv_buffered(const uint8_t* data, size_t size)
     {
-      pending_read.insert(pending_read.end(), data, data + size);
+      pending_read.append(data, size);
       do_handshake();
     }
 
@@ -184,21 +178,26 @@ namespace enclave
 
       if (status == handshake)
       {
-        pending_write.insert(pending_write.end(), data.begin(), data.end());
+        pending_write.append(data.data(), data.size());
         return;
       }
 
       if (status != ready)
         return;
 
-      pending_write.insert(pending_write.end(), data.begin(), data.end());
+      pending_write.append(data.data(), data.size());
 
       flush();
     }
 
     void send_buffered(const std::vector<uint8_t>& data)
     {
-      pending_write.insert(pending_write.end(), data.begin(), data.end());
+      pending_write.append(data.data(), data.size());
+    }
+
+    void send_buffered(const uint8_t* data, size_t size)
+    {
+      pending_write.append(data, size);
     }
 
     void flush()
@@ -208,13 +207,13 @@ namespace enclave
       if (status != ready)
         return;
 
-      while (pending_write.size() > 0)
+      while (!pending_write.empty())
       {
-        auto r = write_some(pending_write);
+        auto r = write_some(pending_write.data());
 
         if (r > 0)
         {
-          pending_write.erase(pending_write.begin(), pending_write.begin() + r);
+          pending_write.consume(r);
         }
         else if (r == 0)
         {
@@ -225,8 +224,11 @@ namespace enclave
           LOG_TRACE_FMT(
             "TLS {} on flush: {}", session_id, tls::error_string(r));
           stop(error);
+          break;
         }
       }
+
+      send_outbound();
     }
 
     void close()
@@ -266,6 +268,8 @@ namespace enclave
               break;
             }
           }
+
+          send_outbound();
           break;
         }
 
@@ -283,6 +287,7 @@ namespace enclave
         return;
 
       auto rc = ctx->handshake();
+      send_outbound();
 
       switch (rc)
       {
@@ -344,9 +349,9 @@ namespace enclave
       }
     }
 
-    int write_some(const std::vector<uint8_t>& data)
+    int write_some(CBuffer data)
     {
-      auto r = ctx->write(data.data(), data.size());
+      auto r = ctx->write(data.p, data.n);
 
       switch (r)
       {
@@ -374,6 +379,10 @@ namespace enclave
 
       status = status_;
 
+      // Make sure anything already produced (e.g. an alert) reaches the host
+      // before the connection is torn down.
+      send_outbound();
+
       switch (status)
       {
         case closed:
@@ -394,41 +403,52 @@ namespace enclave
       }
     }
 
-    int handle_send(const uint8_t* buf, size_t len)
+    void send_outbound()
     {
-      // Either write all of the data or none of it.
-      auto wrote = RINGBUFFER_TRY_WRITE_MESSAGE(
-        tls::tls_outbound,
-        to_host,
-        session_id,
-        serializer::ByteRange{buf, len});
+      // Pass buffered records to the host, in as few messages as possible.
+      // Anything the ringbuffer cannot take now stays buffered until the next
+      // flush.
+      while (!pending_outbound.empty())
+      {
+        auto data = pending_outbound.data();
+        auto len = std::min(data.n, max_outbound_size);
 
-      if (!wrote)
-        return MBEDTLS_ERR_SSL_WANT_WRITE;
+        auto wrote = RINGBUFFER_TRY_WRITE_MESSAGE(
+          tls::tls_outbound,
+          to_host,
+          session_id,
+          serializer::ByteRange{data.p, len});
 
-      return (int)len;
+        if (!wrote)
+          break;
+
+        pending_outbound.consume(len);
+      }
     }
 
-    int handle_recv(uint8_t* buf, size_t len)
+    int handle_send(const uint8_t* buf, size_t len)
     {
-      if (pending_read.size() > 0)
+      // Either buffer all of the data or none of it. Once a message's worth
+      // is waiting for the host, try to pass it on before accepting more.
+      if (pending_outbound.size() >= max_outbound_size)
       {
-        // Use the pending data vector. This is populated when the host
-        // writes a chunk larger than the size requested by the enclave.
-        size_t rd = std::min(len, pending_read.size());
-        ::memcpy(buf, pending_read.data(), rd);
+        send_outbound();
 
-        if (rd >= pending_read.size())
-        {
-          pending_read.clear();
-        }
-        else
-        {
-          pending_read.erase(pending_read.begin(), pending_read.begin() + rd);
-        }
+        if (pending_outbound.size() >= max_outbound_size)
+          return MBEDTLS_ERR_SSL_WANT_WRITE;
+      }
+
+      pending_outbound.append(buf, len);
+      return (int)len;
+    }
 
+    int handle_recv(uint8_t* buf, size_t len)
+    {
+      // Hand over data received from the host. This may be less than was
+      // requested, or only part of a larger chunk written by the host.
+      auto rd = pending_read.read(buf, len);
+      if (rd > 0)
         return (int)rd;
-      }
 
       return MBEDTLS_ERR_SSL_WANT_READ;
     }
@@ -4,68 +4,113 @@
 
 #include "tlsendpoint.h"
 
+#include <vector>
+
 namespace enclave
 {
   class FramedTLSEndpoint : public TLSEndpoint
   {
   protected:
-    uint32_t msg_size;
-    size_t count;
+    // Arbitrary limit on RPC size to stop a client from requesting
+    // a very large allocation.
+    static constexpr uint32_t max_msg_size = 1 << 21;
+
+  private:
+    // True while the frames from one recv() are being handled. Replies sent
+    // in the meantime are buffered, and flushed together at the end.
+    bool receiving = false;
 
   public:
     FramedTLSEndpoint(
       size_t session_id,
       ringbuffer::AbstractWriterFactory& writer_factory,
       std::unique_ptr<tls::Context> ctx) :
-      TLSEndpoint(session_id, writer_factory, std::move(ctx)),
-      msg_size(-1),
-      count(0)
+      TLSEndpoint(session_id, writer_factory, std::move(ctx))
     {}
 
+    /// Called with every complete frame from one read, before any of them
+    /// is passed to handle_data()
+    virtual void prepare_frames(const std::vector<CBuffer>& frames) {}
+
     void recv(const uint8_t* data, size_t size)
     {
       recv_buffered(data, size);
 
-      while (true)
+      // Frames are parsed in place from the decrypted data, and handlers
+      // receive a view of it. A partial frame stays buffered until the rest
+      // of it arrives.
+      auto plain = read();
+      size_t consumed = 0;
+      bool failed = false;
+      std::vector<CBuffer> frames;
+
+      if (is_ready())
       {
-        // Read framed data.
-        if (msg_size == (uint32_t)-1)
+        size_t offset = 0;
+
+        while (true)
         {
-          auto len = read(4, true);
-          if (len.size() == 0)
-            return;
+          const uint8_t* frame = plain.p + offset;
+          size_t remaining = plain.n - offset;
+
+          // Read framed data.
+          if (remaining < sizeof(uint32_t))
+            break;
 
-          const uint8_t* data = len.data();
-          size_t size = len.size();
-          msg_size = serialized::read<uint32_t>(data, size);
+          auto msg_size = serialized::read<uint32_t>(frame, remaining);
           LOG_TRACE_FMT("msg size is: {}", msg_size);
-        }
 
-        // Arbitrary limit on RPC size to stop a client from requesting
-        // a very large allocation.
-        if (msg_size > 1 << 21)
-        {
-          close();
-          return;
+          if (msg_size > max_msg_size)
+          {
+            // Frames before this one are still handled
+            failed = true;
+            break;
+          }
+
+          if (remaining < msg_size)
+            break;
+
+          offset += sizeof(uint32_t) + msg_size;
+          frames.push_back({frame, msg_size});
         }
+      }
 
-        auto req = read(msg_size, true);
-        if (req.size() == 0)
-          return;
+      receiving = true;
 
-        msg_size = -1;
+      try
+      {
+        if (!frames.empty())
+          prepare_frames(frames);
 
-        try
+        for (const auto& frame : frames)
         {
-          if (!handle_data(req))
-            close();
-        }
-        catch (...)
-        {
-          // On any exception, close the connection.
-          close();
+          if (!is_ready())
+            break;
+
+          consumed += sizeof(uint32_t) + frame.n;
+
+          if (!handle_data(frame))
+          {
+            failed = true;
+            break;
+          }
         }
       }
+      catch (...)
+      {
+        // On any exception, close the connection.
+        failed = true;
+      }
+
+      receiving = false;
+      consume(consumed);
+
+      // Replies to every request handled above go out together, before the
+      // connection is closed if one of them failed.
+      flush();
+
+      if (failed)
+        close();
     }
 
     void send(const std::vector<uint8_t>& data)
@@ -74,14 +119,16 @@ namespace enclave
       if (data.size() == 0)
         return;
 
-      std::vector<uint8_t> len(4);
-      uint8_t* p = len.data();
-      size_t size = len.size();
+      uint8_t len[sizeof(uint32_t)];
+      uint8_t* p = len;
+      size_t size = sizeof(len);
       serialized::write(p, size, (uint32_t)data.size());
 
-      send_buffered(len);
-      send_buffered(data);
-      flush();
+      send_buffered(len, sizeof(len));
+      send_buffered(data.data(), data.size());
+
+      if (!receiving)
+        flush();
     }
   };
 }
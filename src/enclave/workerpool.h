@@ -0,0 +1,310 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/logger.h"
+#include "ds/messaging.h"
+#include "ds/mpscq.h"
+#include "ds/ringbuffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace enclave
+{
+  /** Task queues for the threads running inside the enclave.
+   *
+   * Thread 0 is the main enclave thread. It reads the ringbuffer from the host
+   * and owns Raft, node-to-node channels and ticks. Threads 1..N are workers,
+   * each owning the RPC sessions pinned to it. Any thread may post a task to
+   * any other thread; each queue is only drained by its owner.
+   */
+  class WorkerPool
+  {
+  public:
+    static constexpr size_t main_thread = 0;
+
+  private:
+    struct Task
+    {
+      std::atomic<Task*> next{nullptr};
+      std::function<void()> fn;
+    };
+
+    // Each queue is drained by a single thread, so keep them on separate cache
+    // lines
+    struct alignas(64) TaskQueue
+    {
+      queue::MPSCQ<Task> q;
+
+      // An idle owner sleeps on this futex word, as a ringbuffer reader does,
+      // unless it sleeps elsewhere and has set a waker instead
+      std::atomic<uint32_t> sleep_state{ringbuffer::Sleep::awake};
+      std::function<void()> waker;
+
+      TaskQueue()
+      {
+        q.init(new Task);
+      }
+
+      ~TaskQueue()
+      {
+        auto t = q.destroy();
+        while (t != nullptr)
+        {
+          auto next = t->next.load(std::memory_order_relaxed);
+          delete t;
+          t = next;
+        }
+      }
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<bool> finished{false};
+
+    static size_t& this_thread()
+    {
+      static thread_local size_t id = main_thread;
+      return id;
+    }
+
+    void wake(size_t id)
+    {
+      auto& queue = *queues[id];
+
+      // Pairs with the fence in Sleeper::try_sleep. Either the owner sees the
+      // task or the finished flag, or we see that it is asleep.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+
+      if (queue.waker)
+      {
+        queue.waker();
+        return;
+      }
+
+      uint32_t expected = ringbuffer::Sleep::asleep;
+      if (queue.sleep_state.compare_exchange_strong(
+            expected, ringbuffer::Sleep::woken))
+        ringbuffer::futex::wake_all(queue.sleep_state);
+    }
+
+    /// Lets an idle worker back off as a ringbuffer reader does (see
+    /// messaging::BackoffIdle), sleeping until a task is posted to it
+    class Sleeper
+    {
+      WorkerPool& pool;
+      TaskQueue& queue;
+
+    public:
+      Sleeper(WorkerPool& pool, size_t id) : pool(pool), queue(*pool.queues[id])
+      {}
+
+      bool try_sleep()
+      {
+        queue.sleep_state.store(
+          ringbuffer::Sleep::asleep, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!queue.q.is_empty() || pool.is_finished())
+        {
+          queue.sleep_state.store(
+            ringbuffer::Sleep::awake, std::memory_order_relaxed);
+          return false;
+        }
+
+        return true;
+      }
+
+      /// Only blocks outside of SGX, and otherwise spins
+      void wait_until_woken()
+      {
+        while (queue.sleep_state.load(std::memory_order_acquire) ==
+               ringbuffer::Sleep::asleep)
+          ringbuffer::futex::wait(queue.sleep_state, ringbuffer::Sleep::asleep);
+
+        queue.sleep_state.store(
+          ringbuffer::Sleep::awake, std::memory_order_relaxed);
+      }
+    };
+
+  public:
+    WorkerPool(size_t num_workers)
+    {
+      for (size_t i = 0; i < num_workers + 1; ++i)
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+
+    size_t num_workers() const
+    {
+      return queues.size() - 1;
+    }
+
+    /// Identify the calling thread as the owner of queue id
+    void set_current_thread(size_t id)
+    {
+      if (id >= queues.size())
+        throw std::logic_error(fmt::format(
+          "Enclave thread {} started, but only {} workers are configured",
+          id,
+          num_workers()));
+
+      this_thread() = id;
+    }
+
+    bool is_current_thread(size_t id) const
+    {
+      return this_thread() == id;
+    }
+
+    /// Sessions created from inside the enclave (in the upper half of the
+    /// session ID range) stay with the main thread which created them.
+    size_t thread_for_session(size_t session_id) const
+    {
+      if (
+        num_workers() == 0 ||
+        session_id >= std::numeric_limits<size_t>::max() / 2)
+        return main_thread;
+
+      return 1 + (session_id % num_workers());
+    }
+
+    /// Wake thread id with waker, rather than its own futex word, when a task
+    /// is posted to it. Must be set before any tasks are posted.
+    void set_waker(size_t id, std::function<void()> waker)
+    {
+      queues[id]->waker = std::move(waker);
+    }
+
+    void post(size_t id, std::function<void()> fn)
+    {
+      auto t = new Task;
+      t->fn = std::move(fn);
+      queues[id]->q.push(t);
+      wake(id);
+    }
+
+    /// True if tasks are queued for thread id, checked after it has announced
+    /// that it is about to sleep. Must only be called by the owner of that
+    /// queue.
+    bool has_queued(size_t id)
+    {
+      // Pairs with the fence in wake()
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      return !queues[id]->q.is_empty();
+    }
+
+    /// Run fn on thread id, immediately if this is already that thread
+    void run_on(size_t id, std::function<void()> fn)
+    {
+      if (is_current_thread(id))
+        fn();
+      else
+        post(id, std::move(fn));
+    }
+
+    /** Run a set of independent tasks, on the calling thread and on any
+     * workers that are free to help, returning once they have all finished.
+     *
+     * Tasks are claimed one at a time, so a busy worker never holds up the
+     * caller: anything not yet claimed by a worker is run by the caller.
+     */
+    void run_all(std::vector<std::function<void()>>&& tasks)
+    {
+      if (tasks.empty())
+        return;
+
+      struct Batch
+      {
+        std::vector<std::function<void()>> tasks;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+
+        void run_some()
+        {
+          for (auto i = next++; i < tasks.size(); i = next++)
+          {
+            tasks[i]();
+            ++done;
+          }
+        }
+      };
+
+      // A busy worker may only get to its helper task after this has
+      // returned, so helpers share ownership of the batch
+      auto batch = std::make_shared<Batch>();
+      batch->tasks = std::move(tasks);
+
+      const auto helpers = std::min(num_workers(), batch->tasks.size() - 1);
+      for (size_t id = 1; id <= helpers; ++id)
+      {
+        if (!is_current_thread(id))
+          post(id, [batch]() { batch->run_some(); });
+      }
+
+      batch->run_some();
+
+      while (batch->done.load() < batch->tasks.size())
+        _mm_pause();
+    }
+
+    /// Run every task currently queued for thread id. Must only be called by
+    /// the owner of that queue.
+    size_t run_queued(size_t id)
+    {
+      auto& q = queues[id]->q;
+      size_t count = 0;
+
+      while (true)
+      {
+        auto [next, prev] = q.pop();
+        if (next == nullptr)
+          break;
+
+        // next is now the queue's stub, so its function can be released
+        // as soon as it has run
+        auto fn = std::move(next->fn);
+        delete prev;
+        fn();
+        ++count;
+      }
+
+      return count;
+    }
+
+    void set_finished()
+    {
+      finished.store(true);
+
+      for (size_t id = 1; id < queues.size(); ++id)
+        wake(id);
+    }
+
+    bool is_finished() const
+    {
+      return finished.load();
+    }
+
+    /// Loop for worker threads, until set_finished() is called. Idle workers
+    /// back off and then sleep until a task is posted to them.
+    void run_worker(size_t id)
+    {
+      set_current_thread(id);
+
+      Sleeper sleeper(*this, id);
+      messaging::BackoffIdle<> idle;
+
+      while (!is_finished())
+      {
+        if (run_queued(id) == 0)
+          idle.idle(sleeper);
+        else
+          idle.reset();
+      }
+    }
+  };
+}
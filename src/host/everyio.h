@@ -4,10 +4,20 @@
 
 #include "proxy.h"
 
+#include <optional>
+#include <type_traits>
+#include <utility>
+
 namespace asynchost
 {
   // This runs every loop. If any instance of this is active, the loop's poll
-  // timeout will be 0 (see uv_prepare_t vs uv_idle_t)
+  // timeout will be 0 (see uv_prepare_t vs uv_idle_t).
+  //
+  // If Behaviour::every() returns a bool, saying whether it found any work,
+  // this backs off: once it has found no work for max_idle_ms, it stops
+  // forcing a 0 timeout and runs on a poll_period_ms timer instead, so that
+  // work which nothing signals is still picked up promptly. It runs every
+  // loop again as soon as it finds work.
   template <typename Behaviour>
   class EveryIO : public with_uv_handle<uv_idle_t>
   {
@@ -15,6 +25,15 @@ namespace asynchost
     friend class close_ptr<EveryIO<Behaviour>>;
     Behaviour behaviour;
 
+    static constexpr uint64_t max_idle_ms = 100;
+    static constexpr uint64_t poll_period_ms = 1;
+    static constexpr bool reports_work =
+      std::is_same_v<decltype(std::declval<Behaviour>().every()), bool>;
+
+    // Runs this while it is backed off
+    uv_timer_t poll_handle;
+    std::optional<uint64_t> idle_since = std::nullopt;
+
     template <typename... Args>
     EveryIO(Args&&... args) : behaviour(std::forward<Args>(args)...)
     {
@@ -33,6 +52,25 @@ namespace asynchost
         LOG_FAIL_FMT("uv_idle_start failed: {}", uv_strerror(rc));
         throw std::logic_error("uv_idle_start failed");
       }
+
+      if ((rc = uv_timer_init(uv_default_loop(), &poll_handle)) < 0)
+      {
+        LOG_FAIL_FMT("uv_timer_init failed: {}", uv_strerror(rc));
+        throw std::logic_error("uv_timer_init failed");
+      }
+
+      poll_handle.data = this;
+    }
+
+    void close() override
+    {
+      // Both handles must be closed before this is deleted
+      uv_close((uv_handle_t*)&poll_handle, on_poll_close);
+    }
+
+    static void on_poll_close(uv_handle_t* handle)
+    {
+      static_cast<EveryIO*>(handle->data)->with_uv_handle<uv_idle_t>::close();
     }
 
     static void on_every(uv_idle_t* handle)
@@ -42,7 +80,47 @@ namespace asynchost
 
     void on_every()
     {
-      behaviour.every();
+      if constexpr (reports_work)
+      {
+        if (behaviour.every())
+        {
+          idle_since = std::nullopt;
+          return;
+        }
+
+        const auto now = uv_now(uv_default_loop());
+        if (!idle_since.has_value())
+        {
+          idle_since = now;
+        }
+        else if (now - idle_since.value() >= max_idle_ms)
+        {
+          idle_since = std::nullopt;
+          uv_idle_stop(&uv_handle);
+          uv_timer_start(&poll_handle, on_poll, poll_period_ms, poll_period_ms);
+        }
+      }
+      else
+      {
+        behaviour.every();
+      }
+    }
+
+    static void on_poll(uv_timer_t* handle)
+    {
+      static_cast<EveryIO*>(handle->data)->on_poll();
+    }
+
+    void on_poll()
+    {
+      if constexpr (reports_work)
+      {
+        if (behaviour.every())
+        {
+          uv_timer_stop(&poll_handle);
+          uv_idle_start(&uv_handle, on_every);
+        }
+      }
     }
   };
 }
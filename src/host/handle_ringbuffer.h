@@ -98,12 +98,16 @@ namespace asynchost
         });
     }
 
-    void every()
+    bool every()
     {
       // This flushes the enclave to host ringbuffer on each libuv loop
-      // iteration.
-      while (bp.read_n(max_messages, r) > 0)
-        continue;
+      // iteration, until it has been empty for a while (see EveryIO).
+      size_t total = 0;
+      size_t read;
+      while ((read = bp.read_n(max_messages, r)) > 0)
+        total += read;
+
+      return total > 0;
     }
   };
 
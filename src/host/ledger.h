@@ -6,138 +6,964 @@
 #include "../ds/messaging.h"
 #include "../raft/rafttypes.h" // TODO(#refactoring): Separate raft messages from ledger messages
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits>
+#include <memory>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
 namespace asynchost
 {
-  class Ledger
+  static constexpr size_t ledger_chunk_threshold_default = 5 * 1024 * 1024;
+  static constexpr size_t ledger_cache_size_default = 64 * 1024 * 1024;
+
+  // Largest set of framed entries sent to the enclave in one message when it
+  // reads a range of the ledger. A single larger entry is still sent whole.
+  static constexpr size_t ledger_range_max_size = 4 * 1024 * 1024;
+
+  struct LedgerSyncConfig
+  {
+    // If set, pending entries are made durable (fdatasync) in groups, and the
+    // enclave is told up to which index the ledger is durable. Otherwise,
+    // pending entries are written out but never explicitly synced.
+    bool enabled = false;
+    // Sync as soon as this many entries are pending. 0 for no limit, so that
+    // all entries written in one pass over the ringbuffer are synced together.
+    size_t max_batch_entries = 0;
+    // Wait up to this long after an entry is written for more entries to be
+    // synced with it
+    std::chrono::microseconds max_delay = std::chrono::microseconds(0);
+  };
+
+  static constexpr auto ledger_file_prefix = "ledger_";
+  static constexpr auto ledger_index_suffix = ".idx";
+  static constexpr auto snapshot_file_prefix = "snapshot_";
+
+  // A LedgerFile holds a contiguous range of ledger entries. While it is the
+  // last file of the ledger, it is open and entries are appended to it. Appended
+  // entries are staged in memory and written out together when the file is
+  // flushed. Once it has grown past the chunk threshold, it is completed: it is
+  // renamed to record the range of entries it contains, an index of entry
+  // positions is written next to it, and it is memory-mapped read-only so
+  // that entries can be served directly from the mapping.
+  //
+  // Open files are named ledger_<start_idx>, completed files are named
+  // ledger_<start_idx>-<last_idx>, with their index in
+  // ledger_<start_idx>-<last_idx>.idx.
+  class LedgerFile
   {
   private:
     static constexpr size_t frame_header_size = sizeof(uint32_t);
 
-    // This uses C stdio instead of fstream because an fstream
-    // cannot be truncated.
-    FILE* file;
+    const std::string dir;
+    const size_t start_idx;
     std::vector<size_t> positions;
-    size_t total_len;
-    std::unique_ptr<ringbuffer::AbstractWriter> to_enclave;
+    size_t total_len = 0;
+    bool completed = false;
 
-  public:
-    Ledger(
-      const std::string& filename,
-      ringbuffer::AbstractWriterFactory& writer_factory) :
-      file(NULL),
-      to_enclave(writer_factory.create_writer_to_inside())
+    // Only valid while the file is open
+    int fd = -1;
+
+    // Entries appended since the last flush, starting at flushed_len
+    std::vector<uint8_t> pending;
+    size_t flushed_len = 0;
+    bool synced = true;
+
+    const uint8_t* mapped = nullptr;
+
+    // Only used to serve reads from open files
+    std::vector<uint8_t> read_buffer;
+
+    std::string path(const std::string& name) const
     {
-      file = fopen(filename.c_str(), "r+b");
+      return dir + "/" + name;
+    }
 
-      if (!file)
-        file = fopen(filename.c_str(), "w+b");
+    void map(const std::string& file_path)
+    {
+      auto fd = open(file_path.c_str(), O_RDONLY);
+      if (fd == -1)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger file {}: {}", file_path, strerror(errno)));
+      }
+
+      auto m = mmap(nullptr, total_len, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+
+      if (m == MAP_FAILED)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to map ledger file {}: {}", file_path, strerror(errno)));
+      }
 
-      if (!file)
-        throw std::logic_error("Unable to open or create ledger file");
+      mapped = static_cast<const uint8_t*>(m);
+    }
 
-      fseeko(file, 0, SEEK_END);
-      auto len = ftello(file);
-      if (len == 1)
+    void unmap()
+    {
+      if (mapped != nullptr)
       {
-        std::stringstream ss;
-        ss << "Failed to tell file size: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        munmap(const_cast<uint8_t*>(mapped), total_len);
+        mapped = nullptr;
       }
-      fseeko(file, 0, SEEK_SET);
+    }
+
+    void open_fd(int flags)
+    {
+      fd = ::open(file_path().c_str(), flags, 0644);
+      if (fd == -1)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger file {}: {}", file_path(), strerror(errno)));
+      }
+    }
+
+    void write_all(const uint8_t* data, size_t size, size_t offset)
+    {
+      while (size > 0)
+      {
+        auto written = pwrite(fd, data, size, offset);
+        if (written == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          throw std::logic_error(
+            fmt::format("Failed to write to file: {}", strerror(errno)));
+        }
+
+        data += written;
+        size -= written;
+        offset += written;
+      }
+    }
+
+    void scan_mapped()
+    {
+      positions.clear();
+
+      size_t pos = 0;
+      while (total_len - pos >= frame_header_size)
+      {
+        uint32_t size;
+        std::memcpy(&size, mapped + pos, frame_header_size);
+
+        if (total_len - pos - frame_header_size < size)
+          throw std::logic_error("Malformed ledger file");
+
+        positions.push_back(pos);
+        pos += (size + frame_header_size);
+      }
+
+      if (pos != total_len)
+        throw std::logic_error("Malformed ledger file");
+    }
+
+    void scan_file()
+    {
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+      {
+        throw std::logic_error(
+          fmt::format("Failed to stat file: {}", strerror(errno)));
+      }
+
+      const size_t len = st.st_size;
       size_t pos = 0;
       uint32_t size = 0;
 
-      while (len >= frame_header_size)
+      while (len - pos >= frame_header_size)
       {
-        if (fread(&size, frame_header_size, 1, file) != 1)
+        if (pread(fd, &size, frame_header_size, pos) != frame_header_size)
           throw std::logic_error("Failed to read from file");
 
-        len -= frame_header_size;
-
-        if (len < size)
+        if (len - pos - frame_header_size < size)
           throw std::logic_error("Malformed ledger file");
 
-        fseeko(file, size, SEEK_CUR);
-        len -= size;
-
         positions.push_back(pos);
         pos += (size + frame_header_size);
       }
 
       total_len = pos;
+      flushed_len = pos;
 
-      if (len != 0)
+      if (pos != len)
         throw std::logic_error("Malformed ledger file");
     }
 
-    Ledger(const Ledger& that) = delete;
+    bool load_index(const std::string& index_path, size_t entries)
+    {
+      auto f = fopen(index_path.c_str(), "rb");
+      if (!f)
+        return false;
 
-    ~Ledger()
+      std::vector<uint64_t> index(entries);
+      auto read = fread(index.data(), sizeof(uint64_t), entries, f);
+      auto trailing = fgetc(f) != EOF;
+      fclose(f);
+
+      // The index must have exactly one position per entry, and the last
+      // entry must end at the end of the file
+      if (read != entries || trailing)
+        return false;
+
+      auto last_pos = index.back();
+      if (last_pos + frame_header_size > total_len)
+        return false;
+
+      uint32_t last_size;
+      std::memcpy(&last_size, mapped + last_pos, frame_header_size);
+      if (last_pos + frame_header_size + last_size != total_len)
+        return false;
+
+      positions.assign(index.begin(), index.end());
+      return true;
+    }
+
+    void write_index()
     {
-      if (file)
+      std::vector<uint64_t> index(positions.begin(), positions.end());
+
+      auto f = fopen(index_path().c_str(), "wb");
+      if (!f)
       {
-        fflush(file);
-        fclose(file);
+        throw std::logic_error(
+          fmt::format("Unable to create ledger index {}", index_path()));
+      }
+
+      auto written = fwrite(index.data(), sizeof(uint64_t), index.size(), f);
+      fclose(f);
+
+      if (written != index.size())
+      {
+        throw std::logic_error(
+          fmt::format("Failed to write ledger index {}", index_path()));
       }
     }
 
-    size_t get_last_idx()
+  public:
+    // Create a new, empty, open file
+    LedgerFile(const std::string& dir, size_t start_idx) :
+      dir(dir),
+      start_idx(start_idx)
     {
-      return positions.size();
+      open_fd(O_RDWR | O_CREAT | O_TRUNC);
     }
 
-    const std::vector<uint8_t> read_entry(size_t idx)
+    // Load an existing file, open or completed. last_idx is 0 for open files.
+    LedgerFile(const std::string& dir, size_t start_idx, size_t last_idx) :
+      dir(dir),
+      start_idx(start_idx),
+      completed(last_idx != 0)
+    {
+      if (!completed)
+      {
+        open_fd(O_RDWR);
+        scan_file();
+        return;
+      }
+
+      if (last_idx < start_idx)
+        throw std::logic_error("Malformed ledger directory");
+
+      auto completed_path =
+        path(fmt::format("{}{}-{}", ledger_file_prefix, start_idx, last_idx));
+
+      struct stat st;
+      if (stat(completed_path.c_str(), &st) != 0 || st.st_size == 0)
+      {
+        throw std::logic_error(
+          fmt::format("Unable to load ledger file {}", completed_path));
+      }
+
+      total_len = st.st_size;
+      map(completed_path);
+
+      // The index avoids walking every frame of completed files. If it is
+      // missing or does not match the file, the frames are scanned and the
+      // index is rewritten.
+      if (!load_index(
+            completed_path + ledger_index_suffix, last_idx - start_idx + 1))
+      {
+        LOG_INFO_FMT("Rebuilding ledger index for {}", completed_path);
+        scan_mapped();
+
+        if (get_last_idx() != last_idx)
+        {
+          throw std::logic_error(fmt::format(
+            "Ledger file {} contains {} entries",
+            completed_path,
+            positions.size()));
+        }
+
+        write_index();
+      }
+    }
+
+    LedgerFile(const LedgerFile& that) = delete;
+
+    ~LedgerFile()
     {
-      if ((idx == 0) || (idx > positions.size()))
-        return {};
+      unmap();
 
-      auto len = entry_size(idx);
-      std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - 1) + frame_header_size, SEEK_SET);
+      if (fd != -1)
+      {
+        // Best effort, since this cannot report errors
+        if (!pending.empty())
+          pwrite(fd, pending.data(), pending.size(), flushed_len);
+        close(fd);
+      }
+    }
+
+    std::string file_name() const
+    {
+      if (completed)
+        return fmt::format(
+          "{}{}-{}", ledger_file_prefix, start_idx, get_last_idx());
+      else
+        return fmt::format("{}{}", ledger_file_prefix, start_idx);
+    }
+
+    std::string file_path() const
+    {
+      return path(file_name());
+    }
+
+    std::string index_path() const
+    {
+      return file_path() + ledger_index_suffix;
+    }
+
+    size_t get_start_idx() const
+    {
+      return start_idx;
+    }
 
-      if (fread(entry.data(), len, 1, file) != 1)
+    size_t get_last_idx() const
+    {
+      return start_idx + positions.size() - 1;
+    }
+
+    size_t get_total_len() const
+    {
+      return total_len;
+    }
+
+    bool is_completed() const
+    {
+      return completed;
+    }
+
+    size_t framed_entries_size(size_t from, size_t to) const
+    {
+      auto end =
+        (to == get_last_idx()) ? total_len : positions.at(to - start_idx + 1);
+      return end - positions.at(from - start_idx);
+    }
+
+    // Calls f on the framed entries [from, to], which must be in this file.
+    // For completed files, f is given a pointer into the read-only mapping.
+    template <typename F>
+    void read_framed_entries(size_t from, size_t to, F&& f)
+    {
+      auto offset = positions.at(from - start_idx);
+      auto size = framed_entries_size(from, to);
+
+      if (mapped != nullptr)
+      {
+        f(mapped + offset, size);
+        return;
+      }
+
+      // Entries that have not been flushed yet are served from memory
+      if (offset >= flushed_len)
+      {
+        f(pending.data() + (offset - flushed_len), size);
+        return;
+      }
+
+      if (offset + size > flushed_len)
+        flush(false);
+
+      read_buffer.resize(size);
+      if (pread(fd, read_buffer.data(), size, offset) != (ssize_t)size)
         throw std::logic_error("Failed to read from file");
 
+      f(read_buffer.data(), size);
+    }
+
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      positions.push_back(total_len);
+
+      total_len += (size + frame_header_size);
+
+      uint32_t frame = (uint32_t)size;
+      auto p = reinterpret_cast<const uint8_t*>(&frame);
+      pending.insert(pending.end(), p, p + frame_header_size);
+      pending.insert(pending.end(), data, data + size);
+      synced = false;
+    }
+
+    // Writes all pending entries with a single write and, if sync is true,
+    // makes them durable.
+    void flush(bool sync)
+    {
+      if (completed)
+        return;
+
+      if (!pending.empty())
+      {
+        write_all(pending.data(), pending.size(), flushed_len);
+        flushed_len = total_len;
+        pending.clear();
+      }
+
+      if (sync && !synced)
+      {
+        if (fdatasync(fd) != 0)
+        {
+          throw std::logic_error(
+            fmt::format("Failed to sync file: {}", strerror(errno)));
+        }
+        synced = true;
+      }
+    }
+
+    void complete(bool sync)
+    {
+      if (completed)
+        return;
+
+      flush(sync);
+      close(fd);
+      fd = -1;
+
+      // The file is renamed before its index is written. If the index is
+      // missing when the file is next loaded, it is rebuilt.
+      auto open_path = file_path();
+      completed = true;
+      if (rename(open_path.c_str(), file_path().c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Failed to rename ledger file {}: {}",
+          open_path,
+          strerror(errno)));
+      }
+
+      write_index();
+      map(file_path());
+
+      LOG_DEBUG_FMT("Completed ledger file {}", file_path());
+    }
+
+    // Truncates the file so that last_idx is its last entry. If last_idx is
+    // before the start of the file, it is left empty.
+    void truncate(size_t last_idx)
+    {
+      if (completed)
+      {
+        // Reopen the completed file for writing
+        auto completed_path = file_path();
+        unmap();
+        unlink(index_path().c_str());
+        completed = false;
+
+        if (rename(completed_path.c_str(), file_path().c_str()) != 0)
+        {
+          throw std::logic_error(fmt::format(
+            "Failed to rename ledger file {}: {}",
+            completed_path,
+            strerror(errno)));
+        }
+
+        open_fd(O_RDWR);
+        flushed_len = total_len;
+      }
+
+      auto entries = last_idx + 1 - start_idx;
+      if (entries >= positions.size())
+        return;
+
+      total_len = positions.at(entries);
+      positions.resize(entries);
+
+      // Truncated entries that have not been flushed are simply dropped
+      if (total_len >= flushed_len)
+      {
+        pending.resize(total_len - flushed_len);
+        return;
+      }
+
+      pending.clear();
+      flushed_len = total_len;
+
+      if (ftruncate(fd, total_len))
+        throw std::logic_error("Failed to truncate file");
+    }
+
+    void remove()
+    {
+      unmap();
+
+      if (fd != -1)
+      {
+        close(fd);
+        fd = -1;
+      }
+
+      if (completed)
+        unlink(index_path().c_str());
+      unlink(file_path().c_str());
+    }
+  };
+
+  // A framed entry, which may be sent to several nodes without being copied
+  using SharedEntry = std::shared_ptr<const std::vector<uint8_t>>;
+
+  // The most recently written framed entries, so that a leader sending the
+  // same entries to each of its followers does not read them back from the
+  // ledger files each time. Once the cache holds more than max_size bytes, the
+  // oldest entries are evicted.
+  class EntryCache
+  {
+  private:
+    const size_t max_size;
+    std::deque<SharedEntry> entries;
+    // Index of the first cached entry
+    size_t start_idx = 1;
+    size_t total_size = 0;
+
+  public:
+    EntryCache(size_t max_size) : max_size(max_size) {}
+
+    bool enabled() const
+    {
+      return max_size > 0;
+    }
+
+    bool contains(size_t idx) const
+    {
+      return idx >= start_idx && idx < start_idx + entries.size();
+    }
+
+    SharedEntry find(size_t idx) const
+    {
+      if (!contains(idx))
+        return nullptr;
+
+      return entries[idx - start_idx];
+    }
+
+    // Entries are expected in order. If there is a gap before idx, everything
+    // previously cached is dropped.
+    void add(size_t idx, SharedEntry entry)
+    {
+      if (idx != start_idx + entries.size())
+      {
+        entries.clear();
+        total_size = 0;
+        start_idx = idx;
+      }
+
+      total_size += entry->size();
+      entries.push_back(std::move(entry));
+
+      while (total_size > max_size && !entries.empty())
+      {
+        total_size -= entries.front()->size();
+        entries.pop_front();
+        ++start_idx;
+      }
+    }
+
+    void truncate(size_t last_idx)
+    {
+      while (!entries.empty() && start_idx + entries.size() - 1 > last_idx)
+      {
+        total_size -= entries.back()->size();
+        entries.pop_back();
+      }
+
+      if (entries.empty())
+        start_idx = last_idx + 1;
+    }
+  };
+
+  class Ledger
+  {
+  private:
+    static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+    const std::string dir;
+    const size_t chunk_threshold;
+    const LedgerSyncConfig sync_config;
+    std::vector<std::unique_ptr<LedgerFile>> files;
+    std::unique_ptr<ringbuffer::AbstractWriter> to_enclave;
+
+    EntryCache cache;
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+
+    // Entries written since the last flush
+    size_t pending_entries = 0;
+
+    // Epoch of the latest truncation requested by the enclave, which is sent
+    // back with durability reports
+    size_t truncation_epoch = 0;
+    std::chrono::steady_clock::time_point first_pending_time;
+
+    // Index of the latest snapshot, named snapshot_<idx>, or 0 if there is
+    // none. Only the latest snapshot is kept.
+    size_t snapshot_idx = 0;
+
+    // The snapshot being written, in chunks, to a temporary file, and how
+    // many bytes of it have been written so far
+    int pending_snapshot_fd = -1;
+    size_t pending_snapshot_idx = 0;
+    size_t pending_snapshot_written = 0;
+
+    // Entries up to this index are not in the ledger. They were discarded
+    // when a snapshot past the end of the ledger was stored.
+    size_t base_idx = 0;
+
+    // Parses ledger_<start>[-<last>], returning false for unrelated files.
+    // last is 0 for open files.
+    static bool parse_file_name(
+      const std::string& name, size_t& start, size_t& last)
+    {
+      const std::string prefix(ledger_file_prefix);
+      const std::string suffix(ledger_index_suffix);
+
+      if (name.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+      if (
+        name.size() >= suffix.size() &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        return false;
+
+      auto range = name.substr(prefix.size());
+      auto sep = range.find('-');
+
+      try
+      {
+        start = std::stoul(range.substr(0, sep));
+        last = (sep == std::string::npos) ? 0 : std::stoul(range.substr(sep + 1));
+      }
+      catch (const std::exception&)
+      {
+        return false;
+      }
+
+      return start > 0;
+    }
+
+    // Parses snapshot_<idx>, returning false for unrelated files
+    static bool parse_snapshot_name(const std::string& name, size_t& idx)
+    {
+      const std::string prefix(snapshot_file_prefix);
+
+      if (name.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+      auto rest = name.substr(prefix.size());
+      size_t end = 0;
+
+      try
+      {
+        idx = std::stoul(rest, &end);
+      }
+      catch (const std::exception&)
+      {
+        return false;
+      }
+
+      return end == rest.size() && idx > 0;
+    }
+
+    std::string snapshot_path(size_t idx) const
+    {
+      return fmt::format("{}/{}{}", dir, snapshot_file_prefix, idx);
+    }
+
+    LedgerFile* find_file(size_t idx)
+    {
+      auto it = std::upper_bound(
+        files.begin(), files.end(), idx, [](size_t idx, const auto& f) {
+          return idx < f->get_start_idx();
+        });
+
+      if (it == files.begin())
+        return nullptr;
+
+      return (--it)->get();
+    }
+
+  public:
+    Ledger(
+      const std::string& dir,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t chunk_threshold = ledger_chunk_threshold_default,
+      const LedgerSyncConfig& sync_config = {},
+      size_t cache_size = ledger_cache_size_default) :
+      dir(dir),
+      chunk_threshold(chunk_threshold),
+      sync_config(sync_config),
+      to_enclave(writer_factory.create_writer_to_inside()),
+      cache(cache_size)
+    {
+      if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to create ledger directory {}: {}", dir, strerror(errno)));
+      }
+
+      auto d = opendir(dir.c_str());
+      if (!d)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to open ledger directory {}: {}", dir, strerror(errno)));
+      }
+
+      std::vector<std::pair<size_t, size_t>> ranges;
+      std::vector<size_t> snapshots;
+      while (auto e = readdir(d))
+      {
+        size_t start, last, idx;
+        if (parse_file_name(e->d_name, start, last))
+          ranges.emplace_back(start, last);
+        else if (parse_snapshot_name(e->d_name, idx))
+          snapshots.push_back(idx);
+      }
+      closedir(d);
+
+      // Only the latest snapshot is kept
+      for (auto idx : snapshots)
+        snapshot_idx = std::max(snapshot_idx, idx);
+
+      for (auto idx : snapshots)
+      {
+        if (idx != snapshot_idx)
+          unlink(snapshot_path(idx).c_str());
+      }
+
+      std::sort(ranges.begin(), ranges.end());
+
+      for (auto& [start, last] : ranges)
+      {
+        if (!files.empty())
+        {
+          auto& prev = files.back();
+          if (!prev->is_completed() || prev->get_last_idx() + 1 != start)
+            throw std::logic_error("Malformed ledger directory");
+        }
+        else if (start != 1 && start > snapshot_idx + 1)
+        {
+          // Unless the ledger continues from a snapshot, it starts at 1
+          throw std::logic_error("Malformed ledger directory");
+        }
+
+        files.push_back(std::make_unique<LedgerFile>(dir, start, last));
+      }
+
+      base_idx =
+        files.empty() ? snapshot_idx : files.front()->get_start_idx() - 1;
+
+      LOG_INFO_FMT(
+        "Loaded ledger with {} entries from {} files",
+        get_last_idx(),
+        files.size());
+    }
+
+    Ledger(const Ledger& that) = delete;
+
+    ~Ledger()
+    {
+      if (pending_snapshot_fd != -1)
+        close(pending_snapshot_fd);
+    }
+
+    size_t get_last_idx()
+    {
+      if (files.empty())
+        return base_idx;
+
+      return files.back()->get_last_idx();
+    }
+
+    // Index of the entry before the first one in the ledger. It is not 0 once
+    // the ledger has been discarded up to a snapshot.
+    size_t get_base_idx() const
+    {
+      return base_idx;
+    }
+
+    size_t get_files_count()
+    {
+      return files.size();
+    }
+
+    // Calls f on each contiguous region of the framed entries [from, to].
+    // Returns false if the range is not in the ledger.
+    template <typename F>
+    bool read_framed_entries(size_t from, size_t to, F&& f)
+    {
+      if ((from <= base_idx) || (to < from) || (to > get_last_idx()))
+        return false;
+
+      while (from <= to)
+      {
+        auto file = find_file(from);
+        auto last = std::min(to, file->get_last_idx());
+        file->read_framed_entries(from, last, f);
+        from = last + 1;
+      }
+
+      return true;
+    }
+
+    // Calls f on the entry at idx, without its frame header. Returns false if
+    // the entry is not in the ledger.
+    template <typename F>
+    bool read_entry(size_t idx, F&& f)
+    {
+      return read_framed_entries(
+        idx, idx, [&f](const uint8_t* data, size_t size) {
+          f(data + frame_header_size, size - frame_header_size);
+        });
+    }
+
+    const std::vector<uint8_t> read_entry(size_t idx)
+    {
+      std::vector<uint8_t> entry;
+      read_entry(idx, [&entry](const uint8_t* data, size_t size) {
+        entry.assign(data, data + size);
+      });
       return entry;
     }
 
     const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
     {
-      auto framed_size = framed_entries_size(from, to);
+      std::vector<uint8_t> framed_entries;
+      framed_entries.reserve(framed_entries_size(from, to));
+      read_framed_entries(
+        from, to, [&framed_entries](const uint8_t* data, size_t size) {
+          framed_entries.insert(framed_entries.end(), data, data + size);
+        });
+      return framed_entries;
+    }
+
+    // Calls f with the framed entries [from, to], as one or more SharedEntry.
+    // Cached entries are passed individually, without being copied. Each run
+    // of uncached entries is read into a single new buffer. Returns false if
+    // the range is not in the ledger.
+    template <typename F>
+    bool read_shared_entries(size_t from, size_t to, F&& f)
+    {
+      if ((from <= base_idx) || (to < from) || (to > get_last_idx()))
+        return false;
 
-      std::vector<uint8_t> framed_entries(framed_size);
-      if (framed_size == 0)
-        return framed_entries;
+      while (from <= to)
+      {
+        auto entry = cache.find(from);
+        if (entry)
+        {
+          ++cache_hits;
+          f(std::move(entry));
+          ++from;
+          continue;
+        }
 
-      fseeko(file, positions.at(from - 1), SEEK_SET);
+        auto last = from;
+        while (last < to && !cache.contains(last + 1))
+          ++last;
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+        cache_misses += last - from + 1;
 
-      return framed_entries;
+        auto run = std::make_shared<std::vector<uint8_t>>();
+        run->reserve(framed_entries_size(from, last));
+        read_framed_entries(
+          from, last, [&run](const uint8_t* data, size_t size) {
+            run->insert(run->end(), data, data + size);
+          });
+        f(std::move(run));
+
+        from = last + 1;
+      }
+
+      return true;
+    }
+
+    size_t get_cache_hits() const
+    {
+      return cache_hits;
+    }
+
+    size_t get_cache_misses() const
+    {
+      return cache_misses;
     }
 
     size_t framed_entries_size(size_t from, size_t to)
     {
-      if ((from == 0) || (to < from) || (to > positions.size()))
+      if ((from <= base_idx) || (to < from) || (to > get_last_idx()))
         return 0;
 
-      if (to == positions.size())
+      size_t size = 0;
+      while (from <= to)
       {
-        return total_len - positions.at(from - 1);
+        auto file = find_file(from);
+        auto last = std::min(to, file->get_last_idx());
+        size += file->framed_entries_size(from, last);
+        from = last + 1;
       }
-      else
+
+      return size;
+    }
+
+    // Returns the end of the longest prefix of [from, to] which is in the
+    // ledger and whose framed entries fit in max_size, or from - 1 if there
+    // are no such entries. The first entry is always included, whatever its
+    // size.
+    size_t range_end(size_t from, size_t to, size_t max_size)
+    {
+      if (from == 0)
+        return 0;
+
+      to = std::min(to, get_last_idx());
+      if (from <= base_idx || to < from)
+        return from - 1;
+
+      if (framed_entries_size(from, to) <= max_size)
+        return to;
+
+      // Binary search, knowing that the range ending at fits is included and
+      // the one ending at too_large is not
+      auto fits = from;
+      auto too_large = to;
+      while (too_large - fits > 1)
       {
-        return positions.at(to) - positions.at(from - 1);
+        auto mid = fits + (too_large - fits) / 2;
+        if (framed_entries_size(from, mid) <= max_size)
+          fits = mid;
+        else
+          too_large = mid;
       }
+
+      return fits;
     }
 
     size_t entry_size(size_t idx)
@@ -149,45 +975,265 @@ namespace asynchost
 
     void write_entry(const uint8_t* data, size_t size)
     {
-      fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
+      if (files.empty() || files.back()->is_completed())
+      {
+        files.push_back(std::make_unique<LedgerFile>(dir, get_last_idx() + 1));
+      }
 
-      LOG_DEBUG_FMT("Ledger write {}: {} bytes", positions.size(), size);
+      auto& file = files.back();
+      file->write_entry(data, size);
 
-      total_len += (size + frame_header_size);
+      LOG_DEBUG_FMT("Ledger write {}: {} bytes", get_last_idx(), size);
 
-      uint32_t frame = (uint32_t)size;
+      if (cache.enabled())
+      {
+        auto framed = std::make_shared<std::vector<uint8_t>>();
+        framed->reserve(frame_header_size + size);
+        uint32_t frame = (uint32_t)size;
+        auto p = reinterpret_cast<const uint8_t*>(&frame);
+        framed->insert(framed->end(), p, p + frame_header_size);
+        framed->insert(framed->end(), data, data + size);
+        cache.add(get_last_idx(), std::move(framed));
+      }
+
+      if (pending_entries++ == 0)
+        first_pending_time = std::chrono::steady_clock::now();
 
-      if (fwrite(&frame, frame_header_size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+      if (file->get_total_len() >= chunk_threshold)
+        file->complete(sync_config.enabled);
 
-      if (fwrite(data, size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+      if (
+        sync_config.max_batch_entries > 0 &&
+        pending_entries >= sync_config.max_batch_entries)
+        flush(true);
+    }
+
+    // Writes all pending entries to disk. When syncing is enabled, this only
+    // happens once enough entries are pending or the oldest has waited long
+    // enough (or if force is set), and the enclave is then told that the
+    // ledger is durable up to the last entry.
+    void flush(bool force = false)
+    {
+      if (pending_entries == 0)
+        return;
+
+      if (
+        sync_config.enabled && !force &&
+        std::chrono::steady_clock::now() - first_pending_time <
+          sync_config.max_delay)
+        return;
+
+      LOG_DEBUG_FMT(
+        "Ledger flush {} entries up to {}", pending_entries, get_last_idx());
+
+      if (!files.empty())
+        files.back()->flush(sync_config.enabled);
+
+      pending_entries = 0;
+
+      if (sync_config.enabled)
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          raft::log_durable,
+          to_enclave,
+          (raft::Index)get_last_idx(),
+          truncation_epoch);
+      }
     }
 
     void truncate(size_t last_idx)
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, positions.size());
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, get_last_idx());
 
-      // positions[last_idx - 1] is the position of the specified
-      // final index. Truncate the ledger at position[last_idx].
-      if (last_idx >= positions.size())
+      if (last_idx >= get_last_idx())
         return;
 
-      total_len = positions.at(last_idx);
-      positions.resize(last_idx);
+      cache.truncate(last_idx);
 
-      if (fflush(file) != 0)
+      // Remove all files that only contain truncated entries
+      while (!files.empty() && files.back()->get_start_idx() > last_idx)
       {
-        std::stringstream ss;
-        ss << "Failed to flush file: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        files.back()->remove();
+        files.pop_back();
       }
 
-      if (ftruncate(fileno(file), total_len))
-        throw std::logic_error("Failed to truncate file");
+      if (!files.empty() && files.back()->get_last_idx() > last_idx)
+        files.back()->truncate(last_idx);
+
+      if (files.empty())
+        base_idx = std::min(base_idx, last_idx);
+    }
+
+    size_t get_snapshot_idx() const
+    {
+      return snapshot_idx;
+    }
+
+    // Stores a snapshot at idx, replacing the previous one. Every entry after
+    // the snapshot must still be in the ledger, so if the snapshot is past
+    // the end of the ledger, the ledger is discarded and the next entry
+    // written is the one after the snapshot.
+    void write_snapshot(size_t idx, const uint8_t* data, size_t size)
+    {
+      write_snapshot_chunk(idx, size, 0, data, size);
+    }
+
+    // Writes size bytes, from offset, of the snapshot at idx, which is
+    // total_size bytes long. Chunks are written in order, starting a new
+    // snapshot at offset 0, and the snapshot is only stored once all of it
+    // has been written.
+    void write_snapshot_chunk(
+      size_t idx,
+      size_t total_size,
+      size_t offset,
+      const uint8_t* data,
+      size_t size)
+    {
+      const auto path = snapshot_path(idx);
+      const auto tmp_path = path + ".tmp";
 
-      fseeko(file, total_len, SEEK_SET);
+      if (offset == 0)
+      {
+        LOG_DEBUG_FMT("Ledger snapshot at {}: {} bytes", idx, total_size);
+
+        if (pending_snapshot_fd != -1)
+        {
+          close(pending_snapshot_fd);
+          unlink(snapshot_path(pending_snapshot_idx).append(".tmp").c_str());
+        }
+
+        pending_snapshot_fd =
+          ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (pending_snapshot_fd == -1)
+        {
+          throw std::logic_error(fmt::format(
+            "Unable to open snapshot file {}: {}", tmp_path, strerror(errno)));
+        }
+
+        pending_snapshot_idx = idx;
+        pending_snapshot_written = 0;
+      }
+      else if (
+        pending_snapshot_fd == -1 || pending_snapshot_idx != idx ||
+        pending_snapshot_written != offset)
+      {
+        throw std::logic_error(fmt::format(
+          "Unexpected chunk of snapshot at {} from {}", idx, offset));
+      }
+
+      if (offset + size > total_size)
+      {
+        throw std::logic_error(fmt::format(
+          "Chunk of snapshot at {} ends past its size {}", idx, total_size));
+      }
+
+      auto fd = pending_snapshot_fd;
+      pending_snapshot_written += size;
+
+      while (size > 0)
+      {
+        auto written = ::write(fd, data, size);
+        if (written == -1)
+        {
+          if (errno == EINTR)
+            continue;
+
+          throw std::logic_error(
+            fmt::format("Failed to write snapshot: {}", strerror(errno)));
+        }
+
+        data += written;
+        size -= written;
+      }
+
+      if (pending_snapshot_written < total_size)
+        return;
+
+      // The snapshot is written in full before it replaces the previous one
+      pending_snapshot_fd = -1;
+      if (fsync(fd) != 0)
+      {
+        close(fd);
+        throw std::logic_error(
+          fmt::format("Failed to sync snapshot: {}", strerror(errno)));
+      }
+      close(fd);
+
+      if (rename(tmp_path.c_str(), path.c_str()) != 0)
+      {
+        throw std::logic_error(fmt::format(
+          "Unable to rename snapshot file {}: {}", tmp_path, strerror(errno)));
+      }
+
+      if (snapshot_idx != 0 && snapshot_idx != idx)
+        unlink(snapshot_path(snapshot_idx).c_str());
+      snapshot_idx = idx;
+
+      if (idx > get_last_idx())
+      {
+        LOG_INFO_FMT(
+          "Discarding ledger up to {}, which ends before snapshot at {}",
+          get_last_idx(),
+          idx);
+
+        for (auto& file : files)
+          file->remove();
+        files.clear();
+
+        cache.truncate(0);
+        pending_entries = 0;
+        base_idx = idx;
+      }
+    }
+
+    // Returns the snapshot at idx, or nothing if it is not the latest one
+    std::vector<uint8_t> read_snapshot(size_t idx)
+    {
+      return read_snapshot(idx, 0, std::numeric_limits<size_t>::max());
+    }
+
+    // Returns at most size bytes of the snapshot at idx, from offset, or
+    // nothing if it is not the latest one
+    std::vector<uint8_t> read_snapshot(size_t idx, size_t offset, size_t size)
+    {
+      std::vector<uint8_t> snapshot;
+      if (idx == 0 || idx != snapshot_idx)
+        return snapshot;
+
+      const auto path = snapshot_path(idx);
+      auto fd = ::open(path.c_str(), O_RDONLY);
+      if (fd == -1)
+      {
+        LOG_FAIL_FMT(
+          "Unable to open snapshot file {}: {}", path, strerror(errno));
+        return snapshot;
+      }
+
+      struct stat st;
+      if (fstat(fd, &st) == 0 && offset <= (size_t)st.st_size)
+      {
+        snapshot.resize(std::min(size, (size_t)st.st_size - offset));
+        size_t read = 0;
+        while (read < snapshot.size())
+        {
+          auto r = pread(
+            fd, snapshot.data() + read, snapshot.size() - read, offset + read);
+          if (r == -1 && errno == EINTR)
+            continue;
+
+          if (r <= 0)
+          {
+            LOG_FAIL_FMT("Failed to read snapshot file {}", path);
+            snapshot.clear();
+            break;
+          }
+
+          read += r;
+        }
+      }
+
+      close(fd);
+      return snapshot;
     }
 
     void register_message_handlers(
@@ -200,25 +1246,40 @@ namespace asynchost
 
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, raft::log_truncate, [this](const uint8_t* data, size_t size) {
-          auto idx = serialized::read<raft::Index>(data, size);
+          auto [idx, epoch] =
+            ringbuffer::read_message<raft::log_truncate>(data, size);
+          truncation_epoch = epoch;
           truncate(idx);
         });
 
       DISPATCHER_SET_MESSAGE_HANDLER(
-        disp, raft::log_get, [&](const uint8_t* data, size_t size) {
-          // The enclave has asked for a ledger entry.
-          auto [idx] = ringbuffer::read_message<raft::log_get>(data, size);
-
-          auto& entry = read_entry(idx);
+        disp, raft::log_get_range, [&](const uint8_t* data, size_t size) {
+          // The enclave has asked for a range of ledger entries. It asks
+          // again for any that do not fit in this response.
+          auto [from, to] =
+            ringbuffer::read_message<raft::log_get_range>(data, size);
 
-          if (entry.size() > 0)
+          std::vector<uint8_t> framed;
+          if (from > 0 && to >= from)
           {
-            RINGBUFFER_WRITE_MESSAGE(raft::log_entry, to_enclave, entry);
-          }
-          else
-          {
-            RINGBUFFER_WRITE_MESSAGE(raft::log_no_entry, to_enclave);
+            auto last = range_end(from, to, ledger_range_max_size);
+            if (last >= (size_t)from)
+              framed = read_framed_entries(from, last);
           }
+
+          RINGBUFFER_WRITE_MESSAGE(
+            raft::log_entries,
+            to_enclave,
+            from,
+            serializer::ByteRange{framed.data(), framed.size()});
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp, raft::log_snapshot, [this](const uint8_t* data, size_t size) {
+          auto [idx, total_size, offset, chunk] =
+            ringbuffer::read_message<raft::log_snapshot>(data, size);
+          write_snapshot_chunk(
+            idx, total_size, offset, chunk.data(), chunk.size());
         });
     }
   };
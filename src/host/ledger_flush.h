@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "beforeio.h"
+#include "ledger.h"
+
+namespace asynchost
+{
+  class LedgerFlushImpl
+  {
+  private:
+    Ledger& ledger;
+
+  public:
+    LedgerFlushImpl(Ledger& ledger) : ledger(ledger) {}
+
+    void before_io()
+    {
+      // This runs once per libuv loop iteration, after HandleRingbuffer, so
+      // all the entries written while draining the ringbuffer in one
+      // iteration are flushed (and synced) together. Unlike EveryIO, this
+      // does not stop the loop from blocking when idle.
+      ledger.flush();
+    }
+  };
+
+  using LedgerFlush = proxy_ptr<BeforeIO<LedgerFlushImpl>>;
+}
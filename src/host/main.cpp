@@ -6,6 +6,7 @@
 #include "ds/oversized.h"
 #include "enclave.h"
 #include "handle_ringbuffer.h"
+#include "ledger_flush.h"
 #include "nodeconnections.h"
 #include "notifyconnections.h"
 #include "rpcconnections.h"
@@ -90,6 +91,15 @@ int main(int argc, char** argv)
     "Size of the internal ringbuffers, as a power of 2",
     true);
 
+  size_t arena_size_shift = 24;
+  app.add_option(
+    "--arena-size-shift",
+    arena_size_shift,
+    "Size of the buffers holding large messages passed between host and "
+    "enclave, as a power of 2. Larger messages are fragmented. 0 disables "
+    "them, so that all large messages are fragmented",
+    true);
+
   cli::ParsedAddress node_address;
   cli::add_address_option(
     app, node_address, "--node-address", "Node-to-node listening address");
@@ -105,8 +115,48 @@ int main(int argc, char** argv)
     "--notify-server-address",
     "Server address to notify progress to");
 
-  std::string ledger_file("ccf.ledger");
-  app.add_option("--ledger-file", ledger_file, "Ledger file", true);
+  std::string ledger_dir("ccf.ledger");
+  app.add_option("--ledger-dir", ledger_dir, "Ledger directory", true);
+
+  size_t ledger_chunk_bytes = asynchost::ledger_chunk_threshold_default;
+  app.add_option(
+    "--ledger-chunk-bytes",
+    ledger_chunk_bytes,
+    "Size after which a ledger file is completed and a new one is started. "
+    "Completed ledger files are indexed and served read-only from memory",
+    true);
+
+  size_t ledger_cache_bytes = asynchost::ledger_cache_size_default;
+  app.add_option(
+    "--ledger-cache-bytes",
+    ledger_cache_bytes,
+    "Size of the cache of recently written ledger entries, from which append "
+    "entries sent to other nodes are served. 0 disables the cache",
+    true);
+
+  bool ledger_sync = false;
+  app.add_flag(
+    "--ledger-sync",
+    ledger_sync,
+    "Sync ledger writes to disk, and only acknowledge entries once they are "
+    "durable. Entries written together are synced together");
+
+  size_t ledger_sync_max_entries = 0;
+  app.add_option(
+    "--ledger-sync-max-entries",
+    ledger_sync_max_entries,
+    "Sync the ledger as soon as this many entries are pending. 0 for no limit, "
+    "so that all entries read from the enclave in one pass are synced together",
+    true);
+
+  size_t ledger_sync_delay_us = 0;
+  app.add_option(
+    "--ledger-sync-delay-us",
+    ledger_sync_delay_us,
+    "Wait up to this many microseconds after a ledger entry is written for "
+    "more entries to sync with it. Higher values reduce the number of syncs at "
+    "a cost to commit latency",
+    true);
 
   size_t raft_timeout = 100;
   app.add_option(
@@ -119,6 +169,28 @@ int main(int argc, char** argv)
     "Raft election timeout in milliseconds",
     true);
 
+  size_t raft_max_inflight_batches = raft::default_max_inflight_batches;
+  app.add_option(
+    "--raft-max-inflight-batches",
+    raft_max_inflight_batches,
+    "Maximum number of unacknowledged batches of entries sent to a follower",
+    true);
+
+  size_t raft_max_inflight_bytes = raft::default_max_inflight_bytes;
+  app.add_option(
+    "--raft-max-inflight-bytes",
+    raft_max_inflight_bytes,
+    "Maximum size of the unacknowledged entries sent to a follower",
+    true);
+
+  size_t raft_snapshot_interval = 0;
+  app.add_option(
+    "--raft-snapshot-interval",
+    raft_snapshot_interval,
+    "Number of committed entries between snapshots of the store, or 0 to "
+    "disable snapshots",
+    true);
+
   std::string node_cert_file("nodecert.pem");
   app.add_option(
     "--node-cert-file",
@@ -153,6 +225,15 @@ int main(int argc, char** argv)
     "latency at a cost to throughput",
     true);
 
+  size_t worker_threads = 0;
+  app.add_option(
+    "--worker-threads",
+    worker_threads,
+    "Number of additional enclave threads processing client sessions. The "
+    "main enclave thread always handles consensus and node-to-node traffic. "
+    "The total number of enclave threads is bounded by the enclave's NumTCS",
+    true);
+
   size_t memory_reserve_startup = 0;
   app.add_option(
     "--memory-reserve-startup",
@@ -213,10 +294,20 @@ int main(int argc, char** argv)
   // Factory for creating writers which will handle writing of large messages
   oversized::WriterConfig writer_config{(size_t)(1 << max_fragment_size),
                                         (size_t)(1 << max_msg_size)};
+
+  // large messages are written whole to these, rather than fragmented
+  std::unique_ptr<oversized::Arenas> arenas;
+  if (arena_size_shift != 0)
+  {
+    arenas = std::make_unique<oversized::Arenas>(1 << arena_size_shift);
+    writer_config.arenas = arenas.get();
+  }
+
   oversized::WriterFactory writer_factory(&circuit, writer_config);
 
   // reconstruct oversized messages sent to the host
-  oversized::FragmentReconstructor fr(bp.get_dispatcher());
+  oversized::FragmentReconstructor fr(
+    bp.get_dispatcher(), arenas ? &arenas->read_from_inside() : nullptr);
 
   // provide regular ticks to the enclave
   asynchost::Ticker ticker(tick_period_ms, writer_factory, [](auto s) {
@@ -238,6 +329,10 @@ int main(int argc, char** argv)
   raft::Config raft_config{
     std::chrono::milliseconds(raft_timeout),
     std::chrono::milliseconds(raft_election_timeout),
+    ledger_sync,
+    raft_max_inflight_batches,
+    raft_max_inflight_bytes,
+    raft_snapshot_interval,
   };
 
   EnclaveConfig config;
@@ -245,6 +340,7 @@ int main(int argc, char** argv)
   config.writer_config = writer_config;
   config.raft_config = raft_config;
   config.signature_intervals = {sig_max_tx, sig_max_ms};
+  config.worker_threads = worker_threads;
 #ifdef DEBUG_CONFIG
   config.debug_config = {memory_reserve_startup};
 #endif
@@ -254,9 +350,27 @@ int main(int argc, char** argv)
   LOG_INFO_FMT("Created new node");
 
   // ledger
-  asynchost::Ledger ledger(ledger_file, writer_factory);
+  asynchost::LedgerSyncConfig ledger_sync_config{
+    ledger_sync,
+    ledger_sync_max_entries,
+    std::chrono::microseconds(ledger_sync_delay_us)};
+  asynchost::Ledger ledger(
+    ledger_dir,
+    writer_factory,
+    ledger_chunk_bytes,
+    ledger_sync_config,
+    ledger_cache_bytes);
   ledger.register_message_handlers(bp.get_dispatcher());
 
+  // Recovery reads the whole ledger, since snapshots kept by the host are not
+  // trusted
+  if (start == "recover" && ledger.get_base_idx() != 0)
+    throw std::logic_error(fmt::format(
+      "Cannot recover from a ledger which starts after the snapshot at {}. "
+      "Recover from a node whose ledger is complete",
+      ledger.get_base_idx()));
+  asynchost::LedgerFlush ledger_flush(ledger);
+
   asynchost::NodeConnections node(
     ledger, writer_factory, node_address.hostname, node_address.port);
   node.register_message_handlers(bp.get_dispatcher());
@@ -280,31 +394,43 @@ int main(int argc, char** argv)
     LOG_FATAL_FMT("Verification of local node quote failed");
 #endif
 
-  // Start a thread which will ECall and process messages inside the enclave
-  auto enclave_thread = std::thread([&]() {
+  // Start threads which will ECall and process messages inside the enclave.
+  // The first to enter becomes the main enclave thread, the rest are workers.
+  std::vector<std::thread> enclave_threads;
+  for (size_t i = 0; i < worker_threads + 1; ++i)
+  {
+    enclave_threads.emplace_back([&]() {
 #ifndef VIRTUAL_ENCLAVE
-    try
+      try
 #endif
-    {
-      enclave.run();
-    }
+      {
+        // The main enclave thread returns here to sleep when it has nothing
+        // to do, leaving its reader asleep. Wait for a write to wake it, then
+        // re-enter.
+        auto& to_enclave = circuit.read_from_outside();
+        while (enclave.run() && to_enclave.is_sleeping())
+          to_enclave.wait_until_woken();
+      }
 #ifndef VIRTUAL_ENCLAVE
-    catch (const std::exception& e)
-    {
-      LOG_FAIL_FMT("Exception in enclave::run: {}", e.what());
-
-      // This exception should be rethrown, probably aborting the process, but
-      // we sleep briefly to allow more outbound messages to be processed. If
-      // the enclave sent logging messages, it is useful to read and print them
-      // before dying.
-      std::this_thread::sleep_for(1s);
-      throw;
-    }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("Exception in enclave::run: {}", e.what());
+
+        // This exception should be rethrown, probably aborting the process,
+        // but we sleep briefly to allow more outbound messages to be
+        // processed. If the enclave sent logging messages, it is useful to
+        // read and print them before dying.
+        std::this_thread::sleep_for(1s);
+        throw;
+      }
 #endif
-  });
+    });
+  }
 
   uv_run(uv_default_loop(), UV_RUN_DEFAULT);
-  enclave_thread.join();
+
+  for (auto& t : enclave_threads)
+    t.join();
 
   return 0;
 }
@@ -211,12 +211,44 @@ namespace asynchost
           auto size_to_send = size;
 
           // If the message is a raft append entries message, affix the
-          // corresponding ledger entries
-          if (
-            serialized::read<ccf::NodeMsgType>(data, size) ==
-              ccf::NodeMsgType::consensus_msg_raft &&
-            serialized::peek<raft::RaftMsgType>(data, size) ==
-              raft::raft_append_entries)
+          // corresponding ledger entries. If it is an install snapshot
+          // message, affix the snapshot.
+          const auto msg_type = serialized::read<ccf::NodeMsgType>(data, size);
+          const auto raft_msg_type =
+            msg_type == ccf::NodeMsgType::consensus_msg_raft ?
+            std::optional<raft::RaftMsgType>(
+              serialized::peek<raft::RaftMsgType>(data, size)) :
+            std::nullopt;
+
+          if (raft_msg_type == raft::raft_install_snapshot)
+          {
+            auto p = data;
+            auto psize = size;
+            const auto& is =
+              serialized::overlay<raft::InstallSnapshot>(p, psize);
+
+            // Only the requested chunk of the snapshot is affixed. If this is
+            // no longer the latest snapshot, nothing is affixed and the
+            // recipient abandons the snapshot.
+            auto snapshot = std::make_shared<std::vector<uint8_t>>(
+              ledger.read_snapshot(is.idx, is.offset, is.size));
+            uint32_t frame = (uint32_t)(size_to_send + snapshot->size());
+
+            LOG_DEBUG_FMT(
+              "raft send snapshot to {} [{}]: {} from {}",
+              to,
+              frame,
+              is.idx,
+              is.offset);
+
+            std::vector<SharedBytes> pieces;
+            pieces.push_back(std::make_shared<std::vector<uint8_t>>(
+              framed(frame, data_to_send, size_to_send)));
+            pieces.push_back(std::move(snapshot));
+
+            node.value()->write(std::move(pieces));
+          }
+          else if (raft_msg_type == raft::raft_append_entries)
           {
             // Parse the indices to be sent to the recipient.
             auto p = data;
@@ -236,14 +268,24 @@ namespace asynchost
               ae.idx,
               ae.prev_idx);
 
-            // TODO(#performance): writev
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            // The header and entries are sent with a single write. Entries
+            // are shared with every other node they are sent to, rather than
+            // being read and copied for each.
+            std::vector<SharedBytes> pieces;
+            pieces.push_back(std::make_shared<std::vector<uint8_t>>(
+              framed(frame, data_to_send, size_to_send)));
+
+            ledger.read_shared_entries(
+              ae.prev_idx + 1, ae.idx, [&pieces](SharedEntry entries) {
+                pieces.push_back(std::move(entries));
+              });
+
+            node.value()->write(std::move(pieces));
 
-            auto framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            frame = (uint32_t)framed_entries.size();
-            node.value()->write(frame, framed_entries.data());
+            LOG_DEBUG_FMT(
+              "raft AE entry cache: {} hits, {} misses",
+              ledger.get_cache_hits(),
+              ledger.get_cache_misses());
           }
           else
           {
@@ -252,13 +294,24 @@ namespace asynchost
 
             LOG_DEBUG_FMT("node send to {} [{}]", to, frame);
 
-            node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
-            node.value()->write(size_to_send, data_to_send);
+            auto msg = framed(frame, data_to_send, size_to_send);
+            node.value()->write(msg.size(), msg.data());
           }
         });
     }
 
   private:
+    // The frame, which is the size of everything that follows, and then the
+    // message itself
+    static std::vector<uint8_t> framed(
+      uint32_t frame, const uint8_t* data, size_t size)
+    {
+      std::vector<uint8_t> msg(sizeof(frame) + size);
+      ::memcpy(msg.data(), &frame, sizeof(frame));
+      ::memcpy(msg.data() + sizeof(frame), data, size);
+      return msg;
+    }
+
     bool add_node(
       ccf::NodeId node, const std::string& host, const std::string& service)
     {
@@ -65,15 +65,16 @@ namespace asynchost
 
     virtual ~with_uv_handle() = default;
 
-  private:
     template <typename T>
     friend class close_ptr;
 
-    void close()
+    virtual void close()
     {
       uv_close((uv_handle_t*)&uv_handle, on_close);
     }
 
+  private:
+
     static void on_close(uv_handle_t* handle)
     {
       static_cast<with_uv_handle<handle_type>*>(handle->data)->on_close();
@@ -6,11 +6,18 @@
 #include "dns.h"
 #include "proxy.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 namespace asynchost
 {
   class TCPImpl;
   using TCP = proxy_ptr<TCPImpl>;
 
+  // Bytes which may be written to several connections without being copied
+  using SharedBytes = std::shared_ptr<const std::vector<uint8_t>>;
+
   class TCPBehaviour
   {
   public:
@@ -31,7 +38,13 @@ namespace asynchost
     friend class close_ptr<TCPImpl>;
 
     static constexpr int backlog = 128;
-    static constexpr size_t read_size = 1024;
+
+    // Reads start small, and the buffer size doubles each time a read fills
+    // it, so that bulk transfers are read in few large pieces while idle
+    // connections hold little memory. It halves again when reads use less
+    // than a quarter of it.
+    static constexpr size_t min_read_size = 1024;
+    static constexpr size_t max_read_size = 256 * 1024;
 
     enum Status
     {
@@ -48,14 +61,22 @@ namespace asynchost
       RECONNECTING
     };
 
+    // Keeps the bytes of a write alive until it completes. These are either
+    // a private copy, or shared with other writes.
+    struct WriteData
+    {
+      std::vector<uint8_t> copy;
+      std::vector<SharedBytes> shared;
+      std::vector<uv_buf_t> bufs;
+    };
+
     struct PendingWrite
     {
       uv_write_t* req;
-      size_t len;
 
-      PendingWrite(uv_write_t* req, size_t len) : req(req), len(len) {}
+      PendingWrite(uv_write_t* req) : req(req) {}
 
-      PendingWrite(PendingWrite&& that) : req(that.req), len(that.len)
+      PendingWrite(PendingWrite&& that) : req(that.req)
       {
         that.req = nullptr;
       }
@@ -67,6 +88,7 @@ namespace asynchost
     };
 
     Status status;
+    size_t read_size = min_read_size;
     std::unique_ptr<TCPBehaviour> behaviour;
     std::vector<PendingWrite> pending_writes;
 
@@ -142,11 +164,57 @@ namespace asynchost
 
     bool write(size_t len, const uint8_t* data)
     {
-      auto req = new uv_write_t;
-      char* copy = new char[len];
+      // If nothing is queued, send as much as the socket takes immediately,
+      // and only copy the rest
+      if (status == CONNECTED && data != nullptr && len > 0)
+      {
+        auto buf = uv_buf_init((char*)data, len);
+        auto rc = uv_try_write((uv_stream_t*)&uv_handle, &buf, 1);
+
+        if (rc > 0)
+        {
+          data += rc;
+          len -= rc;
+
+          if (len == 0)
+            return true;
+        }
+      }
+
+      auto wd = new WriteData;
       if (data)
-        memcpy(copy, data, len);
-      req->data = copy;
+        wd->copy.assign(data, data + len);
+      else
+        wd->copy.resize(len);
+      wd->bufs.push_back(uv_buf_init((char*)wd->copy.data(), len));
+
+      return queue_write(wd);
+    }
+
+    /// Write bytes which are shared with other writes. They are not copied,
+    /// and are kept alive until the write completes.
+    bool write(SharedBytes bytes)
+    {
+      return write(std::vector<SharedBytes>{std::move(bytes)});
+    }
+
+    /// Write several shared buffers, in order, with a single uv_write
+    bool write(std::vector<SharedBytes> pieces)
+    {
+      auto wd = new WriteData;
+      wd->bufs.reserve(pieces.size());
+      for (auto& piece : pieces)
+        wd->bufs.push_back(uv_buf_init((char*)piece->data(), piece->size()));
+      wd->shared = std::move(pieces);
+
+      return queue_write(wd);
+    }
+
+  private:
+    bool queue_write(WriteData* wd)
+    {
+      auto req = new uv_write_t;
+      req->data = wd;
 
       switch (status)
       {
@@ -155,12 +223,12 @@ namespace asynchost
         case RESOLVING_FAILED:
         case CONNECTING_FAILED:
         {
-          pending_writes.emplace_back(req, len);
+          pending_writes.emplace_back(req);
           break;
         }
 
         case CONNECTED:
-          return send_write(req, len);
+          return send_write(req);
 
         default:
         {
@@ -172,7 +240,6 @@ namespace asynchost
       return true;
     }
 
-  private:
     bool init()
     {
       assert_status(FRESH, FRESH);
@@ -188,17 +255,19 @@ namespace asynchost
       return true;
     }
 
-    bool send_write(uv_write_t* req, size_t len)
+    bool send_write(uv_write_t* req)
     {
-      char* copy = (char*)req->data;
-
-      uv_buf_t buf;
-      buf.base = copy;
-      buf.len = len;
+      auto wd = static_cast<WriteData*>(req->data);
 
       int rc;
 
-      if ((rc = uv_write(req, (uv_stream_t*)&uv_handle, &buf, 1, on_write)) < 0)
+      if (
+        (rc = uv_write(
+           req,
+           (uv_stream_t*)&uv_handle,
+           wd->bufs.data(),
+           wd->bufs.size(),
+           on_write)) < 0)
       {
         free_write(req);
         LOG_FAIL_FMT("uv_write failed: {}", uv_strerror(rc));
@@ -417,7 +486,7 @@ namespace asynchost
 
         for (auto& w : pending_writes)
         {
-          send_write(w.req, w.len);
+          send_write(w.req);
           w.req = nullptr;
         }
 
@@ -485,6 +554,11 @@ namespace asynchost
         return;
       }
 
+      if ((size_t)sz == buf->len)
+        read_size = std::min(read_size * 2, max_read_size);
+      else if ((size_t)sz < buf->len / 4)
+        read_size = std::max(read_size / 2, min_read_size);
+
       uint8_t* p = (uint8_t*)buf->base;
       behaviour->on_read((size_t)sz, p);
 
@@ -503,8 +577,7 @@ namespace asynchost
       if (req == nullptr)
         return;
 
-      char* copy = (char*)req->data;
-      delete[] copy;
+      delete static_cast<WriteData*>(req->data);
       delete req;
     }
 
@@ -58,4 +58,261 @@ TEST_CASE("Entry sizes")
     for (auto c : e)
       std::cout << std::hex << (int)c;
     std::cout << std::endl;*/
-}
\ No newline at end of file
+}
+
+TEST_CASE("Multiple ledger files")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each entry is 8 bytes framed, so each file holds 2 entries
+  const size_t chunk_threshold = 16;
+  const size_t entries = 7;
+  std::vector<std::vector<uint8_t>> written;
+  {
+    asynchost::Ledger l("testlog", wf, chunk_threshold);
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+
+    for (uint8_t i = 1; i <= entries; ++i)
+    {
+      std::vector<uint8_t> e = {i, i, i, i};
+      l.write_entry(e.data(), e.size());
+      written.push_back(e);
+    }
+
+    REQUIRE(l.get_files_count() == 4);
+  }
+
+  asynchost::Ledger l("testlog", wf, chunk_threshold);
+  REQUIRE(l.get_last_idx() == entries);
+  REQUIRE(l.get_files_count() == 4);
+
+  for (size_t i = 1; i <= entries; ++i)
+    REQUIRE(l.read_entry(i) == written.at(i - 1));
+
+  SUBCASE("Framed entries across files")
+  {
+    const auto framed = l.read_framed_entries(2, 6);
+    REQUIRE(framed.size() == l.framed_entries_size(2, 6));
+    REQUIRE(framed.size() == 5 * (sizeof(uint32_t) + 4));
+
+    size_t regions = 0;
+    l.read_framed_entries(2, 6, [&regions](const uint8_t*, size_t) {
+      regions++;
+    });
+    REQUIRE(regions == 3);
+  }
+
+  SUBCASE("Truncate into a completed file")
+  {
+    l.truncate(3);
+    REQUIRE(l.get_last_idx() == 3);
+    REQUIRE(l.get_files_count() == 2);
+    REQUIRE(l.read_entry(3) == written.at(2));
+    REQUIRE(l.read_entry(4).empty());
+
+    const std::vector<uint8_t> e = {9, 9};
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_last_idx() == 4);
+    REQUIRE(l.read_entry(4) == e);
+  }
+}
+
+TEST_CASE("Durable writes")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  asynchost::LedgerSyncConfig sync_config;
+  sync_config.enabled = true;
+  sync_config.max_batch_entries = 3;
+
+  const std::vector<uint8_t> e = {1, 2, 3};
+
+  auto read_durable = [&eio]() {
+    std::optional<raft::Index> durable_idx = std::nullopt;
+    eio.read_from_outside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == raft::log_durable);
+        auto [idx, epoch] =
+          ringbuffer::read_message<raft::log_durable>(data, size);
+        REQUIRE(epoch == 0);
+        durable_idx = idx;
+      });
+    return durable_idx;
+  };
+
+  asynchost::Ledger l(
+    "testlog", wf, asynchost::ledger_chunk_threshold_default, sync_config);
+  l.truncate(0);
+
+  l.write_entry(e.data(), e.size());
+  l.write_entry(e.data(), e.size());
+  REQUIRE(l.read_entry(2) == e);
+  REQUIRE(!read_durable().has_value());
+
+  INFO("Pending entries are synced together");
+  l.flush();
+  REQUIRE(read_durable() == 2);
+
+  INFO("Batches are synced when they reach the maximum size");
+  l.write_entry(e.data(), e.size());
+  l.write_entry(e.data(), e.size());
+  REQUIRE(!read_durable().has_value());
+  l.write_entry(e.data(), e.size());
+  REQUIRE(read_durable() == 5);
+
+  l.flush();
+  REQUIRE(!read_durable().has_value());
+}
+
+TEST_CASE("Entry ranges")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  asynchost::Ledger l("testlog", wf);
+  l.truncate(0);
+
+  // Each entry is 8 bytes framed
+  for (uint8_t i = 1; i <= 8; ++i)
+  {
+    std::vector<uint8_t> e = {i, i, i, i};
+    l.write_entry(e.data(), e.size());
+  }
+
+  INFO("Ranges are limited to the end of the ledger");
+  REQUIRE(l.range_end(3, 100, 1000) == 8);
+  REQUIRE(l.range_end(9, 10, 1000) == 8);
+
+  INFO("Ranges are limited to the largest prefix which fits");
+  REQUIRE(l.range_end(1, 8, 20) == 2);
+  REQUIRE(l.range_end(2, 8, 24) == 4);
+  REQUIRE(l.range_end(1, 8, 63) == 7);
+  REQUIRE(l.range_end(1, 8, 64) == 8);
+
+  INFO("The first entry is included even if it is too large");
+  REQUIRE(l.range_end(5, 8, 1) == 5);
+}
+
+TEST_CASE("Shared entries")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each entry is 8 bytes framed, so the cache holds the last 4 entries
+  const size_t cache_size = 32;
+  const size_t entries = 8;
+
+  auto read_shared = [](asynchost::Ledger& l, size_t from, size_t to) {
+    std::vector<asynchost::SharedEntry> shared;
+    REQUIRE(l.read_shared_entries(
+      from, to, [&shared](asynchost::SharedEntry e) { shared.push_back(e); }));
+    return shared;
+  };
+
+  asynchost::Ledger l(
+    "testlog",
+    wf,
+    asynchost::ledger_chunk_threshold_default,
+    {},
+    cache_size);
+  l.truncate(0);
+
+  for (uint8_t i = 1; i <= entries; ++i)
+  {
+    std::vector<uint8_t> e = {i, i, i, i};
+    l.write_entry(e.data(), e.size());
+  }
+
+  INFO("Recent entries are served from the cache, and shared");
+  auto first = read_shared(l, 5, 8);
+  auto second = read_shared(l, 5, 8);
+  REQUIRE(first.size() == 4);
+  REQUIRE(first == second);
+  REQUIRE(l.get_cache_hits() == 8);
+  REQUIRE(l.get_cache_misses() == 0);
+
+  INFO("Evicted entries are read from the ledger, in one buffer per run");
+  auto mixed = read_shared(l, 2, 6);
+  REQUIRE(mixed.size() == 3);
+  REQUIRE(*mixed[0] == l.read_framed_entries(2, 4));
+  REQUIRE(mixed[1] == first[0]);
+  REQUIRE(l.get_cache_hits() == 10);
+  REQUIRE(l.get_cache_misses() == 3);
+
+  INFO("Truncated entries are not served from the cache");
+  l.truncate(6);
+  const std::vector<uint8_t> e = {9, 9};
+  l.write_entry(e.data(), e.size());
+  auto after = read_shared(l, 7, 7);
+  REQUIRE(after.size() == 1);
+  REQUIRE(*after[0] == l.read_framed_entries(7, 7));
+  REQUIRE(l.read_entry(7) == e);
+
+  REQUIRE(!l.read_shared_entries(8, 8, [](asynchost::SharedEntry) {}));
+}
+
+TEST_CASE("Snapshots")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string dir = "testlog_snapshot";
+  const std::vector<uint8_t> s1 = {1, 2, 3, 4};
+  const std::vector<uint8_t> s2 = {5, 6, 7};
+  const std::vector<uint8_t> e = {9, 9};
+  {
+    asynchost::Ledger l(dir, wf);
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+
+    for (uint8_t i = 1; i <= 3; ++i)
+    {
+      std::vector<uint8_t> entry = {i, i};
+      l.write_entry(entry.data(), entry.size());
+    }
+
+    INFO("A snapshot of entries in the ledger is stored next to them");
+    l.write_snapshot(2, s1.data(), s1.size());
+    REQUIRE(l.get_snapshot_idx() == 2);
+    REQUIRE(l.read_snapshot(2) == s1);
+    REQUIRE(l.read_snapshot(1).empty());
+    REQUIRE(l.get_last_idx() == 3);
+    REQUIRE(l.read_entry(1) == std::vector<uint8_t>{1, 1});
+    REQUIRE(l.read_snapshot(2, 1, 2) == std::vector<uint8_t>{2, 3});
+    REQUIRE(l.read_snapshot(2, 3, 2) == std::vector<uint8_t>{4});
+
+    INFO("A snapshot written in chunks is only stored once complete");
+    l.write_snapshot_chunk(5, s2.size(), 0, s2.data(), 2);
+    REQUIRE(l.get_snapshot_idx() == 2);
+    REQUIRE(l.get_last_idx() == 3);
+    REQUIRE_THROWS(l.write_snapshot_chunk(5, s2.size(), 1, s2.data() + 1, 2));
+
+    INFO("A snapshot past the end of the ledger replaces the ledger");
+    l.write_snapshot_chunk(5, s2.size(), 0, s2.data(), 2);
+    l.write_snapshot_chunk(5, s2.size(), 2, s2.data() + 2, 1);
+    REQUIRE(l.get_snapshot_idx() == 5);
+    REQUIRE(l.read_snapshot(2).empty());
+    REQUIRE(l.read_snapshot(5) == s2);
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.get_files_count() == 0);
+    REQUIRE(l.framed_entries_size(1, 5) == 0);
+    REQUIRE(l.range_end(1, 5, 1024) == 0);
+
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_last_idx() == 6);
+    REQUIRE(l.read_entry(6) == e);
+    REQUIRE(!l.read_framed_entries(5, 6, [](const uint8_t*, size_t) {}));
+  }
+
+  INFO("The ledger still continues from the snapshot once loaded again");
+  asynchost::Ledger l(dir, wf);
+  REQUIRE(l.get_snapshot_idx() == 5);
+  REQUIRE(l.read_snapshot(5) == s2);
+  REQUIRE(l.get_last_idx() == 6);
+  REQUIRE(l.read_entry(6) == e);
+  REQUIRE(l.range_end(1, 6, 1024) == 0);
+  REQUIRE(l.range_end(6, 6, 1024) == 6);
+}
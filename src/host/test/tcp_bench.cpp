@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "../tcp.h"
+
+#include <picobench/picobench.hpp>
+
+using namespace asynchost;
+
+static constexpr auto bench_host = "127.0.0.1";
+static constexpr auto bench_service = "48721";
+
+// Counts the bytes and reads received by the server end of the connection
+struct Received
+{
+  size_t bytes = 0;
+  size_t reads = 0;
+  std::optional<TCP> peer;
+};
+
+class CountingBehaviour : public TCPBehaviour
+{
+  Received& received;
+
+public:
+  CountingBehaviour(Received& received) : received(received) {}
+
+  void on_read(size_t len, uint8_t*&) override
+  {
+    received.bytes += len;
+    ++received.reads;
+  }
+};
+
+class AcceptingBehaviour : public TCPBehaviour
+{
+  Received& received;
+
+public:
+  AcceptingBehaviour(Received& received) : received(received) {}
+
+  void on_accept(TCP& peer) override
+  {
+    peer->set_behaviour(std::make_unique<CountingBehaviour>(received));
+    received.peer.emplace(peer);
+  }
+};
+
+class ConnectedBehaviour : public TCPBehaviour
+{
+  bool& connected;
+
+public:
+  ConnectedBehaviour(bool& connected) : connected(connected) {}
+
+  void on_connect() override
+  {
+    connected = true;
+  }
+};
+
+// Sends messages from a client to a server over loopback, either copying
+// each one or sharing a single buffer between all of them
+template <size_t MsgSize, bool Shared>
+static void loopback(picobench::state& s)
+{
+  Received received;
+  bool connected = false;
+
+  {
+    TCP listener;
+    listener->set_behaviour(std::make_unique<AcceptingBehaviour>(received));
+    listener->listen(bench_host, bench_service);
+
+    TCP client;
+    client->set_behaviour(std::make_unique<ConnectedBehaviour>(connected));
+    client->connect(bench_host, bench_service);
+
+    while (!connected || !received.peer.has_value())
+      uv_run(uv_default_loop(), UV_RUN_ONCE);
+
+    auto msg = std::make_shared<std::vector<uint8_t>>(MsgSize, 42);
+    const size_t expected = MsgSize * s.iterations();
+
+    s.start_timer();
+    for (auto _ : s)
+    {
+      (void)_;
+      if constexpr (Shared)
+        client->write(msg);
+      else
+        client->write(msg->size(), msg->data());
+    }
+
+    while (received.bytes < expected)
+      uv_run(uv_default_loop(), UV_RUN_ONCE);
+    s.stop_timer();
+
+    received.peer.reset();
+  }
+
+  // Let libuv finish closing the handles
+  uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+}
+
+const std::vector<int> msg_counts = {16, 64};
+
+PICOBENCH_SUITE("loopback 1k messages");
+auto copy_1k = loopback<1024, false>;
+PICOBENCH(copy_1k).iterations(msg_counts).samples(10).baseline();
+auto shared_1k = loopback<1024, true>;
+PICOBENCH(shared_1k).iterations(msg_counts).samples(10);
+
+PICOBENCH_SUITE("loopback 1M messages");
+auto copy_1m = loopback<1024 * 1024, false>;
+PICOBENCH(copy_1m).iterations(msg_counts).samples(10).baseline();
+auto shared_1m = loopback<1024 * 1024, true>;
+PICOBENCH(shared_1m).iterations(msg_counts).samples(10);
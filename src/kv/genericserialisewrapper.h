@@ -57,6 +57,9 @@ namespace kv
   template <typename W>
   class GenericSerialiseWrapper
   {
+  public:
+    using Writer = W;
+
   private:
     W public_writer;
     W private_writer;
@@ -166,10 +169,25 @@ namespace kv
     template <class K, class V, class Version>
     void serialise_write_version(const K& k, const V& v, const Version& version)
     {
-      serialise_internal(KvOperationType::KOT_WRITE_VERSION);
-      serialise_internal(k);
-      serialise_internal(v);
-      serialise_internal(version);
+      serialise_write_version(*current_writer, k, v, version);
+    }
+
+    /// Writes an entry as above, but to a separate writer, whose raw data can
+    /// then be appended by serialise_raw_entries() to any number of
+    /// serialisers (or none)
+    template <class K, class V, class Version>
+    static void serialise_write_version(
+      W& writer, const K& k, const V& v, const Version& version)
+    {
+      writer.append(KvOperationType::KOT_WRITE_VERSION);
+      writer.append(k);
+      writer.append(v);
+      writer.append(version);
+    }
+
+    void serialise_raw_entries(const std::vector<uint8_t>& entries)
+    {
+      current_writer->append_raw_data(entries);
     }
 
     template <class K>
@@ -4,9 +4,12 @@
 
 #include "../ds/champmap.h"
 #include "../ds/logger.h"
+#include "../ds/serialized.h"
 #include "../ds/spinlock.h"
 #include "kvtypes.h"
 
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -102,6 +105,13 @@ namespace kv
     SpinLock sl;
     const SecurityDomain security_domain;
 
+    // Serialised entries of the subtrees written by the previous snapshot,
+    // which are appended as they are when still in the next one. The store
+    // serialises one snapshot at a time.
+    using Chunk = std::shared_ptr<const std::vector<uint8_t>>;
+    using Chunks = champ::Serialiser<K, VersionV, H, Chunk>;
+    std::shared_ptr<Chunks> chunks = std::make_shared<Chunks>();
+
     Map(
       Store<S, D>* store_,
       std::string name_,
@@ -364,6 +374,40 @@ namespace kv
         return found.value;
       }
 
+      /** Get the version at which the value for key was written
+       *
+       * Like get(), this records a dependency on the value of the key. A
+       * version is only reused if it is rolled back.
+       *
+       * @param key Key
+       *
+       * @return optional containing the version, empty if the key doesn't
+       * exist or has been written in this transaction
+       */
+      std::optional<Version> get_version(const K& key)
+      {
+        if (commit_version != NoVersion)
+          return {};
+
+        if (writes.find(key) != writes.end())
+          return {};
+
+        auto search = state.get(key);
+        if (!search.has_value())
+        {
+          reads.insert(std::make_pair(key, NoVersion));
+          return {};
+        }
+
+        auto& found = search.value();
+        reads.insert(std::make_pair(key, found.version));
+
+        if (deleted(found.version))
+          return {};
+
+        return found.version;
+      }
+
       /** Write value at key
        *
        * If the key already exists, the value will be replaced.
@@ -549,7 +593,7 @@ namespace kv
 
         if (!writes.empty())
         {
-          auto state = map.roll->back().state;
+          auto state = map.roll->back().state.transient();
 
           for (auto it = writes.begin(); it != writes.end(); ++it)
           {
@@ -557,7 +601,7 @@ namespace kv
             {
               // Write the new value with the global version.
               changes = true;
-              state = state.put(it->first, VersionV{v, it->second.value});
+              state.put(it->first, VersionV{v, it->second.value});
             }
             else
             {
@@ -567,13 +611,13 @@ namespace kv
               if (search.has_value())
               {
                 changes = true;
-                state = state.put(it->first, VersionV{-v, V()});
+                state.put(it->first, VersionV{-v, V()});
               }
             }
           }
 
           if (changes)
-            map.roll->push_back({v, state, writes});
+            map.roll->push_back({v, state.persistent(), writes});
         }
       }
 
@@ -819,6 +863,163 @@ namespace kv
       std::swap(rollback_counter, map->rollback_counter);
       std::swap(roll, map->roll);
     }
+
+    // A committed state is never modified, so once captured it can be
+    // serialised without holding the map's lock
+    class Snapshot : public AbstractMapSnapshot<S>
+    {
+    private:
+      std::shared_ptr<Chunks> chunks;
+      bool started = false;
+      typename S::Writer chunk;
+
+      // Called back by chunks->step() as it walks the state
+      struct ChunkWriter
+      {
+        S& s;
+        typename S::Writer& chunk;
+
+        void begin_chunk()
+        {
+          chunk.clear();
+        }
+
+        void entry(const K& k, const VersionV& v)
+        {
+          S::serialise_write_version(chunk, k, v.value, v.version);
+        }
+
+        Chunk end_chunk()
+        {
+          auto c = std::make_shared<const std::vector<uint8_t>>(
+            chunk.get_raw_data());
+          s.serialise_raw_entries(*c);
+          return c;
+        }
+
+        void reuse_chunk(const Chunk& c)
+        {
+          s.serialise_raw_entries(*c);
+        }
+      };
+
+    public:
+      const std::string name;
+      const SecurityDomain security_domain;
+      const State state;
+
+      Snapshot(
+        const std::string& name_,
+        SecurityDomain security_domain_,
+        const State& state_,
+        std::shared_ptr<Chunks> chunks_ = std::make_shared<Chunks>()) :
+        chunks(chunks_),
+        name(name_),
+        security_domain(security_domain_),
+        state(state_)
+      {}
+
+      void serialise(S& s) override
+      {
+        // Removed keys are included, so that the restored state is exactly
+        // the same as this one
+        s.start_map(name, security_domain);
+        s.serialise_count_header(state.size());
+        state.foreach([&s](const K& k, const VersionV& v) {
+          s.serialise_write_version(k, v.value, v.version);
+          return true;
+        });
+      }
+
+      bool serialise_step(S& s, size_t max_entries) override
+      {
+        // The entries are in a different order from serialise(), which does
+        // not matter when they are deserialised
+        if (!started)
+        {
+          s.start_map(name, security_domain);
+          s.serialise_count_header(state.size());
+          chunks->start(state);
+          started = true;
+        }
+
+        ChunkWriter writer{s, chunk};
+        return chunks->step(max_entries, writer);
+      }
+    };
+
+    std::unique_ptr<AbstractMapSnapshot<S>> snapshot(Version v) override
+    {
+      // Captures the last state committed at or before version v. The Map
+      // expects to be locked while this is found.
+      for (auto it = roll->rbegin(); it != roll->rend(); ++it)
+      {
+        if (it->version <= v)
+          return std::make_unique<Snapshot>(
+            name, security_domain, it->state, chunks);
+      }
+
+      throw std::logic_error(fmt::format(
+        "Cannot snapshot map {} at {}: its state has been compacted", name, v));
+    }
+
+    std::unique_ptr<AbstractMapSnapshot<S>> deserialise_snapshot(
+      D& d) override
+    {
+      auto state = State().transient();
+
+      auto ctr = d.deserialise_write_header();
+      for (size_t i = 0; i < ctr; ++i)
+      {
+        auto w = d.template deserialise_write_version<K, V, Version>();
+        if (!w.has_value())
+          return nullptr;
+
+        state.put(w->key, VersionV{w->version, w->value});
+      }
+
+      return std::make_unique<Snapshot>(
+        name, security_domain, state.persistent());
+    }
+
+    void apply_snapshot(AbstractMapSnapshot<S>* snapshot, Version v) override
+    {
+      // This replaces the whole state with a snapshot taken at version v, or
+      // with an empty state if there is no snapshot of this map. Transactions
+      // which started before cannot commit. The Map expects to be locked
+      // while a snapshot is applied.
+      State state;
+      if (snapshot != nullptr)
+      {
+        auto s = dynamic_cast<Snapshot*>(snapshot);
+        if (s == nullptr)
+          throw std::logic_error(
+            "Attempted to apply a snapshot of an incompatible map");
+
+        state = s->state;
+      }
+
+      // Hooks see every key in the snapshot as having been written at v
+      Write writes;
+      if (local_hook || global_hook)
+      {
+        state.foreach([&writes](const K& k, const VersionV& v) {
+          if (!deleted(v.version))
+            writes.emplace(k, v);
+          return true;
+        });
+      }
+
+      roll->clear();
+      roll->push_back({v, state, std::move(writes)});
+      rollback_counter++;
+
+      if (local_hook)
+      {
+        auto& r = roll->back();
+        local_hook(r.version, r.state, r.writes);
+      }
+    }
   };
 
   template <class S, class D>
@@ -984,7 +1185,15 @@ namespace kv
       }
 
       auto store = view_list.begin()->second.map->get_store();
-      auto c = commit(view_list, [store]() { return store->next_version(); });
+      // Read together with the version, so that the transaction is not
+      // published at a version which a rollback has since handed out again
+      Version rollback_count = 0;
+      auto c = commit(view_list, [store, &rollback_count]() {
+        Version version;
+        std::tie(version, rollback_count) =
+          store->next_version_and_rollback_count();
+        return version;
+      });
       success = c.has_value();
 
       if (!success)
@@ -1006,14 +1215,18 @@ namespace kv
         return CommitSuccess::OK;
       }
 
-      return store->commit(
+      auto result = store->commit(
         version,
         [data = std::move(data), req_id = std::move(req_id)]()
           -> std::
             tuple<CommitSuccess, TxHistory::RequestID, std::vector<uint8_t>> {
               return {CommitSuccess::OK, std::move(req_id), std::move(data)};
             },
-        false);
+        false,
+        rollback_count);
+      if (result == CommitSuccess::CONFLICT)
+        success = false;
+      return result;
     }
 
     /** Commit version if committed
@@ -1192,16 +1405,201 @@ namespace kv
     std::shared_ptr<Replicator> replicator = nullptr;
     std::shared_ptr<TxHistory> history = nullptr;
     std::shared_ptr<AbstractTxEncryptor> encryptor = nullptr;
-    Version version = 0;
+    // Used to decrypt and parse the transactions in a batch concurrently.
+    // When this is not set, they are parsed one at a time.
+    TaskRunner task_runner = nullptr;
+    // Used by the history to sign off the committing thread. When this is
+    // not set, the history signs on the committing thread.
+    BackgroundRunner background_runner = nullptr;
+    // Tasks passed to run_in_background(), which are run by whichever comes
+    // first: the background runner, or a committer waiting for a slot in
+    // pending_txs, which may be waiting for one of these tasks to commit
+    SpinLock background_lock;
+    std::deque<std::function<void()>> background_tasks;
+    // Versions are handed out without taking version_lock, so that
+    // transactions touching disjoint maps can commit concurrently.
+    std::atomic<Version> version{0};
     Version compacted = 0;
 
     SpinLock maps_lock;
     SpinLock version_lock;
 
-    std::unordered_map<Version, std::pair<PendingTx, bool>> pending_txs;
+    // Only one thread at a time drains pending_txs into the replicator.
+    // Committers that find it held leave their transaction to the holder.
+    SpinLock replicate_lock;
+
+    // Transactions that have been assigned a version but not yet replicated
+    // are parked in a ring, in the slot given by their version. A slot is
+    // free (NoVersion), claimed by a committer that is filling it in
+    // (ClaimedVersion), or holds a transaction ready for replication. A
+    // committer only claims a slot once every version max_pending_txs below
+    // its own has been drained, so a slot is never taken by a later version
+    // while an earlier one is still waiting for it.
+    static constexpr Version ClaimedVersion = NoVersion + 1;
+    static constexpr size_t max_pending_txs = 4096;
+
+    struct PendingSlot
+    {
+      std::atomic<Version> version{NoVersion};
+      PendingTx pending_tx;
+      bool globally_committable = false;
+    };
+    std::vector<PendingSlot> pending_txs =
+      std::vector<PendingSlot>(max_pending_txs);
+
+    // last_drained is the last version moved out of pending_txs, and only
+    // differs from last_replicated while a batch is being replicated, or
+    // after the replicator has refused one.
+    std::atomic<Version> last_drained{0};
     Version last_replicated = 0;
     Version last_committable = 0;
-    Version rollback_count = 0;
+    // Only changed with version_lock held, but read without it by committers
+    // waiting for a slot
+    std::atomic<Version> rollback_count{0};
+
+    PendingSlot& pending_slot(Version v)
+    {
+      return pending_txs[static_cast<size_t>(v) % max_pending_txs];
+    }
+
+    // Must be called with version_lock held
+    void reset_pending_txs(Version v)
+    {
+      for (auto& slot : pending_txs)
+      {
+        auto sv = slot.version.load();
+        if (sv != NoVersion && sv != ClaimedVersion)
+        {
+          slot.pending_tx = nullptr;
+          slot.version.store(NoVersion);
+        }
+      }
+      last_drained = v;
+      last_replicated = v;
+    }
+
+    bool run_background_task()
+    {
+      std::function<void()> task;
+      {
+        std::lock_guard<SpinLock> guard(background_lock);
+        if (background_tasks.empty())
+          return false;
+
+        task = std::move(background_tasks.front());
+        background_tasks.pop_front();
+      }
+      task();
+      return true;
+    }
+
+    void run_background_tasks()
+    {
+      while (run_background_task())
+      {
+      }
+    }
+
+    bool pending_tx_ready()
+    {
+      const auto next = last_drained.load() + 1;
+      return pending_slot(next).version.load() == next;
+    }
+
+    // Moves the contiguous run of ready transactions following last_drained
+    // out of the ring, and hands them to the replicator. Must be called with
+    // replicate_lock held, so that batches reach the replicator in version
+    // order. version_lock is only held while the ring is inspected, not while
+    // transactions are serialised or replicated.
+    bool replicate_pending_txs(const std::shared_ptr<Replicator>& r)
+    {
+      std::vector<std::pair<PendingTx, bool>> ready;
+      Version first = 0;
+      Version previous_rollback_count = 0;
+      bool contiguous = false;
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        first = last_drained.load() + 1;
+        contiguous = last_replicated + 1 == first;
+        previous_rollback_count = rollback_count;
+
+        for (auto v = first; true; ++v)
+        {
+          auto& slot = pending_slot(v);
+          if (slot.version.load(std::memory_order_acquire) != v)
+            break;
+
+          ready.emplace_back(
+            std::move(slot.pending_tx), slot.globally_committable);
+          slot.pending_tx = nullptr;
+          slot.version.store(NoVersion, std::memory_order_release);
+        }
+
+        last_drained = first + ready.size() - 1;
+      }
+
+      if (ready.empty())
+        return true;
+
+      // A previous batch was not replicated. Nothing after it can be either,
+      // until the store is rolled back.
+      if (!contiguous)
+      {
+        LOG_DEBUG_FMT(
+          "Dropping {} Txs after replication failure", ready.size());
+        return false;
+      }
+
+      auto h = get_history();
+      std::vector<std::tuple<Version, std::vector<uint8_t>, bool>> batch;
+      batch.reserve(ready.size());
+
+      // Results point into batch, which is never reallocated. They are added
+      // to the history together, except that a signature must sign the root
+      // of every transaction before it.
+      std::vector<TxHistory::Result> results;
+      auto add_results = [&h, &results]() {
+        if (h && !results.empty())
+          h->add_results(results);
+        results.clear();
+      };
+
+      auto v = first;
+      for (auto& [pending_tx, committable] : ready)
+      {
+        if (committable)
+          add_results();
+
+        auto [success_, reqid, data_] = pending_tx();
+
+        // NB: this cannot happen currently. Regular Tx only make it here if
+        // they did succeed, and signatures cannot conflict because they
+        // execute in order with a read_version that's version - 1, so even
+        // two contiguous signatures are fine
+        if (success_ != CommitSuccess::OK)
+          LOG_DEBUG_FMT("Failed Tx commit {}", v);
+
+        LOG_DEBUG_FMT("Batching {} ({})", v, data_.size());
+        const auto& entry =
+          batch.emplace_back(v++, std::move(data_), committable);
+        results.push_back({reqid, std::get<0>(entry), &std::get<1>(entry)});
+      }
+      add_results();
+
+      if (!r->replicate(batch))
+      {
+        LOG_DEBUG_FMT("Failed to replicate");
+        return false;
+      }
+
+      std::lock_guard<SpinLock> vguard(version_lock);
+      if (
+        last_replicated + 1 == first &&
+        previous_rollback_count == rollback_count)
+        last_replicated = v - 1;
+      return true;
+    }
 
     template <typename SP, typename DP>
     inline std::map<kv::SecurityDomain, std::vector<AbstractMap<SP, DP>*>>
@@ -1270,6 +1668,37 @@ namespace kv
       return encryptor;
     }
 
+    void set_task_runner(TaskRunner task_runner_)
+    {
+      task_runner = task_runner_;
+    }
+
+    TaskRunner get_task_runner()
+    {
+      return task_runner;
+    }
+
+    void set_background_runner(BackgroundRunner background_runner_)
+    {
+      background_runner = background_runner_;
+    }
+
+    /// Runs task on the background runner, or immediately if there is none
+    void run_in_background(std::function<void()>&& task)
+    {
+      if (!background_runner)
+      {
+        task();
+        return;
+      }
+
+      {
+        std::lock_guard<SpinLock> guard(background_lock);
+        background_tasks.push_back(std::move(task));
+      }
+      background_runner([this]() { run_background_tasks(); });
+    }
+
     template <class K, class V, class H = std::hash<K>>
     Map<K, V, H>* get(std::string name)
     {
@@ -1406,10 +1835,9 @@ namespace kv
 
       std::lock_guard<SpinLock> vguard(version_lock);
       version = v;
-      last_replicated = v;
       last_committable = v;
       rollback_count++;
-      pending_txs.clear();
+      reset_pending_txs(v);
       auto h = get_history();
       if (h)
         h->rollback(v);
@@ -1425,6 +1853,369 @@ namespace kv
       // Processing transactions locally and also deserialising to the
       // same store will result in a store version mismatch and
       // deserialisation will then fail.
+      auto tx = parse(data, public_only);
+      if (tx == nullptr)
+        return DeserialiseSuccess::FAILED;
+
+      return apply(*tx, data, public_only, term);
+    }
+
+    /** Deserialise a batch of consecutive transactions.
+     *
+     * The transactions are decrypted and parsed first, concurrently if a task
+     * runner has been set, and are then applied in order. f is called with the
+     * result of applying each transaction, and the signature term it
+     * contained, until one fails.
+     */
+    template <typename F>
+    void deserialise_batch(
+      const std::vector<std::vector<uint8_t>>& entries,
+      bool public_only,
+      F&& f)
+    {
+      std::vector<std::unique_ptr<DeserialisedTx>> txs(entries.size());
+
+      if (task_runner && entries.size() > 1)
+      {
+        std::vector<std::function<void()>> tasks;
+        tasks.reserve(entries.size());
+
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+          tasks.emplace_back([this, &txs, &entries, i, public_only]() {
+            // A malformed transaction is parsed again when it is applied,
+            // so that the error is reported in order
+            try
+            {
+              txs[i] = parse(entries[i], public_only);
+            }
+            catch (const std::exception& e)
+            {
+              LOG_DEBUG_FMT("Failed to parse transaction: {}", e.what());
+            }
+          });
+        }
+
+        task_runner(std::move(tasks));
+      }
+
+      for (size_t i = 0; i < entries.size(); ++i)
+      {
+        Term term = 0;
+        auto success = txs[i] != nullptr ?
+          apply(*txs[i], entries[i], public_only, &term) :
+          deserialise(entries[i], public_only, &term);
+
+        // Views hold references to their maps' state, so release them as soon
+        // as they have been applied
+        txs[i].reset();
+
+        f(success, term);
+
+        if (success == DeserialiseSuccess::FAILED)
+          return;
+      }
+    }
+
+  private:
+    // The state of every map and the history at a committed version, which
+    // is serialised without holding any lock, a map at a time
+    struct CapturedSnapshot
+    {
+      Version version;
+      std::vector<std::unique_ptr<AbstractMapSnapshot<S>>> maps;
+      std::vector<uint8_t> tree;
+
+      std::unique_ptr<S> s;
+      size_t next_map = 0;
+    };
+
+    // Set while a snapshot is being serialised, since the snapshots of a map
+    // share the chunks serialised by the previous one
+    std::atomic<bool> snapshotting{false};
+
+    // Entries serialised by each background task, so that other tasks, and
+    // committers waiting for one, are not held up by a large snapshot
+    static constexpr size_t snapshot_step_entries = 10000;
+
+    std::shared_ptr<CapturedSnapshot> capture_snapshot(Version v)
+    {
+      if (snapshotting.exchange(true))
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot at {}: another snapshot is in progress", v));
+
+      auto c = std::make_shared<CapturedSnapshot>();
+      c->version = v;
+
+      try
+      {
+        // Compaction cannot proceed past v while maps_lock is held
+        std::lock_guard<SpinLock> mguard(maps_lock);
+
+        if (v > commit_version())
+          throw std::logic_error(fmt::format(
+            "Cannot snapshot at {}: only committed up to {}",
+            v,
+            commit_version()));
+
+        for (auto& map : maps)
+        {
+          map.second->lock();
+          c->maps.push_back(map.second->snapshot(v));
+          map.second->unlock();
+        }
+
+        auto h = get_history();
+        if (h)
+          c->tree = h->serialise_tree(v);
+      }
+      catch (...)
+      {
+        snapshotting = false;
+        throw;
+      }
+
+      return c;
+    }
+
+    // Returns true while any entries are left to serialise
+    bool serialise_snapshot_step(CapturedSnapshot& c, size_t max_entries)
+    {
+      if (c.s == nullptr)
+        c.s = std::make_unique<S>(get_encryptor(), c.version);
+
+      while (c.next_map < c.maps.size())
+      {
+        if (c.maps[c.next_map]->serialise_step(*c.s, max_entries))
+          return true;
+
+        c.next_map++;
+      }
+
+      return false;
+    }
+
+    std::vector<uint8_t> finish_snapshot(CapturedSnapshot& c)
+    {
+      auto state = c.s->get_raw_data();
+
+      // Format: size of history, history, serialised state
+      std::vector<uint8_t> data(
+        sizeof(uint64_t) + c.tree.size() + state.size());
+      auto p = data.data();
+      auto size = data.size();
+      serialized::write(p, size, (uint64_t)c.tree.size());
+      serialized::write(p, size, c.tree.data(), c.tree.size());
+      serialized::write(p, size, state.data(), state.size());
+
+      LOG_DEBUG_FMT(
+        "Snapshot at {}: {} maps, {} bytes",
+        c.version,
+        c.maps.size(),
+        data.size());
+      return data;
+    }
+
+    void serialise_snapshot_in_background(
+      std::shared_ptr<CapturedSnapshot> c,
+      std::function<void(std::vector<uint8_t>&&)> done)
+    {
+      run_in_background([this, c, done]() {
+        std::vector<uint8_t> data;
+        try
+        {
+          while (serialise_snapshot_step(*c, snapshot_step_entries))
+          {
+            // The rest is queued behind any other background task
+            if (background_runner)
+            {
+              serialise_snapshot_in_background(c, done);
+              return;
+            }
+          }
+          data = finish_snapshot(*c);
+        }
+        catch (const std::exception& e)
+        {
+          LOG_FAIL_FMT(
+            "Failed to serialise snapshot at {}: {}", c->version, e.what());
+        }
+
+        snapshotting = false;
+        done(std::move(data));
+      });
+    }
+
+  public:
+    /** Serialise the state of every map at version v, which must have been
+     * globally committed.
+     *
+     * The maps are only locked while the state of each at v is captured.
+     * Committed states are never modified, so they are serialised afterwards
+     * without blocking transactions. Each map reuses the serialised entries
+     * of the parts of its state unchanged since its previous snapshot, so
+     * only one snapshot can be serialised at a time. The history at v is
+     * included, so that a store restored from the snapshot can verify later
+     * signatures.
+     */
+    std::vector<uint8_t> snapshot(Version v)
+    {
+      auto c = capture_snapshot(v);
+
+      std::vector<uint8_t> data;
+      try
+      {
+        serialise_snapshot_step(*c, std::numeric_limits<size_t>::max());
+        data = finish_snapshot(*c);
+      }
+      catch (...)
+      {
+        snapshotting = false;
+        throw;
+      }
+
+      snapshotting = false;
+      return data;
+    }
+
+    /** Serialise the state of every map at version v, as above, off the
+     * calling thread.
+     *
+     * The state at v is captured before this returns, and throws if it
+     * cannot be. It is then serialised by tasks passed to
+     * run_in_background(), a bounded number of entries each, the last of
+     * which calls done with the snapshot, or with no data if serialising it
+     * failed.
+     */
+    void snapshot(
+      Version v, std::function<void(std::vector<uint8_t>&&)> done)
+    {
+      serialise_snapshot_in_background(capture_snapshot(v), std::move(done));
+    }
+
+    /** Replace the state of the store with a snapshot.
+     *
+     * Afterwards, the store is at the snapshot's version and has compacted
+     * up to it, so that it can carry on deserialising the transactions that
+     * follow. Commit hooks are called with everything in the snapshot. Maps
+     * missing from the snapshot are emptied, except for private maps when
+     * only the public domain is deserialised, which are left untouched.
+     */
+    DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      auto p = data.data();
+      auto size = data.size();
+      auto tree_size = serialized::read<uint64_t>(p, size);
+      auto tree = serialized::read(p, size, tree_size);
+      const std::vector<uint8_t> state(p, p + size);
+
+      D d(
+        get_encryptor(),
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+      if (!d.init(state))
+      {
+        LOG_FAIL_FMT("Initialisation of snapshot deserialise object failed");
+        return DeserialiseSuccess::FAILED;
+      }
+
+      const Version v = d.template deserialise_version<Version>();
+      LOG_DEBUG_FMT("Deserialising snapshot at {}", v);
+
+      // The snapshot is parsed before anything is modified
+      std::map<std::string, std::unique_ptr<AbstractMapSnapshot<S>>> snapshots;
+      for (auto r = d.start_map(); r.has_value(); r = d.start_map())
+      {
+        const auto map_name = r.value();
+
+        AbstractMap<S, D>* map = nullptr;
+        {
+          std::lock_guard<SpinLock> mguard(maps_lock);
+          auto search = maps.find(map_name);
+          if (search != maps.end())
+            map = search->second.get();
+        }
+
+        if (map == nullptr)
+        {
+          LOG_FAIL_FMT("No such map {} in snapshot at {}", map_name, v);
+          return DeserialiseSuccess::FAILED;
+        }
+
+        auto snapshot = map->deserialise_snapshot(d);
+        if (snapshot == nullptr || snapshots.count(map_name) != 0)
+        {
+          LOG_FAIL_FMT(
+            "Could not deserialise map {} in snapshot at {}", map_name, v);
+          return DeserialiseSuccess::FAILED;
+        }
+
+        snapshots[map_name] = std::move(snapshot);
+      }
+
+      if (!d.end())
+      {
+        LOG_FAIL_FMT("Unexpected content in snapshot at {}", v);
+        return DeserialiseSuccess::FAILED;
+      }
+
+      auto h = get_history();
+      if (h && !h->deserialise_tree(tree))
+      {
+        LOG_FAIL_FMT("Could not deserialise history in snapshot at {}", v);
+        return DeserialiseSuccess::FAILED;
+      }
+
+      {
+        std::lock_guard<SpinLock> mguard(maps_lock);
+
+        for (auto& map : maps)
+          map.second->lock();
+
+        for (auto& [name, map] : maps)
+        {
+          auto search = snapshots.find(name);
+          if (search != snapshots.end())
+            map->apply_snapshot(search->second.get(), v);
+          else if (
+            !public_only ||
+            map->get_security_domain() == SecurityDomain::PUBLIC)
+            map->apply_snapshot(nullptr, v);
+        }
+
+        for (auto& map : maps)
+          map.second->unlock();
+
+        std::lock_guard<SpinLock> vguard(version_lock);
+        version = v;
+        last_committable = v;
+        rollback_count++;
+        reset_pending_txs(v);
+      }
+
+      // Run the global hooks, since everything in the snapshot is committed
+      compact(v);
+
+      return DeserialiseSuccess::PASS;
+    }
+
+  private:
+    // A transaction which has been decrypted and parsed, but not yet applied
+    struct DeserialisedTx
+    {
+      Version version;
+      OrderedViews<S, D> views;
+
+      // Views created before a rollback cannot be committed after it
+      Version rollback_count;
+    };
+
+    // This does not modify the store, so may be called concurrently for
+    // different transactions
+    std::unique_ptr<DeserialisedTx> parse(
+      const std::vector<uint8_t>& data, bool public_only)
+    {
       auto e = get_encryptor();
       D d(
         e,
@@ -1433,69 +2224,111 @@ namespace kv
       if (!d.init(data))
       {
         LOG_FAIL_FMT("Initialisation of deserialise object failed");
-        return DeserialiseSuccess::FAILED;
+        return nullptr;
       }
 
-      Version v = d.template deserialise_version<Version>();
+      auto tx = std::make_unique<DeserialisedTx>();
+      const Version v = d.template deserialise_version<Version>();
+      tx->version = v;
       LOG_DEBUG_FMT("Deserialising {}", v);
 
-      // Throw away any local commits that have not propagated via the
-      // replicator.
-      rollback(v - 1);
-
-      // Make sure this is the next transaction.
-      auto cv = current_version();
-      if (cv != (v - 1))
       {
-        LOG_FAIL_FMT(
-          "Tried to deserialise {} but current_version is {}", v, cv);
-        return DeserialiseSuccess::FAILED;
+        std::lock_guard<SpinLock> vguard(version_lock);
+        tx->rollback_count = rollback_count;
       }
 
       // Deserialised transactions express read dependencies as versions,
       // rather than with the actual value read. As a result, they don't
       // need snapshot isolation on the map state, and so do not need to
       // lock all the maps before creating the transaction.
-      OrderedViews<S, D> views;
-      std::unordered_set<std::string> present;
-      std::lock_guard<SpinLock> mguard(maps_lock);
+      auto& views = tx->views;
 
       for (auto r = d.start_map(); r.has_value(); r = d.start_map())
       {
         const auto map_name = r.value();
 
-        auto search = maps.find(map_name);
-        if (search == maps.end())
+        // Only the lookup needs maps_lock, so that other transactions can be
+        // parsed at the same time
+        AbstractMap<S, D>* map = nullptr;
+        {
+          std::lock_guard<SpinLock> mguard(maps_lock);
+          auto search = maps.find(map_name);
+          if (search != maps.end())
+            map = search->second.get();
+        }
+
+        if (map == nullptr)
         {
           LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
+          return nullptr;
         }
 
         auto view_search = views.find(map_name);
         if (view_search != views.end())
         {
           LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
+          return nullptr;
         }
 
-        auto view = search->second->create_view(v);
+        auto view = map->create_view(v);
+        views[map_name] = {map, std::unique_ptr<AbstractTxView<S, D>>(view)};
+
         if (!view->deserialise(d, v))
         {
           LOG_FAIL_FMT(
             "Could not deserialise Tx for map {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
+          return nullptr;
         }
-
-        views[map_name] = {search->second.get(),
-                           std::unique_ptr<AbstractTxView<S, D>>(view)};
       }
 
       if (!d.end())
       {
         LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+        return nullptr;
+      }
+
+      return tx;
+    }
+
+    DeserialiseSuccess apply(
+      DeserialisedTx& tx,
+      const std::vector<uint8_t>& data,
+      bool public_only,
+      Term* term)
+    {
+      const auto v = tx.version;
+
+      // Throw away any local commits that have not propagated via the
+      // replicator.
+      rollback(v - 1);
+
+      Version current_rollback_count;
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        current_rollback_count = rollback_count;
+      }
+
+      if (tx.rollback_count != current_rollback_count)
+      {
+        auto fresh = parse(data, public_only);
+        if (fresh == nullptr)
+          return DeserialiseSuccess::FAILED;
+
+        tx = std::move(*fresh);
+      }
+
+      // Make sure this is the next transaction.
+      auto cv = current_version();
+      if (cv != (v - 1))
+      {
+        LOG_FAIL_FMT(
+          "Tried to deserialise {} but current_version is {}", v, cv);
         return DeserialiseSuccess::FAILED;
       }
 
+      auto& views = tx.views;
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
       auto c = Tx::commit(views, [v]() { return v; });
       if (!c.has_value())
       {
@@ -1506,6 +2339,7 @@ namespace kv
       {
         std::lock_guard<SpinLock> vguard(version_lock);
         version = v;
+        last_drained = v;
         last_replicated = v;
       }
 
@@ -1539,6 +2373,7 @@ namespace kv
       return success;
     }
 
+  public:
     bool operator==(const Store<S, D>& that) const
     {
       // Only used for debugging, not thread safe.
@@ -1570,9 +2405,7 @@ namespace kv
 
     Version current_version() override
     {
-      // Must lock in case the version is being incremented.
-      std::lock_guard<SpinLock> vguard(version_lock);
-      return version;
+      return version.load();
     }
 
     Version commit_version() override
@@ -1582,8 +2415,37 @@ namespace kv
       return compacted;
     }
 
+    /// Incremented each time the store is rolled back or replaced by a
+    /// snapshot, discarding state that may have been read before
+    Version get_rollback_count()
+    {
+      return rollback_count.load();
+    }
+
+    /// Reserves the next version, as next_version() does, along with the
+    /// rollback count at the time, which can be passed to commit()
+    std::pair<Version, Version> next_version_and_rollback_count() override
+    {
+      std::lock_guard<SpinLock> vguard(version_lock);
+      return {next_version(), rollback_count};
+    }
+
     CommitSuccess commit(
       Version version, PendingTx pending_tx, bool globally_committable) override
+    {
+      return commit(
+        version, std::move(pending_tx), globally_committable, std::nullopt);
+    }
+
+    /// Commits a transaction at a reserved version, unless the store has been
+    /// rolled back since expected_rollback_count was read, in which case the
+    /// version may have been given to another transaction and CONFLICT is
+    /// returned
+    CommitSuccess commit(
+      Version version,
+      PendingTx pending_tx,
+      bool globally_committable,
+      std::optional<Version> expected_rollback_count) override
     {
       auto r = get_replicator();
       if (!r)
@@ -1594,84 +2456,86 @@ namespace kv
         version,
         (globally_committable ? " globally_committable" : ""));
 
-      std::vector<std::tuple<Version, std::vector<uint8_t>, bool>> batch;
-      Version previous_last_replicated = 0;
-      Version next_last_replicated = 0;
-      Version previous_rollback_count = 0;
-
+      // Park the transaction in its slot. If this is more than
+      // max_pending_txs ahead of the last drained version, help drain the
+      // ring until it is not. The ring may be waiting for a background task,
+      // which could be queued behind this thread, so those are run too.
+      auto& slot = pending_slot(version);
+      auto expected = NoVersion;
+      while (
+        version - last_drained.load() > static_cast<Version>(max_pending_txs) ||
+        !slot.version.compare_exchange_weak(expected, ClaimedVersion))
       {
-        std::lock_guard<SpinLock> vguard(version_lock);
-        if (globally_committable && version > last_committable)
-          last_committable = version;
-
-        pending_txs.insert({version, {pending_tx, globally_committable}});
-
-        auto h = get_history();
+        // After a rollback, the ring may never drain up to this version
+        if (
+          expected_rollback_count.has_value() &&
+          expected_rollback_count.value() != rollback_count.load())
+          return CommitSuccess::CONFLICT;
 
-        for (Version offset = 1; true; ++offset)
+        expected = NoVersion;
         {
-          auto search = pending_txs.find(last_replicated + offset);
-          if (search == pending_txs.end())
-            break;
-
-          auto& [pending_tx_, committable_] = search->second;
-          auto [success_, reqid, data_] = pending_tx_();
-
-          // NB: this cannot happen currently. Regular Tx only make it here if
-          // they did succeed, and signatures cannot conflict because they
-          // execute in order with a read_version that's version - 1, so even
-          // two contiguous signatures are fine
-          if (success_ != CommitSuccess::OK)
-            LOG_DEBUG_FMT("Failed Tx commit {}", last_replicated + offset);
-
-          if (h)
-          {
-            h->add_result(reqid, version, data_);
-          }
-
-          LOG_DEBUG_FMT(
-            "Batching {} ({})", last_replicated + offset, data_.size());
-          batch.emplace_back(
-            last_replicated + offset, std::move(data_), committable_);
-          pending_txs.erase(search);
+          std::unique_lock<SpinLock> rguard(replicate_lock, std::try_to_lock);
+          if (rguard.owns_lock())
+            replicate_pending_txs(r);
         }
 
-        if (batch.size() == 0)
-          return CommitSuccess::OK;
-
-        previous_rollback_count = rollback_count;
-        previous_last_replicated = last_replicated;
-        next_last_replicated = last_replicated + batch.size();
+        // Only one at a time, so as to notice as soon as the slot is free
+        run_background_task();
       }
 
-      if (r->replicate(batch))
       {
+        // Checked and published together, so that either the rollback
+        // discards the transaction, or the transaction is not published
         std::lock_guard<SpinLock> vguard(version_lock);
         if (
-          last_replicated == previous_last_replicated &&
-          previous_rollback_count == rollback_count)
-          last_replicated = next_last_replicated;
-        return CommitSuccess::OK;
+          expected_rollback_count.has_value() &&
+          expected_rollback_count.value() != rollback_count)
+        {
+          slot.version.store(NoVersion);
+          return CommitSuccess::CONFLICT;
+        }
+
+        if (globally_committable && version > last_committable)
+          last_committable = version;
+        slot.pending_tx = std::move(pending_tx);
+        slot.globally_committable = globally_committable;
+        slot.version.store(version);
       }
-      else
+
+      // Whichever committer holds replicate_lock drains every ready
+      // transaction, including those published while it was replicating: it
+      // checks the ring again after releasing the lock, so a committer that
+      // fails to take the lock can rely on its transaction being picked up.
+      auto success = CommitSuccess::OK;
+      while (true)
       {
-        std::lock_guard<SpinLock> vguard(version_lock);
-        LOG_DEBUG_FMT("Failed to replicate");
-        return CommitSuccess::NO_REPLICATE;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        {
+          std::unique_lock<SpinLock> rguard(replicate_lock, std::try_to_lock);
+          if (!rguard.owns_lock())
+            return success;
+
+          if (!replicate_pending_txs(r))
+            success = CommitSuccess::NO_REPLICATE;
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!pending_tx_ready())
+          return success;
       }
     }
 
     Version next_version() override
     {
-      std::lock_guard<SpinLock> vguard(version_lock);
-
       // Get the next global version. If we would go negative, wrap to 0.
-      ++version;
-
-      if (version < 0)
-        version = 0;
+      auto current = version.load();
+      Version next;
+      do
+      {
+        next = current == std::numeric_limits<Version>::max() ? 0 : current + 1;
+      } while (!version.compare_exchange_weak(current, next));
 
-      return version;
+      return next;
     }
 
     size_t commit_gap() override
@@ -1694,12 +2558,14 @@ namespace kv
       for (auto& map : maps)
         map.second->unlock();
 
+      std::lock_guard<SpinLock> vguard(version_lock);
       version = 0;
       compacted = 0;
-      last_replicated = 0;
       last_committable = 0;
-      rollback_count = 0;
-      pending_txs.clear();
+      // Not reset, so that transactions given versions before the store was
+      // cleared are not published
+      rollback_count++;
+      reset_pending_txs(0);
     }
 
     /** This is only safe in very restricted circumstances, and is only
@@ -8,6 +8,8 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <optional>
+#include <utility>
 #include <vector>
 
 namespace kv
@@ -87,6 +89,27 @@ namespace kv
       std::vector<uint8_t> response;
     };
 
+    // A serialised transaction to be appended to the history
+    struct Result
+    {
+      RequestID id;
+      Version version;
+      const std::vector<uint8_t>* data;
+    };
+
+    // Proof that the transaction at version was included in the history
+    // signed at signed_version: path leads from its leaf to root, which
+    // node signed
+    struct Receipt
+    {
+      Version version;
+      Version signed_version;
+      crypto::Sha256Hash root;
+      std::vector<crypto::Sha256Hash> path;
+      NodeId node;
+      std::vector<uint8_t> signature;
+    };
+
     using RequestCallbackHandler = std::function<bool(RequestCallbackArgs)>;
     using ResultCallbackHandler = std::function<bool(ResultCallbackArgs)>;
     using ResponseCallbackHandler = std::function<bool(ResponseCallbackArgs)>;
@@ -105,6 +128,9 @@ namespace kv
     virtual void add_result(
       RequestID id, kv::Version version, const std::vector<uint8_t>& data) = 0;
     virtual void add_result(RequestID id, kv::Version version) = 0;
+    // Equivalent to add_result() for each result in turn, which must be in
+    // version order
+    virtual void add_results(const std::vector<Result>& results) = 0;
     virtual void add_response(
       RequestID id, const std::vector<uint8_t>& response) = 0;
     virtual void register_on_request(RequestCallbackHandler func) = 0;
@@ -114,11 +140,28 @@ namespace kv
     virtual void clear_on_result() = 0;
     virtual void clear_on_response() = 0;
     virtual crypto::Sha256Hash get_root() = 0;
+    // Receipt for version from the first signature after it, if that
+    // signature is known and version has not been compacted away
+    virtual std::optional<Receipt> get_receipt(Version version) = 0;
+
+    // Serialise the history as it was at version v, which must not have been
+    // compacted away, so that a store restored from a snapshot at v can carry
+    // on from there
+    virtual std::vector<uint8_t> serialise_tree(Version v) = 0;
+    virtual bool deserialise_tree(const std::vector<uint8_t>& tree) = 0;
   };
 
   using PendingTx = std::function<
     std::tuple<CommitSuccess, TxHistory::RequestID, std::vector<uint8_t>>()>;
 
+  // Runs every task, possibly concurrently, and returns once they have all
+  // finished
+  using TaskRunner =
+    std::function<void(std::vector<std::function<void()>>&& tasks)>;
+
+  // Runs a task on another thread, returning without waiting for it
+  using BackgroundRunner = std::function<void(std::function<void()>&& task)>;
+
   class AbstractTxEncryptor
   {
   public:
@@ -154,12 +197,30 @@ namespace kv
       Term* term = nullptr) = 0;
     virtual void compact(Version v) = 0;
     virtual void rollback(Version v) = 0;
+    virtual std::pair<Version, Version> next_version_and_rollback_count() = 0;
     // TODO (#api): split out?
     virtual CommitSuccess commit(
       Version v, PendingTx pt, bool globally_committable) = 0;
+    virtual CommitSuccess commit(
+      Version v,
+      PendingTx pt,
+      bool globally_committable,
+      std::optional<Version> expected_rollback_count) = 0;
     virtual size_t commit_gap() = 0;
   };
 
+  // The state of a single map at some version, captured for a snapshot
+  template <class S>
+  class AbstractMapSnapshot
+  {
+  public:
+    virtual ~AbstractMapSnapshot() {}
+    virtual void serialise(S& s) = 0;
+    // Serialises the state as serialise() does, at most max_entries at a
+    // time, returning true while any are left
+    virtual bool serialise_step(S& s, size_t max_entries) = 0;
+  };
+
   template <class S, class D>
   class AbstractTxView
   {
@@ -196,5 +257,11 @@ namespace kv
 
     virtual AbstractMap<S, D>* clone(AbstractStore* store) = 0;
     virtual void swap(AbstractMap<S, D>* map) = 0;
+
+    virtual std::unique_ptr<AbstractMapSnapshot<S>> snapshot(Version v) = 0;
+    virtual std::unique_ptr<AbstractMapSnapshot<S>> deserialise_snapshot(
+      D& d) = 0;
+    virtual void apply_snapshot(
+      AbstractMapSnapshot<S>* snapshot, Version v) = 0;
   };
 }
\ No newline at end of file
@@ -40,6 +40,13 @@ namespace kv
       msgpack::pack(sb, std::forward<T>(t));
     }
 
+    // Appends the raw data of another writer, as if what was written to it
+    // had been written to this one
+    void append_raw_data(const std::vector<uint8_t>& data)
+    {
+      sb.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
     void clear()
     {
       sb.clear();
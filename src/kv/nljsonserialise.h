@@ -37,6 +37,14 @@ namespace kv
       arr.push_back(obj);
     }
 
+    // Appends the raw data of another writer, as if what was written to it
+    // had been written to this one
+    void append_raw_data(const std::vector<uint8_t>& data)
+    {
+      for (auto& obj : nlohmann::json::from_msgpack(data))
+        arr.push_back(std::move(obj));
+    }
+
     void clear()
     {
       arr.clear();
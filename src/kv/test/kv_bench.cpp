@@ -8,7 +8,10 @@
 #include "../replicator.h"
 
 #include <picobench/picobench.hpp>
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace ccfapp;
 
@@ -94,7 +97,187 @@ static void deserialise(picobench::state& s)
   s.stop_timer();
 }
 
+// Replays a recorded batch of transactions, as a follower does with each
+// append entries, parsing them on the given number of threads
+template <size_t threads>
+static void deserialise_batch(picobench::state& s)
+{
+  auto replicator = std::make_shared<kv::StubReplicator>();
+  Store kv_store(replicator);
+  Store kv_store2;
+
+  auto secrets = create_network_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+  kv_store2.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& priv_map = kv_store.create<std::string, std::string>(
+    "priv_map", kv::SecurityDomain::PRIVATE);
+  kv_store2.clone_schema(kv_store);
+
+  if (threads > 1)
+  {
+    kv_store2.set_task_runner([](std::vector<std::function<void()>>&& tasks) {
+      std::atomic<size_t> next{0};
+      auto run_some = [&]() {
+        for (auto i = next++; i < tasks.size(); i = next++)
+          tasks[i]();
+      };
+
+      std::vector<std::thread> helpers;
+      for (size_t t = 1; t < threads; ++t)
+        helpers.emplace_back(run_some);
+      run_some();
+      for (auto& h : helpers)
+        h.join();
+    });
+  }
+
+  std::vector<std::vector<uint8_t>> batch;
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(pub_map, priv_map);
+    for (int j = 0; j < 10; j++)
+    {
+      auto key = "key" + std::to_string(i) + "_" + std::to_string(j);
+      pub_view->put(key, std::string(100, 'p'));
+      priv_view->put(key, std::string(1000, 's'));
+    }
+    auto rc = tx.commit();
+    if (rc != kv::CommitSuccess::OK)
+      throw std::logic_error(
+        "Transaction commit failed: " + std::to_string(rc));
+    batch.push_back(replicator->get_latest_data().first);
+  }
+
+  size_t applied = 0;
+  s.start_timer();
+  kv_store2.deserialise_batch(
+    batch, false, [&applied](kv::DeserialiseSuccess rc, kv::Term) {
+      if (rc != kv::DeserialiseSuccess::PASS)
+        throw std::logic_error(
+          "Transaction deserialisation failed: " + std::to_string(rc));
+      ++applied;
+    });
+  s.stop_timer();
+
+  if (applied != batch.size())
+    throw std::logic_error("Not all transactions were applied");
+}
+
+// A node joining a service whose history has many updates to the same keys,
+// either by replaying every transaction or by installing a snapshot
+template <bool from_snapshot>
+static void join(picobench::state& s)
+{
+  auto replicator = std::make_shared<kv::StubReplicator>();
+  Store kv_store(replicator);
+  Store kv_store2;
+
+  auto secrets = create_network_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+  kv_store2.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& priv_map = kv_store.create<std::string, std::string>(
+    "priv_map", kv::SecurityDomain::PRIVATE);
+  kv_store2.clone_schema(kv_store);
+
+  const int keys = 1000;
+  std::vector<std::vector<uint8_t>> batch;
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(pub_map, priv_map);
+    for (int j = 0; j < 10; j++)
+    {
+      auto key = "key" + std::to_string((i * 10 + j) % keys);
+      pub_view->put(key, std::string(100, 'p'));
+      priv_view->put(key, std::string(100, 's'));
+    }
+    auto rc = tx.commit();
+    if (rc != kv::CommitSuccess::OK)
+      throw std::logic_error(
+        "Transaction commit failed: " + std::to_string(rc));
+    batch.push_back(replicator->get_latest_data().first);
+  }
+  kv_store.compact(kv_store.current_version());
+
+  s.start_timer();
+  if (from_snapshot)
+  {
+    auto snapshot = kv_store.snapshot(kv_store.current_version());
+    auto rc = kv_store2.deserialise_snapshot(snapshot);
+    if (rc != kv::DeserialiseSuccess::PASS)
+      throw std::logic_error(
+        "Snapshot deserialisation failed: " + std::to_string(rc));
+  }
+  else
+  {
+    kv_store2.deserialise_batch(
+      batch, false, [](kv::DeserialiseSuccess rc, kv::Term) {
+        if (rc != kv::DeserialiseSuccess::PASS)
+          throw std::logic_error(
+            "Transaction deserialisation failed: " + std::to_string(rc));
+      });
+  }
+  s.stop_timer();
+
+  if (kv_store2.current_version() != kv_store.current_version())
+    throw std::logic_error("Joining store is not up to date");
+}
+
+// Each committer thread writes to its own map, so transactions never conflict
+// and throughput is bounded by version allocation and replication handoff
+template <size_t threads>
+static void commit_contention(picobench::state& s)
+{
+  auto replicator = std::make_shared<kv::StubReplicator>();
+  Store kv_store(replicator);
+
+  std::vector<Store::Map<size_t, size_t>*> maps;
+  for (size_t i = 0; i < threads; ++i)
+  {
+    maps.push_back(&kv_store.create<size_t, size_t>(
+      "map" + std::to_string(i), kv::SecurityDomain::PUBLIC));
+  }
+
+  const size_t txs_per_thread = s.iterations() / threads;
+
+  auto committer = [&](size_t t) {
+    for (size_t i = 0; i < txs_per_thread; ++i)
+    {
+      Store::Tx tx;
+      auto view = tx.get_view(*maps[t]);
+      view->put(i, i);
+      auto rc = tx.commit();
+      if (rc != kv::CommitSuccess::OK)
+        throw std::logic_error(
+          "Transaction commit failed: " + std::to_string(rc));
+    }
+  };
+
+  s.start_timer();
+  std::vector<std::thread> committers;
+  for (size_t t = 0; t < threads; ++t)
+    committers.emplace_back(committer, t);
+  for (auto& c : committers)
+    c.join();
+  s.stop_timer();
+
+  if (replicator->number_of_replicas() != txs_per_thread * threads)
+    throw std::logic_error("Not all transactions were replicated");
+}
+
 const std::vector<int> tx_count = {10, 100, 200};
+const std::vector<int> batch_tx_count = {16, 256};
+const std::vector<int> contention_tx_count = {1024, 16384};
+const std::vector<int> join_tx_count = {1000, 10000};
 const uint32_t sample_size = 100;
 
 using SD = kv::SecurityDomain;
@@ -112,3 +295,23 @@ PICOBENCH(deserialise<SD::PUBLIC>)
   .samples(sample_size)
   .baseline();
 PICOBENCH(deserialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+
+PICOBENCH_SUITE("deserialise_batch");
+PICOBENCH(deserialise_batch<1>)
+  .iterations(batch_tx_count)
+  .samples(10)
+  .baseline();
+PICOBENCH(deserialise_batch<4>).iterations(batch_tx_count).samples(10);
+PICOBENCH(deserialise_batch<8>).iterations(batch_tx_count).samples(10);
+
+PICOBENCH_SUITE("commit_contention");
+PICOBENCH(commit_contention<1>)
+  .iterations(contention_tx_count)
+  .samples(10)
+  .baseline();
+PICOBENCH(commit_contention<4>).iterations(contention_tx_count).samples(10);
+PICOBENCH(commit_contention<16>).iterations(contention_tx_count).samples(10);
+
+PICOBENCH_SUITE("join");
+PICOBENCH(join<false>).iterations(join_tx_count).samples(10).baseline();
+PICOBENCH(join<true>).iterations(join_tx_count).samples(10);
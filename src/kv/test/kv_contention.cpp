@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #include "../kv.h"
 #include "../kvserialiser.h"
+#include "../replicator.h"
 
 #include <atomic>
 #include <chrono>
@@ -149,3 +150,74 @@ TEST_CASE("Concurrent kv access" * doctest::test_suite("concurrency"))
     compact_thread.join();
   }
 }
+
+class VersionRecorder : public kv::StubReplicator
+{
+public:
+  std::atomic<kv::Version> last_replicated{0};
+
+  bool replicate(
+    const std::vector<std::tuple<kv::Version, std::vector<uint8_t>, bool>>&
+      entries) override
+  {
+    last_replicated.store(std::get<0>(entries.back()));
+    return true;
+  }
+};
+
+TEST_CASE(
+  "Concurrent commits and rollbacks" * doctest::test_suite("concurrency"))
+{
+  // Multiple threads commit to their own tables, while a single thread
+  // repeatedly rolls the kv back to the last replicated version. Transactions
+  // given versions before a rollback must not take the place of those given
+  // the same versions after it, and must not stop them from being replicated
+  auto replicator = std::make_shared<VersionRecorder>();
+  Store kv_store(replicator);
+
+  using MapType = Store::Map<size_t, size_t>;
+
+  constexpr size_t thread_count = 8;
+  constexpr size_t tx_count = 2000;
+
+  std::vector<MapType*> maps;
+  for (size_t i = 0u; i < thread_count; ++i)
+    maps.push_back(&kv_store.create<MapType>(
+      std::to_string(i), kv::SecurityDomain::PUBLIC));
+
+  std::atomic<size_t> active_tx_threads(thread_count);
+
+  std::vector<std::thread> tx_threads;
+  for (size_t i = 0u; i < thread_count; ++i)
+  {
+    tx_threads.emplace_back([&, map = maps[i]]() {
+      for (size_t j = 0u; j < tx_count; ++j)
+      {
+        // Transactions conflict with rollbacks, and are not retried
+        Store::Tx tx;
+        tx.get_view(*map)->put(j, j);
+        tx.commit();
+      }
+      --active_tx_threads;
+    });
+  }
+
+  while (active_tx_threads.load() > 0)
+  {
+    kv_store.rollback(replicator->last_replicated.load());
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  for (auto& t : tx_threads)
+    t.join();
+
+  // Once rollbacks have stopped, every map can be committed to and replicated
+  kv_store.rollback(replicator->last_replicated.load());
+  for (auto map : maps)
+  {
+    Store::Tx tx;
+    tx.get_view(*map)->put(0, 0);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    REQUIRE(replicator->last_replicated.load() == kv_store.current_version());
+  }
+}
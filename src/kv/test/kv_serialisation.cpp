@@ -10,6 +10,7 @@
 #include <doctest/doctest.h>
 #include <msgpack-c/msgpack.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace ccfapp;
@@ -233,6 +234,270 @@ TEST_CASE("Serialise private map with no encryptor/Deserialise in new store")
   }
 }
 
+TEST_CASE("Deserialise batch")
+{
+  auto replicator = std::make_shared<kv::StubReplicator>();
+  auto secrets = ccf::NetworkSecrets("");
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(1, secrets);
+
+  Store kv_store(replicator);
+  Store kv_store_target;
+  kv_store.set_encryptor(encryptor);
+  kv_store_target.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<size_t, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& priv_map = kv_store.create<size_t, std::string>(
+    "priv_map", kv::SecurityDomain::PRIVATE);
+  kv_store_target.clone_schema(kv_store);
+
+  auto target_pub_map = kv_store_target.get<size_t, std::string>("pub_map");
+  auto target_priv_map = kv_store_target.get<size_t, std::string>("priv_map");
+
+  // Parse each transaction on its own thread
+  kv_store_target.set_task_runner(
+    [](std::vector<std::function<void()>>&& tasks) {
+      std::vector<std::thread> threads;
+      for (auto& task : tasks)
+        threads.emplace_back(task);
+      for (auto& thread : threads)
+        thread.join();
+    });
+
+  constexpr size_t batch_size = 16;
+
+  // Every transaction writes the same private key, so its final value shows
+  // whether they were applied in order
+  auto make_batch = [&]() {
+    std::vector<std::vector<uint8_t>> batch;
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      Store::Tx tx;
+      auto [pub_view, priv_view] = tx.get_view(pub_map, priv_map);
+      pub_view->put(i, "public");
+      priv_view->put(0, std::to_string(i));
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+      batch.push_back(replicator->get_latest_data().first);
+    }
+    return batch;
+  };
+
+  auto deserialise_batch = [&](const std::vector<std::vector<uint8_t>>& b) {
+    std::vector<kv::DeserialiseSuccess> results;
+    kv_store_target.deserialise_batch(
+      b, false, [&results](kv::DeserialiseSuccess success, kv::Term) {
+        results.push_back(success);
+      });
+    return results;
+  };
+
+  const auto batch = make_batch();
+
+  INFO("Transactions are applied in order");
+  {
+    auto results = deserialise_batch(batch);
+    REQUIRE(
+      results ==
+      std::vector<kv::DeserialiseSuccess>(
+        batch_size, kv::DeserialiseSuccess::PASS));
+    REQUIRE(kv_store_target.current_version() == batch_size);
+
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(*target_pub_map, *target_priv_map);
+    REQUIRE(pub_view->get(batch_size - 1).has_value());
+    REQUIRE(priv_view->get(0) == std::to_string(batch_size - 1));
+  }
+
+  const auto next_batch = make_batch();
+
+  INFO("Applying stops at the first transaction which fails");
+  {
+    // Without its first transaction, the batch does not follow on from the
+    // target's current version
+    auto results = deserialise_batch(
+      {next_batch.begin() + 1, next_batch.end()});
+    REQUIRE(
+      results ==
+      std::vector<kv::DeserialiseSuccess>{kv::DeserialiseSuccess::FAILED});
+    REQUIRE(kv_store_target.current_version() == batch_size);
+  }
+
+  INFO("Local commits are rolled back before a batch is applied");
+  {
+    Store::Tx local_tx;
+    auto priv_view = local_tx.get_view(*target_priv_map);
+    priv_view->put(0, "local");
+    REQUIRE(local_tx.commit() == kv::CommitSuccess::OK);
+
+    auto results = deserialise_batch(next_batch);
+    REQUIRE(
+      results ==
+      std::vector<kv::DeserialiseSuccess>(
+        batch_size, kv::DeserialiseSuccess::PASS));
+    REQUIRE(kv_store_target.current_version() == 2 * batch_size);
+
+    Store::Tx tx;
+    auto view = tx.get_view(*target_priv_map);
+    REQUIRE(view->get(0) == std::to_string(batch_size - 1));
+  }
+}
+
+TEST_CASE("Snapshot")
+{
+  auto replicator = std::make_shared<kv::StubReplicator>();
+  auto secrets = ccf::NetworkSecrets("");
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(1, secrets);
+
+  Store kv_store(replicator);
+  kv_store.set_encryptor(encryptor);
+
+  auto& pub_map = kv_store.create<std::string, std::string>(
+    "pub_map", kv::SecurityDomain::PUBLIC);
+  auto& priv_map = kv_store.create<std::string, std::string>(
+    "priv_map", kv::SecurityDomain::PRIVATE);
+
+  {
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(pub_map, priv_map);
+    pub_view->put("pub1", "a");
+    pub_view->put("pub2", "b");
+    priv_view->put("priv", "c");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  {
+    Store::Tx tx;
+    auto pub_view = tx.get_view(pub_map);
+    pub_view->remove("pub2");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Only committed versions can be snapshot");
+  {
+    REQUIRE_THROWS_AS(kv_store.snapshot(2), std::logic_error);
+  }
+
+  kv_store.compact(2);
+
+  {
+    Store::Tx tx;
+    auto pub_view = tx.get_view(pub_map);
+    pub_view->put("pub1", "d");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  auto snapshot = kv_store.snapshot(2);
+
+  INFO("Later transactions are not in the snapshot");
+  {
+    using State = Store::Map<std::string, std::string>::State;
+    using Write = Store::Map<std::string, std::string>::Write;
+    std::vector<Write> local_writes;
+    auto local_hook = [&](kv::Version v, const State& s, const Write& w) {
+      local_writes.push_back(w);
+    };
+
+    Store kv_store_target;
+    kv_store_target.set_encryptor(encryptor);
+    auto& target_pub_map = kv_store_target.create<std::string, std::string>(
+      "pub_map", kv::SecurityDomain::PUBLIC, local_hook);
+    auto& target_priv_map = kv_store_target.create<std::string, std::string>(
+      "priv_map", kv::SecurityDomain::PRIVATE);
+
+    REQUIRE(
+      kv_store_target.deserialise_snapshot(snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(kv_store_target.current_version() == 2);
+    REQUIRE(kv_store_target.commit_version() == 2);
+
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(target_pub_map, target_priv_map);
+    REQUIRE(pub_view->get("pub1").value() == "a");
+    REQUIRE(!pub_view->get("pub2").has_value());
+    REQUIRE(priv_view->get("priv").value() == "c");
+
+    // The hook only sees the keys that are present
+    REQUIRE(local_writes.size() == 1);
+    REQUIRE(local_writes.at(0).size() == 1);
+    REQUIRE(local_writes.at(0).at("pub1").value == "a");
+
+    INFO("Transactions after the snapshot can be applied");
+    {
+      REQUIRE(
+        kv_store_target.deserialise(replicator->get_latest_data().first) ==
+        kv::DeserialiseSuccess::PASS);
+
+      Store::Tx tx2;
+      auto pub_view2 = tx2.get_view(target_pub_map);
+      REQUIRE(pub_view2->get("pub1").value() == "d");
+    }
+  }
+
+  INFO("Only the public domain can be restored");
+  {
+    Store kv_store_target;
+    kv_store_target.set_encryptor(encryptor);
+    auto& target_pub_map = kv_store_target.create<std::string, std::string>(
+      "pub_map", kv::SecurityDomain::PUBLIC);
+    auto& target_priv_map = kv_store_target.create<std::string, std::string>(
+      "priv_map", kv::SecurityDomain::PRIVATE);
+
+    REQUIRE(
+      kv_store_target.deserialise_snapshot(snapshot, true) ==
+      kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(target_pub_map, target_priv_map);
+    REQUIRE(pub_view->get("pub1").value() == "a");
+    REQUIRE(!priv_view->get("priv").has_value());
+  }
+
+  INFO("A snapshot can be serialised in the background");
+  {
+    std::vector<std::function<void()>> tasks;
+    kv_store.set_background_runner([&tasks](std::function<void()>&& task) {
+      tasks.push_back(std::move(task));
+    });
+
+    std::optional<std::vector<uint8_t>> background_snapshot;
+    kv_store.snapshot(2, [&](std::vector<uint8_t>&& data) {
+      background_snapshot = std::move(data);
+    });
+    REQUIRE(!background_snapshot.has_value());
+
+    INFO("Only one snapshot is serialised at a time");
+    {
+      REQUIRE_THROWS_AS(kv_store.snapshot(2), std::logic_error);
+    }
+
+    for (auto& task : tasks)
+      task();
+    REQUIRE(background_snapshot.has_value());
+
+    Store kv_store_target;
+    kv_store_target.set_encryptor(encryptor);
+    auto& target_pub_map = kv_store_target.create<std::string, std::string>(
+      "pub_map", kv::SecurityDomain::PUBLIC);
+    auto& target_priv_map = kv_store_target.create<std::string, std::string>(
+      "priv_map", kv::SecurityDomain::PRIVATE);
+
+    REQUIRE(
+      kv_store_target.deserialise_snapshot(background_snapshot.value()) ==
+      kv::DeserialiseSuccess::PASS);
+
+    Store::Tx tx;
+    auto [pub_view, priv_view] = tx.get_view(target_pub_map, target_priv_map);
+    REQUIRE(pub_view->get("pub1").value() == "a");
+    REQUIRE(priv_view->get("priv").value() == "c");
+  }
+
+  INFO("Compacted versions cannot be snapshot");
+  {
+    kv_store.compact(3);
+    REQUIRE_THROWS_AS(kv_store.snapshot(2), std::logic_error);
+  }
+}
+
 bool corrupt_serialised_tx(
   std::vector<uint8_t>& serialised_tx, std::vector<uint8_t>& value_to_corrupt)
 {
@@ -259,6 +524,90 @@ bool corrupt_serialised_tx(
   return false;
 }
 
+TEST_CASE("Snapshot serialised in chunks")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+  kv::AbstractMap<kv::KvStoreSerialiser, kv::KvStoreDeserialiser>& am = map;
+
+  auto serialise = [&am](kv::Version v, bool in_chunks) {
+    am.lock();
+    auto snapshot = am.snapshot(v);
+    am.unlock();
+
+    kv::KvStoreSerialiser s(nullptr, v);
+    if (in_chunks)
+    {
+      size_t steps = 1;
+      while (snapshot->serialise_step(s, 7))
+        steps++;
+      REQUIRE(steps > 1);
+    }
+    else
+    {
+      snapshot->serialise(s);
+    }
+    return s.get_raw_data();
+  };
+
+  // The order of the entries depends on how they were serialised
+  using Entries = std::map<std::string, std::pair<std::string, kv::Version>>;
+  auto entries = [](const std::vector<uint8_t>& data) {
+    kv::KvStoreDeserialiser d(nullptr, std::nullopt);
+    REQUIRE(d.init(data));
+    d.deserialise_version<kv::Version>();
+    REQUIRE(d.start_map() == "map");
+
+    Entries e;
+    auto ctr = d.deserialise_write_header();
+    for (size_t i = 0; i < ctr; ++i)
+    {
+      auto w =
+        d.deserialise_write_version<std::string, std::string, kv::Version>();
+      REQUIRE(w.has_value());
+      REQUIRE(e.count(w->key) == 0);
+      e[w->key] = {w->value, w->version};
+    }
+    REQUIRE(d.end());
+    return e;
+  };
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    for (size_t i = 0; i < 1000; ++i)
+      view->put(fmt::format("key{}", i), fmt::format("value{}", i));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+  const auto v1 = kv_store.current_version();
+
+  INFO("The chunks hold the same entries as a single pass");
+  const auto first = entries(serialise(v1, false));
+  REQUIRE(first.size() == 1000);
+  REQUIRE(entries(serialise(v1, true)) == first);
+
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put("key5", "new value");
+    view->remove("key7");
+    view->put("key1000", "value1000");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+  const auto v2 = kv_store.current_version();
+
+  INFO("Chunks reused from the previous snapshot hold the same entries");
+  const auto second = entries(serialise(v2, false));
+  REQUIRE(second.size() == 1001);
+  REQUIRE(second.at("key5").first == "new value");
+  REQUIRE(second.at("key7").second < 0);
+  REQUIRE(entries(serialise(v2, true)) == second);
+
+  INFO("An earlier state can still be serialised in chunks");
+  REQUIRE(entries(serialise(v1, true)) == first);
+}
+
 TEST_CASE("Integrity")
 {
   SUBCASE("Public and Private")
@@ -134,6 +134,7 @@ TEST_CASE("Reads/writes and deletions")
     auto va = view->get(k);
     REQUIRE(va.has_value());
     REQUIRE(va.value() == v1);
+    REQUIRE(!view->get_version(k).has_value());
     REQUIRE(tx.commit() == kv::CommitSuccess::OK);
   }
 
@@ -144,6 +145,7 @@ TEST_CASE("Reads/writes and deletions")
     auto v = view->get(k);
     REQUIRE(v.has_value());
     REQUIRE(v.value() == v1);
+    REQUIRE(view->get_version(k) == kv_store.current_version());
     REQUIRE(tx.commit() == kv::CommitSuccess::OK);
   }
 
@@ -182,6 +184,7 @@ TEST_CASE("Reads/writes and deletions")
     auto view3 = tx3.get_view(map);
     auto vc = view3->get(k);
     REQUIRE(!vc.has_value());
+    REQUIRE(!view3->get_version(k).has_value());
   }
 
   INFO("Test early temination of KV foreach");
@@ -78,6 +78,30 @@ namespace ccf
 {
   namespace lua
   {
+    //! Registry field holding every box pushed since the last invalidate_boxes
+    static constexpr auto boxes_table = "ccf_boxes";
+
+    /**
+     * Clears the pointer in every box pushed so far, so that data which is
+     * no longer valid cannot be reached from boxes that Lua still holds (for
+     * instance, when an interpreter is reused after the data was destroyed).
+     */
+    inline void invalidate_boxes(lua_State* l)
+    {
+      luaL_getsubtable(l, LUA_REGISTRYINDEX, boxes_table);
+      const auto n = lua_rawlen(l, -1);
+      for (lua_Unsigned i = 1; i <= n; ++i)
+      {
+        lua_rawgeti(l, -1, i);
+        *reinterpret_cast<void**>(lua_touserdata(l, -1)) = nullptr;
+        lua_pop(l, 1);
+      }
+      lua_pop(l, 1);
+
+      lua_newtable(l);
+      lua_setfield(l, LUA_REGISTRYINDEX, boxes_table);
+    }
+
     template <typename T, typename X = T>
     struct UserData
     {
@@ -100,7 +124,8 @@ namespace ccf
        * Pushes userdata onto the lua stack which wraps the given data.
        *
        * A metatable for T must have set in l, else an exception will be thrown.
-       * The caller is responsible for ensuring that d remains valid.
+       * The caller is responsible for ensuring that d remains valid, or that
+       * invalidate_boxes() is called before it is destroyed.
        */
       static void push_boxed(lua_State* l, T* d)
       {
@@ -111,6 +136,12 @@ namespace ccf
 
         lua_setmetatable(l, -2);
         *p = d;
+
+        // Keep the box alive until invalidate_boxes() has cleared it
+        luaL_getsubtable(l, LUA_REGISTRYINDEX, boxes_table);
+        lua_pushvalue(l, -2);
+        lua_rawseti(l, -2, lua_rawlen(l, -2) + 1);
+        lua_pop(l, 1);
       }
 
       /**
@@ -122,8 +153,11 @@ namespace ccf
        */
       static T* unbox(lua_State* l, int arg = 1)
       {
-        return *reinterpret_cast<T**>(
+        const auto p = *reinterpret_cast<T**>(
           luaL_checkudata(l, arg, metatable_name()));
+        if (p == nullptr)
+          luaL_argerror(l, arg, "object is no longer valid");
+        return p;
       }
     };
 
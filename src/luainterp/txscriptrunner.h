@@ -1,11 +1,15 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #pragma once
+#include "ds/spinlock.h"
 #include "luainterp/luainterp.h"
 #include "luainterp/luakv.h"
 #include "node/networktables.h"
 #include "node/rpc/rpcexception.h"
 
+#include <list>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <type_traits>
 #include <unordered_map>
@@ -15,6 +19,19 @@ namespace ccf
 {
   namespace lua
   {
+    //! Identifies a script stored in a table, by its key and the version at
+    //! which it was written
+    struct ScriptVersion
+    {
+      std::string name;
+      kv::Version version;
+
+      bool operator==(const ScriptVersion& other) const
+      {
+        return version == other.version && name == other.name;
+      }
+    };
+
     //! Describes a script to be run within a transaction
     struct TxScript
     {
@@ -26,6 +43,12 @@ namespace ccf
       std::optional<WlId> whitelist_read;
       //! [optional] script to setup the environment for the actual script
       std::optional<Script> env_script;
+      //! [optional] the version of script, by which interpreters that have
+      //! already loaded it are reused. Without it, or without the version of
+      //! env_script when there is one, a new interpreter is set up.
+      std::optional<ScriptVersion> script_version;
+      //! [optional] the version of env_script
+      std::optional<ScriptVersion> env_script_version;
     };
 
     class TxScriptRunner
@@ -212,6 +235,274 @@ namespace ccf
         lua::Interpreter& li, Store::Tx& tx, int& n_registered_tables) const
       {}
 
+      /** An interpreter whose environment has been set up and whose script
+       * has been loaded, ready to be run again.
+       *
+       * Everything reachable when it was set up, from the global table, the
+       * string metatable and the named entries of the registry, is recorded
+       * and restored after each run, so that state written by one run is not
+       * seen by the next. This includes the upvalues of reachable functions
+       * (eg. locals captured by functions of the environment script). Named
+       * registry entries added by a run, such as the metatables of the tables
+       * it was given, are removed, and set up again by the next run.
+       */
+      struct WarmInterpreter
+      {
+        lua::Interpreter li;
+        int script_ref = LUA_NOREF;
+        int reset_ref = LUA_NOREF;
+
+        void push_script()
+        {
+          lua_rawgeti(li.get_state(), LUA_REGISTRYINDEX, script_ref);
+        }
+
+        // Returns false if the interpreter could not be reset, in which case
+        // it must not be reused. This is not part of the script's run, so is
+        // not subject to its execution limit.
+        bool reset()
+        {
+          auto l = li.get_state();
+          lua_settop(l, 0);
+          invalidate_boxes(l);
+          lua_sethook(l, nullptr, 0, 0);
+          lua_rawgeti(l, LUA_REGISTRYINDEX, reset_ref);
+          const auto ok = lua_pcall(l, 0, 0, 0) == LUA_OK;
+          lua_settop(l, 0);
+          return ok;
+        }
+      };
+
+      // Equivalent to debug.getupvalue and debug.setupvalue, which are not
+      // available to scripts
+      static int get_upvalue(lua_State* l)
+      {
+        luaL_checktype(l, 1, LUA_TFUNCTION);
+        const auto name = lua_getupvalue(l, 1, luaL_checkinteger(l, 2));
+        if (name == nullptr)
+          return 0;
+        lua_pushstring(l, name);
+        lua_insert(l, -2);
+        return 2;
+      }
+
+      static int set_upvalue(lua_State* l)
+      {
+        luaL_checktype(l, 1, LUA_TFUNCTION);
+        luaL_checkany(l, 3);
+        lua_settop(l, 3);
+        lua_setupvalue(l, 1, luaL_checkinteger(l, 2));
+        return 0;
+      }
+
+      // Called with the global table, the string metatable, the registry,
+      // and the functions above. Integer keys of the registry are references
+      // held by C++ (eg. to the script and to the function returned here),
+      // so they are neither saved nor restored.
+      static constexpr auto snapshot_globals = R"xxx(
+        local globals, string_meta, registry, getupvalue, setupvalue = ...
+        local next, rawget, rawset, type = next, rawget, rawset, type
+        local rawequal = rawequal
+        local getmetatable, setmetatable = getmetatable, setmetatable
+        local saved, upvalues = {}, {}
+        local save
+        local function save_value(v)
+          if type(v) == "table" then
+            save(v)
+          elseif type(v) == "function" and not upvalues[v] then
+            local copy = {n = 0}
+            upvalues[v] = copy
+            while true do
+              local name, uv = getupvalue(v, copy.n + 1)
+              if name == nil then break end
+              copy.n = copy.n + 1
+              copy[copy.n] = uv
+              save_value(uv)
+            end
+          end
+        end
+        function save(t, skip_integers)
+          if saved[t] then return end
+          local copy = {}
+          saved[t] = {entries = copy, meta = getmetatable(t),
+                      skip_integers = skip_integers}
+          for k, v in next, t do
+            if not (skip_integers and type(k) == "number") then
+              copy[k] = v
+              save_value(v)
+            end
+          end
+          save_value(saved[t].meta)
+        end
+        save(globals)
+        if string_meta then save(string_meta) end
+        save(registry, true)
+        return function()
+          for t, s in next, saved do
+            for k in next, t do
+              if s.entries[k] == nil and
+                not (s.skip_integers and type(k) == "number") then
+                rawset(t, k, nil)
+              end
+            end
+            for k, v in next, s.entries do
+              if not rawequal(rawget(t, k), v) then rawset(t, k, v) end
+            end
+            if not rawequal(getmetatable(t), s.meta) then
+              setmetatable(t, s.meta)
+            end
+          end
+          for f, copy in next, upvalues do
+            for i = 1, copy.n do
+              local _, uv = getupvalue(f, i)
+              if not rawequal(uv, copy[i]) then setupvalue(f, i, copy[i]) end
+            end
+          end
+        end
+      )xxx";
+
+      std::unique_ptr<WarmInterpreter> create_interpreter(
+        const TxScript& txs) const
+      {
+        auto wi = std::make_unique<WarmInterpreter>();
+        auto l = wi->li.get_state();
+
+        // run an optional environment script
+        setup_environment(wi->li, txs.env_script);
+        lua_settop(l, 0);
+
+        load(wi->li, txs.script);
+        wi->script_ref = luaL_ref(l, LUA_REGISTRYINDEX);
+
+        wi->li.push_code(snapshot_globals);
+        lua_pushglobaltable(l);
+        lua_pushliteral(l, "");
+        if (!lua_getmetatable(l, -1))
+          lua_pushnil(l);
+        lua_remove(l, -2);
+        lua_pushvalue(l, LUA_REGISTRYINDEX);
+        lua_pushcfunction(l, get_upvalue);
+        lua_pushcfunction(l, set_upvalue);
+
+        // Like reset(), this is not subject to the execution limit of scripts
+        lua_sethook(l, nullptr, 0, 0);
+        if (lua_pcall(l, 5, 1, 0) != LUA_OK)
+          throw lua::ex(
+            "Failed to snapshot interpreter: " + wi->li.pop<std::string>());
+        wi->reset_ref = luaL_ref(l, LUA_REGISTRYINDEX);
+
+        return wi;
+      }
+
+      /** Idle warm interpreters, by version of script and environment
+       * script. Only the most recently used max_pooled_scripts pairs are
+       * kept, with up to max_idle_interpreters interpreters each.
+       */
+      class InterpreterPool
+      {
+      private:
+        static constexpr size_t max_pooled_scripts = 16;
+        static constexpr size_t max_idle_interpreters = 4;
+
+        struct Entry
+        {
+          ScriptVersion script_version;
+          std::optional<ScriptVersion> env_script_version;
+          Script script;
+          std::optional<Script> env_script;
+          std::vector<std::unique_ptr<WarmInterpreter>> idle;
+        };
+
+        SpinLock lock;
+        std::list<Entry> entries;
+
+        // Closing an interpreter can take a while, so those which are not
+        // kept are moved to evicted, and only closed once the lock has been
+        // released
+        std::list<Entry>::iterator find(
+          const TxScript& txs, std::list<Entry>& evicted)
+        {
+          auto it = entries.begin();
+          for (; it != entries.end(); ++it)
+          {
+            if (
+              it->script_version == txs.script_version &&
+              it->env_script_version == txs.env_script_version)
+              break;
+          }
+
+          // A version is reused if it is rolled back, possibly with a
+          // different script. The scripts are only compared once found.
+          if (
+            it != entries.end() &&
+            !(it->script == txs.script && it->env_script == txs.env_script))
+          {
+            evicted.splice(evicted.end(), entries, it);
+            return entries.end();
+          }
+
+          return it;
+        }
+
+      public:
+        static bool can_pool(const TxScript& txs)
+        {
+          return txs.script_version.has_value() &&
+            (!txs.env_script.has_value() ||
+             txs.env_script_version.has_value());
+        }
+
+        std::unique_ptr<WarmInterpreter> take(const TxScript& txs)
+        {
+          if (!can_pool(txs))
+            return nullptr;
+
+          // Declared first, so closed after the lock is released
+          std::list<Entry> evicted;
+          std::lock_guard<SpinLock> guard(lock);
+          auto it = find(txs, evicted);
+          if (it == entries.end() || it->idle.empty())
+            return nullptr;
+
+          auto wi = std::move(it->idle.back());
+          it->idle.pop_back();
+          return wi;
+        }
+
+        void put(const TxScript& txs, std::unique_ptr<WarmInterpreter> wi)
+        {
+          if (!can_pool(txs))
+            return;
+
+          std::list<Entry> evicted;
+          {
+            std::lock_guard<SpinLock> guard(lock);
+            auto it = find(txs, evicted);
+            if (it == entries.end())
+            {
+              entries.push_front({*txs.script_version,
+                                  txs.env_script_version,
+                                  txs.script,
+                                  txs.env_script,
+                                  {}});
+              if (entries.size() > max_pooled_scripts)
+                evicted.splice(
+                  evicted.end(), entries, std::prev(entries.end()));
+            }
+            else if (it != entries.begin())
+            {
+              entries.splice(entries.begin(), entries, it);
+            }
+
+            auto& idle = entries.front().idle;
+            if (idle.size() < max_idle_interpreters)
+              idle.push_back(std::move(wi));
+          }
+        }
+      };
+
+      mutable InterpreterPool interpreters;
+
     public:
       /** Run a script transactionally in a given environment.
        *
@@ -239,12 +530,12 @@ namespace ccf
       template <typename T, typename... Args>
       T run(Store::Tx& tx, const TxScript& txs, Args&&... args) const
       {
-        lua::Interpreter li;
+        auto wi = interpreters.take(txs);
+        if (wi == nullptr)
+          wi = create_interpreter(txs);
 
-        // run an optional environment script
-        setup_environment(li, txs.env_script);
-
-        load(li, txs.script);
+        auto& li = wi->li;
+        wi->push_script();
 
         // register writable and read-only tables with respect to the given
         // whitelists the table of writable tables will be pushed on the stack
@@ -269,18 +560,36 @@ namespace ccf
             n_registered_tables++;
           }
         }
-        try
+        // An interpreter that fails at any point is dropped rather than
+        // returned to the pool, since it may have been left in any state
+        auto invoke = [&]() -> T {
+          try
+          {
+            // no return if T == void
+            if constexpr (std::is_same_v<T, void>)
+              li.invoke_raw(n_registered_tables, std::forward<Args>(args)...);
+            else
+              return li.template invoke_raw<T>(
+                n_registered_tables, std::forward<Args>(args)...);
+          }
+          catch (const lua::ex& e)
+          {
+            lua_fail(e);
+          }
+        };
+
+        if constexpr (std::is_same_v<T, void>)
         {
-          // no return if T == void
-          if constexpr (std::is_same_v<T, void>)
-            li.invoke_raw(n_registered_tables, std::forward<Args>(args)...);
-          else
-            return li.template invoke_raw<T>(
-              n_registered_tables, std::forward<Args>(args)...);
+          invoke();
+          if (wi->reset())
+            interpreters.put(txs, std::move(wi));
         }
-        catch (const lua::ex& e)
+        else
         {
-          lua_fail(e);
+          auto result = invoke();
+          if (wi->reset())
+            interpreters.put(txs, std::move(wi));
+          return result;
         }
       }
 
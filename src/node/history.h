@@ -4,6 +4,7 @@
 
 #include "../crypto/hash.h"
 #include "../ds/logger.h"
+#include "../ds/spinlock.h"
 #include "../kv/kvtypes.h"
 #include "../pbft/pbfttypes.h"
 #include "../tls/keypair.h"
@@ -12,8 +13,11 @@
 #include "nodes.h"
 #include "signatures.h"
 
+#include <algorithm>
 #include <array>
 #include <deque>
+#include <map>
+#include <optional>
 #include <string.h>
 
 extern "C"
@@ -128,18 +132,19 @@ namespace ccf
 
     void emit_signature() override
     {
-      auto version = store.next_version();
+      auto [version, rollback_count] = store.next_version_and_rollback_count();
       LOG_INFO_FMT("Issuing signature at {}", version);
       store.commit(
         version,
-        [version, this]() {
+        [version = version, this]() {
           Store::Tx sig(version);
           auto sig_view = sig.get_view(signatures);
           Signature sig_value(id, version);
           sig_view->put(0, sig_value);
           return sig.commit_reserved();
         },
-        true);
+        true,
+        rollback_count);
     }
 
     bool add_request(
@@ -156,6 +161,7 @@ namespace ccf
       const std::vector<uint8_t>& data) override
     {}
     void add_result(RequestID id, kv::Version version) override {}
+    void add_results(const std::vector<Result>& batch) override {}
     void add_response(
       kv::TxHistory::RequestID id,
       const std::vector<uint8_t>& response) override
@@ -177,6 +183,21 @@ namespace ccf
     {
       return crypto::Sha256Hash();
     }
+
+    std::optional<Receipt> get_receipt(kv::Version) override
+    {
+      return std::nullopt;
+    }
+
+    std::vector<uint8_t> serialise_tree(kv::Version) override
+    {
+      return {};
+    }
+
+    bool deserialise_tree(const std::vector<uint8_t>&) override
+    {
+      return true;
+    }
   };
 
   class MerkleTreeHistory
@@ -206,6 +227,20 @@ namespace ccf
       mt_insert(tree, h);
     }
 
+    // The tree keeps its root until the next insertion or retraction, so
+    // appending a batch before asking for the root only computes it once
+    void append(const std::vector<crypto::Sha256Hash>& hashes)
+    {
+      for (const auto& hash : hashes)
+        append(hash);
+    }
+
+    // Number of leaves appended, including those that have been flushed
+    uint64_t size() const
+    {
+      return tree->offset + tree->j;
+    }
+
     crypto::Sha256Hash get_root() const
     {
       crypto::Sha256Hash res;
@@ -215,6 +250,97 @@ namespace ccf
       return res;
     }
 
+    // The root of the tree at a given size, with the hashes on the right
+    // hand side of the tree that went into it. Nodes of complete subtrees
+    // never change as the tree grows, so these are enough to find the path
+    // from any leaf to this root later, until the leaf is flushed.
+    struct Frontier
+    {
+      uint64_t size = 0;
+      crypto::Sha256Hash root;
+      std::vector<crypto::Sha256Hash> rhs;
+    };
+
+    Frontier get_frontier() const
+    {
+      Frontier f;
+      f.root = get_root();
+      f.size = size();
+      for (uint32_t lv = 0; lv < tree->rhs.sz && (tree->j >> lv) != 0; ++lv)
+        f.rhs.push_back(to_hash(tree->rhs.vs[lv]));
+      return f;
+    }
+
+    // Path from leaf index to the root at frontier f, as built by
+    // mt_get_path: the leaf hash, then the sibling hashes up to the root. It
+    // is found in O(log n), or not at all if the leaf has been flushed or is
+    // not under that root.
+    std::optional<std::vector<crypto::Sha256Hash>> get_path(
+      uint64_t index, const Frontier& f) const
+    {
+      if (
+        index < tree->offset + tree->i || index >= f.size ||
+        f.size > tree->offset + tree->j)
+        return std::nullopt;
+
+      uint32_t i = tree->i;
+      uint32_t j = f.size - tree->offset;
+      uint32_t k = index - tree->offset;
+      bool actd = false;
+
+      std::vector<crypto::Sha256Hash> path;
+      path.push_back(to_hash(tree->hs.vs[0].vs[k - offset_of(i)]));
+      for (uint32_t lv = 0; j != 0; ++lv)
+      {
+        const auto& hs = tree->hs.vs[lv];
+        const auto ofs = offset_of(i);
+        if (k % 2 == 1)
+          path.push_back(to_hash(hs.vs[k - 1 - ofs]));
+        else if (k + 1 < j)
+          path.push_back(to_hash(hs.vs[k + 1 - ofs]));
+        else if (k + 1 == j && actd)
+          path.push_back(f.rhs.at(lv));
+
+        actd = actd || j % 2 == 1;
+        i /= 2;
+        j /= 2;
+        k /= 2;
+      }
+      return path;
+    }
+
+    // Checks a path from get_path(), as mt_verify does
+    static bool verify_path(
+      uint64_t index,
+      uint64_t size,
+      const std::vector<crypto::Sha256Hash>& path,
+      const crypto::Sha256Hash& root)
+    {
+      if (path.empty() || index >= size)
+        return false;
+
+      auto acc = path[0];
+      size_t pos = 1;
+      bool actd = false;
+      for (auto k = index, j = size; j != 0; k /= 2, j /= 2)
+      {
+        const bool nactd = actd || j % 2 == 1;
+        if (k % 2 == 1 || !(j == k || (j == k + 1 && !actd)))
+        {
+          if (pos == path.size())
+            return false;
+
+          auto sibling = path[pos++];
+          if (k % 2 == 1)
+            hash_2(sibling.h, acc.h, acc.h);
+          else
+            hash_2(acc.h, sibling.h, acc.h);
+        }
+        actd = nactd;
+      }
+      return pos == path.size() && acc == root;
+    }
+
     void operator=(const MerkleTreeHistory& rhs)
     {
       mt_free(tree);
@@ -235,6 +361,55 @@ namespace ccf
         throw std::logic_error("Precondition to mt_retract_to violated");
       mt_retract_to(tree, index);
     }
+
+    // Serialises the tree as it was when index was its last leaf. Later
+    // leaves are retracted from a copy, so this tree is left as it is.
+    std::vector<uint8_t> serialise(uint64_t index)
+    {
+      auto data = serialise(tree);
+
+      auto copy = mt_deserialize(data.data(), data.size());
+      if (copy == nullptr)
+        throw std::logic_error("Failed to copy merkle tree");
+
+      if (!mt_retract_to_pre(copy, index))
+      {
+        mt_free(copy);
+        throw std::logic_error("Precondition to mt_retract_to violated");
+      }
+      mt_retract_to(copy, index);
+
+      data = serialise(copy);
+      mt_free(copy);
+      return data;
+    }
+
+    bool deserialise(const std::vector<uint8_t>& data)
+    {
+      auto t = mt_deserialize(const_cast<uint8_t*>(data.data()), data.size());
+      if (t == nullptr)
+        return false;
+
+      mt_free(tree);
+      tree = t;
+      return true;
+    }
+
+  private:
+    static crypto::Sha256Hash to_hash(const uint8_t* h)
+    {
+      crypto::Sha256Hash res;
+      std::copy(h, h + crypto::Sha256Hash::SIZE, res.h);
+      return res;
+    }
+
+    static std::vector<uint8_t> serialise(merkle_tree* t)
+    {
+      std::vector<uint8_t> data(mt_serialize_size(t));
+      if (mt_serialize(t, data.data(), data.size()) == 0)
+        throw std::logic_error("Failed to serialise merkle tree");
+      return data;
+    }
   };
 
   template <class T>
@@ -257,6 +432,50 @@ namespace ccf
     std::optional<ResultCallbackHandler> on_result;
     std::optional<ResponseCallbackHandler> on_response;
 
+    // The tree as it was at each signature that has not been compacted away
+    // yet, so that receipts can be produced without going to the ledger
+    struct SignedRoot
+    {
+      typename T::Frontier frontier;
+      NodeId node;
+      std::vector<uint8_t> sig;
+    };
+    std::map<kv::Version, SignedRoot> signed_roots;
+    // Number of transactions before the last compacted one that can still
+    // be given receipts. A transaction is signed by the next signature, so
+    // this should span at least two signature intervals.
+    size_t receipt_history_len = 2 * MAX_HISTORY_LEN;
+
+    // A signature is given its version when it is requested, but its root
+    // is only known once every transaction before it is in the tree. It is
+    // then signed on the store's background runner, while later
+    // transactions wait in the store. One signature is pending at a time.
+    // The store only commits the signature if it has not been rolled back
+    // since the version was reserved, as rollback_count would then differ.
+    struct PendingSignature
+    {
+      kv::Version version;
+      kv::Version rollback_count;
+      kv::Term term;
+      kv::Version commit;
+      bool signing = false;
+    };
+    std::optional<PendingSignature> pending_signature;
+    // Bumped when a rollback discards the pending signature, so that a
+    // signer which has already started does not record it
+    size_t signature_epoch = 0;
+
+    struct SignatureRequest
+    {
+      PendingSignature pending;
+      typename T::Frontier frontier;
+      size_t epoch;
+    };
+
+    // Results are appended by whichever thread replicates them, while
+    // rollback and compaction are driven by consensus
+    SpinLock state_lock;
+
   public:
     HashedTxHistory(
       Store& store_,
@@ -312,16 +531,47 @@ namespace ccf
       id = id_;
     }
 
+    void set_receipt_history_len(size_t len)
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      receipt_history_len = std::max(len, MAX_HISTORY_LEN);
+    }
+
     crypto::Sha256Hash get_root() override
     {
+      std::lock_guard<SpinLock> guard(state_lock);
       return tree.get_root();
     }
 
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      return tree.serialise(v);
+    }
+
+    bool deserialise_tree(const std::vector<uint8_t>& data) override
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      signed_roots.clear();
+      if (
+        pending_signature.has_value() &&
+        pending_signature->version != kv::NoVersion)
+        cancel_pending_signature();
+      return tree.deserialise(data);
+    }
+
     void append(const std::vector<uint8_t>& data) override
     {
       crypto::Sha256Hash h({data});
       log_hash(h, APPEND);
-      tree.append(h);
+      std::optional<SignatureRequest> ready;
+      {
+        std::lock_guard<SpinLock> guard(state_lock);
+        tree.append(h);
+        ready = take_ready_signature();
+      }
+      if (ready.has_value())
+        start_signing(std::move(ready.value()));
     }
 
     bool verify(kv::Term* term = nullptr) override
@@ -346,22 +596,61 @@ namespace ccf
         return false;
       }
       tls::VerifierPtr from_cert = tls::make_verifier(ni.value().cert);
-      crypto::Sha256Hash root = tree.get_root();
+      auto frontier = get_frontier();
+      const auto& root = frontier.root;
       log_hash(root, VERIFY);
-      return from_cert->verify_hash(
-        root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size());
+      if (!from_cert->verify_hash(
+            root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size()))
+        return false;
+
+      record_signature(
+        sig_value.index, std::move(frontier), sig_value.node, sig_value.sig);
+      return true;
+    }
+
+    std::optional<Receipt> get_receipt(kv::Version version) override
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      auto s = signed_roots.upper_bound(version);
+      if (s == signed_roots.end())
+        return std::nullopt;
+
+      auto path = tree.get_path(version, s->second.frontier);
+      if (!path.has_value())
+        return std::nullopt;
+
+      return Receipt{version,
+                     s->first,
+                     s->second.frontier.root,
+                     std::move(path.value()),
+                     s->second.node,
+                     s->second.sig};
     }
 
     void rollback(kv::Version v) override
     {
+      std::lock_guard<SpinLock> guard(state_lock);
+      signed_roots.erase(signed_roots.upper_bound(v), signed_roots.end());
+      // A signature whose version is still being reserved is kept. If its
+      // version turns out to be from before the rollback, the store refuses
+      // to commit it.
+      if (pending_signature.has_value() && pending_signature->version > v)
+        cancel_pending_signature();
       tree.retract(v);
       log_hash(tree.get_root(), ROLLBACK);
     }
 
     void compact(kv::Version v) override
     {
-      if (v > MAX_HISTORY_LEN)
-        tree.flush(v - MAX_HISTORY_LEN);
+      std::lock_guard<SpinLock> guard(state_lock);
+      if (v > receipt_history_len)
+      {
+        tree.flush(v - receipt_history_len);
+        // Signatures over flushed leaves only can no longer give receipts
+        signed_roots.erase(
+          signed_roots.begin(),
+          signed_roots.upper_bound(v - receipt_history_len));
+      }
       log_hash(tree.get_root(), COMPACT);
     }
 
@@ -373,23 +662,38 @@ namespace ccf
       if (!replicator)
         return;
 
-      auto version = store.next_version();
       auto term = replicator->get_term();
       auto commit = replicator->get_commit_idx();
+      {
+        std::lock_guard<SpinLock> guard(state_lock);
+        if (pending_signature.has_value())
+        {
+          LOG_DEBUG_FMT(
+            "Signature at {} is still pending", pending_signature->version);
+          return;
+        }
+
+        // The store is rolled back with its version lock held, and then
+        // rolls back the history, so the version cannot be reserved with
+        // state_lock held. Until it is, rollbacks leave the signature alone.
+        pending_signature = PendingSignature{kv::NoVersion, 0, term, commit};
+      }
+
+      // Reserving the version here means no transaction after it can be
+      // replicated until the signature has been committed
+      auto [version, rollback_count] = store.next_version_and_rollback_count();
       LOG_INFO_FMT("Issuing signature at {}", version);
       LOG_DEBUG_FMT("Signed at {} term: {} commit: {}", version, term, commit);
-      store.commit(
-        version,
-        [version, term, commit, this]() {
-          Store::Tx sig(version);
-          auto sig_view = sig.get_view(signatures);
-          crypto::Sha256Hash root = tree.get_root();
-          Signature sig_value(
-            id, version, term, commit, kp.sign_hash(root.h, root.SIZE));
-          sig_view->put(0, sig_value);
-          return sig.commit_reserved();
-        },
-        true);
+
+      std::optional<SignatureRequest> ready;
+      {
+        std::lock_guard<SpinLock> guard(state_lock);
+        pending_signature->version = version;
+        pending_signature->rollback_count = rollback_count;
+        ready = take_ready_signature();
+      }
+      if (ready.has_value())
+        start_signing(std::move(ready.value()));
 #endif
     }
 
@@ -400,7 +704,10 @@ namespace ccf
       const std::vector<uint8_t>& request) override
     {
       LOG_DEBUG << fmt::format("HISTORY: add_request {0}", id) << std::endl;
-      requests[id] = request;
+      {
+        std::lock_guard<SpinLock> guard(state_lock);
+        requests[id] = request;
+      }
 
       if (!on_request.has_value())
         return false;
@@ -425,6 +732,45 @@ namespace ccf
 #endif
     }
 
+    void add_results(const std::vector<Result>& batch) override
+    {
+      if (batch.empty())
+        return;
+
+      auto hashes = hash_batch(batch);
+      for (const auto& h : hashes)
+        log_hash(h, APPEND);
+
+#ifdef PBFT
+      // Every result is reported with the root that includes it
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        crypto::Sha256Hash root;
+        {
+          std::lock_guard<SpinLock> guard(state_lock);
+          tree.append(hashes[i]);
+          root = tree.get_root();
+        }
+        results[batch[i].id] = {batch[i].version, root};
+        if (on_result.has_value())
+          on_result.value()({batch[i].id, batch[i].version, root});
+      }
+#else
+      std::optional<SignatureRequest> ready;
+      {
+        std::lock_guard<SpinLock> guard(state_lock);
+        tree.append(hashes);
+        ready = take_ready_signature();
+      }
+      LOG_DEBUG_FMT(
+        "HISTORY: add_results {} to {}",
+        batch.front().version,
+        batch.back().version);
+      if (ready.has_value())
+        start_signing(std::move(ready.value()));
+#endif
+    }
+
     void add_result(kv::TxHistory::RequestID id, kv::Version version) override
     {
       auto root = get_root();
@@ -443,8 +789,151 @@ namespace ccf
       const std::vector<uint8_t>& response) override
     {
       LOG_DEBUG << fmt::format("HISTORY: add_response {0}", id) << std::endl;
+      std::lock_guard<SpinLock> guard(state_lock);
       responses[id] = response;
     }
+
+  private:
+    // Hashes a batch of transactions, on the store's task runner if there is
+    // one, each task taking a contiguous range of them
+    std::vector<crypto::Sha256Hash> hash_batch(
+      const std::vector<Result>& batch)
+    {
+      static constexpr size_t results_per_task = 16;
+
+      std::vector<crypto::Sha256Hash> hashes(batch.size());
+      auto hash_range = [&hashes, &batch](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+          hashes[i] = crypto::Sha256Hash({*batch[i].data});
+      };
+
+      auto task_runner = store.get_task_runner();
+      if (!task_runner || batch.size() <= results_per_task)
+      {
+        hash_range(0, batch.size());
+        return hashes;
+      }
+
+      std::vector<std::function<void()>> tasks;
+      for (size_t i = 0; i < batch.size(); i += results_per_task)
+      {
+        const auto end = std::min(i + results_per_task, batch.size());
+        tasks.emplace_back([&hash_range, i, end]() { hash_range(i, end); });
+      }
+      task_runner(std::move(tasks));
+      return hashes;
+    }
+
+    // Must be called with state_lock held. Returns the pending signature
+    // once the tree has reached its version.
+    std::optional<SignatureRequest> take_ready_signature()
+    {
+      if (
+        !pending_signature.has_value() || pending_signature->signing ||
+        pending_signature->version == kv::NoVersion ||
+        tree.size() != static_cast<uint64_t>(pending_signature->version))
+        return std::nullopt;
+
+      pending_signature->signing = true;
+      return SignatureRequest{
+        pending_signature.value(), tree.get_frontier(), signature_epoch};
+    }
+
+    // Must be called with state_lock held
+    void cancel_pending_signature()
+    {
+      pending_signature.reset();
+      ++signature_epoch;
+    }
+
+    void start_signing(SignatureRequest&& request)
+    {
+      auto sign = [this, request = std::move(request)]() mutable {
+        commit_signature(request);
+      };
+
+      store.run_in_background(std::move(sign));
+    }
+
+    void commit_signature(SignatureRequest& request)
+    {
+      const auto version = request.pending.version;
+      const auto& root = request.frontier.root;
+      Signature sig_value(
+        id,
+        version,
+        request.pending.term,
+        request.pending.commit,
+        kp.sign_hash(root.h, root.SIZE));
+
+      Store::Tx sig(version);
+      auto sig_view = sig.get_view(signatures);
+      sig_view->put(0, sig_value);
+      auto reserved = sig.commit_reserved();
+
+      // Even if the signature has been discarded by a rollback, its version
+      // must be given to the store, which only knows whether it has been
+      // reused since
+      auto success = store.commit(
+        version,
+        [reserved = std::move(reserved)]() mutable {
+          return std::move(reserved);
+        },
+        true,
+        request.pending.rollback_count);
+
+      // A rollback after the signature was committed discards it from the
+      // store, and then from signed_roots, as it rolls back the history
+      std::lock_guard<SpinLock> guard(state_lock);
+      if (request.epoch != signature_epoch)
+      {
+        LOG_DEBUG_FMT("Signature at {} was rolled back", version);
+        return;
+      }
+
+      if (success == kv::CommitSuccess::CONFLICT)
+        LOG_DEBUG_FMT("Signature at {} was rolled back", version);
+      else
+        record_signed_root(
+          version, std::move(request.frontier), id, sig_value.sig);
+      pending_signature.reset();
+    }
+
+    typename T::Frontier get_frontier()
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      return tree.get_frontier();
+    }
+
+    void record_signature(
+      kv::Version version,
+      typename T::Frontier&& frontier,
+      NodeId node,
+      const std::vector<uint8_t>& sig)
+    {
+      std::lock_guard<SpinLock> guard(state_lock);
+      record_signed_root(version, std::move(frontier), node, sig);
+    }
+
+    // Must be called with state_lock held
+    void record_signed_root(
+      kv::Version version,
+      typename T::Frontier&& frontier,
+      NodeId node,
+      const std::vector<uint8_t>& sig)
+    {
+      // Receipts are checked against a tree of signed_version leaves
+      if (frontier.size != version)
+      {
+        LOG_FAIL_FMT(
+          "Signature at {} is over {} leaves, no receipts will be given for it",
+          version,
+          frontier.size);
+        return;
+      }
+
+      signed_roots[version] = {std::move(frontier), node, sig};
+    }
   };
 
   using MerkleTxHistory = HashedTxHistory<MerkleTreeHistory>;
@@ -118,6 +118,7 @@ namespace ccf
     ringbuffer::AbstractWriterFactory& writer_factory;
     std::unique_ptr<ringbuffer::AbstractWriter> to_host;
     raft::Config raft_config;
+    size_t sig_max_tx = 0;
 
     NetworkState& network;
 
@@ -154,8 +155,19 @@ namespace ccf
     std::vector<kv::Version> term_history;
     kv::Version last_recovered_commit_idx = 1;
 
+    // During recovery, the ledger is read from the host in ranges of up to
+    // this many entries. The next range is requested as soon as one arrives,
+    // so that the host reads it while the entries received are applied.
+    static constexpr raft::Index recovery_range_entries = 4096;
+    static constexpr std::chrono::milliseconds recovery_report_interval{5000};
+
+    // Index of the last ledger entry read during recovery
     raft::Index ledger_idx = 0;
 
+    // Time spent reading the ledger in the current pass, as reported by ticks
+    std::chrono::milliseconds recovery_elapsed{0};
+    std::chrono::milliseconds recovery_last_report{0};
+
   public:
     NodeState(
       ringbuffer::AbstractWriterFactory& writer_factory,
@@ -178,12 +190,14 @@ namespace ccf
     void initialize(
       raft::Config& raft_config_,
       std::shared_ptr<NodeToNode> n2n_channels_,
-      std::shared_ptr<enclave::RpcMap> rpc_map_)
+      std::shared_ptr<enclave::RpcMap> rpc_map_,
+      size_t sig_max_tx_)
     {
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::uninitialized);
 
       raft_config = raft_config_;
+      sig_max_tx = sig_max_tx_;
       n2n_channels = n2n_channels_;
       // Capture rpc_map to pass to pbft for frontend execution
       rpc_map = rpc_map_;
@@ -471,19 +485,104 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
       LOG_INFO_FMT("Start public recovery");
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
     }
 
-    void recover_public_ledger_entry(std::vector<uint8_t> ledger_entry)
+    //
+    // funcs in state "readingPublicLedger" or "readingPrivateLedger"
+    //
+
+    // Handles a range of entries read from the ledger, starting at from
+    void recover_ledger_entries(
+      raft::Index from, const std::vector<uint8_t>& framed_entries)
     {
       std::lock_guard<SpinLock> guard(lock);
-      sm.expect(State::readingPublicLedger);
 
-      LOG_DEBUG_FMT(
-        "Deserialising public ledger entry ({})", ledger_entry.size());
+      const bool reading_public = is_reading_public_ledger();
+      if (!reading_public && !is_reading_private_ledger())
+      {
+        LOG_FAIL_FMT("Cannot recover ledger entries: Unexpected state");
+        return;
+      }
+
+      // Ranges prefetched before a pass over the ledger ended early are
+      // discarded
+      if (from != ledger_idx + 1)
+      {
+        LOG_DEBUG_FMT(
+          "Ignoring ledger entries from {}, expected {}", from, ledger_idx + 1);
+        return;
+      }
+
+      if (framed_entries.empty())
+      {
+        if (reading_public)
+          recover_public_ledger_end_unsafe();
+        else
+          recover_private_ledger_end_unsafe();
+        return;
+      }
+
+      std::vector<std::vector<uint8_t>> entries;
+      auto data = framed_entries.data();
+      auto size = framed_entries.size();
+      while (size > 0)
+      {
+        auto entry_len = serialized::read<uint32_t>(data, size);
+        entries.emplace_back(data, data + entry_len);
+        serialized::skip(data, size, entry_len);
+      }
+
+      // The private ledger is only read up to the version recovered from the
+      // public ledger
+      raft::Index last = from + entries.size() - 1;
+      if (!reading_public)
+      {
+        last = std::min(last, recovery_v);
+        entries.resize(std::max<raft::Index>(last - from + 1, 0));
+      }
+
+      if (entries.empty())
+      {
+        recover_private_ledger_end_unsafe();
+        return;
+      }
+
+      // Ask for the next range before applying this one
+      if (reading_public || last < recovery_v)
+        request_ledger_range(last + 1);
+
+      if (reading_public)
+        recover_public_ledger_entries(entries);
+      else
+        recover_private_ledger_entries(entries);
 
+      if (
+        sm.check(reading_public ? State::readingPublicLedger :
+                                  State::readingPrivateLedger) &&
+        recovery_elapsed - recovery_last_report >= recovery_report_interval)
+      {
+        recovery_last_report = recovery_elapsed;
+        LOG_INFO_FMT(
+          "Read {} ledger entries ({} entries/s)", ledger_idx, recovery_rate());
+      }
+    }
+
+  private:
+    void recover_public_ledger_entries(
+      const std::vector<std::vector<uint8_t>>& entries)
+    {
       // When reading the public ledger, deserialise in the real store
-      auto result = network.tables->deserialise(ledger_entry, true);
+      network.tables->deserialise_batch(
+        entries, true, [this](kv::DeserialiseSuccess result, kv::Term) {
+          recover_public_ledger_entry(result);
+        });
+    }
+
+    void recover_public_ledger_entry(kv::DeserialiseSuccess result)
+    {
+      ++ledger_idx;
+
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in public ledger");
@@ -496,33 +595,38 @@ namespace ccf
       if (result == kv::DeserialiseSuccess::PASS_SIGNATURE)
       {
         network.tables->compact(ledger_idx);
-        Store::Tx tx;
-        auto sig_view = tx.get_view(network.signatures);
-        auto sig = sig_view->get(0);
-        if (sig.has_value())
-        {
-          auto sig_value = sig.value();
-          LOG_DEBUG_FMT(
-            "Read signature at {} for term {}", ledger_idx, sig_value.term);
-          for (auto i = term_history.size(); i <= sig_value.term; ++i)
-          {
-            term_history.push_back(last_recovered_commit_idx + 1);
-          }
-          last_recovered_commit_idx = ledger_idx;
-        }
-        else
-        {
+        if (recover_signature() == 0)
           throw std::logic_error("Invalid signature");
-        }
       }
+    }
 
-      read_ledger_idx(++ledger_idx);
+    // Records the term of the latest signature, read at ledger_idx, and
+    // returns it, or 0 if there is no signature
+    kv::Term recover_signature()
+    {
+      Store::Tx tx;
+      auto sig_view = tx.get_view(network.signatures);
+      auto sig = sig_view->get(0);
+      if (!sig.has_value())
+        return 0;
+
+      auto sig_value = sig.value();
+      LOG_DEBUG_FMT(
+        "Read signature at {} for term {}", ledger_idx, sig_value.term);
+      for (auto i = term_history.size(); i <= sig_value.term; ++i)
+      {
+        term_history.push_back(last_recovered_commit_idx + 1);
+      }
+      last_recovered_commit_idx = ledger_idx;
+      return sig_value.term;
     }
 
+  public:
     void recover_public_ledger_end_unsafe()
     {
       Store::Tx tx;
       sm.expect(State::readingPublicLedger);
+      report_recovery_end();
 
       // When reaching the end of the public ledger, truncate to last signed
       // index and promote network secrets to this index
@@ -547,19 +651,27 @@ namespace ccf
       return sig_value.index;
     }
 
+  private:
     //
     // funcs in state "readingPrivateLedger"
     //
-    void recover_private_ledger_entry(std::vector<uint8_t> ledger_entry)
+    void recover_private_ledger_entries(
+      const std::vector<std::vector<uint8_t>>& entries)
     {
-      std::lock_guard<SpinLock> guard(lock);
-      sm.expect(State::readingPrivateLedger);
+      // When reading the private ledger, deserialise in the recovery store.
+      // Reaching the end of the private ledger releases the recovery store,
+      // so keep it alive until the batch has been applied.
+      auto store = recovery_store;
+      store->deserialise_batch(
+        entries, false, [this](kv::DeserialiseSuccess result, kv::Term) {
+          recover_private_ledger_entry(result);
+        });
+    }
 
-      LOG_INFO_FMT(
-        "Deserialising private ledger entry ({})", ledger_entry.size());
+    void recover_private_ledger_entry(kv::DeserialiseSuccess result)
+    {
+      ++ledger_idx;
 
-      // When reading the private ledger, deserialise in the recovery store
-      auto result = recovery_store->deserialise(ledger_entry);
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in private ledger");
@@ -576,15 +688,13 @@ namespace ccf
         LOG_INFO_FMT("Reached recovery final version at {}", recovery_v);
         recover_private_ledger_end_unsafe();
       }
-      else
-      {
-        read_ledger_idx(++ledger_idx);
-      }
     }
 
+  public:
     void recover_private_ledger_end_unsafe()
     {
       sm.expect(State::readingPrivateLedger);
+      report_recovery_end();
 
       // When reaching the end of the private ledger, make sure the same
       // ledger has been read and swap in private state
@@ -616,29 +726,6 @@ namespace ccf
       sm.advance(State::partOfNetwork);
     }
 
-    //
-    // funcs in state "readingPublicLedger" or "readingPrivateLedger"
-    //
-    void recover_ledger_end()
-    {
-      std::lock_guard<SpinLock> guard(lock);
-
-      if (is_reading_public_ledger())
-      {
-        recover_public_ledger_end_unsafe();
-      }
-      else if (is_reading_private_ledger())
-      {
-        recover_private_ledger_end_unsafe();
-      }
-      else
-      {
-        throw std::logic_error(
-          "Cannot end ledger recovery if not reading public or private "
-          "ledger");
-      }
-    }
-
     void node_quotes(Store::Tx& tx, GetQuotes::Out& result)
     {
       auto nodes_view = tx.get_view(network.nodes);
@@ -776,16 +863,20 @@ namespace ccf
       // Setup recovery store by cloning tables of store
       recovery_store = std::make_shared<Store>();
       recovery_store->clone_schema(*network.tables);
+      recovery_store->set_task_runner(network.tables->get_task_runner());
       Signatures* recovery_signature_map =
         recovery_store->get<Signatures>("signatures");
       Nodes* recovery_nodes_map = recovery_store->get<Nodes>("nodes");
 
-      recovery_history = std::make_shared<MerkleTxHistory>(
+      auto recovery_merkle_history = std::make_shared<MerkleTxHistory>(
         *recovery_store.get(),
         self,
         *node_kp,
         *recovery_signature_map,
         *recovery_nodes_map);
+      recovery_merkle_history->set_receipt_history_len(
+        receipt_history_len());
+      recovery_history = recovery_merkle_history;
 
       recovery_encryptor =
 #ifdef USE_NULL_ENCRYPTOR
@@ -890,8 +981,7 @@ namespace ccf
       setup_private_recovery_store();
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
 
       sm.advance(State::readingPrivateLedger);
       return true;
@@ -902,6 +992,9 @@ namespace ccf
     //
     void tick(std::chrono::milliseconds elapsed)
     {
+      if (is_reading_public_ledger() || is_reading_private_ledger())
+        recovery_elapsed += elapsed;
+
       if (
         !sm.check(State::partOfNetwork) &&
         !sm.check(State::partOfPublicNetwork))
@@ -1073,8 +1166,7 @@ namespace ccf
       raft->suspend_replication(recovery_v + 1);
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger();
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1093,7 +1185,11 @@ namespace ccf
         self,
         raft_config.requestTimeout,
         raft_config.electionTimeout,
-        public_only);
+        public_only,
+        raft_config.waitForDurableLedger,
+        raft_config.maxInflightBatches,
+        raft_config.maxInflightBytes,
+        raft_config.snapshotInterval);
 #else
       raft = std::make_shared<pbft::NullReplicator>(n2n_channels, self);
 #endif
@@ -1211,16 +1307,25 @@ namespace ccf
       });
     }
 
+    size_t receipt_history_len() const
+    {
+      // Receipts are kept for the last two signature intervals, each of which
+      // ends with its signature transaction
+      return 2 * (sig_max_tx + 1);
+    }
+
     void setup_history()
     {
       // This function can be called once the node has started up and before it
       // has joined the service.
-      history = std::make_shared<MerkleTxHistory>(
+      auto h = std::make_shared<MerkleTxHistory>(
         *network.tables.get(),
         self,
         *node_kp,
         network.signatures,
         network.nodes);
+      h->set_receipt_history_len(receipt_history_len());
+      history = h;
 
 #ifdef PBFT
       if (pbft)
@@ -1263,14 +1368,54 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(raft::Index idx)
+    void start_reading_ledger()
+    {
+      ledger_idx = 0;
+      recovery_elapsed = std::chrono::milliseconds(0);
+      recovery_last_report = std::chrono::milliseconds(0);
+
+      // Snapshots kept by the host are not signed, so could have been
+      // tampered with. The whole ledger is read instead.
+      request_ledger_range(1);
+    }
+
+    void request_ledger_range(raft::Index from)
+    {
+      RINGBUFFER_WRITE_MESSAGE(
+        raft::log_get_range,
+        to_host,
+        from,
+        from + recovery_range_entries - 1);
+    }
+
+    size_t recovery_rate() const
+    {
+      const auto ms = std::max<size_t>(recovery_elapsed.count(), 1);
+      return ledger_idx * 1000 / ms;
+    }
+
+    void report_recovery_end()
     {
-      RINGBUFFER_WRITE_MESSAGE(raft::log_get, to_host, idx);
+      LOG_INFO_FMT(
+        "Read {} ledger entries in {}ms ({} entries/s)",
+        ledger_idx,
+        recovery_elapsed.count(),
+        recovery_rate());
+    }
+
+    void durable_ledger(raft::Index idx, size_t epoch)
+    {
+#ifndef PBFT
+      if (raft)
+        raft->durable_ledger(idx, epoch);
+#endif
     }
 
     void log_truncate(raft::Index idx)
     {
-      RINGBUFFER_WRITE_MESSAGE(raft::log_truncate, to_host, idx);
+      // Only used before consensus starts, so these truncations precede any
+      // made by raft, which start from epoch 1
+      RINGBUFFER_WRITE_MESSAGE(raft::log_truncate, to_host, idx, (size_t)0);
     }
 
 #ifdef PBFT
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ds/ringbuffer_types.h"
+#include "ds/spinlock.h"
 #include "enclave/interface.h"
 #include "rpc/frontend.h"
 
@@ -13,6 +14,9 @@ namespace ccf
   private:
     std::unique_ptr<ringbuffer::AbstractWriter> to_host;
 
+    // Notifications may be sent by RPCs running on any enclave thread
+    SpinLock lock;
+
   public:
     Notifier(ringbuffer::AbstractWriterFactory& writer_factory_) :
       to_host(writer_factory_.create_writer_to_outside())
@@ -20,6 +24,7 @@ namespace ccf
 
     void notify(const std::vector<uint8_t>& data) override
     {
+      std::lock_guard<SpinLock> guard(lock);
       RINGBUFFER_WRITE_MESSAGE(AdminMessage::notification, to_host, data);
     }
   };
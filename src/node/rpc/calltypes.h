@@ -86,4 +86,22 @@ namespace ccf
       ds::json::JsonSchema result_schema = {};
     };
   };
+
+  struct GetReceipt
+  {
+    struct In
+    {
+      int64_t commit = {};
+    };
+
+    struct Out
+    {
+      int64_t commit = {};
+      int64_t signed_index = {};
+      std::vector<uint8_t> root = {};
+      std::vector<std::vector<uint8_t>> path = {};
+      NodeId node = {};
+      std::vector<uint8_t> signature = {};
+    };
+  };
 }
\ No newline at end of file
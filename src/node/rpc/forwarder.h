@@ -4,6 +4,7 @@
 
 #include "enclave/enclavetypes.h"
 #include "enclave/rpcmap.h"
+#include "enclave/workerpool.h"
 #include "node/nodetonode.h"
 
 namespace ccf
@@ -36,13 +37,16 @@ namespace ccf
     enclave::AbstractRPCResponder& rpcresponder;
     std::shared_ptr<NodeToNode> n2n_channels;
     std::shared_ptr<enclave::RpcMap> rpc_map;
+    enclave::WorkerPool* workers;
 
   public:
     Forwarder(
       enclave::AbstractRPCResponder& rpcresponder,
-      std::shared_ptr<NodeToNode> n2n_channels) :
+      std::shared_ptr<NodeToNode> n2n_channels,
+      enclave::WorkerPool* workers = nullptr) :
       rpcresponder(rpcresponder),
-      n2n_channels(n2n_channels)
+      n2n_channels(n2n_channels),
+      workers(workers)
     {}
 
     void initialize(std::shared_ptr<enclave::RpcMap> rpc_map_)
@@ -69,6 +73,36 @@ namespace ccf
 
       ForwardedHeader msg = {ForwardedMsg::forwarded_cmd, from};
 
+      // Node-to-node channels belong to the main enclave thread. A command
+      // received by a worker is handed over, and if it turns out it cannot be
+      // forwarded the client is answered from there.
+      if (
+        workers != nullptr &&
+        !workers->is_current_thread(enclave::WorkerPool::main_thread))
+      {
+        workers->post(
+          enclave::WorkerPool::main_thread,
+          [this,
+           to,
+           msg,
+           plain = std::move(plain),
+           session_id = rpc_ctx.client_session_id,
+           pack = rpc_ctx.pack.value_or(jsonrpc::Pack::Text)]() {
+            if (!n2n_channels->send_encrypted(to, plain, msg))
+            {
+              rpcresponder.reply_async(
+                session_id,
+                jsonrpc::pack(
+                  jsonrpc::error_response(
+                    0,
+                    jsonrpc::CCFErrorCodes::RPC_NOT_FORWARDED,
+                    "RPC could not be forwarded to leader."),
+                  pack));
+            }
+          });
+        return true;
+      }
+
       return n2n_channels->send_encrypted(to, plain, msg);
     }
 
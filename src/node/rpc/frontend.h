@@ -2,9 +2,11 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 #include "consts.h"
+#include "ds/batchqueue.h"
 #include "ds/buffer.h"
 #include "ds/histogram.h"
 #include "ds/json_schema.h"
+#include "ds/spinlock.h"
 #include "enclave/rpchandler.h"
 #include "forwarder.h"
 #include "jsonrpc.h"
@@ -18,6 +20,9 @@
 #include "serialization.h"
 
 #include <fmt/format_header_only.h>
+#include <msgpack-c/msgpack.hpp>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -59,10 +64,28 @@ namespace ccf
     using MinimalHandleFunction = std::function<std::pair<bool, nlohmann::json>(
       Store::Tx& tx, const nlohmann::json& params)>;
 
+    // Handles a binary request, decoding its MsgPack params directly
+    using BinaryHandleFunction = std::function<std::pair<bool, nlohmann::json>(
+      RequestArgs& args, CBuffer params)>;
+
     using CallerKey = std::vector<uint8_t>;
 
     // TODO: replace with an lru map
+    // Signatures may be checked by several threads at once, so only
+    // verifiers which support concurrent verification are kept here
     std::map<CallerId, tls::VerifierPtr> verifiers;
+    SpinLock verifiers_lock;
+
+    // A client signature to be checked, and the result of checking it
+    struct SignatureCheck
+    {
+      SignedReq signed_request;
+      bool verified = false;
+    };
+
+    // Signatures pending on every session are collected here, and checked
+    // together on the store's task runner
+    ds::BatchQueue signature_checks;
 
     struct Handler
     {
@@ -71,48 +94,119 @@ namespace ccf
       nlohmann::json params_schema;
       nlohmann::json result_schema;
       Forwardable forwardable;
+      BinaryHandleFunction binary_func = nullptr;
     };
 
     Nodes* nodes;
     ClientSignatures* client_signatures;
     Certs* certs;
+    // Counts global commits to certs, after which sessions resolve their
+    // caller again. Shared with the commit hook, which may outlive this.
+    std::shared_ptr<std::atomic<size_t>> certs_epoch =
+      std::make_shared<std::atomic<size_t>>(0);
     std::optional<Handler> default_handler;
     std::unordered_map<std::string, Handler> handlers;
-    kv::Replicator* raft;
+    // Entries of handlers, by the method ID used in binary requests
+    std::unordered_map<
+      jsonrpc::MethodId,
+      std::pair<const std::string, Handler>*>
+      methods_by_id;
+    // Requests are processed on the workers while the main thread ticks, so
+    // each caller works on its own copy of these pointers
+    std::atomic<kv::Replicator*> raft;
     std::shared_ptr<AbstractForwarder> cmd_forwarder;
-    kv::TxHistory* history;
-    size_t sig_max_tx = 1000;
-    size_t tx_count = 0;
+    std::atomic<kv::TxHistory*> history;
+    std::atomic<size_t> sig_max_tx{1000};
+    std::atomic<size_t> tx_count{0};
+    // Guards the signature interval and the time left until the next
+    // signature
+    SpinLock sig_lock;
     std::chrono::milliseconds sig_max_ms = std::chrono::milliseconds(1000);
     std::chrono::milliseconds ms_to_sig = std::chrono::milliseconds(1000);
     bool request_storing_disabled = false;
     metrics::Metrics metrics;
 
-    void update_raft()
+    kv::Replicator* update_raft()
     {
-      if (raft != tables.get_replicator().get())
-      {
-        raft = tables.get_replicator().get();
-      }
+      auto r = tables.get_replicator().get();
+      raft.store(r);
+      return r;
     }
 
-    void update_history()
+    kv::TxHistory* update_history()
     {
       // TODO: removed for now because frontend needs access to history
       // during recovery, on RPC, when not primary. Can be changed back once
       // frontend calls into Consensus.
       // if (history == nullptr)
-      history = tables.get_history().get();
+      auto h = tables.get_history().get();
+      history.store(h);
+      return h;
+    }
+
+    template <typename T, typename = void>
+    struct has_msgpack_unpack : std::false_type
+    {};
+
+    template <typename T>
+    struct has_msgpack_unpack<
+      T,
+      std::void_t<decltype(std::declval<T&>().msgpack_unpack(
+        std::declval<const msgpack::object&>()))>> : std::true_type
+    {};
+
+    template <typename In>
+    static In decode_binary_params(CBuffer params)
+    {
+      if constexpr (has_msgpack_unpack<In>::value)
+      {
+        // Types declaring MSGPACK_DEFINE_MAP are decoded without building a
+        // JSON object. msgpack-c would value-initialise any missing field, so
+        // the fields required by the JSON schema are checked for first.
+        static const nlohmann::json required =
+          ds::json::build_schema<In>("params").value(
+            "required", nlohmann::json::array());
+
+        auto oh =
+          msgpack::unpack(reinterpret_cast<const char*>(params.p), params.n);
+        const auto& obj = oh.get();
+        if (obj.type != msgpack::type::MAP)
+          throw std::logic_error("Params are not an object");
+
+        for (const auto& field : required)
+        {
+          const auto& name = field.get_ref<const std::string&>();
+          bool found = false;
+          for (uint32_t i = 0; i < obj.via.map.size && !found; ++i)
+          {
+            const auto& key = obj.via.map.ptr[i].key;
+            found = key.type == msgpack::type::STR &&
+              std::string_view(key.via.str.ptr, key.via.str.size) == name;
+          }
+          if (!found)
+            throw std::logic_error(
+              fmt::format("Missing required field '{}'", name));
+        }
+
+        In in{};
+        obj.convert(in);
+        return in;
+      }
+      else
+      {
+        return nlohmann::json::from_msgpack(params.p, params.p + params.n)
+          .get<In>();
+      }
     }
 
     std::pair<bool, nlohmann::json> unpack_json(
-      const std::vector<uint8_t>& input, jsonrpc::Pack pack)
+      CBuffer input, jsonrpc::Pack pack, bool allow_batch = false)
     {
       nlohmann::json rpc;
       try
       {
         rpc = jsonrpc::unpack(input, pack);
-        if (!rpc.is_object())
+        if (!rpc.is_object() && !(allow_batch && rpc.is_array()))
           return jsonrpc::error(
             jsonrpc::StandardErrorCodes::INVALID_REQUEST,
             fmt::format("RPC payload is a not a valid object: {}", rpc.dump()));
@@ -127,6 +221,35 @@ namespace ccf
       return {true, rpc};
     }
 
+    /** Id of the caller of ctx. It is looked up once per session, and again
+     * after a change to the certs table is globally committed or the store
+     * is rolled back.
+     */
+    std::optional<CallerId> resolve_caller(
+      Store::Tx& tx, enclave::RPCContext& ctx)
+    {
+      auto session = ctx.session_caller;
+      if (session == nullptr)
+        return valid_caller(tx, ctx.caller_cert);
+
+      // Read before the lookup, so that a concurrent change is never missed
+      const auto epoch = certs_epoch->load();
+      const auto rollback_count = tables.get_rollback_count();
+
+      if (
+        session->caller_id.has_value() && session->certs_epoch == epoch &&
+        session->rollback_count == rollback_count)
+        return session->caller_id;
+
+      // Unknown callers are not cached, so that a certificate added since
+      // is accepted straight away
+      session->caller_id = valid_caller(tx, ctx.caller_cert);
+      session->verifier = nullptr;
+      session->certs_epoch = epoch;
+      session->rollback_count = rollback_count;
+      return session->caller_id;
+    }
+
     std::optional<CallerId> valid_caller(Store::Tx& tx, const CBuffer& caller)
     {
       if (certs == nullptr)
@@ -154,6 +277,7 @@ namespace ccf
       {
         // If this frontend is not allowed to forward or the command has already
         // been forwarded, redirect to the current leader
+        auto raft = this->raft.load();
         if ((nodes != nullptr) && (raft != nullptr))
         {
           NodeId leader_id = raft->leader();
@@ -187,12 +311,23 @@ namespace ccf
       raft(nullptr),
       history(nullptr)
     {
+      if (certs != nullptr)
+      {
+        // A revoked certificate stops being accepted on existing sessions
+        // once its removal is globally committed
+        certs->set_global_hook(
+          [certs_epoch = certs_epoch](
+            kv::Version, const Certs::State&, const Certs::Write&) {
+            ++*certs_epoch;
+          });
+      }
+
       auto get_commit = [this](Store::Tx& tx, const nlohmann::json& params) {
         const auto in = params.get<GetCommit::In>();
 
         kv::Version commit = in.commit.value_or(tables.commit_version());
 
-        update_raft();
+        auto raft = update_raft();
 
         if (raft != nullptr)
         {
@@ -212,7 +347,7 @@ namespace ccf
 
       auto make_signature =
         [this](Store::Tx& tx, const nlohmann::json& params) {
-          update_history();
+          auto history = update_history();
 
           if (history != nullptr)
           {
@@ -227,6 +362,7 @@ namespace ccf
 
       auto get_leader_info =
         [this](Store::Tx& tx, const nlohmann::json& params) {
+          auto raft = this->raft.load();
           if ((nodes != nullptr) && (raft != nullptr))
           {
             NodeId leader_id = raft->leader();
@@ -251,6 +387,7 @@ namespace ccf
       auto get_network_info =
         [this](Store::Tx& tx, const nlohmann::json& params) {
           GetNetworkInfo::Out out;
+          auto raft = this->raft.load();
           if (raft != nullptr)
           {
             out.leader_id = raft->leader();
@@ -298,6 +435,45 @@ namespace ccf
         return jsonrpc::success(out);
       };
 
+      auto get_receipt = [this](Store::Tx& tx, const nlohmann::json& params) {
+        const auto in = params.get<GetReceipt::In>();
+
+        if (in.commit <= 0 || in.commit > tables.commit_version())
+        {
+          return jsonrpc::error(
+            jsonrpc::StandardErrorCodes::INVALID_PARAMS,
+            fmt::format("Version {} is not committed", in.commit));
+        }
+
+        auto history = update_history();
+
+        if (history != nullptr)
+        {
+          auto receipt = history->get_receipt(in.commit);
+          if (
+            receipt.has_value() &&
+            receipt->signed_version <= tables.commit_version())
+          {
+            GetReceipt::Out out;
+            out.commit = receipt->version;
+            out.signed_index = receipt->signed_version;
+            out.root.assign(
+              receipt->root.h, receipt->root.h + receipt->root.SIZE);
+            for (const auto& h : receipt->path)
+              out.path.emplace_back(h.h, h.h + h.SIZE);
+            out.node = receipt->node;
+            out.signature = std::move(receipt->signature);
+            return jsonrpc::success(out);
+          }
+        }
+
+        return jsonrpc::error(
+          jsonrpc::StandardErrorCodes::INVALID_PARAMS,
+          fmt::format(
+            "No committed signature over version {} is held in the history",
+            in.commit));
+      };
+
       install_with_auto_schema<GetCommit>(
         GeneralProcs::GET_COMMIT, get_commit, Read);
       install_with_auto_schema<void, GetMetrics::Out>(
@@ -312,6 +488,8 @@ namespace ccf
         GeneralProcs::LIST_METHODS, list_methods, Read);
       install_with_auto_schema<GetSchema>(
         GeneralProcs::GET_SCHEMA, get_schema, Read);
+      install_with_auto_schema<GetReceipt>(
+        GeneralProcs::GET_RECEIPT, get_receipt, Read);
     }
 
     void disable_request_storing()
@@ -322,6 +500,8 @@ namespace ccf
     void set_sig_intervals(size_t sig_max_tx_, size_t sig_max_ms_)
     {
       sig_max_tx = sig_max_tx_;
+
+      std::lock_guard<SpinLock> guard(sig_lock);
       sig_max_ms = std::chrono::milliseconds(sig_max_ms_);
       ms_to_sig = sig_max_ms;
     }
@@ -351,7 +531,21 @@ namespace ccf
       const nlohmann::json& result_schema = nlohmann::json::object(),
       Forwardable forwardable = Forwardable::CanForward)
     {
-      handlers[method] = {f, rw, params_schema, result_schema, forwardable};
+      auto& entry = *handlers
+                       .insert_or_assign(
+                         method,
+                         Handler{
+                           f, rw, params_schema, result_schema, forwardable})
+                       .first;
+
+      const auto id = jsonrpc::method_id(method);
+      const auto [it, inserted] = methods_by_id.emplace(id, &entry);
+      if (!inserted && it->second != &entry)
+        throw std::logic_error(fmt::format(
+          "Method ID {} of {} is already used by {}",
+          id,
+          method,
+          it->second->first));
     }
 
     void install(
@@ -405,13 +599,47 @@ namespace ccf
         result_schema = ds::json::build_schema<Out>(method + "/result");
       }
 
-      install(
-        method,
-        std::forward<F>(f),
-        rw,
-        params_schema,
-        result_schema,
-        forwardable);
+      if constexpr (
+        !std::is_same_v<In, void> && std::is_invocable_v<F, RequestArgs&, In&&>)
+      {
+        // Handlers taking In directly can also be called with binary
+        // requests, without going through JSON
+        install(
+          method,
+          [f](RequestArgs& args) { return f(args, args.params.get<In>()); },
+          rw,
+          params_schema,
+          result_schema,
+          forwardable);
+
+        handlers[method].binary_func =
+          [f](
+            RequestArgs& args,
+            CBuffer params) -> std::pair<bool, nlohmann::json> {
+          std::optional<In> in;
+          try
+          {
+            in = decode_binary_params<In>(params);
+          }
+          catch (const std::exception& e)
+          {
+            return jsonrpc::error(
+              jsonrpc::StandardErrorCodes::INVALID_PARAMS,
+              fmt::format("Could not decode params: {}", e.what()));
+          }
+          return f(args, std::move(in.value()));
+        };
+      }
+      else
+      {
+        install(
+          method,
+          std::forward<F>(f),
+          rw,
+          params_schema,
+          result_schema,
+          forwardable);
+      }
     }
 
     template <typename T, typename... Ts>
@@ -434,13 +662,15 @@ namespace ccf
       default_handler = {f, rw};
     }
 
-    std::optional<jsonrpc::Pack> detect_pack(const std::vector<uint8_t>& input)
+    std::optional<jsonrpc::Pack> detect_pack(CBuffer input)
     {
-      if (input.size() == 0)
+      if (input.n == 0)
         return {};
 
-      if (input[0] == '{')
+      if (input.p[0] == '{' || input.p[0] == '[')
         return jsonrpc::Pack::Text;
+      else if (input.p[0] == jsonrpc::BINARY_MAGIC)
+        return jsonrpc::Pack::Binary;
       else
         return jsonrpc::Pack::MsgPack;
     }
@@ -454,7 +684,7 @@ namespace ccf
      * @param input Serialised JSON RPC
      */
     std::vector<uint8_t> process(
-      enclave::RPCContext& ctx, const std::vector<uint8_t>& input) override
+      enclave::RPCContext& ctx, CBuffer input) override
     {
       Store::Tx tx;
 
@@ -466,7 +696,7 @@ namespace ccf
           jsonrpc::Pack::Text);
 
       // Retrieve id of caller
-      auto caller_id = valid_caller(tx, ctx.caller_cert);
+      auto caller_id = resolve_caller(tx, ctx);
       if (!caller_id.has_value())
       {
         return jsonrpc::pack(
@@ -476,24 +706,50 @@ namespace ccf
             "No corresponding caller entry exists."),
           ctx.pack.value());
       }
-      auto rpc = unpack_json(input, ctx.pack.value());
+
+      if (ctx.pack.value() == jsonrpc::Pack::Binary)
+      {
+#ifdef PBFT
+        return jsonrpc::pack(
+          jsonrpc::error_response(
+            0,
+            jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+            "Binary requests are not supported with PBFT."),
+          ctx.pack.value());
+#else
+        return reply_or_forward(
+          ctx,
+          caller_id.value(),
+          input,
+          process_binary(ctx, tx, caller_id.value(), input));
+#endif
+      }
+
+      auto rpc = unpack_json(input, ctx.pack.value(), true);
 
       if (!rpc.first)
         return jsonrpc::pack(rpc.second, ctx.pack.value());
 
+      if (rpc.second.is_array())
+        return process_batch(ctx, caller_id.value(), rpc.second);
+
       auto rpc_ = &rpc.second;
       SignedReq signed_request(rpc.second);
       if (rpc_->find(jsonrpc::SIG) != rpc_->end())
       {
         auto& req = rpc_->at(jsonrpc::REQ);
 
+        // The signature may already have been checked, with those of other
+        // requests read at the same time
         if (!verify_client_signature(
               tx,
               ctx.caller_cert,
               caller_id.value(),
               *rpc_,
               ctx.fwd.has_value(),
-              signed_request))
+              signed_request,
+              ctx.signature_verified,
+              ctx.session_caller))
         {
           return jsonrpc::pack(
             jsonrpc::error_response(
@@ -509,12 +765,13 @@ namespace ccf
 #ifdef PBFT
       kv::TxHistory::RequestID reqid;
 
-      update_history();
+      auto history = update_history();
       size_t jsonrpc_id = unsigned_rpc[jsonrpc::ID];
       reqid = {caller_id.value(), ctx.client_session_id, jsonrpc_id};
       if (history)
       {
-        if (!history->add_request(reqid, ctx.actor, caller_id.value(), input))
+        if (!history->add_request(
+              reqid, ctx.actor, caller_id.value(), std::vector<uint8_t>(input)))
         {
           LOG_FAIL_FMT("Adding request {} failed", jsonrpc_id);
           return jsonrpc::pack(
@@ -538,12 +795,27 @@ namespace ccf
       }
       return {};
 #else
-      auto rep =
-        process_json(ctx, tx, caller_id.value(), unsigned_rpc, signed_request);
+      return reply_or_forward(
+        ctx,
+        caller_id.value(),
+        input,
+        process_json(
+          ctx, tx, caller_id.value(), unsigned_rpc, signed_request));
+#endif
+    }
 
-      // If necessary, forward the RPC to the current leader
+    /** Pack the response to a command, or forward it to the current leader if
+     * it could not be executed here
+     */
+    std::vector<uint8_t> reply_or_forward(
+      enclave::RPCContext& ctx,
+      CallerId caller_id,
+      CBuffer input,
+      const std::optional<nlohmann::json>& rep)
+    {
       if (!rep.has_value())
       {
+        auto raft = this->raft.load();
         if (raft != nullptr)
         {
           auto leader_id = raft->leader();
@@ -552,7 +824,11 @@ namespace ccf
           if (
             leader_id != NoNode &&
             cmd_forwarder->forward_command(
-              ctx, local_id, leader_id, caller_id.value(), input))
+              ctx,
+              local_id,
+              leader_id,
+              caller_id,
+              std::vector<uint8_t>(input)))
           {
             // Indicate that the RPC has been forwarded to leader
             LOG_DEBUG_FMT("RPC forwarded to leader {}", leader_id);
@@ -568,12 +844,114 @@ namespace ccf
           ctx.pack.value());
       }
 
-      auto rv = jsonrpc::pack(rep.value(), ctx.pack.value());
+      return jsonrpc::pack(rep.value(), ctx.pack.value());
+    }
 
-      return rv;
+    /** Process a JSON-RPC batch
+     *
+     * Each request in the batch is executed in turn, in its own transaction,
+     * and the responses are returned together in a single array. Requests
+     * which would have to be forwarded to the leader are rejected, since the
+     * batch is answered as a whole by this node.
+     *
+     * @param ctx Context for this batch
+     * @param caller_id Id of the caller, already validated
+     * @param batch Array of (possibly signed) JSON RPCs
+     */
+    std::vector<uint8_t> process_batch(
+      enclave::RPCContext& ctx,
+      CallerId caller_id,
+      const nlohmann::json& batch)
+    {
+      if (batch.empty())
+        return jsonrpc::pack(
+          jsonrpc::error_response(
+            0, jsonrpc::StandardErrorCodes::INVALID_REQUEST, "Empty batch."),
+          ctx.pack.value());
+
+#ifdef PBFT
+      return jsonrpc::pack(
+        jsonrpc::error_response(
+          0,
+          jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+          "Batched requests are not supported with PBFT."),
+        ctx.pack.value());
+#else
+      // The signatures of all entries are checked together, before any entry
+      // is processed, so that they can be verified in parallel
+      std::vector<const nlohmann::json*> rpcs;
+      for (const auto& rpc : batch)
+        rpcs.push_back(&rpc);
+      auto verified = check_client_signatures(ctx, caller_id, rpcs);
+
+      auto responses = nlohmann::json::array();
+      for (size_t i = 0; i < batch.size(); ++i)
+        responses.push_back(
+          process_batch_entry(ctx, caller_id, batch[i], verified[i]));
+
+      return jsonrpc::pack(responses, ctx.pack.value());
 #endif
     }
 
+    nlohmann::json process_batch_entry(
+      enclave::RPCContext& ctx,
+      CallerId caller_id,
+      const nlohmann::json& rpc,
+      std::optional<bool> verified)
+    {
+      if (!rpc.is_object())
+        return jsonrpc::error_response(
+          0,
+          jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+          fmt::format("RPC payload is a not a valid object: {}", rpc.dump()));
+
+      Store::Tx tx;
+
+      try
+      {
+        auto rpc_ = &rpc;
+        SignedReq signed_request(rpc);
+        if (rpc.find(jsonrpc::SIG) != rpc.end())
+        {
+          auto& req = rpc.at(jsonrpc::REQ);
+
+          if (!verify_client_signature(
+                tx,
+                ctx.caller_cert,
+                caller_id,
+                rpc,
+                ctx.fwd.has_value(),
+                signed_request,
+                verified,
+                ctx.session_caller))
+          {
+            return jsonrpc::error_response(
+              req.at(jsonrpc::ID),
+              jsonrpc::CCFErrorCodes::INVALID_CLIENT_SIGNATURE,
+              "Failed to verify client signature.");
+          }
+          rpc_ = &req;
+        }
+
+        auto rep = process_json(ctx, tx, caller_id, *rpc_, signed_request);
+        if (!rep.has_value())
+          return jsonrpc::error_response(
+            ctx.req.seq_no,
+            jsonrpc::CCFErrorCodes::RPC_NOT_FORWARDED,
+            "Batched RPC cannot be forwarded to leader.");
+
+        return rep.value();
+      }
+      catch (const std::exception& e)
+      {
+        // A malformed entry only fails that entry, not the whole batch
+        return jsonrpc::error_response(
+          0,
+          jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+          fmt::format("Exception during batch entry: {}", e.what()));
+      }
+    }
+
     /** Process a serialised command with the associated RPC context via PBFT
      *
      * @param ctx Context for this RPC
@@ -611,6 +989,7 @@ namespace ccf
       }
       auto& unsigned_rpc = *rpc_;
       bool has_updated_merkle_root = false;
+      auto history = this->history.load();
 
       auto cb = [&merkle_root, &has_updated_merkle_root](
                   kv::TxHistory::ResultCallbackArgs args) -> bool {
@@ -660,8 +1039,7 @@ namespace ccf
       // instead.
       CBuffer caller;
 
-      update_raft();
-      ctx.fwd->leader_id = raft->id();
+      ctx.fwd->leader_id = update_raft()->id();
 
       auto pack = detect_pack(input);
       if (!pack.has_value())
@@ -684,23 +1062,32 @@ namespace ccf
           pack.value());
       }
 
-      auto rpc = unpack_json(input, pack.value());
-      if (!rpc.first)
-        return jsonrpc::pack(rpc.second, pack.value());
+      std::optional<nlohmann::json> rep;
+      if (pack.value() == jsonrpc::Pack::Binary)
+      {
+        rep = process_binary(ctx, tx, ctx.fwd->caller_id, input);
+      }
+      else
+      {
+        auto rpc = unpack_json(input, pack.value());
+        if (!rpc.first)
+          return jsonrpc::pack(rpc.second, pack.value());
 
-      // Unwrap signed request if necessary
-      auto rpc_ = &rpc.second;
-      SignedReq signed_request(rpc.second);
+        // Unwrap signed request if necessary
+        auto rpc_ = &rpc.second;
+        SignedReq signed_request(rpc.second);
 
-      if (rpc_->find(jsonrpc::SIG) != rpc_->end())
-      {
-        auto& req = rpc_->at(jsonrpc::REQ);
-        rpc_ = &req;
+        if (rpc_->find(jsonrpc::SIG) != rpc_->end())
+        {
+          auto& req = rpc_->at(jsonrpc::REQ);
+          rpc_ = &req;
+        }
+        auto& unsigned_rpc = *rpc_;
+
+        rep = process_json(
+          ctx, tx, ctx.fwd->caller_id, unsigned_rpc, signed_request);
       }
-      auto& unsigned_rpc = *rpc_;
 
-      auto rep =
-        process_json(ctx, tx, ctx.fwd->caller_id, unsigned_rpc, signed_request);
       if (!rep.has_value())
       {
         // This should never be called when process_json is called with a
@@ -761,41 +1148,141 @@ namespace ccf
           jsonrpc::StandardErrorCodes::METHOD_NOT_FOUND,
           method);
 
-      update_raft();
-      update_history();
+      auto args =
+        RequestArgs{ctx, tx, caller_id, method, params, signed_request};
+
+      return execute(
+        ctx,
+        tx,
+        *handler,
+        rpc.value(jsonrpc::READONLY, true),
+        [&func = handler->func, &args]() { return func(args); });
+    }
+
+    /** Execute a binary request
+     *
+     * The method is found by its ID, and handlers installed with a typed In
+     * decode their params directly. Other handlers receive the params
+     * converted to JSON. The default handler is never called, since the method
+     * name is not known.
+     */
+    std::optional<nlohmann::json> process_binary(
+      enclave::RPCContext& ctx,
+      Store::Tx& tx,
+      CallerId caller_id,
+      CBuffer input)
+    {
+      jsonrpc::BinaryRequest req;
+      try
+      {
+        req = jsonrpc::unpack_binary(input);
+      }
+      catch (const std::exception& e)
+      {
+        return jsonrpc::error_response(
+          0,
+          jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+          fmt::format("Exception during unpack: {}", e.what()));
+      }
+
+      ctx.req.seq_no = req.id;
+
+      auto search = methods_by_id.find(req.method);
+      if (search == methods_by_id.end())
+        return jsonrpc::error_response(
+          ctx.req.seq_no,
+          jsonrpc::StandardErrorCodes::METHOD_NOT_FOUND,
+          fmt::format("Method ID {}", req.method));
+
+      const auto& method = search->second->first;
+      auto& handler = search->second->second;
+      SignedReq signed_request;
+
+      if (handler.binary_func)
+      {
+        static const nlohmann::json no_params;
+        auto args =
+          RequestArgs{ctx, tx, caller_id, method, no_params, signed_request};
+
+        return execute(
+          ctx,
+          tx,
+          handler,
+          req.readonly,
+          [&func = handler.binary_func, &args, &req]() {
+            return func(args, req.params);
+          });
+      }
+
+      nlohmann::json params;
+      if (req.params.n > 0)
+      {
+        try
+        {
+          params = nlohmann::json::from_msgpack(
+            req.params.p, req.params.p + req.params.n);
+        }
+        catch (const std::exception& e)
+        {
+          return jsonrpc::error_response(
+            ctx.req.seq_no,
+            jsonrpc::StandardErrorCodes::INVALID_PARAMS,
+            fmt::format("Could not decode params: {}", e.what()));
+        }
+      }
+
+      auto args =
+        RequestArgs{ctx, tx, caller_id, method, params, signed_request};
+
+      return execute(
+        ctx,
+        tx,
+        handler,
+        req.readonly,
+        [&func = handler.func, &args]() { return func(args); });
+    }
+
+    /** Run a handler in tx and commit it, or return nothing if the command
+     * should be forwarded to the leader
+     */
+    template <typename Invoke>
+    std::optional<nlohmann::json> execute(
+      enclave::RPCContext& ctx,
+      Store::Tx& tx,
+      const Handler& handler,
+      bool readonly,
+      Invoke&& invoke)
+    {
+      auto raft = update_raft();
+      auto history = update_history();
 
       bool is_leader = (raft == nullptr) || raft->is_leader();
 
       if (!is_leader)
       {
-        switch (handler->rw)
+        switch (handler.rw)
         {
           case Read:
             break;
 
           case Write:
-            return forward_or_redirect_json(ctx, handler->forwardable);
+            return forward_or_redirect_json(ctx, handler.forwardable);
             break;
 
           case MayWrite:
-            bool readonly = rpc.value(jsonrpc::READONLY, true);
             if (!readonly)
-              return forward_or_redirect_json(ctx, handler->forwardable);
+              return forward_or_redirect_json(ctx, handler.forwardable);
             break;
         }
       }
 
-      auto func = handler->func;
-      auto args =
-        RequestArgs{ctx, tx, caller_id, method, params, signed_request};
-
       tx_count++;
 
       while (true)
       {
         try
         {
-          auto tx_result = func(args);
+          auto tx_result = invoke();
 
           if (!tx_result.first)
             return jsonrpc::error_response(ctx.req.seq_no, tx_result.second);
@@ -818,9 +1305,10 @@ namespace ccf
                 result[TERM] = raft->get_term();
                 result[GLOBAL_COMMIT] = raft->get_commit_idx();
 
+                const size_t sig_interval = sig_max_tx;
                 if (
                   history && raft->is_leader() &&
-                  (cv % sig_max_tx == sig_max_tx / 2))
+                  (cv % sig_interval == sig_interval / 2))
                   history->emit_signature();
               }
 
@@ -874,13 +1362,21 @@ namespace ccf
         tx, caller, caller_id, full_rpc, is_forwarded, signed_request);
     }
 
+    /** Verify the client signature of a request and record it
+     *
+     * @param verified Result of checking the signature, if that has already
+     *  been done by check_client_signatures()
+     * @param session Caller of the session, which caches its verifier
+     */
     bool verify_client_signature(
       Store::Tx& tx,
       const CBuffer& caller,
       const CallerId& caller_id,
       const nlohmann::json& full_rpc,
       bool is_forwarded,
-      SignedReq& signed_request)
+      SignedReq& signed_request,
+      std::optional<bool> verified = std::nullopt,
+      enclave::SessionCaller* session = nullptr)
     {
       if (!client_signatures)
         return false;
@@ -891,15 +1387,11 @@ namespace ccf
       // verified by the follower
       if (!is_forwarded)
       {
-        auto v = verifiers.find(caller_id);
-        if (v == verifiers.end())
-        {
-          CallerKey caller_cert(caller);
-          verifiers.emplace(
-            std::make_pair(caller_id, tls::make_verifier(caller_cert)));
-        }
-        if (!verifiers[caller_id]->verify(
-              signed_request.req, signed_request.sig))
+        if (!verified.has_value())
+          verified = get_verifier(caller_id, caller, session)
+                       ->verify(signed_request.req, signed_request.sig);
+
+        if (!verified.value())
           return false;
       }
 
@@ -913,6 +1405,182 @@ namespace ccf
       return true;
     }
 
+    tls::VerifierPtr get_verifier(
+      const CallerId& caller_id,
+      const CBuffer& caller,
+      enclave::SessionCaller* session = nullptr)
+    {
+      if (session != nullptr && session->caller_id == caller_id)
+      {
+        if (session->verifier == nullptr)
+          session->verifier = get_verifier(caller_id, caller);
+        return session->verifier;
+      }
+
+      {
+        std::lock_guard<SpinLock> guard(verifiers_lock);
+        auto v = verifiers.find(caller_id);
+        if (v != verifiers.end())
+          return v->second;
+      }
+
+      // Parsing the certificate is slow, so the lock is not held meanwhile
+      auto verifier = tls::make_verifier(CallerKey(caller));
+      if (!verifier->supports_concurrent_verify())
+        return verifier;
+
+      std::lock_guard<SpinLock> guard(verifiers_lock);
+      return verifiers.emplace(caller_id, verifier).first->second;
+    }
+
+    /** Check the client signatures of several requests at once. They are
+     * checked together with those pending on other sessions, in parallel on
+     * the store's task runner if it has one. Nothing is recorded: the results
+     * are passed to verify_client_signature() when each request is
+     * processed.
+     *
+     * The bundled libsecp256k1 has no batch verification for ECDSA, so each
+     * signature is verified on its own. Verifiers which cannot be shared
+     * between threads are duplicated for each check that runs in parallel.
+     *
+     * @param rpcs Requests to check, which may be null, unsigned or malformed
+     *
+     * @return For each request, whether its signature is valid, or nothing
+     *  if it was not checked
+     */
+    std::vector<std::optional<bool>> check_client_signatures(
+      const enclave::RPCContext& ctx,
+      CallerId caller_id,
+      const std::vector<const nlohmann::json*>& rpcs)
+    {
+      std::vector<std::optional<bool>> results(rpcs.size());
+
+      // Forwarded requests were checked by the node which forwarded them
+      if (!client_signatures || ctx.fwd.has_value())
+        return results;
+
+      std::vector<SignatureCheck> checks;
+      std::vector<size_t> indices;
+      for (size_t i = 0; i < rpcs.size(); ++i)
+      {
+        const auto rpc = rpcs[i];
+        if (
+          rpc == nullptr || !rpc->is_object() ||
+          rpc->find(jsonrpc::SIG) == rpc->end())
+          continue;
+
+        try
+        {
+          checks.push_back({rpc->get<SignedReq>()});
+          indices.push_back(i);
+        }
+        catch (const std::exception&)
+        {
+          // Left to fail when the request is processed
+          continue;
+        }
+      }
+
+      if (checks.empty())
+        return results;
+
+      // Resolved on this thread, which owns the session
+      tls::VerifierPtr verifier;
+      try
+      {
+        verifier = get_verifier(caller_id, ctx.caller_cert, ctx.session_caller);
+      }
+      catch (const std::exception& e)
+      {
+        LOG_DEBUG_FMT("Failed to check client signatures: {}", e.what());
+        for (auto i : indices)
+          results[i] = false;
+        return results;
+      }
+
+      auto task_runner = tables.get_task_runner();
+      const bool parallel = task_runner != nullptr;
+
+      std::vector<std::function<void()>> tasks;
+      for (auto& check : checks)
+      {
+        tasks.emplace_back([&check, &ctx, verifier, parallel]() {
+          try
+          {
+            auto v = verifier;
+            if (parallel && !v->supports_concurrent_verify())
+              v = tls::make_verifier(CallerKey(ctx.caller_cert));
+
+            check.verified =
+              v->verify(check.signed_request.req, check.signed_request.sig);
+          }
+          catch (const std::exception& e)
+          {
+            LOG_DEBUG_FMT("Failed to check client signature: {}", e.what());
+            check.verified = false;
+          }
+        });
+      }
+
+      signature_checks.run(std::move(tasks), task_runner);
+
+      for (size_t i = 0; i < checks.size(); ++i)
+        results[indices[i]] = checks[i].verified;
+
+      return results;
+    }
+
+    /** Check the client signatures of requests read together from a session,
+     * before any of them is processed
+     *
+     * Only requests which may be signed are parsed here. Binary requests
+     * cannot be signed.
+     *
+     * @param ctx Context of the session
+     * @param inputs Serialised JSON RPCs, in the order they will be processed
+     */
+    std::vector<std::optional<bool>> check_signatures(
+      enclave::RPCContext& ctx, const std::vector<CBuffer>& inputs) override
+    {
+      Store::Tx tx;
+      auto caller_id = resolve_caller(tx, ctx);
+      if (!client_signatures || !caller_id.has_value())
+        return std::vector<std::optional<bool>>(inputs.size());
+
+      // The key of the signature, as each encoding usually has it. A request
+      // which spells it differently is still checked, when it is processed.
+      static const std::string sig = jsonrpc::SIG;
+      static const std::string text_key = "\"" + sig + "\"";
+      static const std::string msgpack_key =
+        std::string(1, static_cast<char>(0xa0 | sig.size())) + sig;
+
+      std::vector<nlohmann::json> rpcs(inputs.size());
+      std::vector<const nlohmann::json*> signed_rpcs(inputs.size(), nullptr);
+      for (size_t i = 0; i < inputs.size(); ++i)
+      {
+        const auto& input = inputs[i];
+        auto pack = detect_pack(input);
+        if (!pack.has_value() || pack.value() == jsonrpc::Pack::Binary)
+          continue;
+
+        const auto& key =
+          pack.value() == jsonrpc::Pack::Text ? text_key : msgpack_key;
+        std::string_view contents(
+          reinterpret_cast<const char*>(input.p), input.n);
+        if (contents.find(key) == std::string_view::npos)
+          continue;
+
+        auto rpc = unpack_json(input, pack.value());
+        if (rpc.first)
+        {
+          rpcs[i] = std::move(rpc.second);
+          signed_rpcs[i] = &rpcs[i];
+        }
+      }
+
+      return check_client_signatures(ctx, caller_id.value(), signed_rpcs);
+    }
+
     std::optional<SignedReq> get_signed_req(const CallerId& caller_id)
     {
       Store::Tx tx;
@@ -922,20 +1590,25 @@ namespace ccf
 
     void tick(std::chrono::milliseconds elapsed) override
     {
-      metrics.track_tx_rates(elapsed, tx_count);
-      // reset tx_counter for next tick interval
-      tx_count = 0;
+      // Reset tx_count for the next tick interval, without losing any
+      // increments made meanwhile
+      metrics.track_tx_rates(elapsed, tx_count.exchange(0));
       // TODO(#refactoring): move this to NodeState::tick
-      update_raft();
+      auto raft = update_raft();
       if ((raft != nullptr) && raft->is_leader())
       {
-        if (elapsed < ms_to_sig)
         {
-          ms_to_sig -= elapsed;
-          return;
+          std::lock_guard<SpinLock> guard(sig_lock);
+          if (elapsed < ms_to_sig)
+          {
+            ms_to_sig -= elapsed;
+            return;
+          }
+
+          ms_to_sig = sig_max_ms;
         }
 
-        ms_to_sig = sig_max_ms;
+        auto history = this->history.load();
         if (history && tables.commit_gap() > 0)
           history->emit_signature();
       }
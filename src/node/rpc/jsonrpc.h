@@ -2,9 +2,12 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/buffer.h"
 #include "ds/json.h"
+#include "ds/serialized.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace jsonrpc
@@ -101,7 +104,8 @@ namespace jsonrpc
   enum class Pack
   {
     Text,
-    MsgPack
+    MsgPack,
+    Binary
   };
 
   inline std::vector<uint8_t> pack(const nlohmann::json& j, Pack pack)
@@ -115,26 +119,106 @@ namespace jsonrpc
       }
 
       case Pack::MsgPack:
+      case Pack::Binary:
+        // Responses to binary requests are MsgPack
         return nlohmann::json::to_msgpack(j);
     }
 
     throw std::logic_error("Invalid jsonrpc::Pack");
   }
 
-  inline nlohmann::json unpack(const std::vector<uint8_t>& data, Pack pack)
+  inline nlohmann::json unpack(CBuffer data, Pack pack)
   {
     switch (pack)
     {
       case Pack::Text:
-        return nlohmann::json::parse(data);
+        return nlohmann::json::parse(data.p, data.p + data.n);
 
       case Pack::MsgPack:
-        return nlohmann::json::from_msgpack(data);
+        return nlohmann::json::from_msgpack(data.p, data.p + data.n);
+
+      case Pack::Binary:
+        throw std::logic_error("Binary requests cannot be unpacked as JSON");
     }
 
     throw std::logic_error("Invalid jsonrpc::Pack");
   }
 
+  //
+  // Binary requests
+  //
+  // A compact envelope for requests, which is dispatched without building a
+  // JSON object:
+  //
+  //   uint8_t  BINARY_MAGIC
+  //   uint8_t  flags (BINARY_WRITE if the request may write)
+  //   uint32_t method ID
+  //   uint64_t request ID
+  //   params, as MsgPack (optional)
+  //
+  // 0xc1 is never used by MsgPack, and cannot start a JSON request.
+  static constexpr uint8_t BINARY_MAGIC = 0xc1;
+  static constexpr uint8_t BINARY_WRITE = 0x1;
+
+  using MethodId = uint32_t;
+
+  /// Method IDs are the 32-bit FNV-1a hash of the method name
+  constexpr MethodId method_id(std::string_view method)
+  {
+    MethodId h = 0x811c9dc5;
+    for (auto c : method)
+    {
+      h ^= static_cast<uint8_t>(c);
+      h *= 0x01000193;
+    }
+    return h;
+  }
+
+  struct BinaryRequest
+  {
+    MethodId method;
+    SeqNo id;
+    bool readonly;
+    CBuffer params;
+  };
+
+  static constexpr size_t binary_header_size =
+    sizeof(BINARY_MAGIC) + sizeof(BINARY_WRITE) + sizeof(MethodId) +
+    sizeof(SeqNo);
+
+  inline std::vector<uint8_t> pack_binary(
+    MethodId method, SeqNo id, CBuffer params, bool readonly = true)
+  {
+    std::vector<uint8_t> v(binary_header_size + params.n);
+    auto data = v.data();
+    auto size = v.size();
+
+    serialized::write(data, size, BINARY_MAGIC);
+    serialized::write(data, size, readonly ? (uint8_t)0 : BINARY_WRITE);
+    serialized::write(data, size, method);
+    serialized::write(data, size, id);
+    serialized::write(data, size, params.p, params.n);
+
+    return v;
+  }
+
+  /// The params of the result point into data
+  inline BinaryRequest unpack_binary(CBuffer data)
+  {
+    auto p = data.p;
+    auto size = data.n;
+
+    if (serialized::read<uint8_t>(p, size) != BINARY_MAGIC)
+      throw std::logic_error("Not a binary request");
+
+    BinaryRequest req;
+    req.readonly = (serialized::read<uint8_t>(p, size) & BINARY_WRITE) == 0;
+    req.method = serialized::read<MethodId>(p, size);
+    req.id = serialized::read<SeqNo>(p, size);
+    req.params = {p, size};
+    return req;
+  }
+
   //
   // Requests
   //
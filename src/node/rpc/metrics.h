@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #include "ds/histogram.h"
 #include "ds/logger.h"
+#include "ds/spinlock.h"
 #include "serialization.h"
 
 #include <nlohmann/json.hpp>
@@ -16,6 +17,8 @@ namespace metrics
   class Metrics
   {
   private:
+    // Rates are tracked by the main thread, and read by RPCs on the workers
+    SpinLock lock;
     size_t tick_count = 0;
     double tx_time_passed[TX_RATE_BUCKETS_LEN] = {};
     size_t tx_rates[TX_RATE_BUCKETS_LEN] = {};
@@ -63,6 +66,7 @@ namespace metrics
   public:
     ccf::GetMetrics::Out get_metrics()
     {
+      std::lock_guard<SpinLock> guard(lock);
       nlohmann::json result;
       result["histogram"] = get_histogram_results();
       result["tx_rates"] = get_tx_rates();
@@ -73,6 +77,7 @@ namespace metrics
     void track_tx_rates(
       const std::chrono::milliseconds& elapsed, size_t tx_count)
     {
+      std::lock_guard<SpinLock> guard(lock);
       // calculate how many tx/sec we have processed in this tick
       auto duration = elapsed.count() / 1000.0;
       auto tx_rate = tx_count / duration;
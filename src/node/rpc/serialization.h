@@ -73,4 +73,10 @@ namespace ccf
   DECLARE_JSON_REQUIRED_FIELDS(GetSchema::In, method)
   DECLARE_JSON_TYPE(GetSchema::Out)
   DECLARE_JSON_REQUIRED_FIELDS(GetSchema::Out, params_schema, result_schema)
+
+  DECLARE_JSON_TYPE(GetReceipt::In)
+  DECLARE_JSON_REQUIRED_FIELDS(GetReceipt::In, commit)
+  DECLARE_JSON_TYPE(GetReceipt::Out)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetReceipt::Out, commit, signed_index, root, path, node, signature)
 }
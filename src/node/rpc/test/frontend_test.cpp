@@ -15,6 +15,7 @@
 
 #include <iostream>
 #include <string>
+#include <thread>
 
 extern "C"
 {
@@ -62,6 +63,36 @@ public:
   }
 };
 
+struct Add
+{
+  struct In
+  {
+    int64_t a;
+    int64_t b;
+
+    MSGPACK_DEFINE_MAP(a, b);
+  };
+};
+DECLARE_JSON_TYPE(Add::In);
+DECLARE_JSON_REQUIRED_FIELDS(Add::In, a, b);
+
+class TestBinaryFrontend : public ccf::UserRpcFrontend
+{
+public:
+  TestBinaryFrontend(Store& tables) : UserRpcFrontend(tables)
+  {
+    auto add = [this](RequestArgs& args, Add::In&& in) {
+      return jsonrpc::success(in.a + in.b);
+    };
+    install_with_auto_schema<Add::In, int64_t>("add", add, Read);
+
+    auto echo = [this](RequestArgs& args) {
+      return jsonrpc::success(args.params);
+    };
+    install("echo", echo, Read);
+  }
+};
+
 class TestMemberFrontend : public ccf::MemberCallRpcFrontend
 {
 public:
@@ -428,6 +459,260 @@ TEST_CASE("process")
   }
 }
 
+TEST_CASE("process batch")
+{
+  prepare_callers();
+  TestUserFrontend frontend(*network.tables);
+
+  auto batch = nlohmann::json::array();
+  for (size_t i = 0; i < 3; ++i)
+  {
+    auto call = create_simple_json();
+    call[jsonrpc::ID] = i;
+    batch.push_back(call);
+  }
+
+  SUBCASE("all entries succeed")
+  {
+    batch.push_back(create_signed_json());
+
+    for (auto pack : {jsonrpc::Pack::Text, jsonrpc::Pack::MsgPack})
+    {
+      std::vector<uint8_t> serialized_batch = jsonrpc::pack(batch, pack);
+      std::vector<uint8_t> serialized_response =
+        frontend.process(rpc_ctx, serialized_batch);
+      auto response = jsonrpc::unpack(serialized_response, pack);
+
+      REQUIRE(response.is_array());
+      REQUIRE(response.size() == batch.size());
+      for (size_t i = 0; i < 3; ++i)
+      {
+        CHECK(response[i][jsonrpc::ID] == i);
+        CHECK(response[i][jsonrpc::RESULT] == true);
+      }
+      CHECK(response[3][jsonrpc::RESULT] == true);
+    }
+  }
+
+  SUBCASE("failures are reported per entry")
+  {
+    batch[1][jsonrpc::METHOD] = "unknown_function";
+    batch.push_back(42);
+
+    std::vector<uint8_t> serialized_batch =
+      jsonrpc::pack(batch, jsonrpc::Pack::MsgPack);
+    std::vector<uint8_t> serialized_response =
+      frontend.process(rpc_ctx, serialized_batch);
+    auto response =
+      jsonrpc::unpack(serialized_response, jsonrpc::Pack::MsgPack);
+
+    REQUIRE(response.size() == batch.size());
+    CHECK(response[0][jsonrpc::RESULT] == true);
+    CHECK(
+      response[1][jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::METHOD_NOT_FOUND));
+    CHECK(response[2][jsonrpc::RESULT] == true);
+    CHECK(
+      response[3][jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::INVALID_REQUEST));
+  }
+
+  SUBCASE("empty batch")
+  {
+    std::vector<uint8_t> serialized_batch =
+      jsonrpc::pack(nlohmann::json::array(), jsonrpc::Pack::MsgPack);
+    std::vector<uint8_t> serialized_response =
+      frontend.process(rpc_ctx, serialized_batch);
+    auto response =
+      jsonrpc::unpack(serialized_response, jsonrpc::Pack::MsgPack);
+
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::INVALID_REQUEST));
+  }
+}
+
+TEST_CASE("Signatures checked ahead of time")
+{
+  prepare_callers();
+  TestUserFrontend frontend(*network.tables);
+
+  // Each check runs on a thread of its own
+  network.tables->set_task_runner(
+    [](std::vector<std::function<void()>>&& tasks) {
+      std::vector<std::thread> threads;
+      for (auto& task : tasks)
+        threads.emplace_back(task);
+      for (auto& thread : threads)
+        thread.join();
+    });
+
+  auto invalid_call = create_signed_json();
+  invalid_call[jsonrpc::REQ][jsonrpc::ID] = 2;
+
+  const auto invalid_signature = static_cast<jsonrpc::ErrorBaseType>(
+    jsonrpc::CCFErrorCodes::INVALID_CLIENT_SIGNATURE);
+
+  SUBCASE("pipelined requests")
+  {
+    std::vector<std::vector<uint8_t>> serialized_calls = {
+      jsonrpc::pack(create_signed_json(), jsonrpc::Pack::Text),
+      jsonrpc::pack(create_simple_json(), jsonrpc::Pack::Text),
+      jsonrpc::pack(create_signed_json(), jsonrpc::Pack::MsgPack),
+      jsonrpc::pack(invalid_call, jsonrpc::Pack::MsgPack)};
+    std::vector<CBuffer> inputs(
+      serialized_calls.begin(), serialized_calls.end());
+
+    auto verified = frontend.check_signatures(rpc_ctx, inputs);
+    REQUIRE(verified.size() == inputs.size());
+    CHECK(verified[0] == true);
+    CHECK(!verified[1].has_value());
+    CHECK(verified[2] == true);
+    CHECK(verified[3] == false);
+
+    // The result is trusted when the request is processed
+    enclave::RPCContext ctx(0, user_caller);
+    ctx.signature_verified = false;
+    auto response =
+      jsonrpc::unpack(frontend.process(ctx, inputs[0]), jsonrpc::Pack::Text);
+    CHECK(response[jsonrpc::ERR][jsonrpc::CODE] == invalid_signature);
+  }
+
+  SUBCASE("batched requests")
+  {
+    auto batch = nlohmann::json::array(
+      {create_signed_json(), invalid_call, create_signed_json()});
+    std::vector<uint8_t> serialized_batch =
+      jsonrpc::pack(batch, jsonrpc::Pack::MsgPack);
+    auto response = jsonrpc::unpack(
+      frontend.process(rpc_ctx, serialized_batch), jsonrpc::Pack::MsgPack);
+
+    REQUIRE(response.size() == batch.size());
+    CHECK(response[0][jsonrpc::RESULT] == true);
+    CHECK(response[1][jsonrpc::ERR][jsonrpc::CODE] == invalid_signature);
+    CHECK(response[2][jsonrpc::RESULT] == true);
+  }
+
+  SUBCASE("requests from several sessions")
+  {
+    // Sessions on different threads check their signatures at once, and
+    // each gets back the results for its own requests
+    const auto valid = jsonrpc::pack(create_signed_json(), jsonrpc::Pack::Text);
+    const auto invalid = jsonrpc::pack(invalid_call, jsonrpc::Pack::Text);
+
+    constexpr size_t session_count = 4;
+    std::vector<std::vector<std::optional<bool>>> results(session_count);
+    std::vector<std::thread> sessions;
+    for (size_t i = 0; i < session_count; ++i)
+    {
+      sessions.emplace_back([&, i]() {
+        enclave::RPCContext ctx(i, user_caller);
+        std::vector<CBuffer> inputs = {i % 2 == 0 ? valid : invalid};
+        results[i] = frontend.check_signatures(ctx, inputs);
+      });
+    }
+    for (auto& session : sessions)
+      session.join();
+
+    for (size_t i = 0; i < session_count; ++i)
+    {
+      REQUIRE(results[i].size() == 1);
+      CHECK(results[i][0] == (i % 2 == 0));
+    }
+  }
+
+  network.tables->set_task_runner(nullptr);
+}
+
+TEST_CASE("process binary")
+{
+  prepare_callers();
+  TestBinaryFrontend frontend(*network.tables);
+
+  const auto add_id = jsonrpc::method_id("add");
+  const nlohmann::json add_params = {{"a", 40}, {"b", 2}};
+
+  auto process_binary = [&](const std::vector<uint8_t>& call) {
+    std::vector<uint8_t> serialized_response = frontend.process(rpc_ctx, call);
+    return jsonrpc::unpack(serialized_response, jsonrpc::Pack::MsgPack);
+  };
+
+  SUBCASE("typed handler")
+  {
+    auto response = process_binary(jsonrpc::pack_binary(
+      add_id, 7, nlohmann::json::to_msgpack(add_params)));
+    CHECK(response[jsonrpc::ID] == 7);
+    CHECK(response[jsonrpc::RESULT] == 42);
+
+    // The same handler is still reachable with JSON
+    auto call = create_simple_json();
+    call[jsonrpc::METHOD] = "add";
+    call[jsonrpc::PARAMS] = add_params;
+    std::vector<uint8_t> serialized_response =
+      frontend.process(rpc_ctx, jsonrpc::pack(call, jsonrpc::Pack::Text));
+    response = jsonrpc::unpack(serialized_response, jsonrpc::Pack::Text);
+    CHECK(response[jsonrpc::RESULT] == 42);
+  }
+
+  SUBCASE("JSON handler")
+  {
+    const nlohmann::json params = {{"x", {1, 2, 3}}};
+    auto response = process_binary(jsonrpc::pack_binary(
+      jsonrpc::method_id("echo"), 8, nlohmann::json::to_msgpack(params)));
+    CHECK(response[jsonrpc::ID] == 8);
+    CHECK(response[jsonrpc::RESULT] == params);
+  }
+
+  SUBCASE("invalid params")
+  {
+    const nlohmann::json params = {{"a", "forty"}, {"b", 2}};
+    auto response = process_binary(
+      jsonrpc::pack_binary(add_id, 9, nlohmann::json::to_msgpack(params)));
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::INVALID_PARAMS));
+  }
+
+  SUBCASE("missing params")
+  {
+    // Rejected as it would be with JSON, rather than taking b to be 0
+    const nlohmann::json params = {{"a", 40}};
+    auto response = process_binary(
+      jsonrpc::pack_binary(add_id, 12, nlohmann::json::to_msgpack(params)));
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::INVALID_PARAMS));
+  }
+
+  SUBCASE("unknown method")
+  {
+    auto response = process_binary(jsonrpc::pack_binary(
+      jsonrpc::method_id("unknown"),
+      10,
+      nlohmann::json::to_msgpack(add_params)));
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::METHOD_NOT_FOUND));
+  }
+
+  SUBCASE("truncated request")
+  {
+    auto call = jsonrpc::pack_binary(add_id, 11, {});
+    call.resize(call.size() - 1);
+    auto response = process_binary(call);
+    CHECK(
+      response[jsonrpc::ERR][jsonrpc::CODE] ==
+      static_cast<jsonrpc::ErrorBaseType>(
+        jsonrpc::StandardErrorCodes::INVALID_REQUEST));
+  }
+}
+
 // callers
 
 TEST_CASE("User caller")
@@ -488,6 +773,60 @@ TEST_CASE("Member caller")
   }
 }
 
+TEST_CASE("Caller cached per session")
+{
+  prepare_callers();
+  auto simple_call = create_simple_json();
+  std::vector<uint8_t> serialized_call =
+    jsonrpc::pack(simple_call, jsonrpc::Pack::MsgPack);
+  TestUserFrontend frontend(*network.tables);
+
+  enclave::SessionCaller session;
+  enclave::RPCContext ctx(0, user_caller);
+  ctx.session_caller = &session;
+
+  auto process = [&]() {
+    return jsonrpc::unpack(
+      frontend.process(ctx, serialized_call), jsonrpc::Pack::MsgPack);
+  };
+
+  const auto invalid_caller_id = static_cast<jsonrpc::ErrorBaseType>(
+    jsonrpc::CCFErrorCodes::INVALID_CALLER_ID);
+
+  auto revoke = [&]() {
+    Store::Tx tx;
+    tx.get_view(network.user_certs)->remove(user_caller);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  };
+
+  SUBCASE("until a revocation is globally committed")
+  {
+    CHECK(process()[jsonrpc::RESULT] == true);
+    CHECK(session.caller_id == CallerId(0));
+
+    revoke();
+    CHECK(process()[jsonrpc::RESULT] == true);
+
+    network.tables->compact(network.tables->current_version());
+    CHECK(process()[jsonrpc::ERR][jsonrpc::CODE] == invalid_caller_id);
+    CHECK(!session.caller_id.has_value());
+  }
+
+  SUBCASE("until the store is rolled back")
+  {
+    revoke();
+    const auto revoked = network.tables->current_version();
+
+    Store::Tx tx;
+    tx.get_view(network.user_certs)->put(user_caller, 0);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    CHECK(process()[jsonrpc::RESULT] == true);
+
+    network.tables->rollback(revoked);
+    CHECK(process()[jsonrpc::ERR][jsonrpc::CODE] == invalid_caller_id);
+  }
+}
+
 TEST_CASE("No certs table")
 {
   prepare_callers();
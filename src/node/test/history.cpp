@@ -32,8 +32,9 @@ public:
   {
     if (store)
     {
-      REQUIRE(entries.size() == 1);
-      return store->deserialise(std::get<1>(entries[0]));
+      for (const auto& entry : entries)
+        if (!store->deserialise(std::get<1>(entry)))
+          return false;
     }
     return true;
   }
@@ -442,6 +443,354 @@ TEST_CASE(
   }
 }
 
+TEST_CASE("Batched results give the same root as single appends")
+{
+  Store single_store;
+  auto& single_nodes = single_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& single_signatures = single_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  Store batch_store;
+  auto& batch_nodes = batch_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& batch_signatures = batch_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  // Hashes are split across tasks, which are run here one after another
+  size_t tasks_run = 0;
+  batch_store.set_task_runner(
+    [&tasks_run](std::vector<std::function<void()>>&& tasks) {
+      for (auto& task : tasks)
+        task();
+      tasks_run += tasks.size();
+    });
+
+  auto kp = tls::make_key_pair();
+  ccf::MerkleTxHistory single_history(
+    single_store, 0, *kp, single_signatures, single_nodes);
+  ccf::MerkleTxHistory batch_history(
+    batch_store, 0, *kp, batch_signatures, batch_nodes);
+
+  std::vector<std::vector<uint8_t>> txs;
+  for (size_t i = 0; i < 100; ++i)
+    txs.push_back(std::vector<uint8_t>(i + 1, i));
+
+  size_t appended = 0;
+  for (size_t batch_size : {1, 7, 92})
+  {
+    std::vector<kv::TxHistory::Result> results;
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      const auto& tx = txs[appended++];
+      single_history.append(tx);
+      results.push_back({{0, 0, appended}, (kv::Version)appended, &tx});
+    }
+    batch_history.add_results(results);
+
+    REQUIRE(single_history.get_root() == batch_history.get_root());
+  }
+  REQUIRE(tasks_run > 0);
+}
+
+#ifndef PBFT
+TEST_CASE("Receipts are given for versions covered by a signature")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store leader_store;
+  leader_store.set_encryptor(encryptor);
+  auto& leader_nodes = leader_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& leader_signatures = leader_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  Store follower_store;
+  follower_store.set_encryptor(encryptor);
+  auto& follower_nodes = follower_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& follower_signatures = follower_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  auto kp = tls::make_key_pair();
+  auto cert = kp->self_sign("CN=name");
+
+  std::shared_ptr<kv::Replicator> replicator =
+    std::make_shared<DummyReplicator>(&follower_store);
+  leader_store.set_replicator(replicator);
+  std::shared_ptr<kv::Replicator> null_replicator =
+    std::make_shared<DummyReplicator>(nullptr);
+  follower_store.set_replicator(null_replicator);
+
+  std::shared_ptr<kv::TxHistory> leader_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      leader_store, 0, *kp, leader_signatures, leader_nodes);
+  leader_store.set_history(leader_history);
+
+  std::shared_ptr<kv::TxHistory> follower_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      follower_store, 1, *kp, follower_signatures, follower_nodes);
+  follower_store.set_history(follower_history);
+
+  for (ccf::NodeId id = 0; id < 10; ++id)
+  {
+    Store::Tx txs;
+    auto tx = txs.get_view(leader_nodes);
+    ccf::NodeInfo ni;
+    ni.cert = cert;
+    tx->put(id, ni);
+    REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+  }
+  const auto last_version = leader_store.current_version();
+
+  INFO("No receipts before anything is signed");
+  {
+    REQUIRE_FALSE(leader_history->get_receipt(1).has_value());
+  }
+
+  leader_history->emit_signature();
+  const auto signed_version = leader_store.current_version();
+  REQUIRE(signed_version == last_version + 1);
+  REQUIRE(follower_store.current_version() == signed_version);
+
+  INFO("Receipts from the leader and the follower verify");
+  {
+    auto verifier = tls::make_verifier(cert);
+    for (auto& history : {leader_history, follower_history})
+    {
+      for (kv::Version v = 1; v < signed_version; ++v)
+      {
+        auto receipt = history->get_receipt(v);
+        REQUIRE(receipt.has_value());
+        REQUIRE(receipt->version == v);
+        REQUIRE(receipt->signed_version == signed_version);
+        REQUIRE(receipt->node == 0);
+        REQUIRE(ccf::MerkleTreeHistory::verify_path(
+          v, signed_version, receipt->path, receipt->root));
+        REQUIRE_FALSE(ccf::MerkleTreeHistory::verify_path(
+          v + 1, signed_version, receipt->path, receipt->root));
+        REQUIRE(verifier->verify_hash(
+          receipt->root.h,
+          receipt->root.SIZE,
+          receipt->signature.data(),
+          receipt->signature.size()));
+      }
+
+      REQUIRE_FALSE(history->get_receipt(signed_version).has_value());
+    }
+  }
+
+  INFO("Receipts are dropped along with the signature on rollback");
+  {
+    leader_store.rollback(last_version);
+    REQUIRE_FALSE(leader_history->get_receipt(1).has_value());
+  }
+}
+#endif
+
+#ifndef PBFT
+TEST_CASE("Receipts are kept for two signature intervals after compaction")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store store;
+  store.set_encryptor(encryptor);
+  auto& nodes =
+    store.create<ccf::Nodes>(ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& signatures = store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  std::shared_ptr<kv::Replicator> replicator =
+    std::make_shared<DummyReplicator>(nullptr);
+  store.set_replicator(replicator);
+
+  auto kp = tls::make_key_pair();
+  const size_t sig_max_tx = 1000;
+  auto history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  history->set_receipt_history_len(2 * (sig_max_tx + 1));
+  store.set_history(history);
+
+  std::vector<kv::Version> signed_versions;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    for (size_t j = 0; j < sig_max_tx; ++j)
+    {
+      Store::Tx txs;
+      auto tx = txs.get_view(nodes);
+      tx->put(0, {});
+      REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+    }
+    history->emit_signature();
+    signed_versions.push_back(store.current_version());
+  }
+
+  store.compact(signed_versions.back());
+
+  INFO("Versions signed by the previous signature still have receipts");
+  {
+    for (auto v = signed_versions[1] - sig_max_tx; v < signed_versions[1]; ++v)
+    {
+      auto receipt = history->get_receipt(v);
+      REQUIRE(receipt.has_value());
+      REQUIRE(receipt->signed_version == signed_versions[1]);
+    }
+  }
+
+  INFO("Versions signed by older signatures do not");
+  {
+    REQUIRE_FALSE(history->get_receipt(signed_versions[0] - 1).has_value());
+  }
+}
+#endif
+
+#ifndef PBFT
+TEST_CASE("Signatures can be made in the background")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store leader_store;
+  leader_store.set_encryptor(encryptor);
+  auto& leader_nodes = leader_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& leader_signatures = leader_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  Store follower_store;
+  follower_store.set_encryptor(encryptor);
+  auto& follower_nodes = follower_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& follower_signatures = follower_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Replicator> replicator =
+    std::make_shared<DummyReplicator>(&follower_store);
+  leader_store.set_replicator(replicator);
+  std::shared_ptr<kv::Replicator> null_replicator =
+    std::make_shared<DummyReplicator>(nullptr);
+  follower_store.set_replicator(null_replicator);
+
+  std::shared_ptr<kv::TxHistory> leader_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      leader_store, 0, *kp, leader_signatures, leader_nodes);
+  leader_store.set_history(leader_history);
+
+  std::shared_ptr<kv::TxHistory> follower_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      follower_store, 1, *kp, follower_signatures, follower_nodes);
+  follower_store.set_history(follower_history);
+
+  // Background tasks are held until the test runs them
+  std::vector<std::function<void()>> background;
+  leader_store.set_background_runner(
+    [&background](std::function<void()>&& task) {
+      background.push_back(std::move(task));
+    });
+  auto run_background = [&background]() {
+    auto tasks = std::move(background);
+    background.clear();
+    for (auto& task : tasks)
+      task();
+  };
+
+  auto write_node = [&](ccf::NodeId id) {
+    Store::Tx txs;
+    auto tx = txs.get_view(leader_nodes);
+    ccf::NodeInfo ni;
+    ni.cert = kp->self_sign("CN=name");
+    tx->put(id, ni);
+    REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+  };
+
+  write_node(0);
+  const auto unsigned_version = leader_store.current_version();
+
+  INFO("Transactions after a pending signature wait for it");
+  {
+    leader_history->emit_signature();
+    REQUIRE(leader_store.current_version() == unsigned_version + 1);
+    REQUIRE(background.size() == 1);
+
+    write_node(1);
+    REQUIRE(leader_store.current_version() == unsigned_version + 2);
+    REQUIRE(follower_store.current_version() == unsigned_version);
+
+    // Only one signature is pending at a time
+    leader_history->emit_signature();
+    REQUIRE(leader_store.current_version() == unsigned_version + 2);
+
+    run_background();
+    REQUIRE(follower_store.current_version() == unsigned_version + 2);
+    REQUIRE(follower_history->get_receipt(unsigned_version).has_value());
+  }
+
+  write_node(2);
+  const auto last_version = leader_store.current_version();
+
+  INFO("A pending signature is dropped on rollback");
+  {
+    leader_history->emit_signature();
+    REQUIRE(background.size() == 1);
+    leader_store.rollback(last_version);
+    run_background();
+    REQUIRE(leader_store.current_version() == last_version);
+    REQUIRE(follower_store.current_version() == last_version);
+  }
+
+  INFO("Signing resumes after rollback");
+  {
+    leader_history->emit_signature();
+    run_background();
+    REQUIRE(follower_store.current_version() == last_version + 1);
+    REQUIRE(follower_history->get_receipt(last_version).has_value());
+  }
+
+  INFO("A signature made before a rollback does not take a reused version");
+  {
+    const auto version = leader_store.current_version();
+    leader_history->emit_signature();
+    REQUIRE(background.size() == 1);
+    leader_store.rollback(version);
+
+    // This transaction is given the version reserved for the signature
+    write_node(3);
+    REQUIRE(follower_store.current_version() == version + 1);
+
+    run_background();
+    REQUIRE(follower_store.current_version() == version + 1);
+    REQUIRE(!leader_history->get_receipt(version).has_value());
+    REQUIRE(!follower_history->get_receipt(version).has_value());
+
+    leader_history->emit_signature();
+    run_background();
+    REQUIRE(follower_store.current_version() == version + 2);
+    REQUIRE(follower_history->get_receipt(version + 1).has_value());
+  }
+
+  INFO("A committer waiting for a signature which is not run makes it");
+  {
+    const auto version = leader_store.current_version();
+    leader_history->emit_signature();
+    REQUIRE(background.size() == 1);
+
+    // More transactions than the store keeps waiting for replication
+    const size_t count = 5000;
+    for (size_t i = 0; i < count; ++i)
+    {
+      Store::Tx txs;
+      auto tx = txs.get_view(leader_nodes);
+      tx->put(4, {});
+      REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+    }
+    REQUIRE(follower_store.current_version() == version + count + 1);
+    REQUIRE(follower_history->get_receipt(version).has_value());
+
+    // The task left with the background runner has nothing left to do
+    run_background();
+    REQUIRE(follower_store.current_version() == version + count + 1);
+  }
+}
+#endif
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char** argv)
 {
@@ -3,9 +3,13 @@
 #define PICOBENCH_IMPLEMENT
 #include "../history.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <mutex>
 #include <picobench/picobench.hpp>
+#include <thread>
 
 extern "C"
 {
@@ -242,7 +246,150 @@ static void append_compact(picobench::state& s)
   s.stop_timer();
 }
 
+// Adds the results of a batch of transactions to the history, one at a time
+// or all at once, as the store does when replicating them
+template <size_t S, bool batched>
+static void add_results(picobench::state& s)
+{
+  ::srand(42);
+
+  Store store;
+  auto& nodes = store.create<ccf::Nodes>(ccf::Tables::NODES);
+  auto& signatures = store.create<ccf::Signatures>(ccf::Tables::SIGNATURES);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::TxHistory> history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  std::vector<std::vector<uint8_t>> txs;
+  std::vector<kv::TxHistory::Result> results;
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    std::vector<uint8_t> tx;
+    for (size_t j = 0; j < S; j++)
+    {
+      tx.push_back(::rand() % 256);
+    }
+    txs.push_back(tx);
+  }
+  for (size_t i = 0; i < txs.size(); i++)
+    results.push_back({{0, 0, i}, (kv::Version)(i + 1), &txs[i]});
+
+  s.start_timer();
+  if (batched)
+  {
+    history->add_results(results);
+  }
+  else
+  {
+    for (const auto& r : results)
+      history->add_result(r.id, r.version, *r.data);
+  }
+  clobber_memory();
+  s.stop_timer();
+}
+
+// Latencies of individual commits, by benchmark and size, reported as
+// percentiles once every benchmark has run
+static std::map<std::string, std::vector<std::chrono::nanoseconds>>
+  commit_latencies;
+
+// Commits transactions one after another, emitting a signature in the middle
+// of every sig_interval of them as the frontend does, and records how long
+// each commit takes. Signatures are made on the committing thread, or on a
+// thread of their own.
+template <bool background>
+static void commit_latency(picobench::state& s)
+{
+  static constexpr size_t sig_interval = 100;
+
+  Store store;
+  auto& nodes = store.create<ccf::Nodes>(ccf::Tables::NODES);
+  auto& signatures = store.create<ccf::Signatures>(ccf::Tables::SIGNATURES);
+  auto& values = store.create<size_t, size_t>("values");
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Replicator> replicator =
+    std::make_shared<DummyReplicator>();
+  store.set_replicator(replicator);
+
+  std::shared_ptr<kv::TxHistory> history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  std::mutex signers_lock;
+  std::vector<std::thread> signers;
+  if (background)
+  {
+    store.set_background_runner(
+      [&signers_lock, &signers](std::function<void()>&& task) {
+        std::lock_guard<std::mutex> guard(signers_lock);
+        signers.emplace_back(std::move(task));
+      });
+  }
+
+  std::vector<std::chrono::nanoseconds> latencies;
+  latencies.reserve(s.iterations());
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); i++)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    Store::Tx tx;
+    auto view = tx.get_view(values);
+    view->put(i, i);
+    if (tx.commit() != kv::CommitSuccess::OK)
+      throw std::logic_error("Failed to commit");
+
+    if (i % sig_interval == sig_interval / 2)
+      history->emit_signature();
+    latencies.push_back(std::chrono::steady_clock::now() - start);
+  }
+  s.stop_timer();
+
+  // A signer may start another one as it replicates
+  while (true)
+  {
+    std::vector<std::thread> finished;
+    {
+      std::lock_guard<std::mutex> guard(signers_lock);
+      finished.swap(signers);
+    }
+    if (finished.empty())
+      break;
+    for (auto& t : finished)
+      t.join();
+  }
+
+  const auto name = background ? "background" : "inline";
+  commit_latencies[fmt::format("{} {}", name, s.iterations())] =
+    std::move(latencies);
+}
+
+static void print_commit_latencies()
+{
+  for (auto& [name, latencies] : commit_latencies)
+  {
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+      const auto i = static_cast<size_t>(p * (latencies.size() - 1));
+      return std::chrono::duration<double, std::micro>(latencies[i]).count();
+    };
+    fmt::print(
+      "{}: p50 {:.1f}us, p99 {:.1f}us, p99.9 {:.1f}us, max {:.1f}us\n",
+      name,
+      percentile(0.5),
+      percentile(0.99),
+      percentile(0.999),
+      percentile(1.0));
+  }
+}
+
 const std::vector<int> sizes = {1000, 10000};
+const std::vector<int> batch_sizes = {1, 8, 64, 256, 1024};
 
 PICOBENCH_SUITE("hash_only");
 PICOBENCH(hash_only<10>).iterations(sizes).samples(10).baseline();
@@ -269,6 +416,22 @@ PICOBENCH(append_compact<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append_compact<100>).iterations(sizes).samples(10);
 PICOBENCH(append_compact<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("add_results");
+auto add_results_each_100 = add_results<100, false>;
+PICOBENCH(add_results_each_100).iterations(batch_sizes).samples(10).baseline();
+auto add_results_batch_100 = add_results<100, true>;
+PICOBENCH(add_results_batch_100).iterations(batch_sizes).samples(10);
+auto add_results_each_1000 = add_results<1000, false>;
+PICOBENCH(add_results_each_1000).iterations(batch_sizes).samples(10);
+auto add_results_batch_1000 = add_results<1000, true>;
+PICOBENCH(add_results_batch_1000).iterations(batch_sizes).samples(10);
+
+PICOBENCH_SUITE("commit_latency");
+auto commit_sign_inline = commit_latency<false>;
+PICOBENCH(commit_sign_inline).iterations(sizes).samples(10).baseline();
+auto commit_sign_background = commit_latency<true>;
+PICOBENCH(commit_sign_background).iterations(sizes).samples(10);
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char* argv[])
 {
@@ -277,5 +440,7 @@ int main(int argc, char* argv[])
 
   picobench::runner runner;
   runner.parse_cmd_line(argc, argv);
-  return runner.run();
+  const auto ret = runner.run();
+  print_commit_latencies();
+  return ret;
 }
\ No newline at end of file
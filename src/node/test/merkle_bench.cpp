@@ -4,6 +4,7 @@
 #include "../history.h"
 
 #include <algorithm>
+#include <map>
 #include <picobench/picobench.hpp>
 #include <random>
 
@@ -88,12 +89,141 @@ static void append_flush(picobench::state& s)
   s.stop_timer();
 }
 
+static vector<crypto::Sha256Hash> gen_hashes(size_t n)
+{
+  vector<crypto::Sha256Hash> hashes;
+  std::random_device r;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+
+    hashes.emplace_back(h);
+  }
+  return hashes;
+}
+
+// Appends a batch of leaves, getting the root after each one
+static void append_each_root(picobench::state& s)
+{
+  ccf::MerkleTreeHistory t;
+  auto hashes = gen_hashes(s.iterations());
+
+  s.start_timer();
+  for (const auto& h : hashes)
+  {
+    t.append(h);
+    auto root = t.get_root();
+    do_not_optimize(root);
+  }
+  clobber_memory();
+  s.stop_timer();
+}
+
+// Appends the same batch at once, then gets the root
+static void append_batch_root(picobench::state& s)
+{
+  ccf::MerkleTreeHistory t;
+  auto hashes = gen_hashes(s.iterations());
+
+  s.start_timer();
+  t.append(hashes);
+  auto root = t.get_root();
+  do_not_optimize(root);
+  clobber_memory();
+  s.stop_timer();
+}
+
+// A tree of 10M leaves with a signature every 100, compacted as a node
+// would, so that the last MAX_HISTORY_LEN leaves remain
+struct SignedTree
+{
+  static constexpr size_t leaves = 10000000;
+  static constexpr size_t sig_interval = 100;
+
+  ccf::MerkleTreeHistory tree;
+  std::map<uint64_t, ccf::MerkleTreeHistory::Frontier> signed_roots;
+  uint64_t first_index = 0;
+
+  SignedTree()
+  {
+    std::mt19937_64 r;
+    std::vector<crypto::Sha256Hash> hashes(sig_interval);
+    for (size_t size = 1; size < leaves; size += sig_interval)
+    {
+      for (auto& h : hashes)
+        for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+          h.h[j] = r();
+
+      tree.append(hashes);
+      auto f = tree.get_frontier();
+      signed_roots[f.size] = f;
+
+      if (f.size > ccf::MAX_HISTORY_LEN)
+      {
+        first_index = f.size - ccf::MAX_HISTORY_LEN;
+        tree.flush(first_index);
+        signed_roots.erase(
+          signed_roots.begin(), signed_roots.upper_bound(first_index));
+      }
+    }
+  }
+
+  static SignedTree& get()
+  {
+    static SignedTree t;
+    return t;
+  }
+};
+
+template <bool verify>
+static void receipt(picobench::state& s)
+{
+  auto& st = SignedTree::get();
+  const auto last_signed = st.signed_roots.rbegin()->first;
+  std::mt19937_64 r;
+  std::vector<uint64_t> indices;
+  for (size_t i = 0; i < s.iterations(); ++i)
+    indices.push_back(st.first_index + r() % (last_signed - st.first_index));
+
+  s.start_timer();
+  for (auto index : indices)
+  {
+    const auto& f = st.signed_roots.upper_bound(index)->second;
+    auto path = st.tree.get_path(index, f);
+    if (!path.has_value())
+      throw std::logic_error("No path to a signed root");
+
+    if constexpr (verify)
+    {
+      if (!ccf::MerkleTreeHistory::verify_path(index, f.size, *path, f.root))
+        throw std::logic_error("Path does not verify");
+    }
+    do_not_optimize(path);
+  }
+  clobber_memory();
+  s.stop_timer();
+}
+
 const std::vector<int> sizes = {10000, 100000};
+const std::vector<int> batch_sizes = {1, 8, 64, 256, 1024};
 
 PICOBENCH_SUITE("append_retract");
 PICOBENCH(append_retract).iterations(sizes).samples(10).baseline();
 PICOBENCH_SUITE("append_flush");
 PICOBENCH(append_flush).iterations(sizes).samples(10).baseline();
+PICOBENCH_SUITE("append_batch");
+PICOBENCH(append_each_root).iterations(batch_sizes).samples(10).baseline();
+PICOBENCH(append_batch_root).iterations(batch_sizes).samples(10);
+
+auto get_receipt = receipt<false>;
+auto get_and_verify_receipt = receipt<true>;
+
+PICOBENCH_SUITE("receipt");
+PICOBENCH(get_receipt).iterations(sizes).samples(10).baseline();
+PICOBENCH(get_and_verify_receipt).iterations(sizes).samples(10);
 
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char* argv[])
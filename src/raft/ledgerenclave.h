@@ -19,6 +19,9 @@ namespace raft
   private:
     std::unique_ptr<ringbuffer::AbstractWriter> to_host;
 
+    // Entries recorded as follower, not yet passed to the host
+    ringbuffer::Batch pending;
+
   public:
     LedgerEnclave(ringbuffer::AbstractWriterFactory& writer_factory_) :
       to_host(writer_factory_.create_writer_to_outside())
@@ -32,12 +35,16 @@ namespace raft
     void put_entry(const std::vector<uint8_t>& entry)
     {
       // write the message
+      flush();
       RINGBUFFER_WRITE_MESSAGE(raft::log_append, to_host, entry);
     }
 
     /**
      * Record a single entry to the ledger, when follower.
      *
+     * The entry is only passed to the host on the next flush(), so that all
+     * the entries from one append entries message are written together.
+     *
      * @param data Serialised entries
      * @param size Size of overall serialised entries
      *
@@ -49,7 +56,7 @@ namespace raft
       auto entry_len = serialized::read<uint32_t>(data, size);
       std::vector<uint8_t> entry(data, data + entry_len);
 
-      RINGBUFFER_WRITE_MESSAGE(raft::log_append, to_host, entry);
+      RINGBUFFER_WRITE_MESSAGE(raft::log_append, &pending, entry);
 
       serialized::skip(data, size, entry_len);
 
@@ -74,10 +81,56 @@ namespace raft
      * Truncate the ledger at a given index.
      *
      * @param idx Index to truncate from
+     * @param epoch Epoch of this truncation, sent back by the host with
+     * later durability reports
      */
-    void truncate(Index idx)
+    void truncate(Index idx, size_t epoch)
     {
-      RINGBUFFER_WRITE_MESSAGE(raft::log_truncate, to_host, idx);
+      flush();
+      RINGBUFFER_WRITE_MESSAGE(raft::log_truncate, to_host, idx, epoch);
+    }
+
+    /**
+     * Store a snapshot of the store at a given index.
+     *
+     * If the index is past the end of the ledger, the host discards the
+     * ledger, which then continues from the entry after the snapshot. The
+     * snapshot is passed to the host in chunks, so that it is not limited to
+     * the size of a single message.
+     *
+     * @param idx Index of the snapshot
+     * @param snapshot Serialised snapshot
+     */
+    void put_snapshot(Index idx, const std::vector<uint8_t>& snapshot)
+    {
+      flush();
+
+      size_t offset = 0;
+      do
+      {
+        auto size =
+          std::min(default_snapshot_chunk_size, snapshot.size() - offset);
+        RINGBUFFER_WRITE_MESSAGE(
+          raft::log_snapshot,
+          to_host,
+          idx,
+          snapshot.size(),
+          offset,
+          serializer::ByteRange{snapshot.data() + offset, size});
+        offset += size;
+      } while (offset < snapshot.size());
+    }
+
+    /**
+     * Pass all recorded entries to the host.
+     */
+    void flush()
+    {
+      if (pending.empty())
+        return;
+
+      to_host->write_batch(pending);
+      pending.clear();
     }
   };
 }
@@ -57,12 +57,28 @@ namespace raft
       Candidate
     };
 
+    // A batch of entries sent to a node, which it has not yet acknowledged
+    struct InFlight
+    {
+      Index end_idx;
+      size_t bytes;
+    };
+
     struct NodeState
     {
       // the highest matching index with the node that was confirmed
       Index match_idx;
       // the highest index sent to the node
       Index sent_idx;
+      // unacknowledged batches, oldest first, and their total size
+      std::deque<InFlight> in_flight = {};
+      size_t in_flight_bytes = 0;
+      // time since the node last acknowledged entries, while some are in
+      // flight to it
+      std::chrono::milliseconds idle{0};
+      // set when entries are sent again after a failure, and cleared on each
+      // periodic update
+      std::optional<Index> retried_from = std::nullopt;
     };
 
     struct Configuration
@@ -104,6 +120,18 @@ namespace raft
     static constexpr int batch_window_size = 100;
     int batch_window_sum = 0;
 
+    // No more entries are sent to a node while this many batches, or this
+    // many bytes, are in flight to it
+    size_t max_inflight_batches;
+    size_t max_inflight_bytes;
+
+    // Running total of the sizes of recent entries on the leader, so that the
+    // size of each batch can be found. entry_offsets[i] is the total size of
+    // the entries (entry_offsets_base, entry_offsets_base + i].
+    static constexpr size_t max_tracked_entries = 1 << 20;
+    std::deque<size_t> entry_offsets = {0};
+    Index entry_offsets_base = 0;
+
     // Indices that are eligible for global commit, from a Node's perspective
     std::deque<Index> committable_indices;
 
@@ -116,6 +144,61 @@ namespace raft
     // should be replicated
     std::optional<Index> recovery_max_index;
 
+    // When this is set, entries are only acknowledged (to the leader, or
+    // towards commit on the leader) once the host reports that they have been
+    // durably written to the ledger, up to durable_idx
+    bool wait_for_durable = false;
+    Index durable_idx = 0;
+
+    // Incremented whenever the local ledger is truncated. The host reports
+    // durability with the epoch of the latest truncation it had seen, so that
+    // reports about entries which have since been replaced are ignored.
+    size_t truncation_epoch = 0;
+
+    // When snapshot_interval is not 0, the store is snapshot once that many
+    // entries have been committed since the latest snapshot, which is at
+    // snapshot_idx. A snapshot installed from the leader is also the latest.
+    size_t snapshot_interval;
+    Index snapshot_idx = 0;
+    Term snapshot_term = 0;
+    size_t snapshot_size = 0;
+    crypto::Sha256Hash snapshot_digest;
+
+    // Snapshots are serialised and hashed off this thread. While one is in
+    // progress no other is taken, and once ready it becomes the latest at the
+    // next commit or periodic() on this thread.
+    struct TakenSnapshot
+    {
+      Index idx;
+      Term term;
+
+      // Set by whichever thread serialised the snapshot
+      SpinLock lock;
+      bool ready = false;
+      std::vector<uint8_t> data;
+      crypto::Sha256Hash digest;
+    };
+    std::shared_ptr<TakenSnapshot> taken_snapshot;
+
+    // Snapshots are sent to followers in chunks of at most this many bytes.
+    // A follower collects the chunks of the snapshot it is receiving from
+    // the leader until it has all of them.
+    size_t snapshot_chunk_size;
+    struct IncomingSnapshot
+    {
+      NodeId from;
+      Term term;
+      Index idx;
+      crypto::Sha256Hash digest;
+      size_t total_size;
+      std::vector<uint8_t> data;
+    };
+    std::optional<IncomingSnapshot> incoming_snapshot;
+
+    // The local ledger only contains entries from this index, since earlier
+    // ones were discarded when a snapshot was installed
+    Index log_start_idx = 1;
+
     // Randomness
     std::uniform_int_distribution<int> distrib;
     std::default_random_engine rand;
@@ -133,7 +216,12 @@ namespace raft
       NodeId id,
       std::chrono::milliseconds request_timeout_,
       std::chrono::milliseconds election_timeout_,
-      bool public_only_ = false) :
+      bool public_only_ = false,
+      bool wait_for_durable_ = false,
+      size_t max_inflight_batches_ = default_max_inflight_batches,
+      size_t max_inflight_bytes_ = default_max_inflight_bytes,
+      size_t snapshot_interval_ = 0,
+      size_t snapshot_chunk_size_ = default_snapshot_chunk_size) :
       store(std::move(store)),
 
       current_term(0),
@@ -149,7 +237,12 @@ namespace raft
 
       request_timeout(request_timeout_),
       election_timeout(election_timeout_),
+      max_inflight_batches(max_inflight_batches_),
+      max_inflight_bytes(max_inflight_bytes_),
       public_only(public_only_),
+      wait_for_durable(wait_for_durable_),
+      snapshot_interval(snapshot_interval_),
+      snapshot_chunk_size(snapshot_chunk_size_),
 
       ledger(std::move(ledger_)),
       channels(channels_),
@@ -229,6 +322,7 @@ namespace raft
       std::lock_guard<SpinLock> guard(lock);
       current_term = term;
       last_idx = index;
+      durable_idx = index;
       commit_idx = commit_idx_;
       term_history.update(index, term);
       current_term += 2;
@@ -249,6 +343,7 @@ namespace raft
       std::lock_guard<SpinLock> guard(lock);
       current_term = term;
       last_idx = index;
+      durable_idx = index;
       commit_idx = commit_idx_;
       term_history.initialise(terms);
       term_history.update(index, term);
@@ -261,6 +356,27 @@ namespace raft
       return last_idx;
     }
 
+    void durable_ledger(Index idx, size_t epoch)
+    {
+      // The host reports that the local ledger is durable up to idx
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (!wait_for_durable || epoch != truncation_epoch || idx <= durable_idx)
+        return;
+
+      durable_idx = std::min(idx, last_idx);
+
+      if (state == Leader)
+      {
+        update_commit();
+      }
+      else if (state == Follower && leader_id != NoNode)
+      {
+        // Acknowledge the newly durable entries
+        send_append_entries_response(leader_id, true);
+      }
+    }
+
     Index get_commit_idx() override
     {
       std::lock_guard<SpinLock> guard(lock);
@@ -318,6 +434,7 @@ namespace raft
 
         last_idx = index;
         ledger->put_entry(data);
+        track_entry_size(index, data.size());
 
         term_history.update(index, current_term);
 
@@ -371,6 +488,10 @@ namespace raft
           recv_request_vote_response(data, size);
           break;
 
+        case raft_install_snapshot:
+          recv_install_snapshot(data, size);
+          break;
+
         default:
         {}
       }
@@ -381,19 +502,48 @@ namespace raft
       std::lock_guard<SpinLock> guard(lock);
       timeout_elapsed += elapsed;
 
+      install_taken_snapshot();
+
       if (state == Leader)
       {
         if (timeout_elapsed >= request_timeout)
         {
           LOG_DEBUG_FMT("Sending periodic updates to followers");
           using namespace std::chrono_literals;
+          const auto since_update = timeout_elapsed;
           timeout_elapsed = 0ms;
 
           update_batch_size();
           // Send newly available entries to all nodes.
-          for (const auto& it : nodes)
+          for (auto& it : nodes)
           {
-            send_append_entries(it.first, it.second.sent_idx + 1);
+            auto& node = it.second;
+
+            // Channels between nodes only lose messages when they reconnect,
+            // and a slow node may take several updates to acknowledge a full
+            // window. Only if a node has acknowledged nothing for a whole
+            // election timeout are the batches in flight to it sent again,
+            // from the last index it acknowledged.
+            if (node.in_flight.empty())
+              node.idle = 0ms;
+            else
+              node.idle += since_update;
+
+            if (node.idle >= election_timeout)
+            {
+              LOG_DEBUG_FMT(
+                "No progress from follower {}, resending from {}",
+                it.first,
+                node.match_idx + 1);
+              reset_window(node, node.match_idx);
+            }
+            node.retried_from.reset();
+
+            // If the node's window is full, still let it know that we are
+            // the leader
+            if (!send_append_entries(it.first, node.sent_idx + 1))
+              send_append_entries_range(
+                it.first, node.sent_idx + 1, node.sent_idx);
           }
         }
       }
@@ -424,6 +574,11 @@ namespace raft
       entries_batch_size = std::max((batch_window_sum / batch_window_size), 1);
     }
 
+    Index get_acked_idx()
+    {
+      return wait_for_durable ? std::min(last_idx, durable_idx) : last_idx;
+    }
+
     Term get_term_internal(Index idx)
     {
       if (idx > last_idx)
@@ -432,22 +587,115 @@ namespace raft
       return term_history.term_at(idx);
     }
 
-    void send_append_entries(NodeId to, Index start_idx)
+    void track_entry_size(Index idx, size_t size)
+    {
+      if (idx != entry_offsets_base + entry_offsets.size())
+      {
+        entry_offsets = {0};
+        entry_offsets_base = idx - 1;
+      }
+
+      entry_offsets.push_back(entry_offsets.back() + size);
+
+      if (entry_offsets.size() > max_tracked_entries + 1)
+      {
+        entry_offsets.pop_front();
+        entry_offsets_base++;
+      }
+    }
+
+    // Sizes are no longer needed once every node has acknowledged the entries
+    void trim_entry_sizes()
+    {
+      Index min_match_idx = last_idx;
+      for (const auto& it : nodes)
+        min_match_idx = std::min(min_match_idx, it.second.match_idx);
+
+      while (entry_offsets.size() > 1 && entry_offsets_base < min_match_idx)
+      {
+        entry_offsets.pop_front();
+        entry_offsets_base++;
+      }
+    }
+
+    size_t batch_size_bytes(Index start_idx, Index end_idx)
+    {
+      const auto last_tracked = entry_offsets_base + entry_offsets.size() - 1;
+
+      // Batches of older entries are assumed to be as large as batches are
+      // meant to be
+      if (start_idx <= entry_offsets_base || end_idx > last_tracked)
+        return append_entries_size_limit;
+
+      return entry_offsets[end_idx - entry_offsets_base] -
+        entry_offsets[start_idx - 1 - entry_offsets_base];
+    }
+
+    bool window_full(const NodeState& node)
     {
+      return node.in_flight.size() >= max_inflight_batches ||
+        node.in_flight_bytes >= max_inflight_bytes;
+    }
+
+    // Forget about the batches in flight to a node, so that entries are next
+    // sent to it from sent_idx + 1
+    void reset_window(NodeState& node, Index sent_idx)
+    {
+      node.sent_idx = sent_idx;
+      node.in_flight.clear();
+      node.in_flight_bytes = 0;
+      node.idle = std::chrono::milliseconds(0);
+    }
+
+    // Sends the entries from start_idx in batches, for as long as the node's
+    // window allows, or an empty append entries if there are no entries to
+    // send. Returns false if nothing was sent because the window is full.
+    bool send_append_entries(NodeId to, Index start_idx)
+    {
+      const auto& node = nodes.at(to);
+      bool sent = false;
+
+      // The latest snapshot is sent in place of the entries it covers if
+      // they are not all in the local ledger, or if there are enough of them
+      // that installing the snapshot is cheaper than replaying them
+      if (
+        snapshot_idx > 0 && start_idx <= snapshot_idx &&
+        (start_idx < log_start_idx ||
+         (snapshot_interval > 0 &&
+          snapshot_idx - start_idx >= (Index)snapshot_interval)))
+      {
+        if (window_full(node))
+          return false;
+
+        send_install_snapshot(to);
+        start_idx = snapshot_idx + 1;
+        sent = true;
+      }
+
       Index end_idx = (last_idx == 0) ?
         0 :
         std::min(start_idx + entries_batch_size, last_idx);
 
       for (Index i = end_idx; i < last_idx; i += entries_batch_size)
       {
+        if (window_full(node))
+          return sent;
+
         send_append_entries_range(to, start_idx, i);
         start_idx = std::min(i + 1, last_idx);
+        sent = true;
       }
 
       if (last_idx == 0 || end_idx <= last_idx)
       {
+        if (start_idx <= last_idx && window_full(node))
+          return sent;
+
         send_append_entries_range(to, start_idx, last_idx);
+        sent = true;
       }
+
+      return sent;
     }
 
     void send_append_entries_range(NodeId to, Index start_idx, Index end_idx)
@@ -478,12 +726,216 @@ namespace raft
       // Record the most recent index we have sent to this node.
       node.sent_idx = end_idx;
 
+      if (end_idx >= start_idx)
+      {
+        const auto bytes = batch_size_bytes(start_idx, end_idx);
+        node.in_flight.push_back({end_idx, bytes});
+        node.in_flight_bytes += bytes;
+      }
+
       // The host will append log entries to this message when it is
       // sent to the destination node.
       channels->send_authenticated(
         ccf::NodeMsgType::consensus_msg_raft, to, ae);
     }
 
+    void send_install_snapshot(NodeId to)
+    {
+      LOG_INFO_FMT(
+        "Send install snapshot from {} to {} at {}",
+        local_id,
+        to,
+        snapshot_idx);
+
+      InstallSnapshot is = {raft_install_snapshot,
+                            local_id,
+                            current_term,
+                            snapshot_idx,
+                            snapshot_term,
+                            commit_idx,
+                            snapshot_digest,
+                            snapshot_size};
+
+      // The whole snapshot is a single batch in flight, acknowledged once
+      // the last chunk has been installed
+      auto& node = nodes.at(to);
+      node.sent_idx = snapshot_idx;
+      node.in_flight.push_back({snapshot_idx, snapshot_size});
+      node.in_flight_bytes += snapshot_size;
+
+      // The host will append each chunk of the snapshot to its message when
+      // it is sent to the destination node.
+      size_t offset = 0;
+      do
+      {
+        is.offset = offset;
+        is.size = std::min(snapshot_chunk_size, snapshot_size - offset);
+        channels->send_authenticated(
+          ccf::NodeMsgType::consensus_msg_raft, to, is);
+        offset += is.size;
+      } while (offset < snapshot_size);
+    }
+
+    void recv_install_snapshot(const uint8_t* data, size_t size)
+    {
+      InstallSnapshot r;
+
+      try
+      {
+        r = channels->template recv_authenticated<InstallSnapshot>(data, size);
+      }
+      catch (const std::logic_error& err)
+      {
+        LOG_FAIL_FMT(err.what());
+        return;
+      }
+
+      restart_election_timeout();
+
+      // Every chunk of a snapshot has the same header, so only the first one
+      // is answered when the snapshot is not wanted
+      if (current_term > r.term)
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot to {} from {} but our term is later",
+          local_id,
+          r.from_node);
+        if (r.offset == 0)
+          send_append_entries_response(r.from_node, false);
+        return;
+      }
+      else if (current_term < r.term || state == Candidate)
+      {
+        become_follower(r.term);
+      }
+
+      // Let the leader know how far our log goes, so that it sends entries
+      // from there instead
+      if (
+        r.idx <= commit_idx ||
+        (recovery_max_index.has_value() && r.idx > recovery_max_index.value()))
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot to {} from {} at {} but committed up to {}",
+          local_id,
+          r.from_node,
+          r.idx,
+          commit_idx);
+        if (r.offset == 0)
+          send_append_entries_response(r.from_node, false);
+        return;
+      }
+
+      if (r.offset == 0)
+      {
+        incoming_snapshot =
+          IncomingSnapshot{r.from_node, r.term, r.idx, r.digest, r.total_size};
+        incoming_snapshot->data.reserve(r.total_size);
+      }
+      else if (
+        !incoming_snapshot.has_value() ||
+        incoming_snapshot->from != r.from_node ||
+        incoming_snapshot->term != r.term || incoming_snapshot->idx != r.idx ||
+        incoming_snapshot->digest != r.digest ||
+        incoming_snapshot->total_size != r.total_size ||
+        incoming_snapshot->data.size() != r.offset)
+      {
+        LOG_DEBUG_FMT(
+          "Recv install snapshot to {} from {} at {} from {} but it does not "
+          "continue the snapshot being received",
+          local_id,
+          r.from_node,
+          r.idx,
+          r.offset);
+        incoming_snapshot.reset();
+        return;
+      }
+
+      // The host affixes nothing if the snapshot has since been replaced on
+      // the leader, which then sends a later one
+      if (size != r.size || r.offset + size > r.total_size)
+      {
+        LOG_FAIL_FMT(
+          "Recv install snapshot to {} from {} at {} but the chunk from {} "
+          "is {} bytes instead of {}",
+          local_id,
+          r.from_node,
+          r.idx,
+          r.offset,
+          size,
+          r.size);
+        incoming_snapshot.reset();
+        send_append_entries_response(r.from_node, false);
+        return;
+      }
+
+      incoming_snapshot->data.insert(
+        incoming_snapshot->data.end(), data, data + size);
+      if (incoming_snapshot->data.size() < r.total_size)
+        return;
+
+      std::vector<uint8_t> snapshot = std::move(incoming_snapshot->data);
+      incoming_snapshot.reset();
+
+      // Unlike entries, which are covered by signatures, the snapshot is
+      // only trusted because the authenticated header has its digest
+      crypto::Sha256Hash digest({CBuffer(snapshot.data(), snapshot.size())});
+      if (digest != r.digest)
+      {
+        LOG_FAIL_FMT(
+          "Recv install snapshot to {} from {} at {} but the digest does not "
+          "match",
+          local_id,
+          r.from_node,
+          r.idx);
+        return;
+      }
+
+      LOG_INFO_FMT(
+        "Installing snapshot on {} from {} at {}",
+        local_id,
+        r.from_node,
+        r.idx);
+
+      // Everything that is not committed is replaced by the snapshot
+      rollback(commit_idx);
+      committable_indices.clear();
+      last_idx = commit_idx;
+      durable_idx = std::min(durable_idx, last_idx);
+      truncate_ledger(commit_idx);
+
+      if (
+        store->deserialise_snapshot(snapshot, public_only) !=
+        kv::DeserialiseSuccess::PASS)
+      {
+        LOG_FAIL_FMT("Failed to install snapshot at {}", r.idx);
+        send_append_entries_response(r.from_node, false);
+        return;
+      }
+
+      ledger->put_snapshot(r.idx, snapshot);
+      last_idx = r.idx;
+      durable_idx = r.idx;
+      log_start_idx = r.idx + 1;
+      term_history.update(r.idx, r.term_of_idx);
+
+      snapshot_idx = r.idx;
+      snapshot_term = r.term_of_idx;
+      snapshot_size = snapshot.size();
+      snapshot_digest = digest;
+
+      commit(r.idx);
+
+      if (leader_id != r.from_node)
+      {
+        leader_id = r.from_node;
+        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
+      }
+
+      send_append_entries_response(r.from_node, true);
+      commit_if_possible(r.leader_commit_idx);
+    }
+
     void recv_append_entries(const uint8_t* data, size_t size)
     {
       AppendEntries r;
@@ -581,6 +1033,11 @@ namespace raft
         r.idx,
         r.prev_idx);
 
+      // Entries are recorded as they are read, and then deserialised
+      // together once the whole batch has been recorded
+      std::vector<std::vector<uint8_t>> entries;
+      std::optional<bool> early_response;
+
       for (Index i = r.prev_idx + 1; i <= r.idx; i++)
       {
         if (i <= last_idx)
@@ -603,8 +1060,7 @@ namespace raft
             // whole batch
             LOG_INFO_FMT(
               "Replication suspended: {} > {}", i, recovery_max_index.value());
-            send_append_entries_response(r.from_node, false);
-            return;
+            early_response = false;
           }
           else
           {
@@ -614,9 +1070,9 @@ namespace raft
               "Replication suspended up to {} but deserialised up to {}",
               recovery_max_index.value(),
               i - 1);
-            send_append_entries_response(r.from_node, true);
-            return;
+            early_response = true;
           }
+          break;
         }
 
         last_idx = i;
@@ -633,17 +1089,52 @@ namespace raft
             local_id,
             r.from_node);
 
+          deserialise_entries(entries, last_idx - 1);
+
           last_idx = r.prev_idx;
-          ledger->truncate(r.prev_idx);
+          durable_idx = std::min(durable_idx, last_idx);
+          truncate_ledger(r.prev_idx);
           send_append_entries_response(r.from_node, false);
           return;
         }
 
-        Term sig_term = 0;
-        auto deserialise_success =
-          store->deserialise(ret.first, public_only, &sig_term);
+        entries.push_back(std::move(ret.first));
+      }
+
+      deserialise_entries(entries, last_idx);
+
+      if (early_response.has_value())
+      {
+        send_append_entries_response(r.from_node, early_response.value());
+        return;
+      }
+
+      // Update the current leader because we accepted entries.
+      if (leader_id != r.from_node)
+      {
+        leader_id = r.from_node;
+        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
+      }
+
+      send_append_entries_response(r.from_node, true);
+      commit_if_possible(r.leader_commit_idx);
+
+      term_history.update(commit_idx + 1, r.term_of_idx);
+    }
+
+    // Deserialises the entries recorded from an append entries, which end at
+    // last_entry_idx. The store may parse them concurrently, but they are
+    // applied in order.
+    void deserialise_entries(
+      const std::vector<std::vector<uint8_t>>& entries, Index last_entry_idx)
+    {
+      Index i = last_entry_idx - entries.size();
+
+      auto on_deserialised = [this, &i](
+                               kv::DeserialiseSuccess success, Term sig_term) {
+        i++;
 
-        switch (deserialise_success)
+        switch (success)
         {
           case kv::DeserialiseSuccess::FAILED:
             throw std::logic_error(
@@ -660,32 +1151,28 @@ namespace raft
           case kv::DeserialiseSuccess::PASS:
             break;
         }
-      }
-
-      // Update the current leader because we accepted entries.
-      if (leader_id != r.from_node)
-      {
-        leader_id = r.from_node;
-        LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
-      }
+      };
 
-      send_append_entries_response(r.from_node, true);
-      commit_if_possible(r.leader_commit_idx);
-
-      term_history.update(commit_idx + 1, r.term_of_idx);
+      store->deserialise_batch(entries, public_only, on_deserialised);
     }
 
     void send_append_entries_response(NodeId to, bool answer)
     {
+      // Recorded entries must reach the host ledger before they are
+      // acknowledged
+      ledger->flush();
+
+      const auto acked_idx = get_acked_idx();
+
       LOG_DEBUG_FMT(
         "Send append entries response from {} to {} for index {}: {}",
         local_id,
         to,
-        last_idx,
+        acked_idx,
         answer);
 
       AppendEntriesResponse response = {
-        raft_append_entries_response, local_id, current_term, last_idx, answer};
+        raft_append_entries_response, local_id, current_term, acked_idx, answer};
 
       channels->send_authenticated(
         ccf::NodeMsgType::consensus_msg_raft, to, response);
@@ -744,16 +1231,25 @@ namespace raft
       }
 
       // Update next and match for the responding node.
-      node->second.match_idx = std::min(r.last_log_idx, last_idx);
+      auto& ns = node->second;
+      ns.match_idx = std::min(r.last_log_idx, last_idx);
 
       if (!r.success)
       {
-        // Failed due to log inconsistency. Reset sent_idx and try again.
+        // Failed due to log inconsistency. Entries are sent again from the
+        // node's last index. Batches pipelined after the one which failed are
+        // rejected too, so this is only done once per periodic update for
+        // the same index.
+        if (ns.retried_from == ns.match_idx)
+          return;
+
         LOG_DEBUG_FMT(
           "Recv append entries response to {} from {}: failed",
           local_id,
           r.from_node);
-        send_append_entries(r.from_node, node->second.match_idx + 1);
+        ns.retried_from = ns.match_idx;
+        reset_window(ns, ns.match_idx);
+        send_append_entries(r.from_node, ns.match_idx + 1);
         return;
       }
 
@@ -762,7 +1258,29 @@ namespace raft
         local_id,
         r.from_node,
         r.last_log_idx);
+
+      // The node has everything it acknowledged, even if it was not sent in
+      // this term, and batches up to there are no longer in flight
+      ns.idle = std::chrono::milliseconds(0);
+      ns.sent_idx = std::max(ns.sent_idx, ns.match_idx);
+      while (!ns.in_flight.empty() &&
+             ns.in_flight.front().end_idx <= ns.match_idx)
+      {
+        ns.in_flight_bytes -= ns.in_flight.front().bytes;
+        ns.in_flight.pop_front();
+      }
+
       update_commit();
+      trim_entry_sizes();
+
+      // Keep the node's window full, rather than waiting for the next
+      // periodic update. Committing may have removed the node.
+      if (state != Leader)
+        return;
+
+      auto it = nodes.find(r.from_node);
+      if (it != nodes.end() && it->second.sent_idx < last_idx)
+        send_append_entries(r.from_node, it->second.sent_idx + 1);
     }
 
     void send_request_vote(NodeId to)
@@ -978,7 +1496,7 @@ namespace raft
       for (auto it = nodes.begin(); it != nodes.end(); ++it)
       {
         it->second.match_idx = 0;
-        it->second.sent_idx = next - 1;
+        reset_window(it->second, next - 1);
 
         // Send an empty append_entries to all nodes.
         send_append_entries(it->first, next);
@@ -1028,7 +1546,7 @@ namespace raft
         for (auto node : c.nodes)
         {
           if (node == local_id)
-            match.push_back(last_idx);
+            match.push_back(get_acked_idx());
           else
             match.push_back(nodes.at(node).match_idx);
         }
@@ -1093,6 +1611,12 @@ namespace raft
       store->compact(idx);
       LOG_DEBUG_FMT("Commit on {}: {}", local_id, idx);
 
+      install_taken_snapshot();
+      if (
+        snapshot_interval > 0 &&
+        idx - snapshot_idx >= (Index)snapshot_interval)
+        take_snapshot(idx);
+
       // Examine all configurations that are followed by a globally committed
       // configuration.
       bool changed = false;
@@ -1118,10 +1642,94 @@ namespace raft
         create_and_remove_node_state();
     }
 
+    void take_snapshot(Index idx)
+    {
+      if (taken_snapshot != nullptr)
+        return;
+
+      auto taken = std::make_shared<TakenSnapshot>();
+      taken->idx = idx;
+      taken->term = get_term_internal(idx);
+      taken_snapshot = taken;
+
+      try
+      {
+        store->snapshot(idx, [taken](std::vector<uint8_t>&& data) {
+          crypto::Sha256Hash digest;
+          if (!data.empty())
+            digest = crypto::Sha256Hash({data});
+
+          std::lock_guard<SpinLock> guard(taken->lock);
+          taken->data = std::move(data);
+          taken->digest = digest;
+          taken->ready = true;
+        });
+      }
+      catch (const std::exception& e)
+      {
+        // Entries are still replicated as usual
+        LOG_FAIL_FMT("Failed to snapshot at {}: {}", idx, e.what());
+        taken_snapshot = nullptr;
+        return;
+      }
+
+      // The store may have serialised it already
+      install_taken_snapshot();
+    }
+
+    void install_taken_snapshot()
+    {
+      if (taken_snapshot == nullptr)
+        return;
+
+      {
+        std::lock_guard<SpinLock> guard(taken_snapshot->lock);
+        if (!taken_snapshot->ready)
+          return;
+      }
+
+      auto taken = std::move(taken_snapshot);
+      taken_snapshot = nullptr;
+
+      if (taken->data.empty())
+      {
+        LOG_FAIL_FMT("Failed to snapshot at {}", taken->idx);
+        return;
+      }
+
+      // A later snapshot may have been installed from the leader meanwhile
+      if (taken->idx <= snapshot_idx)
+        return;
+
+      ledger->put_snapshot(taken->idx, taken->data);
+
+      snapshot_idx = taken->idx;
+      snapshot_term = taken->term;
+      snapshot_size = taken->data.size();
+      snapshot_digest = taken->digest;
+
+      LOG_INFO_FMT(
+        "Snapshot on {} at {}: {} bytes",
+        local_id,
+        snapshot_idx,
+        snapshot_size);
+    }
+
+    void truncate_ledger(Index idx)
+    {
+      ledger->truncate(idx, ++truncation_epoch);
+    }
+
     void rollback(Index idx)
     {
       store->rollback(idx);
 
+      while (entry_offsets.size() > 1 &&
+             entry_offsets_base + entry_offsets.size() - 1 > idx)
+      {
+        entry_offsets.pop_back();
+      }
+
       while (!committable_indices.empty() && (committable_indices.back() > idx))
       {
         committable_indices.pop_back();
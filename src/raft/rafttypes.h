@@ -2,11 +2,14 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "crypto/hash.h"
 #include "ds/ringbuffer_types.h"
 
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <limits>
+#include <vector>
 
 namespace raft
 {
@@ -17,10 +20,28 @@ namespace raft
 
   static constexpr NodeId NoNode = std::numeric_limits<NodeId>::max();
 
+  static constexpr size_t default_max_inflight_batches = 64;
+  static constexpr size_t default_max_inflight_bytes = 4 * 1024 * 1024;
+  // Snapshots are passed between the enclave and the host, and sent to
+  // followers, in chunks of at most this many bytes, so that each fits in a
+  // single ringbuffer message
+  static constexpr size_t default_snapshot_chunk_size = 1024 * 1024;
+
   struct Config
   {
     std::chrono::milliseconds requestTimeout;
     std::chrono::milliseconds electionTimeout;
+    // If set, entries are only acknowledged once the host reports that they
+    // have been durably written to the ledger
+    bool waitForDurableLedger = false;
+    // The leader stops sending entries to a follower once this many batches,
+    // or this many bytes of entries, are unacknowledged
+    size_t maxInflightBatches = default_max_inflight_batches;
+    size_t maxInflightBytes = default_max_inflight_bytes;
+    // If not 0, the store is snapshot whenever at least this many entries
+    // have been committed since the last snapshot. Followers that are further
+    // behind are sent the latest snapshot rather than every entry.
+    size_t snapshotInterval = 0;
   };
 
   template <typename S>
@@ -32,8 +53,23 @@ namespace raft
       const std::vector<uint8_t>& data,
       bool public_only = false,
       Term* term = nullptr) = 0;
+
+    // Deserialises consecutive entries in order, calling f with the result
+    // for each and the term of any signature it contained, until one fails
+    virtual void deserialise_batch(
+      const std::vector<std::vector<uint8_t>>& entries,
+      bool public_only,
+      std::function<void(S, Term)> f) = 0;
     virtual void compact(Index v) = 0;
     virtual void rollback(Index v) = 0;
+
+    // Serialises the store at a committed index, off the calling thread,
+    // and replaces the whole store with such a snapshot. done may be called
+    // on any thread, with no data if the snapshot could not be serialised.
+    virtual void snapshot(
+      Index v, std::function<void(std::vector<uint8_t>&&)> done) = 0;
+    virtual S deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false) = 0;
   };
 
   template <typename T, typename S>
@@ -57,6 +93,18 @@ namespace raft
       return S::FAILED;
     }
 
+    void deserialise_batch(
+      const std::vector<std::vector<uint8_t>>& entries,
+      bool public_only,
+      std::function<void(S, Term)> f)
+    {
+      auto p = x.lock();
+      if (p)
+        p->deserialise_batch(entries, public_only, f);
+      else if (!entries.empty())
+        f(S::FAILED, 0);
+    }
+
     void compact(Index v)
     {
       auto p = x.lock();
@@ -70,6 +118,25 @@ namespace raft
       if (p)
         p->rollback(v);
     }
+
+    void snapshot(Index v, std::function<void(std::vector<uint8_t>&&)> done)
+    {
+      auto p = x.lock();
+      if (p)
+        p->snapshot(v, std::move(done));
+      else
+        done({});
+    }
+
+    S deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      auto p = x.lock();
+      if (p)
+        return p->deserialise_snapshot(data, public_only);
+
+      return S::FAILED;
+    }
   };
 
   enum RaftMsgType : Node2NodeMsg
@@ -78,6 +145,7 @@ namespace raft
     raft_append_entries_response,
     raft_request_vote,
     raft_request_vote_response,
+    raft_install_snapshot,
   };
 
 #pragma pack(push, 1)
@@ -116,30 +184,61 @@ namespace raft
     Term term;
     bool vote_granted;
   };
+
+  // Sent instead of the entries up to idx when a follower is too far behind.
+  // The host appends the snapshot of the store at idx, which must match the
+  // digest.
+  struct InstallSnapshot : RaftHeader
+  {
+    Term term;
+    Index idx;
+    Term term_of_idx;
+    Index leader_commit_idx;
+    crypto::Sha256Hash digest;
+    // The host affixes size bytes of the snapshot, from offset, which is
+    // total_size bytes long
+    size_t total_size;
+    size_t offset;
+    size_t size;
+  };
 #pragma pack(pop)
 
   /// Raft-related ringbuffer messages
   enum : ringbuffer::Message
   {
-    /// Request individual log entries. Enclave -> Host
-    DEFINE_RINGBUFFER_MSG_TYPE(log_get),
+    /// Request a range of log entries. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(log_get_range),
 
-    ///@{
-    /// Respond to log_get. Host -> Enclave
-    DEFINE_RINGBUFFER_MSG_TYPE(log_entry),
-    DEFINE_RINGBUFFER_MSG_TYPE(log_no_entry),
-    ///@}
+    /// Respond to log_get_range with the framed entries from the start of the
+    /// range, as many as are in the log and fit in one message. No entries
+    /// means the range is past the end of the log. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(log_entries),
 
     ///@{
-    /// Modify the local log. Enclave -> Host
+    /// Modify the local log. Truncations carry an epoch, which increases
+    /// with each one. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(log_append),
     DEFINE_RINGBUFFER_MSG_TYPE(log_truncate),
     ///@}
+
+    /// Report the last index written durably to the local log, with the
+    /// epoch of the latest truncation before it was written. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(log_durable),
+
+    /// Store a snapshot at an index, replacing any older snapshot. If the
+    /// index is past the end of the local log, the log is discarded and
+    /// continues after the snapshot. The snapshot is sent in chunks, in
+    /// order, each with its offset and the total size. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(log_snapshot),
   };
 }
 
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_get, raft::Index);
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_entry, std::vector<uint8_t>);
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_no_entry);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  raft::log_get_range, raft::Index, raft::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  raft::log_entries, raft::Index, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_append, std::vector<uint8_t>);
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_truncate, raft::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_truncate, raft::Index, size_t);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(raft::log_durable, raft::Index, size_t);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  raft::log_snapshot, raft::Index, size_t, size_t, std::vector<uint8_t>);
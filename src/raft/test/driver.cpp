@@ -29,8 +29,11 @@ int main(int argc, char** argv)
     switch (shash(items[0].c_str()))
     {
       case shash("nodes"):
-        assert(items.size() == 2);
-        driver = make_shared<RaftDriver>(stoi(items[1]));
+        assert(items.size() == 2 || items.size() == 3);
+        if (items.size() == 3)
+          driver = make_shared<RaftDriver>(stoi(items[1]), stoi(items[2]));
+        else
+          driver = make_shared<RaftDriver>(stoi(items[1]));
         break;
       case shash("connect"):
         assert(items.size() == 3);
@@ -67,6 +70,15 @@ int main(int argc, char** argv)
           stoi(items[2]),
           vector<uint8_t>(items[3].begin(), items[3].end()));
         break;
+      case shash("replicate_n"):
+        assert(items.size() == 5);
+        driver->replicate_n(
+          stoi(items[1]), stoi(items[2]), stoi(items[3]), stoi(items[4]));
+        break;
+      case shash("slow_node"):
+        assert(items.size() == 3);
+        driver->slow_node(stoi(items[1]), stoi(items[2]));
+        break;
       case shash("disconnect"):
         assert(items.size() == 3);
         driver->disconnect(stoi(items[1]), stoi(items[2]));
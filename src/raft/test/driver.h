@@ -32,8 +32,14 @@ private:
   std::unordered_map<raft::NodeId, NodeDriver> _nodes;
   std::set<std::pair<raft::NodeId, raft::NodeId>> _connections;
 
+  // Nodes which only receive this many messages of each type per dispatch.
+  // The rest are delivered by later dispatches.
+  std::unordered_map<raft::NodeId, size_t> _slow;
+
 public:
-  RaftDriver(size_t number_of_nodes)
+  RaftDriver(
+    size_t number_of_nodes,
+    size_t max_inflight_batches = raft::default_max_inflight_batches)
   {
     std::unordered_set<raft::NodeId> configuration;
 
@@ -48,7 +54,10 @@ public:
         std::make_shared<raft::ChannelStubProxy>(),
         node_id,
         ms(10),
-        ms(i * 100));
+        ms(i * 100),
+        false,
+        false,
+        max_inflight_batches);
 
       _nodes.emplace(node_id, NodeDriver{kv, raft});
       configuration.insert(node_id);
@@ -160,6 +169,8 @@ public:
   size_t dispatch_one_queue(raft::NodeId node_id, Messages& messages)
   {
     size_t count = 0;
+    Messages deferred;
+    std::unordered_map<raft::NodeId, size_t> delivered;
 
     while (messages.size())
     {
@@ -167,6 +178,13 @@ public:
       messages.pop_front();
       auto tgt_node_id = std::get<0>(message);
 
+      auto slow = _slow.find(tgt_node_id);
+      if (slow != _slow.end() && delivered[tgt_node_id] >= slow->second)
+      {
+        deferred.push_back(message);
+        continue;
+      }
+
       if (
         _connections.find(std::make_pair(node_id, tgt_node_id)) !=
         _connections.end())
@@ -176,10 +194,12 @@ public:
         _nodes.at(tgt_node_id)
           .raft->recv_message(
             reinterpret_cast<uint8_t*>(&contents), sizeof(contents));
+        delivered[tgt_node_id]++;
         count++;
       }
     }
 
+    messages.swap(deferred);
     return count;
   }
 
@@ -224,6 +244,26 @@ public:
     _nodes.at(node_id).raft->replicate({{idx, data, true}});
   }
 
+  void replicate_n(
+    raft::NodeId node_id, raft::Index first_idx, size_t count, size_t size)
+  {
+    std::cout << "  KV" << node_id << "->>Node" << node_id
+              << ": replicate idx: " << first_idx << " to "
+              << first_idx + count - 1 << " (" << size << " bytes each)"
+              << std::endl;
+    std::vector<uint8_t> data(size, 1);
+    for (size_t i = 0; i < count; ++i)
+      _nodes.at(node_id).raft->replicate({{first_idx + i, data, true}});
+  }
+
+  void slow_node(raft::NodeId node_id, size_t messages_per_dispatch)
+  {
+    std::cout << "  Note right of Node" << node_id << ": slow, receives "
+              << messages_per_dispatch << " of each message per dispatch"
+              << std::endl;
+    _slow[node_id] = messages_per_dispatch;
+  }
+
   void disconnect(raft::NodeId left, raft::NodeId right)
   {
     bool noop = true;
@@ -18,6 +18,9 @@ namespace raft
   public:
     std::vector<std::shared_ptr<std::vector<uint8_t>>> ledger;
     uint64_t skip_count = 0;
+    // The latest snapshot, if any
+    Index snapshot_idx = 0;
+    std::vector<uint8_t> snapshot;
 
     LedgerStubProxy(NodeId id) : _id(id) {}
 
@@ -55,7 +58,7 @@ namespace raft
       skip_count++;
     }
 
-    void truncate(Index idx)
+    void truncate(Index idx, size_t epoch)
     {
 #ifdef STUB_LOG
       std::cout << "  KV" << _id << "->>Node" << _id << ": truncate i: " << idx
@@ -63,6 +66,19 @@ namespace raft
 #endif
     }
 
+    void put_snapshot(Index idx, const std::vector<uint8_t>& data)
+    {
+#ifdef STUB_LOG
+      std::cout << "  Node" << _id << "->>Ledger" << _id
+                << ": snapshot i: " << idx << " s: " << data.size()
+                << std::endl;
+#endif
+      snapshot_idx = idx;
+      snapshot = data;
+    }
+
+    void flush() {}
+
     void reset_skip_count()
     {
       skip_count = 0;
@@ -79,6 +95,7 @@ namespace raft
       sent_request_vote_response;
     std::list<std::pair<NodeId, AppendEntriesResponse>>
       sent_append_entries_response;
+    std::list<std::pair<NodeId, InstallSnapshot>> sent_install_snapshot;
 
     ChannelStubProxy() {}
 
@@ -110,10 +127,17 @@ namespace raft
       sent_append_entries_response.push_back(std::make_pair(to, data));
     }
 
+    void send_authenticated(
+      const ccf::NodeMsgType& msg_type, NodeId to, const InstallSnapshot& data)
+    {
+      sent_install_snapshot.push_back(std::make_pair(to, data));
+    }
+
     size_t sent_msg_count() const
     {
       return sent_request_vote.size() + sent_request_vote_response.size() +
-        sent_append_entries.size() + sent_append_entries_response.size();
+        sent_append_entries.size() + sent_append_entries_response.size() +
+        sent_install_snapshot.size();
     }
 
     template <class T>
@@ -129,6 +153,15 @@ namespace raft
     raft::NodeId _id;
 
   public:
+    // The index of each snapshot taken or installed
+    std::vector<Index> snapshots;
+    std::vector<Index> installed_snapshots;
+
+    // When set, snapshots are only handed back by complete_snapshots(), as
+    // when they are serialised on another thread
+    bool defer_snapshots = false;
+    std::vector<std::function<void()>> deferred_snapshots;
+
     LoggingStubStore(raft::NodeId id) : _id(id) {}
 
     void compact(Index i)
@@ -154,5 +187,55 @@ namespace raft
     {
       return kv::DeserialiseSuccess::PASS;
     }
+
+    template <typename F>
+    void deserialise_batch(
+      const std::vector<std::vector<uint8_t>>& entries,
+      bool public_only,
+      F&& f)
+    {
+      for (const auto& entry : entries)
+        f(deserialise(entry, public_only), 0);
+    }
+
+    void snapshot(Index i, std::function<void(std::vector<uint8_t>&&)> done)
+    {
+#ifdef STUB_LOG
+      std::cout << "  Node" << _id << "->>KV" << _id << ": snapshot i: " << i
+                << std::endl;
+#endif
+      snapshots.push_back(i);
+
+      // The snapshot is only its index
+      std::vector<uint8_t> data(sizeof(Index));
+      auto p = data.data();
+      auto size = data.size();
+      serialized::write(p, size, i);
+
+      if (defer_snapshots)
+        deferred_snapshots.emplace_back(
+          [data, done]() mutable { done(std::move(data)); });
+      else
+        done(std::move(data));
+    }
+
+    void complete_snapshots()
+    {
+      for (auto& f : deferred_snapshots)
+        f();
+      deferred_snapshots.clear();
+    }
+
+    kv::DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      auto p = data.data();
+      auto size = data.size();
+      if (size != sizeof(Index))
+        return kv::DeserialiseSuccess::FAILED;
+
+      installed_snapshots.push_back(serialized::read<Index>(p, size));
+      return kv::DeserialiseSuccess::PASS;
+    }
   };
 }
\ No newline at end of file
@@ -82,6 +82,48 @@ TEST_CASE("Single node commit" * doctest::test_suite("single"))
   }
 }
 
+TEST_CASE("Single node durable commit" * doctest::test_suite("single"))
+{
+  auto kv_store = std::make_shared<Store>(0);
+  raft::NodeId node_id(0);
+  ms election_timeout(150);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store),
+    std::make_unique<raft::LedgerStubProxy>(node_id),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id,
+    ms(10),
+    election_timeout,
+    false,
+    true);
+
+  std::unordered_set<raft::NodeId> config = {node_id};
+  r0.add_configuration(0, config);
+
+  r0.periodic(election_timeout * 2);
+  REQUIRE(r0.is_leader());
+
+  INFO("Observe that data is only committed once it is durable");
+
+  for (size_t i = 1; i <= 5; ++i)
+  {
+    r0.replicate({{i, {1, 2, 3}, true}});
+    REQUIRE(r0.get_last_idx() == i);
+  }
+  REQUIRE(r0.get_commit_idx() == 0);
+
+  INFO("Reports from before another truncation of the ledger are ignored");
+  r0.durable_ledger(3, 1);
+  REQUIRE(r0.get_commit_idx() == 0);
+
+  r0.durable_ledger(3, 0);
+  REQUIRE(r0.get_commit_idx() == 3);
+
+  r0.durable_ledger(5, 0);
+  REQUIRE(r0.get_commit_idx() == 5);
+}
+
 TEST_CASE(
   "Multiple nodes startup and election" * doctest::test_suite("multiple"))
 {
@@ -470,6 +512,216 @@ TEST_CASE("Multiple nodes, late join" * doctest::test_suite("multiple"))
       }));
 }
 
+TEST_CASE(
+  "Multiple nodes, late join from snapshot" * doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+  auto kv_store2 = std::make_shared<Store>(2);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+  raft::NodeId node_id2(2);
+
+  ms request_timeout(10);
+  const size_t snapshot_interval = 2;
+  const size_t snapshot_chunk_size = 3;
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    false,
+    raft::default_max_inflight_batches,
+    raft::default_max_inflight_bytes,
+    snapshot_interval,
+    snapshot_chunk_size);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100));
+  TRaft r2(
+    std::make_unique<Adaptor>(kv_store2),
+    std::make_unique<raft::LedgerStubProxy>(node_id2),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id2,
+    request_timeout,
+    ms(50));
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0.add_configuration(0, config0);
+  r1.add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  INFO("The leader takes a snapshot once enough entries are committed");
+  for (size_t i = 1; i <= 3; ++i)
+    REQUIRE(r0.replicate({{i, {1, 2, 3}, true}}));
+  r0.periodic(ms(10));
+
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  REQUIRE(r0.get_commit_idx() == 3);
+  REQUIRE(kv_store0->snapshots == std::vector<raft::Index>{3});
+  REQUIRE(r0.ledger->snapshot_idx == 3);
+
+  INFO("The next snapshot is only taken after another interval");
+  REQUIRE(r0.replicate({{4, {1, 2, 3}, true}}));
+  r0.periodic(ms(10));
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  REQUIRE(r0.get_commit_idx() == 4);
+  REQUIRE(kv_store0->snapshots == std::vector<raft::Index>{3});
+
+  INFO("Node 2 joins the ensemble");
+
+  std::unordered_set<raft::NodeId> config1 = {node_id0, node_id1, node_id2};
+  r0.add_configuration(4, config1);
+  r1.add_configuration(4, config1);
+  r2.add_configuration(4, config1);
+
+  nodes[node_id2] = &r2;
+
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes, r0.channels->sent_append_entries, [](const auto& msg) {
+        REQUIRE(msg.prev_idx == 4);
+      }));
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes, r2.channels->sent_append_entries_response, [](const auto& msg) {
+        REQUIRE(msg.last_log_idx == 0);
+        REQUIRE(!msg.success);
+      }));
+
+  INFO("Node 0 sends Node 2 its snapshot in chunks");
+  const auto snapshot = r0.ledger->snapshot;
+  REQUIRE(snapshot.size() == 8);
+  std::vector<raft::InstallSnapshot> chunks;
+  for (auto& [to, is] : r0.channels->sent_install_snapshot)
+    chunks.push_back(is);
+  r0.channels->sent_install_snapshot.clear();
+  REQUIRE(chunks.size() == 3);
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    REQUIRE(chunks[i].idx == 3);
+    REQUIRE(chunks[i].term == 1);
+    REQUIRE(chunks[i].term_of_idx == 1);
+    REQUIRE(chunks[i].leader_commit_idx == 4);
+    REQUIRE(chunks[i].total_size == 8);
+    REQUIRE(chunks[i].offset == i * snapshot_chunk_size);
+  }
+  REQUIRE(chunks[2].size == 2);
+
+  auto deliver_chunk = [&](
+                         const raft::InstallSnapshot& is,
+                         const std::vector<uint8_t>& snapshot) {
+    std::vector<uint8_t> msg(sizeof(is) + is.size);
+    memcpy(msg.data(), &is, sizeof(is));
+    memcpy(msg.data() + sizeof(is), snapshot.data() + is.offset, is.size);
+    r2.recv_message(msg.data(), msg.size());
+  };
+
+  auto deliver_snapshot = [&](const std::vector<uint8_t>& snapshot) {
+    for (const auto& is : chunks)
+      deliver_chunk(is, snapshot);
+  };
+
+  INFO("A snapshot which does not match the digest is ignored");
+  deliver_snapshot(std::vector<uint8_t>(snapshot.size(), 0));
+  REQUIRE(r2.get_last_idx() == 0);
+  REQUIRE(kv_store2->installed_snapshots.empty());
+  REQUIRE(r2.channels->sent_msg_count() == 0);
+
+  INFO("A chunk which does not follow the previous one is ignored");
+  deliver_chunk(chunks[0], snapshot);
+  deliver_chunk(chunks[2], snapshot);
+  deliver_chunk(chunks[1], snapshot);
+  REQUIRE(kv_store2->installed_snapshots.empty());
+  REQUIRE(r2.channels->sent_msg_count() == 0);
+
+  INFO("A chunk which the host could not affix is refused");
+  {
+    auto is = chunks[0];
+    r2.recv_message(reinterpret_cast<uint8_t*>(&is), sizeof(is));
+    REQUIRE(kv_store2->installed_snapshots.empty());
+    REQUIRE(r2.channels->sent_append_entries_response.size() == 1);
+    REQUIRE(!r2.channels->sent_append_entries_response.front().second.success);
+    r2.channels->sent_append_entries_response.clear();
+  }
+
+  INFO("Node 2 installs the snapshot, then receives the entries after it");
+  deliver_snapshot(snapshot);
+  REQUIRE(kv_store2->installed_snapshots == std::vector<raft::Index>{3});
+  REQUIRE(r2.ledger->snapshot_idx == 3);
+  REQUIRE(r2.get_last_idx() == 3);
+  REQUIRE(r2.get_commit_idx() == 3);
+  REQUIRE(r2.get_term(3) == 1);
+
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes, r2.channels->sent_append_entries_response, [](const auto& msg) {
+        REQUIRE(msg.last_log_idx == 3);
+        REQUIRE(msg.success);
+      }));
+
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes, r0.channels->sent_append_entries, [](const auto& msg) {
+        REQUIRE(msg.prev_idx == 3);
+        REQUIRE(msg.idx == 4);
+      }));
+  REQUIRE(r2.get_last_idx() == 4);
+  REQUIRE(1 == dispatch_all(nodes, r2.channels->sent_append_entries_response));
+
+  INFO("A snapshot which is already committed is not installed again");
+  deliver_snapshot(snapshot);
+  REQUIRE(kv_store2->installed_snapshots.size() == 1);
+  REQUIRE(
+    1 ==
+    dispatch_all_and_check(
+      nodes, r2.channels->sent_append_entries_response, [](const auto& msg) {
+        REQUIRE(msg.last_log_idx == 4);
+        REQUIRE(!msg.success);
+      }));
+
+  INFO("A snapshot serialised later becomes the latest once it is ready");
+  kv_store0->defer_snapshots = true;
+  REQUIRE(r0.replicate({{5, {1, 2, 3}, true}, {6, {1, 2, 3}, true}}));
+  r0.periodic(ms(10));
+  dispatch_all(nodes, r0.channels->sent_append_entries);
+  dispatch_all(nodes, r1.channels->sent_append_entries_response);
+  dispatch_all(nodes, r2.channels->sent_append_entries_response);
+  REQUIRE(r0.get_commit_idx() == 6);
+  REQUIRE(kv_store0->snapshots == std::vector<raft::Index>{3, 6});
+  REQUIRE(r0.ledger->snapshot_idx == 3);
+
+  kv_store0->complete_snapshots();
+  REQUIRE(r0.ledger->snapshot_idx == 3);
+  r0.periodic(ms(10));
+  REQUIRE(r0.ledger->snapshot_idx == 6);
+}
+
 TEST_CASE("Recv append entries logic" * doctest::test_suite("multiple"))
 {
   auto kv_store0 = std::make_shared<Store>(0);
@@ -604,6 +856,76 @@ TEST_CASE("Recv append entries logic" * doctest::test_suite("multiple"))
   }
 }
 
+TEST_CASE(
+  "Entries are only resent once a node makes no progress for an election "
+  "timeout" *
+  doctest::test_suite("multiple"))
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+  ms election_timeout(100);
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    election_timeout);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    election_timeout * 2);
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0.add_configuration(0, config0);
+  r1.add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(election_timeout * 2);
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  REQUIRE(r0.is_leader());
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+
+  REQUIRE(r0.replicate({{1, {1, 2, 3}, true}}));
+  r0.periodic(request_timeout);
+  REQUIRE(r0.channels->sent_append_entries.size() == 1);
+  REQUIRE(r0.channels->sent_append_entries.front().second.prev_idx == 0);
+  r0.channels->sent_append_entries.clear();
+
+  INFO("A node which has not acknowledged a batch yet is only sent heartbeats");
+  for (auto elapsed = request_timeout; elapsed < election_timeout;
+       elapsed += request_timeout)
+  {
+    r0.periodic(request_timeout);
+    REQUIRE(r0.channels->sent_append_entries.size() == 1);
+    REQUIRE(r0.channels->sent_append_entries.front().second.prev_idx == 1);
+    r0.channels->sent_append_entries.clear();
+  }
+
+  INFO("After an election timeout, the batch is sent again");
+  r0.periodic(request_timeout);
+  REQUIRE(r0.channels->sent_append_entries.size() == 1);
+  REQUIRE(r0.channels->sent_append_entries.front().second.prev_idx == 0);
+  REQUIRE(r0.channels->sent_append_entries.front().second.idx == 1);
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  REQUIRE(r0.get_commit_idx() == 1);
+}
+
 TEST_CASE("Exceed append entries limit")
 {
   auto kv_store0 = std::make_shared<Store>(0);
@@ -730,11 +1052,16 @@ TEST_CASE("Exceed append entries limit")
   r2.channels->sent_append_entries_response.pop_front();
   r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
 
-  REQUIRE(
-    (r0.channels->sent_append_entries.size() > num_small_entries_sent &&
-     r0.channels->sent_append_entries.size() <=
-       num_small_entries_sent + num_big_entries));
-  auto sent_entries = dispatch_all(nodes, r0.channels->sent_append_entries);
+  INFO("No more than a window of batches is in flight at once");
+  size_t sent_entries = 0;
+  while (r0.channels->sent_append_entries.size() > 0)
+  {
+    REQUIRE(
+      r0.channels->sent_append_entries.size() <=
+      raft::default_max_inflight_batches);
+    sent_entries += dispatch_all(nodes, r0.channels->sent_append_entries);
+    dispatch_all(nodes, r2.channels->sent_append_entries_response);
+  }
   REQUIRE(
     (sent_entries > num_small_entries_sent &&
      sent_entries <= num_small_entries_sent + num_big_entries));
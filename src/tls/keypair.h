@@ -1066,6 +1066,16 @@ namespace tls
       return verify_hash(hash, signature);
     }
 
+    /**
+     * Whether verify_hash() may be called by several threads at once.
+     * mbedtls caches precomputed points in the key's group on first use, so
+     * the default implementation may not.
+     */
+    virtual bool supports_concurrent_verify() const
+    {
+      return false;
+    }
+
     const mbedtls_x509_crt* raw()
     {
       return &cert;
@@ -1108,6 +1118,12 @@ namespace tls
 
       return ok;
     }
+
+    // Verification only reads the context and the public key
+    bool supports_concurrent_verify() const override
+    {
+      return true;
+    }
   };
 
   using VerifierPtr = std::shared_ptr<Verifier>;
@@ -0,0 +1,140 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "../../enclave/tlsframedendpoint.h"
+#include "../client.h"
+#include "../keypair.h"
+#include "../server.h"
+
+#include <picobench/picobench.hpp>
+
+using namespace std;
+
+// Framed endpoint which counts the requests it receives, without replying
+class CountingEndpoint : public enclave::FramedTLSEndpoint
+{
+public:
+  size_t requests = 0;
+  size_t bytes = 0;
+
+  using FramedTLSEndpoint::FramedTLSEndpoint;
+
+  bool handle_data(CBuffer data) override
+  {
+    ++requests;
+    bytes += data.n;
+    return true;
+  }
+};
+
+// A client and a server endpoint connected through the ringbuffer, as if the
+// host were forwarding data between them. Everything the client writes is
+// delivered to the server in a single chunk, as the host would do after
+// reading a burst of pipelined requests from its socket.
+class Connection
+{
+  static constexpr size_t client_id = 1;
+  static constexpr size_t server_id = 2;
+
+  ringbuffer::Circuit circuit;
+  ringbuffer::WriterFactory factory;
+
+  vector<uint8_t> to_client;
+  vector<uint8_t> to_server;
+
+public:
+  CountingEndpoint client;
+  CountingEndpoint server;
+
+  Connection(shared_ptr<tls::Cert> client_cert, shared_ptr<tls::Cert> cert) :
+    circuit(1 << 24),
+    factory(circuit),
+    client(client_id, factory, make_unique<tls::Client>(client_cert)),
+    server(server_id, factory, make_unique<tls::Server>(cert))
+  {
+    // Sending nothing starts the handshake
+    client.flush();
+
+    while (pump() > 0)
+      ;
+  }
+
+  size_t pump()
+  {
+    circuit.read_from_inside().read(
+      -1, [this](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        if (m != tls::tls_outbound)
+          return;
+
+        auto [id, body] =
+          ringbuffer::read_message<tls::tls_outbound>(data, size);
+        auto& dest = id == client_id ? to_server : to_client;
+        dest.insert(dest.end(), body.data, body.data + body.size);
+      });
+
+    const auto delivered = to_client.size() + to_server.size();
+
+    if (!to_server.empty())
+    {
+      server.recv(to_server.data(), to_server.size());
+      to_server.clear();
+    }
+
+    if (!to_client.empty())
+    {
+      client.recv(to_client.data(), to_client.size());
+      to_client.clear();
+    }
+
+    return delivered;
+  }
+};
+
+template <size_t MsgSize>
+static void pipelined_requests(picobench::state& s)
+{
+  auto kp = tls::make_key_pair();
+  auto cert = make_shared<tls::Cert>(
+    "", nullptr, kp->self_sign("CN=bench"), kp->private_key_pem(), nullb);
+  auto client_cert = make_shared<tls::Cert>(
+    "bench", nullptr, nullb, tls::Pem(), nullb, tls::auth_none);
+
+  Connection c(client_cert, cert);
+  vector<uint8_t> request(MsgSize, 'x');
+
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    c.client.send(request);
+  }
+
+  // Anything which did not fit in the ringbuffer is still pending in the
+  // client
+  do
+  {
+    c.client.flush();
+  } while (c.pump() > 0);
+  s.stop_timer();
+
+  if (c.server.requests != (size_t)s.iterations())
+    throw logic_error(fmt::format(
+      "Server received {} of {} requests",
+      c.server.requests,
+      s.iterations()));
+}
+
+const std::vector<int> counts = {16, 256};
+
+PICOBENCH_SUITE("pipelined_requests");
+namespace
+{
+  auto pipelined_64 = pipelined_requests<64>;
+  PICOBENCH(pipelined_64).iterations(counts).samples(10).baseline();
+  auto pipelined_1k = pipelined_requests<1024>;
+  PICOBENCH(pipelined_1k).iterations(counts).samples(10);
+  auto pipelined_16k = pipelined_requests<16 * 1024>;
+  PICOBENCH(pipelined_16k).iterations(counts).samples(10);
+  auto pipelined_256k = pipelined_requests<256 * 1024>;
+  PICOBENCH(pipelined_256k).iterations(counts).samples(10);
+}
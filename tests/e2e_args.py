@@ -62,6 +62,12 @@ def cli_args(add=lambda x: None, parser=None, accept_unknown=False):
         help="Reserve this many bytes of memory on startup, to simulate memory restrictions",
         type=int,
     )
+    parser.add_argument(
+        "--worker-threads",
+        help="Number of additional enclave threads processing client sessions",
+        type=int,
+        default=0,
+    )
     parser.add_argument(
         "--wait-with-client",
         help="If set, the python client is used to query joining nodes",
@@ -77,6 +77,7 @@ class Network:
         "sig_max_ms",
         "election_timeout",
         "memory_reserve_startup",
+        "worker_threads",
         "notify_server",
     ]
 
@@ -1,6 +1,7 @@
 # Copyright (c) Microsoft Corporation. All rights reserved.
 # Licensed under the Apache 2.0 License.
 import os
+import stat
 import time
 from enum import Enum
 import paramiko
@@ -145,7 +146,12 @@ class SSHRemote(CmdMixin):
         for path in self.files:
             tgt_path = os.path.join(self.root, os.path.basename(path))
             LOG.info("[{}] copy {} from {}".format(self.hostname, tgt_path, path))
-            session.put(path, tgt_path)
+            if os.path.isdir(path):
+                session.mkdir(tgt_path)
+                for f in os.listdir(path):
+                    session.put(os.path.join(path, f), os.path.join(tgt_path, f))
+            else:
+                session.put(path, tgt_path)
         session.close()
         executable = self.cmd[0]
         if executable.startswith("./"):
@@ -167,7 +173,15 @@ class SSHRemote(CmdMixin):
             for seconds in range(timeout):
                 try:
                     targetname = targetname or filename
-                    session.get(os.path.join(self.root, filename), targetname)
+                    path = os.path.join(self.root, filename)
+                    if stat.S_ISDIR(session.stat(path).st_mode):
+                        os.makedirs(targetname, exist_ok=True)
+                        for f in session.listdir(path):
+                            session.get(
+                                os.path.join(path, f), os.path.join(targetname, f)
+                            )
+                    else:
+                        session.get(path, targetname)
                     LOG.debug(
                         "[{}] found {} after {}s".format(
                             self.hostname, filename, seconds
@@ -347,7 +361,7 @@ class LocalRemote(CmdMixin):
         for path in self.data_files:
             dst_path = os.path.join(self.root, os.path.basename(path))
             src_path = os.path.join(os.getcwd(), path)
-            assert self._rc("cp {} {}".format(src_path, dst_path)) == 0
+            assert self._rc("cp -r {} {}".format(src_path, dst_path)) == 0
 
         # Make sure relative paths include current directory. Absolute paths will be unaffected
         self.cmd[0] = os.path.join(".", os.path.normpath(self.cmd[0]))
@@ -361,7 +375,7 @@ class LocalRemote(CmdMixin):
         else:
             raise ValueError(path)
         targetname = targetname or filename
-        assert self._rc("cp {} {}".format(path, targetname)) == 0
+        assert self._rc("cp -r {} {}".format(path, targetname)) == 0
 
     def list_files(self):
         return os.listdir(self.root)
@@ -477,6 +491,7 @@ class CCFRemote(object):
         node_status="pending",
         election_timeout=1000,
         memory_reserve_startup=0,
+        worker_threads=0,
         notify_server=None,
         ledger_file=None,
         sealed_secrets=None,
@@ -526,7 +541,7 @@ class CCFRemote(object):
                 f"--raft-election-timeout-ms={election_timeout}",
                 f"--node-address={host}:{node_port}",
                 f"--rpc-address={host}:{rpc_port}",
-                f"--ledger-file={self.ledger_file_name}",
+                f"--ledger-dir={self.ledger_file_name}",
                 f"--node-cert-file={self.pem}",
                 f"--enclave-type={enclave_type}",
                 f"--log-level={log_level}",
@@ -541,6 +556,9 @@ class CCFRemote(object):
             if memory_reserve_startup:
                 cmd += [f"--memory-reserve-startup={memory_reserve_startup}"]
 
+            if worker_threads:
+                cmd += [f"--worker-threads={worker_threads}"]
+
             if notify_server:
                 notify_server_host, *notify_server_port = notify_server.split(":")
 
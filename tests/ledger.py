@@ -2,12 +2,15 @@
 # Licensed under the Apache 2.0 License.
 import io
 import msgpack
+import os
 import struct
 
 GCM_SIZE_TAG = 16
 GCM_SIZE_IV = 12
 LEDGER_TRANSACTION_SIZE = 4
 LEDGER_DOMAIN_SIZE = 8
+LEDGER_FILE_PREFIX = "ledger_"
+LEDGER_INDEX_SUFFIX = ".idx"
 
 
 def to_uint_32(buffer):
@@ -148,12 +151,29 @@ class Transaction:
             raise StopIteration()
 
 
-class Ledger:
+def _ledger_file_start_idx(filename):
+    # Ledger files are named ledger_<start_idx> or ledger_<start_idx>-<last_idx>
+    return int(filename[len(LEDGER_FILE_PREFIX) :].split("-")[0])
 
-    _filename = None
 
-    def __init__(self, filename):
-        self._filename = filename
+class Ledger:
+
+    _filenames = []
+
+    def __init__(self, directory):
+        self._filenames = [
+            os.path.join(directory, f)
+            for f in sorted(
+                (
+                    f
+                    for f in os.listdir(directory)
+                    if f.startswith(LEDGER_FILE_PREFIX)
+                    and not f.endswith(LEDGER_INDEX_SUFFIX)
+                ),
+                key=_ledger_file_start_idx,
+            )
+        ]
 
     def __iter__(self):
-        return Transaction(self._filename)
+        for filename in self._filenames:
+            yield from Transaction(filename)